@@ -14,7 +14,9 @@
 #include <shlobj.h>
 #include <strsafe.h>
 #else 
+#include <fcntl.h>
 #include <sys/utsname.h>
+#include <unistd.h>
 #endif
 
 
@@ -346,6 +348,52 @@ std::string get_nix_version_display_string()
     return std::error_code(code, std::system_category());
   }
 
+  std::error_code sync_file(const std::string& name)
+  {
+    int code = 0;
+#if defined(WIN32)
+    HANDLE file = ::CreateFile(name.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+      return std::error_code(static_cast<int>(::GetLastError()), std::system_category());
+    }
+
+    if (!::FlushFileBuffers(file)) {
+      code = static_cast<int>(::GetLastError());
+    }
+
+    ::CloseHandle(file);
+#else
+    int fd = ::open(name.c_str(), O_RDONLY);
+    if (fd == -1) {
+      return std::error_code(errno, std::system_category());
+    }
+
+    if (::fsync(fd) != 0) {
+      code = errno;
+    }
+
+    ::close(fd);
+#endif
+    return std::error_code(code, std::system_category());
+  }
+
+  std::error_code replace_file_durably(const std::string& replacement_name, const std::string& replaced_name)
+  {
+    std::error_code code = sync_file(replacement_name);
+    if (!code) {
+      code = replace_file(replacement_name, replaced_name);
+    }
+
+#if !defined(WIN32)
+    // the rename itself is only durable once the directory is synced
+    if (!code) {
+      std::string directory = boost::filesystem::path(replaced_name).parent_path().string();
+      code = sync_file(directory.empty() ? "." : directory);
+    }
+#endif
+    return code;
+  }
+
   bool directoryExists(const std::string& path) {
     boost::system::error_code ec;
     return boost::filesystem::is_directory(path, ec);
@@ -13,5 +13,9 @@ namespace Tools
   std::string get_os_version_string();
   bool create_directories_if_necessary(const std::string& path);
   std::error_code replace_file(const std::string& replacement_name, const std::string& replaced_name);
+  // makes what was written to the file durable, the data must be flushed from any stream first
+  std::error_code sync_file(const std::string& name);
+  // syncs the replacement and renames it over the replaced file, a crash leaves one of the two
+  std::error_code replace_file_durably(const std::string& replacement_name, const std::string& replaced_name);
   bool directoryExists(const std::string& path);
 }
@@ -72,9 +72,19 @@ const size_t   FUSION_TX_MIN_IN_OUT_COUNT_RATIO              = 3;
 const char     CRYPTONOTE_BLOCKS_FILENAME[]                  = "blocks.dat";
 const char     CRYPTONOTE_BLOCKINDEXES_FILENAME[]            = "blockindexes.dat";
 const char     CRYPTONOTE_BLOCKSCACHE_FILENAME[]             = "blockscache.dat";
+const char     CRYPTONOTE_BLOCKHEADERS_FILENAME[]            = "blockheaders.dat";
+const char     CRYPTONOTE_BLOCKSCACHE_JOURNAL_FILENAME[]     = "blockscachejournal.dat";
+const char     CRYPTONOTE_BLOCKLAYOUTS_FILENAME[]            = "blocklayouts.dat";
+const char     CRYPTONOTE_BLOCKLAYOUTINDEXES_FILENAME[]      = "blocklayoutindexes.dat";
+const char     CRYPTONOTE_BLOCKUNDO_FILENAME[]               = "blockundo.dat";
+const char     CRYPTONOTE_BLOCKUNDOINDEXES_FILENAME[]        = "blockundoindexes.dat";
+const char     CRYPTONOTE_TRANSACTIONS_INDEX_FILENAME[]      = "transactionsindex.dat";
+const char     CRYPTONOTE_SPENT_KEYS_INDEX_FILENAME[]        = "spentkeysindex.dat";
 const char     CRYPTONOTE_POOLDATA_FILENAME[]                = "poolstate.bin";
 const char     P2P_NET_DATA_FILENAME[]                       = "p2pstate.bin";
 const char     CRYPTONOTE_BLOCKCHAIN_INDICES_FILENAME[]      = "blockchainindices.dat";
+const char     CRYPTONOTE_PAYMENT_ID_INDEX_FILENAME[]        = "paymentidindex.dat";
+const char     CRYPTONOTE_GENERATED_TRANSACTIONS_INDEX_FILENAME[] = "generatedtransactions.dat";
 const char     MINER_CONFIG_FILE_NAME[]                      = "miner_conf.json";
 } // parameters
 
@@ -98,6 +108,10 @@ const uint8_t  BLOCK_MINOR_VERSION_0                         =  0;
 const size_t   BLOCKS_IDS_SYNCHRONIZING_DEFAULT_COUNT        =  10000; 
 // default: blocks count in blocks downloading 
 const size_t   BLOCKS_SYNCHRONIZING_DEFAULT_COUNT            =  75;
+// default: memory budget of decoded blocks kept in memory, in megabytes
+const uint64_t BLOCK_CACHE_DEFAULT_SIZE                      =  256;
+// blocks decoded ahead on a background thread once reads turn sequential
+const uint64_t BLOCK_CACHE_READ_AHEAD_COUNT                  =  32;
 
 const size_t   CURRENCY_PROTOCOL_MAX_OBJECT_REQUEST_COUNT    =  2000;
 const size_t   COMMAND_RPC_GET_BLOCKS_FAST_MAX_COUNT         =  1000;
@@ -0,0 +1,142 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "AlternativeBlockStore.h"
+
+#include <queue>
+#include <unordered_set>
+
+namespace CryptoNote {
+
+AlternativeBlockStore::AlternativeBlockStore(uint64_t maxMemorySize) : m_memorySize(0), m_maxMemorySize(maxMemorySize) {
+}
+
+std::pair<AlternativeBlockStore::iterator, bool> AlternativeBlockStore::insert(const Crypto::Hash& hash, AlternativeBlockEntry&& entry) {
+  auto result = m_blocks.emplace(hash, std::move(entry));
+  if (result.second) {
+    m_heights.emplace(result.first->second.height, hash);
+    m_memorySize += entrySize(result.first->second);
+  }
+
+  return result;
+}
+
+void AlternativeBlockStore::erase(iterator it) {
+  auto range = m_heights.equal_range(it->second.height);
+  for (auto height = range.first; height != range.second; ++height) {
+    if (height->second == it->first) {
+      m_heights.erase(height);
+      break;
+    }
+  }
+
+  m_memorySize -= entrySize(it->second);
+  m_blocks.erase(it);
+}
+
+void AlternativeBlockStore::clear() {
+  m_blocks.clear();
+  m_heights.clear();
+  m_memorySize = 0;
+}
+
+void AlternativeBlockStore::prune(uint32_t minHeight, uint32_t minLiveHeight, std::vector<Removed>& removed) {
+  while (!m_heights.empty() && m_heights.begin()->first < minHeight) {
+    eraseWithDescendants(m_heights.begin()->second, removed);
+  }
+
+  // a chain can only grow from its top, so a block deeper than minLiveHeight
+  // is kept only as the ancestor of a block that can still be extended
+  std::unordered_set<Crypto::Hash> live;
+  for (auto height = m_heights.lower_bound(minLiveHeight); height != m_heights.end(); ++height) {
+    auto block = m_blocks.find(height->second);
+    for (;;) {
+      auto parent = m_blocks.find(block->second.previousBlockHash);
+      if (parent == m_blocks.end() || parent->second.height >= minLiveHeight || !live.insert(parent->first).second) {
+        break;
+      }
+
+      block = parent;
+    }
+  }
+
+  std::vector<Removed> dead;
+  for (auto height = m_heights.begin(); height != m_heights.end() && height->first < minLiveHeight; ++height) {
+    if (live.count(height->second) == 0) {
+      dead.push_back(Removed(height->second, height->first));
+    }
+  }
+
+  for (const Removed& block : dead) {
+    erase(m_blocks.find(block.first));
+  }
+
+  removed.insert(removed.end(), dead.begin(), dead.end());
+
+  if (m_memorySize > m_maxMemorySize) {
+    eraseWeakestTips(removed);
+  }
+}
+
+// Only blocks without a child are removed, weakest first, so chains shrink
+// from the top and the base of the strongest competing chain goes last.
+// Blocks of equal cumulative difficulty go from the lowest up.
+void AlternativeBlockStore::eraseWeakestTips(std::vector<Removed>& removed) {
+  std::unordered_map<Crypto::Hash, size_t> children;
+  for (const auto& block : m_blocks) {
+    if (m_blocks.count(block.second.previousBlockHash) != 0) {
+      ++children[block.second.previousBlockHash];
+    }
+  }
+
+  typedef std::pair<std::pair<difficulty_type, uint32_t>, Crypto::Hash> Tip;
+  auto weaker = [](const Tip& a, const Tip& b) { return a.first > b.first; };
+  std::priority_queue<Tip, std::vector<Tip>, decltype(weaker)> tips(weaker);
+  for (const auto& block : m_blocks) {
+    if (children.count(block.first) == 0) {
+      tips.push(Tip(std::make_pair(block.second.cumulativeDifficulty, block.second.height), block.first));
+    }
+  }
+
+  while (m_memorySize > m_maxMemorySize && !tips.empty()) {
+    auto block = m_blocks.find(tips.top().second);
+    tips.pop();
+    Crypto::Hash parentHash = block->second.previousBlockHash;
+    removed.push_back(Removed(block->first, block->second.height));
+    erase(block);
+
+    auto parent = m_blocks.find(parentHash);
+    if (parent != m_blocks.end() && --children[parentHash] == 0) {
+      tips.push(Tip(std::make_pair(parent->second.cumulativeDifficulty, parent->second.height), parentHash));
+    }
+  }
+}
+
+// node overheads of the containers are left out
+uint64_t AlternativeBlockStore::entrySize(const AlternativeBlockEntry& entry) {
+  return sizeof(Blocks::value_type) + sizeof(std::pair<uint32_t, Crypto::Hash>) + entry.block.size();
+}
+
+void AlternativeBlockStore::eraseWithDescendants(const Crypto::Hash& hash, std::vector<Removed>& removed) {
+  std::vector<Crypto::Hash> pending(1, hash);
+  while (!pending.empty()) {
+    auto block = m_blocks.find(pending.back());
+    pending.pop_back();
+    if (block == m_blocks.end()) {
+      continue;
+    }
+
+    auto children = m_heights.equal_range(block->second.height + 1);
+    for (auto child = children.first; child != children.second; ++child) {
+      if (m_blocks.at(child->second).previousBlockHash == block->first) {
+        pending.push_back(child->second);
+      }
+    }
+
+    removed.push_back(Removed(block->first, block->second.height));
+    erase(block);
+  }
+}
+
+}
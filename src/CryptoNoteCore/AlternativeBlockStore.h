@@ -0,0 +1,77 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "CryptoNote.h"
+#include "crypto/hash.h"
+#include "CryptoNoteCore/Difficulty.h"
+
+namespace CryptoNote
+{
+  // A block off the main chain. Only the fields chain switching reads are
+  // kept decoded, the block itself stays encoded until it is connected.
+  struct AlternativeBlockEntry {
+    Crypto::Hash previousBlockHash;
+    uint32_t height;
+    uint64_t timestamp;
+    difficulty_type cumulativeDifficulty;
+    uint64_t blockCumulativeSize;
+    uint64_t alreadyGeneratedCoins;
+    BinaryArray block;
+  };
+
+  // Blocks off the main chain by hash, held within a memory budget. Removing
+  // a block removes its descendants too, so every stored chain still leads
+  // back to the main chain or to a block that was never stored.
+  class AlternativeBlockStore {
+
+  public:
+    typedef std::unordered_map<Crypto::Hash, AlternativeBlockEntry> Blocks;
+    typedef Blocks::iterator iterator;
+    typedef Blocks::const_iterator const_iterator;
+    // hash and height of a removed block
+    typedef std::pair<Crypto::Hash, uint32_t> Removed;
+
+    explicit AlternativeBlockStore(uint64_t maxMemorySize);
+
+    iterator begin() { return m_blocks.begin(); }
+    iterator end() { return m_blocks.end(); }
+    const_iterator begin() const { return m_blocks.begin(); }
+    const_iterator end() const { return m_blocks.end(); }
+
+    iterator find(const Crypto::Hash& hash) { return m_blocks.find(hash); }
+    const_iterator find(const Crypto::Hash& hash) const { return m_blocks.find(hash); }
+    size_t count(const Crypto::Hash& hash) const { return m_blocks.count(hash); }
+    size_t size() const { return m_blocks.size(); }
+    uint64_t memorySize() const { return m_memorySize; }
+
+    std::pair<iterator, bool> insert(const Crypto::Hash& hash, AlternativeBlockEntry&& entry);
+    void erase(iterator it);
+    void clear();
+
+    // Removes blocks below minHeight, blocks below minLiveHeight without a
+    // descendant at or above it, then the chain tips of the lowest cumulative
+    // difficulty until the store fits its budget. The removed blocks are
+    // appended to removed.
+    void prune(uint32_t minHeight, uint32_t minLiveHeight, std::vector<Removed>& removed);
+
+  private:
+    static uint64_t entrySize(const AlternativeBlockEntry& entry);
+
+    void eraseWithDescendants(const Crypto::Hash& hash, std::vector<Removed>& removed);
+    void eraseWeakestTips(std::vector<Removed>& removed);
+
+    Blocks m_blocks;
+    std::multimap<uint32_t, Crypto::Hash> m_heights;
+    uint64_t m_memorySize;
+    uint64_t m_maxMemorySize;
+  };
+}
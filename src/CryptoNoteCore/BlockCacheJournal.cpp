@@ -0,0 +1,285 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "BlockCacheJournal.h"
+
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <boost/filesystem/operations.hpp>
+
+#include "Common/Util.h"
+
+namespace CryptoNote {
+
+namespace {
+
+// set in the size of a frame that marks a snapshot tip instead of a record
+const uint32_t MARK_FLAG = 0x80000000;
+
+}
+
+BlockCacheJournal::BlockCacheJournal() : m_baseHash(), m_recordCount(0), m_size(0) {
+}
+
+BlockCacheJournal::~BlockCacheJournal() {
+  close();
+}
+
+bool BlockCacheJournal::open(const std::string& fileName, std::vector<BinaryArray>& records) {
+  close();
+  records.clear();
+  m_fileName = fileName;
+  m_snapshots.clear();
+  m_recordCount = 0;
+  m_size = 0;
+
+  uint64_t validSize;
+  if (!read(fileName, m_baseHash, records, m_snapshots, validSize)) {
+    records.clear();
+    return false;
+  }
+
+  // drop a partial record so new ones are not appended behind it
+  boost::system::error_code ec;
+  if (boost::filesystem::file_size(fileName, ec) != validSize) {
+    boost::filesystem::resize_file(fileName, validSize, ec);
+    if (ec) {
+      records.clear();
+      return false;
+    }
+  }
+
+  m_file.open(fileName, std::ios::in | std::ios::out | std::ios::binary);
+  if (!m_file) {
+    records.clear();
+    return false;
+  }
+
+  m_size = validSize;
+  m_recordCount = records.size();
+  return true;
+}
+
+void BlockCacheJournal::close() {
+  if (m_file.is_open()) {
+    m_file.close();
+  }
+}
+
+bool BlockCacheJournal::reset(const Crypto::Hash& baseHash) {
+  close();
+  m_baseHash = baseHash;
+  m_snapshots.assign(1, std::make_pair(baseHash, 0));
+  try {
+    rewrite(std::vector<BinaryArray>());
+  } catch (std::exception&) {
+    close();
+    return false;
+  }
+
+  return true;
+}
+
+bool BlockCacheJournal::rebase(const Crypto::Hash& baseHash) {
+  size_t first = m_snapshots.size();
+  for (size_t i = m_snapshots.size(); i-- > 1;) {
+    if (m_snapshots[i].first == baseHash) {
+      first = i;
+      break;
+    }
+  }
+
+  if (first == m_snapshots.size()) {
+    return false;
+  }
+
+  try {
+    sync();
+
+    Crypto::Hash oldBaseHash;
+    std::vector<BinaryArray> records;
+    std::vector<std::pair<Crypto::Hash, uint64_t>> snapshots;
+    uint64_t validSize;
+    if (!read(m_fileName, oldBaseHash, records, snapshots, validSize) || snapshots.size() != m_snapshots.size()) {
+      return false;
+    }
+
+    uint64_t skipped = snapshots[first].second;
+    std::vector<std::pair<Crypto::Hash, uint64_t>> kept;
+    for (size_t i = first; i < snapshots.size(); ++i) {
+      kept.push_back(std::make_pair(snapshots[i].first, snapshots[i].second - skipped));
+    }
+
+    records.erase(records.begin(), records.begin() + static_cast<ptrdiff_t>(skipped));
+    m_baseHash = baseHash;
+    m_snapshots.swap(kept);
+    try {
+      rewrite(records);
+    } catch (std::exception&) {
+      // back to the old journal, it still applies to both snapshots
+      m_baseHash = oldBaseHash;
+      m_snapshots.swap(kept);
+      m_recordCount = records.size() + skipped;
+      m_size = validSize;
+      if (!m_file.is_open()) {
+        m_file.open(m_fileName, std::ios::in | std::ios::out | std::ios::binary);
+      }
+
+      return false;
+    }
+  } catch (std::exception&) {
+    return false;
+  }
+
+  return true;
+}
+
+void BlockCacheJournal::append(const BinaryArray& record) {
+  writeFrame(static_cast<uint32_t>(record.size()), checksum(record.data(), record.size()), record.data());
+  ++m_recordCount;
+}
+
+void BlockCacheJournal::mark(const Crypto::Hash& tip) {
+  writeFrame(MARK_FLAG | sizeof tip, checksum(&tip, sizeof tip), &tip);
+  m_snapshots.push_back(std::make_pair(tip, m_recordCount));
+}
+
+void BlockCacheJournal::sync() {
+  if (!m_file) {
+    throw std::runtime_error("BlockCacheJournal::sync: invalid journal file");
+  }
+
+  m_file.flush();
+  if (!m_file || Tools::sync_file(m_fileName)) {
+    throw std::runtime_error("BlockCacheJournal::sync: could not sync journal file");
+  }
+}
+
+void BlockCacheJournal::writeFrame(uint32_t size, uint32_t checksum, const void* data) {
+  if (!m_file) {
+    throw std::runtime_error("BlockCacheJournal::append: invalid journal file");
+  }
+
+  uint32_t header[2] = { size, checksum };
+  size_t dataSize = size & ~MARK_FLAG;
+  m_file.seekp(m_size);
+  m_file.write(reinterpret_cast<const char*>(header), sizeof header);
+  m_file.write(static_cast<const char*>(data), dataSize);
+  m_file.flush();
+  if (!m_file) {
+    throw std::runtime_error("BlockCacheJournal::append: could not write to journal file");
+  }
+
+  m_size += sizeof header + dataSize;
+}
+
+// Writes the base hash, records and marks to a new file and renames it over
+// the journal, so a crash leaves either the old or the new one.
+void BlockCacheJournal::rewrite(const std::vector<BinaryArray>& records) {
+  std::string newFileName = m_fileName + ".new";
+  close();
+
+  m_file.open(newFileName, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!m_file) {
+    throw std::runtime_error("BlockCacheJournal: could not create journal file " + newFileName);
+  }
+
+  m_file.write(reinterpret_cast<const char*>(&m_baseHash), sizeof m_baseHash);
+  if (!m_file) {
+    throw std::runtime_error("BlockCacheJournal: could not write to journal file " + newFileName);
+  }
+
+  std::vector<std::pair<Crypto::Hash, uint64_t>> snapshots;
+  snapshots.swap(m_snapshots);
+  m_snapshots.push_back(snapshots.front());
+  m_size = sizeof m_baseHash;
+  m_recordCount = 0;
+  size_t nextMark = 1;
+  for (size_t i = 0; i <= records.size(); ++i) {
+    for (; nextMark < snapshots.size() && snapshots[nextMark].second == i; ++nextMark) {
+      mark(snapshots[nextMark].first);
+    }
+
+    if (i < records.size()) {
+      append(records[i]);
+    }
+  }
+
+  m_file.flush();
+  bool written = static_cast<bool>(m_file);
+  close();
+  if (!written || Tools::replace_file_durably(newFileName, m_fileName)) {
+    std::remove(newFileName.c_str());
+    throw std::runtime_error("BlockCacheJournal: could not replace journal file " + m_fileName);
+  }
+
+  m_file.open(m_fileName, std::ios::in | std::ios::out | std::ios::binary);
+  if (!m_file) {
+    throw std::runtime_error("BlockCacheJournal: could not open journal file " + m_fileName);
+  }
+}
+
+bool BlockCacheJournal::read(const std::string& fileName, Crypto::Hash& baseHash, std::vector<BinaryArray>& records,
+  std::vector<std::pair<Crypto::Hash, uint64_t>>& snapshots, uint64_t& validSize) {
+  std::ifstream file(fileName, std::ios::binary | std::ios::ate);
+  if (!file) {
+    return false;
+  }
+
+  uint64_t fileSize = static_cast<uint64_t>(file.tellg());
+  file.seekg(0);
+
+  file.read(reinterpret_cast<char*>(&baseHash), sizeof baseHash);
+  if (!file) {
+    return false;
+  }
+
+  snapshots.assign(1, std::make_pair(baseHash, 0));
+  validSize = sizeof baseHash;
+  for (;;) {
+    uint32_t header[2];
+    file.read(reinterpret_cast<char*>(header), sizeof header);
+    if (!file) {
+      break;
+    }
+
+    uint32_t size = header[0] & ~MARK_FLAG;
+    if (size > fileSize - static_cast<uint64_t>(file.tellg())) {
+      break;
+    }
+
+    BinaryArray data(size);
+    file.read(reinterpret_cast<char*>(data.data()), data.size());
+    if (!file || checksum(data.data(), data.size()) != header[1]) {
+      break;
+    }
+
+    if ((header[0] & MARK_FLAG) != 0) {
+      if (data.size() != sizeof(Crypto::Hash)) {
+        break;
+      }
+
+      Crypto::Hash tip;
+      memcpy(&tip, data.data(), sizeof tip);
+      snapshots.push_back(std::make_pair(tip, records.size()));
+    } else {
+      records.push_back(std::move(data));
+    }
+
+    validSize += sizeof header + size;
+  }
+
+  return true;
+}
+
+uint32_t BlockCacheJournal::checksum(const void* data, size_t size) {
+  Crypto::Hash hash = Crypto::cn_fast_hash(data, size);
+  uint32_t result;
+  memcpy(&result, &hash, sizeof result);
+  return result;
+}
+
+}
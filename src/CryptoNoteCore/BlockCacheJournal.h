@@ -0,0 +1,81 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "CryptoNote.h"
+#include "crypto/hash.h"
+
+namespace CryptoNote
+{
+  // Append only log of block cache changes made since the last snapshot.
+  // The file starts with the tip hash of the snapshot it applies to, followed
+  // by records framed as uint32_t size, uint32_t checksum and the payload.
+  // A record cut short by a crash fails its checksum and is dropped on open.
+  //
+  // Taking a new snapshot marks its tip in the journal first, the journal is
+  // rebased on it only once the snapshot is safely on disk. Until then either
+  // snapshot can be brought up to date, whichever a crash leaves behind.
+  class BlockCacheJournal {
+
+  public:
+    BlockCacheJournal();
+    ~BlockCacheJournal();
+
+    // returns false if there is no usable journal, records are left empty then
+    bool open(const std::string& fileName, std::vector<BinaryArray>& records);
+    void close();
+
+    bool isOpened() const {
+      return m_file.is_open();
+    }
+
+    const Crypto::Hash& baseHash() const {
+      return m_baseHash;
+    }
+
+    uint64_t recordCount() const {
+      return m_recordCount;
+    }
+
+    // Tips of the snapshots the journal applies to, the base first, and the
+    // index of the first record to replay on top of each.
+    const std::vector<std::pair<Crypto::Hash, uint64_t>>& snapshots() const {
+      return m_snapshots;
+    }
+
+    // drops all records, the journal then applies to the snapshot with baseHash
+    // as tip. On failure the journal is left closed.
+    bool reset(const Crypto::Hash& baseHash);
+    // Makes a marked snapshot the base, keeping the records after its mark.
+    // The new journal replaces the old one in one rename, on failure the old
+    // one is still used.
+    bool rebase(const Crypto::Hash& baseHash);
+    void append(const BinaryArray& record);
+    // the records appended so far apply to the snapshot with tip as well
+    void mark(const Crypto::Hash& tip);
+    // makes what was appended durable
+    void sync();
+
+  private:
+    void writeFrame(uint32_t size, uint32_t checksum, const void* data);
+    void rewrite(const std::vector<BinaryArray>& records);
+    static bool read(const std::string& fileName, Crypto::Hash& baseHash, std::vector<BinaryArray>& records,
+      std::vector<std::pair<Crypto::Hash, uint64_t>>& snapshots, uint64_t& validSize);
+    static uint32_t checksum(const void* data, size_t size);
+
+    std::fstream m_file;
+    std::string m_fileName;
+    Crypto::Hash m_baseHash;
+    std::vector<std::pair<Crypto::Hash, uint64_t>> m_snapshots;
+    uint64_t m_recordCount;
+    uint64_t m_size;
+  };
+}
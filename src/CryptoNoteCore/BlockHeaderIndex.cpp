@@ -0,0 +1,111 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "BlockHeaderIndex.h"
+
+#include <stdexcept>
+
+namespace CryptoNote {
+
+BlockHeaderIndex::BlockHeaderIndex() {
+}
+
+BlockHeaderIndex::~BlockHeaderIndex() {
+  close();
+}
+
+bool BlockHeaderIndex::open(const std::string& fileName) {
+  close();
+  m_headers.clear();
+
+  m_file.open(fileName, std::ios::in | std::ios::out | std::ios::binary);
+  if (!m_file) {
+    m_file.clear();
+    m_file.open(fileName, std::ios::out | std::ios::binary);
+    m_file.close();
+    m_file.open(fileName, std::ios::in | std::ios::out | std::ios::binary);
+    if (!m_file) {
+      return false;
+    }
+
+    writeCount();
+    return static_cast<bool>(m_file);
+  }
+
+  uint64_t count = 0;
+  m_file.read(reinterpret_cast<char*>(&count), sizeof count);
+  if (!m_file) {
+    // empty or truncated header, start over
+    m_file.clear();
+    writeCount();
+    return static_cast<bool>(m_file);
+  }
+
+  m_file.seekg(0, std::ios::end);
+  uint64_t available = (static_cast<uint64_t>(m_file.tellg()) - sizeof count) / sizeof(CompactBlockHeader);
+  if (count > available) {
+    count = available;
+  }
+
+  m_headers.resize(count);
+  m_file.seekg(sizeof count);
+  if (count > 0) {
+    m_file.read(reinterpret_cast<char*>(m_headers.data()), count * sizeof(CompactBlockHeader));
+  }
+
+  if (!m_file) {
+    m_file.clear();
+    m_headers.clear();
+  }
+
+  writeCount();
+  return static_cast<bool>(m_file);
+}
+
+void BlockHeaderIndex::close() {
+  if (m_file.is_open()) {
+    m_file.close();
+  }
+}
+
+void BlockHeaderIndex::push(const CompactBlockHeader& header) {
+  if (!m_file) {
+    throw std::runtime_error("BlockHeaderIndex::push: invalid block headers file");
+  }
+
+  m_file.seekp(sizeof(uint64_t) + m_headers.size() * sizeof(CompactBlockHeader));
+  m_file.write(reinterpret_cast<const char*>(&header), sizeof header);
+  if (!m_file) {
+    throw std::runtime_error("BlockHeaderIndex::push: could not write to block headers file");
+  }
+
+  m_headers.push_back(header);
+  writeCount();
+}
+
+void BlockHeaderIndex::pop() {
+  m_headers.pop_back();
+  writeCount();
+}
+
+void BlockHeaderIndex::clear() {
+  m_headers.clear();
+  writeCount();
+}
+
+void BlockHeaderIndex::writeCount() {
+  if (!m_file) {
+    throw std::runtime_error("BlockHeaderIndex: invalid block headers file");
+  }
+
+  uint64_t count = m_headers.size();
+  m_file.seekp(0);
+  m_file.write(reinterpret_cast<const char*>(&count), sizeof count);
+  m_file.flush();
+  if (!m_file) {
+    throw std::runtime_error("BlockHeaderIndex: could not write count to block headers file");
+  }
+}
+
+}
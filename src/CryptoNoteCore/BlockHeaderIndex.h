@@ -0,0 +1,77 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "crypto/hash.h"
+#include "CryptoNoteCore/Difficulty.h"
+
+namespace CryptoNote
+{
+  // Per height values needed by difficulty, median size and timestamp checks,
+  // one cache line each, so these checks never have to decode a block.
+  struct CompactBlockHeader {
+    uint64_t timestamp;
+    difficulty_type cumulativeDifficulty;
+    uint64_t blockCumulativeSize;
+    uint64_t alreadyGeneratedCoins;
+    Crypto::Hash blockHash;
+  };
+
+  static_assert(sizeof(CompactBlockHeader) == 64, "CompactBlockHeader is stored on disk as is");
+
+  // Dense array of CompactBlockHeader indexed by height, persisted as a uint64_t
+  // count followed by the raw records. The count is written after the record
+  // so an interrupted push leaves the file consistent.
+  class BlockHeaderIndex {
+
+  public:
+    typedef std::vector<CompactBlockHeader>::const_iterator const_iterator;
+
+    BlockHeaderIndex();
+    ~BlockHeaderIndex();
+
+    bool open(const std::string& fileName);
+    void close();
+
+    bool empty() const {
+      return m_headers.empty();
+    }
+
+    uint32_t size() const {
+      return static_cast<uint32_t>(m_headers.size());
+    }
+
+    const CompactBlockHeader& operator[](uint32_t height) const {
+      return m_headers[height];
+    }
+
+    const CompactBlockHeader& back() const {
+      return m_headers.back();
+    }
+
+    const_iterator begin() const {
+      return m_headers.begin();
+    }
+
+    const_iterator end() const {
+      return m_headers.end();
+    }
+
+    void push(const CompactBlockHeader& header);
+    void pop();
+    void clear();
+
+  private:
+    void writeCount();
+
+    std::fstream m_file;
+    std::vector<CompactBlockHeader> m_headers;
+  };
+}
@@ -6,11 +6,15 @@
 
 #include <algorithm>
 #include <cstdio>
+#include <future>
+#include <thread>
+#include <unordered_set>
 #include <boost/foreach.hpp>
 #include "Common/Math.h"
 #include "Common/ShuffleGenerator.h"
 #include "Common/StdInputStream.h"
 #include "Common/StdOutputStream.h"
+#include "Common/Util.h"
 #include "Rpc/CoreRpcServerCommandsDefinitions.h"
 #include "Serialization/BinarySerializationTools.h"
 #include "CryptoNoteTools.h"
@@ -53,12 +57,22 @@ bool operator<(const Crypto::KeyImage& keyImage1, const Crypto::KeyImage& keyIma
 }
 }
 
-#define CURRENT_BLOCKCACHE_STORAGE_ARCHIVE_VER 1
-#define CURRENT_BLOCKCHAININDICES_STORAGE_ARCHIVE_VER 1
+#define CURRENT_BLOCKCACHE_STORAGE_ARCHIVE_VER 2
+#define BLOCKCACHE_JOURNAL_COMPACTION_BLOCKS 10000
+#define RANDOM_OUTS_DIRECT_DRAW_MAX_COUNT 256
+#define RING_SIGNATURE_CHECKS_PER_WORKER 4
+#define RING_SIGNATURE_CACHE_SIZE 100000
+#define RING_MEMBER_KEY_CACHE_SIZE 65536
+#define BLOCK_LAYOUT_CACHE_SIZE (4 * 1024 * 1024)
+#define BLOCK_UNDO_CACHE_SIZE (4 * 1024 * 1024)
+#define BLOCK_BATCH_MAX_PENDING_SIZE (64 * 1024 * 1024)
+#define DISK_INDEX_MAX_UNCOMMITTED_SIZE (64 * 1024 * 1024)
+#define ALTERNATIVE_BLOCKS_MAX_MEMORY_SIZE (32 * 1024 * 1024)
+#define INVALID_BLOCKS_MAX_MEMORY_SIZE (4 * 1024 * 1024)
+#define ALTERNATIVE_BLOCKS_MAX_LIVE_DEPTH 1000
 
 namespace CryptoNote {
 class BlockCacheSerializer;
-class BlockchainIndicesSerializer;
 }
 
 namespace CryptoNote {
@@ -93,8 +107,8 @@ bool serialize(google::sparse_hash_set<K, Hash>& value, Common::StringView name,
 }
 
 // custom serialization to speedup cache loading
-bool serialize(std::vector<std::pair<Blockchain::TransactionIndex, uint16_t>>& value, Common::StringView name, CryptoNote::ISerializer& s) {
-  const uint64_t elementSize = sizeof(std::pair<Blockchain::TransactionIndex, uint16_t>);
+bool serialize(std::vector<Blockchain::OutputEntry>& value, Common::StringView name, CryptoNote::ISerializer& s) {
+  const uint64_t elementSize = sizeof(Blockchain::OutputEntry);
   uint64_t size = value.size() * elementSize;
 
   if (!s.beginArray(size, name)) {
@@ -125,15 +139,22 @@ class BlockCacheSerializer {
 
 public:
   BlockCacheSerializer(Blockchain& bs, const Crypto::Hash lastBlockHash, ILogger& logger) :
-    logger(logger, "BlockCacheSerializer"), m_bs(bs), m_lastBlockHash(lastBlockHash) {
+    logger(logger, "BlockCacheSerializer"), m_bs(bs), m_lastBlockHash(lastBlockHash), m_tips(1, lastBlockHash), m_snapshot(0), m_loaded(false) {
+  }
+
+  // loads whichever of the snapshots with these tips is on disk, in the order
+  // they were taken
+  BlockCacheSerializer(Blockchain& bs, const std::vector<Crypto::Hash>& tips, ILogger& logger) :
+    logger(logger, "BlockCacheSerializer"), m_bs(bs), m_lastBlockHash(tips.front()), m_tips(tips), m_snapshot(0), m_loaded(false) {
   }
 
   void load(const std::string& filename) {
 
     //logger(INFO) << "BlockCacheSerializer::load...";
 
-    if (m_cacheloaded) {
+    if (m_bs.m_blockCacheLoaded) {
       logger(INFO) << "block cache already loaded... skipped";
+      m_loaded = true;
       return;
     }
 
@@ -154,27 +175,53 @@ public:
     }
   }
 
-  bool save(const std::string& filename) {
-
-    if (! m_cacheloaded) {
-      logger(INFO) << "save operations are skipped until cache is fully loaded...";
-      return true; // not a fatal error, normal...
+  // Takes the snapshot, the caller holds the blockchain lock. The cache is
+  // serialized to memory and write() saves it without the lock.
+  bool save() {
+    try {
+      m_data.clear();
+      Common::VectorOutputStream stream(m_data);
+      BinaryOutputStreamSerializer s(stream);
+      //logger(INFO) << "calling serialize for block cache save...";
+      CryptoNote::serialize(*this, s);
+    } catch (std::exception& e) {
+      logger(WARNING) << "exception while serializing cache: " << e.what();
+      return false;
     }
 
+    return true;
+  }
+
+  // The previous snapshot is replaced only once the new one is on disk.
+  bool write(const std::string& filename) {
     try {
-      std::ofstream file(filename, std::ios::binary);
-      if (!file) {
-        logger(INFO) << "error creating output stream for: " << filename;
+      if (!m_storeTransactions() || !m_storeSpentKeys()) {
+        logger(WARNING) << "could not save the transaction map and spent keys";
         return false;
       }
 
-      StdOutputStream stream(file);
-      BinaryOutputStreamSerializer s(stream);
-      //logger(INFO) << "calling serialize for block cache save...";
-      CryptoNote::serialize(*this, s);
-      stream.flush();
+      std::string newFilename = filename + ".new";
+      {
+        std::ofstream file(newFilename, std::ios::binary);
+        if (!file) {
+          logger(INFO) << "error creating output stream for: " << newFilename;
+          return false;
+        }
+
+        file.write(reinterpret_cast<const char*>(m_data.data()), m_data.size());
+        file.flush();
+        if (!file) {
+          logger(WARNING) << "error writing: " << newFilename;
+          return false;
+        }
+      }
+
+      if (Tools::replace_file_durably(newFilename, filename)) {
+        logger(WARNING) << "error replacing: " << filename;
+        return false;
+      }
     } catch (std::exception& e) {
-      logger(WARNING) << "exception while serializing cache: " << e.what();
+      logger(WARNING) << "exception while saving cache: " << e.what();
       return false;
     }
 
@@ -204,20 +251,19 @@ public:
       Crypto::Hash blockHash;
       s(blockHash, "last_block");
 
-      std::string lasth = Common::podToHex(m_lastBlockHash);
-      std::string thish = Common::podToHex(blockHash);
-      if (m_lastBlockHash != NULL_HASH && blockHash != NULL_HASH &&
-        lasth.length() > 0 && thish.length() > 0) {
-        if (lasth.compare(thish) != 0) {
-
-          logger(INFO) << "last block does not match... rebuild block cache..." <<
-            "  stored last_block: " << lasth <<
-            "  last_block in current chain: " << thish;
+      // the snapshot may lag the chain, the journal replays the difference
+      auto tip = std::find(m_tips.begin(), m_tips.end(), blockHash);
+      if (tip == m_tips.end()) {
+        logger(INFO) << "last block does not match... rebuild block cache..." <<
+          "  stored last_block: " << Common::podToHex(blockHash) <<
+          "  expected last_block: " << Common::podToHex(m_tips.back());
 
-          return;
-        }
+        return;
       }
 
+      m_lastBlockHash = blockHash;
+      m_snapshot = static_cast<size_t>(tip - m_tips.begin());
+
     } else {
       operation = "- saving ";
       logger(INFO) << "  saving...";
@@ -227,28 +273,27 @@ public:
     logger(INFO) << operation << "block index...";
     s(m_bs.m_blockIndex, "block_index");
 
-    try {
-      logger(INFO) << operation << "transaction map...";
-      //s(m_bs.m_transactionMap, "transactions");
-      if (s.type() == ISerializer::INPUT) {
-        phmap::BinaryInputArchive ar_in(appendPath(m_bs.m_config_folder, "transactionsmap.dat").c_str());
-        m_bs.m_transactionMap.load(ar_in);
-      }
-      else {
-        phmap::BinaryOutputArchive ar_out(appendPath(m_bs.m_config_folder, "transactionsmap.dat").c_str());
-        m_bs.m_transactionMap.dump(ar_out);
+    logger(INFO) << operation << "transaction map...";
+    //s(m_bs.m_transactionMap, "transactions");
+    std::string transactionsPath = appendPath(m_bs.m_config_folder, "transactionsmap.dat");
+    if (s.type() == ISerializer::INPUT) {
+      if (!m_bs.m_transactionMap->loadSnapshot(transactionsPath, laterTips())) {
+        // trigger rebuild
+        return;
       }
-    } catch(...) { /* trigger rebuild */ return; }
+    } else {
+      m_storeTransactions = m_bs.m_transactionMap->takeSnapshot(transactionsPath, m_lastBlockHash);
+    }
 
     logger(INFO) << operation << "spent keys...";
     //s(m_bs.m_spent_keys, "spent_keys");
+    std::string spentKeysPath = appendPath(m_bs.m_config_folder, "spentkeys.dat");
     if (s.type() == ISerializer::INPUT) {
-      phmap::BinaryInputArchive ar_in(appendPath(m_bs.m_config_folder, "spentkeys.dat").c_str());
-      m_bs.m_spent_keys.load(ar_in);
-    }
-    else {
-      phmap::BinaryOutputArchive ar_out(appendPath(m_bs.m_config_folder, "spentkeys.dat").c_str());
-      m_bs.m_spent_keys.dump(ar_out);
+      if (!m_bs.m_spent_keys->loadSnapshot(spentKeysPath, laterTips())) {
+        return;
+      }
+    } else {
+      m_storeSpentKeys = m_bs.m_spent_keys->takeSnapshot(spentKeysPath, m_lastBlockHash);
     }
 
     logger(INFO) << operation << "outputs...";
@@ -261,141 +306,57 @@ public:
 
     logger(INFO) << "Serialization time: " << std::chrono::duration_cast<std::chrono::milliseconds>(dur).count() << "ms";
 
-    m_cacheloaded = true;
+    m_loaded = true;
   }
 
-  static bool m_cacheloaded;
-  static bool loaded() {
-    return m_cacheloaded;
+  bool loaded() const {
+    return m_loaded;
   }
-  static void reset() {
-    m_cacheloaded = false;
-  } 
-
-private:
-
-  LoggerRef logger;
-  Blockchain& m_bs;
-  Crypto::Hash m_lastBlockHash;
-};
-
-class BlockchainIndicesSerializer {
 
-public:
-  BlockchainIndicesSerializer(Blockchain& bs, const Crypto::Hash lastBlockHash, ILogger& logger) :
-    logger(logger, "BlockchainIndicesSerializer"), m_bs(bs), m_lastBlockHash(lastBlockHash) {
-  }
-
-  void serialize(ISerializer& s) {
-
-    uint8_t version = CURRENT_BLOCKCHAININDICES_STORAGE_ARCHIVE_VER;
-
-    KV_MEMBER(version);
-
-    // ignore old versions, do rebuild
-    if (version != CURRENT_BLOCKCHAININDICES_STORAGE_ARCHIVE_VER) {
-      logger(INFO) << "this is an old version... rebuild block cache indices...";
-      return;
-    }
-
-    std::string operation;
-
-    if (s.type() == ISerializer::INPUT) {
-      operation = "- loading ";
-
-      Crypto::Hash blockHash;
-      s(blockHash, "blockHash");
-
-      //std::string lasth(m_lastBlockHash.data, m_lastBlockHash.data + sizeof(m_lastBlockHash.data));
-      //std::string thish(blockHash.data, blockHash.data + sizeof(blockHash.data));
-      std::string lasth = Common::podToHex(m_lastBlockHash);
-      std::string thish = Common::podToHex(blockHash);
-
-      if (m_lastBlockHash != NULL_HASH && blockHash != NULL_HASH && 
-        lasth.length() > 0 && thish.length() > 0) {
-        if (lasth.compare(thish) != 0) {
-          logger(INFO) << "last block does not match, reloading block indices...";
-          return;
-        }
-      }
-
-    } else {
-      operation = "- saving ";
-      s(m_lastBlockHash, "blockHash");
-    }
-
-    //logger(INFO) << operation << "paymentID index...";
-    s(m_bs.m_paymentIdIndex, "paymentIdIndex");
-
-    //logger(INFO) << operation << "timestamp index...";
-    s(m_bs.m_timestampIndex, "timestampIndex");
-
-    //logger(INFO) << operation << "generated transactions index...";
-    s(m_bs.m_generatedTransactionsIndex, "generatedTransactionsIndex");
-  }
-
-  template<class Archive> void serialize(Archive& ar, unsigned int version) {
-
-    // ignore old versions, do rebuild
-    if (version < CURRENT_BLOCKCHAININDICES_STORAGE_ARCHIVE_VER)
-      return;
-
-    std::string operation;
-    if (Archive::is_loading::value) {
-      operation = "- loading ";
-      Crypto::Hash blockHash;
-      ar & blockHash;
-
-      if (blockHash != m_lastBlockHash) {
-        return;
-      }
-
-    } else {
-      operation = "- saving ";
-      ar & m_lastBlockHash;
-    }
-
-    logger(INFO) << operation << "paymentID index...";
-    ar & m_bs.m_paymentIdIndex;
-
-    logger(INFO) << operation << "timestamp index...";
-    ar & m_bs.m_timestampIndex;
-
-    logger(INFO) << operation << "generated transactions index...";
-    ar & m_bs.m_generatedTransactionsIndex;
-  }
-
-  static bool m_indiceloaded;
-  bool indice_loaded() const {
-    return m_indiceloaded;
-  }
-  static void reset() {
-    m_indiceloaded = false;
+  // which of the tips the loaded snapshot ends at
+  size_t snapshot() const {
+    return m_snapshot;
   }
 
 private:
+  std::vector<Crypto::Hash> laterTips() const {
+    return std::vector<Crypto::Hash>(m_tips.begin() + m_snapshot, m_tips.end());
+  }
 
   LoggerRef logger;
   Blockchain& m_bs;
   Crypto::Hash m_lastBlockHash;
+  std::vector<Crypto::Hash> m_tips;
+  size_t m_snapshot;
+  bool m_loaded;
+  BinaryArray m_data;
+  std::function<bool()> m_storeTransactions;
+  std::function<bool()> m_storeSpentKeys;
 };
 
-// static data initialization
-bool BlockCacheSerializer::m_cacheloaded = false;
-bool BlockchainIndicesSerializer::m_indiceloaded = false;
-
 Blockchain::Blockchain(const Currency& currency, tx_memory_pool& tx_pool, ILogger& logger, bool blockchainIndexesEnabled) :
 m_currency(currency),
 m_tx_pool(tx_pool),
 m_current_block_cumul_sz_limit(0),
+m_alternative_chains(ALTERNATIVE_BLOCKS_MAX_MEMORY_SIZE),
+m_invalid_blocks(INVALID_BLOCKS_MAX_MEMORY_SIZE),
+m_blockCacheSize(BLOCK_CACHE_DEFAULT_SIZE * 1024 * 1024),
+m_diskIndexes(false),
 m_checkpoints(logger),
 m_paymentIdIndex(blockchainIndexesEnabled),
 m_timestampIndex(blockchainIndexesEnabled),
 m_generatedTransactionsIndex(blockchainIndexesEnabled),
 m_orphanBlocksIndex(blockchainIndexesEnabled),
 m_blockchainIndexesEnabled(blockchainIndexesEnabled),
-logger(logger, "Blockchain") {
-
+m_ringSignatureCache(RING_SIGNATURE_CACHE_SIZE),
+m_ringMemberKeyCache(RING_MEMBER_KEY_CACHE_SIZE),
+logger(logger, "Blockchain"),
+m_blockBatchDepth(0),
+m_storageFailed(false),
+m_blockCacheLoaded(false) {
+
+  m_transactionMap.reset(new MemoryKeyValueIndex<Crypto::Hash, TransactionIndex>());
+  m_spent_keys.reset(new MemoryKeyValueIndex<Crypto::KeyImage, uint32_t>());
   m_outputs.set_deleted_key(0);
   Crypto::KeyImage nullImage = boost::value_initialized<decltype(nullImage)>();
   //m_spent_keys.set_deleted_key(nullImage);
@@ -469,18 +430,18 @@ bool Blockchain::checkTransactionSize(size_t blobSize) {
 }
 
 bool Blockchain::haveTransaction(const Crypto::Hash &id) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
-  return m_transactionMap.find(id) != m_transactionMap.end();
+  ReadLock lk(*this);
+  return m_transactionMap->contains(id);
 }
 
 bool Blockchain::have_tx_keyimg_as_spent(const Crypto::KeyImage &key_im) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
-  return  m_spent_keys.find(key_im) != m_spent_keys.end();
+  ReadLock lk(*this);
+  return m_spent_keys->contains(key_im);
 }
 
 // is 32 bit in the network protocol
 uint32_t Blockchain::getCurrentBlockchainHeight() {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
 
   return static_cast<uint32_t>(m_blocks.size());
 }
@@ -491,7 +452,9 @@ bool Blockchain::loadIndexes(std::string config_folder, bool load_existing) {
     BlockCacheSerializer cacheloader(*this, get_block_hash(m_blocks.back().bl), logger.getLogger());
     cacheloader.load(appendPath(config_folder, m_currency.blocksCacheFileName()));
 
-    if (!cacheloader.loaded()) {
+    if (cacheloader.loaded()) {
+      m_blockCacheLoaded = true;
+    } else {
       logger(INFO, BRIGHT_YELLOW) << "No recent blockchain cache found, rebuilding internal structures...";
       if (!rebuildCache()) {
         logger(DEBUGGING) << "Rebuild of cache failed.";
@@ -504,6 +467,9 @@ bool Blockchain::loadIndexes(std::string config_folder, bool load_existing) {
     }
   } else {
       m_blocks.clear();
+      m_blockHeaders.clear();
+      m_blockLayouts.clear();
+      m_blockUndo.clear();
   }
 
   return results;
@@ -523,18 +489,18 @@ bool Blockchain::init(const std::string& config_folder, bool load_existing) {
   }
 
   m_config_folder = config_folder;
+  logger(DEBUGGING) << "Proof of work scratchpad on " << m_cn_context.pages_name();
 
   std::string blockFilePath = appendPath(config_folder, m_currency.blocksFileName());
   std::string indexesPath = appendPath(config_folder, m_currency.blockIndexesFileName());
-  if (!m_blocks.open(blockFilePath, indexesPath, 1024)) {
+  if (!m_blocks.open(blockFilePath, indexesPath, m_blockCacheSize)) {
     logger(ERROR, BRIGHT_RED) << "Failed to open the block file " << blockFilePath << " with indexes path " << indexesPath << " after append of config folder path: " << m_config_folder;
 
     remove(blockFilePath.c_str());
-    BlockCacheSerializer::reset();
+    m_blockCacheLoaded = false;
     remove(indexesPath.c_str());
-    BlockchainIndicesSerializer::reset();
 
-    if (!m_blocks.open(blockFilePath, indexesPath, 1024)) {
+    if (!m_blocks.open(blockFilePath, indexesPath, m_blockCacheSize)) {
       logger(ERROR, BRIGHT_RED) << "Failed to open the block file for resync " << blockFilePath << " with indexes path " << indexesPath << " after append of config folder path: " << m_config_folder;
       return false;
     }
@@ -542,20 +508,78 @@ bool Blockchain::init(const std::string& config_folder, bool load_existing) {
     load_existing = false;
   }
 
+  m_blocks.setReadAhead(BLOCK_CACHE_READ_AHEAD_COUNT);
+
+  std::string headersPath = appendPath(config_folder, m_currency.blockHeadersFileName());
+  if (!m_blockHeaders.open(headersPath)) {
+    logger(ERROR, BRIGHT_RED) << "Failed to open the block headers file " << headersPath;
+    return false;
+  }
+
+  std::string layoutsPath = appendPath(config_folder, m_currency.blockLayoutsFileName());
+  std::string layoutIndexesPath = appendPath(config_folder, m_currency.blockLayoutIndexesFileName());
+  if (!m_blockLayouts.open(layoutsPath, layoutIndexesPath, BLOCK_LAYOUT_CACHE_SIZE)) {
+    logger(ERROR, BRIGHT_RED) << "Failed to open the block layouts file " << layoutsPath;
+    return false;
+  }
+
+  std::string undoPath = appendPath(config_folder, m_currency.blockUndoFileName());
+  std::string undoIndexesPath = appendPath(config_folder, m_currency.blockUndoIndexesFileName());
+  if (!m_blockUndo.open(undoPath, undoIndexesPath, BLOCK_UNDO_CACHE_SIZE)) {
+    logger(ERROR, BRIGHT_RED) << "Failed to open the block undo file " << undoPath;
+    return false;
+  }
+
+  if (m_diskIndexes && !openDiskIndexes()) {
+    logger(WARNING, BRIGHT_YELLOW) << "Failed to open the disk indexes, keeping them in memory";
+  }
+
+  std::string journalPath = appendPath(config_folder, m_currency.blocksCacheJournalFileName());
+  std::vector<BinaryArray> journalRecords;
+  bool journalLoaded = m_cacheJournal.open(journalPath, journalRecords);
+
   std::string cachePath = "";
   if (load_existing && !m_blocks.empty()) {
     //logger(INFO) << "Loading blockchain...";
-    BlockCacheSerializer cacheloader(*this, get_block_hash(m_blocks.back().bl), logger.getLogger()); 
+    // a journal applies to the snapshot it was started from and the ones
+    // marked in it since, without one the snapshot has to match the chain tip
+    std::vector<Crypto::Hash> snapshotTips;
+    if (journalLoaded) {
+      for (const auto& snapshot : m_cacheJournal.snapshots()) {
+        snapshotTips.push_back(snapshot.first);
+      }
+    } else {
+      snapshotTips.push_back(get_block_hash(m_blocks.back().bl));
+    }
+
+    BlockCacheSerializer cacheloader(*this, snapshotTips, logger.getLogger()); 
     cachePath = appendPath(config_folder, m_currency.blocksCacheFileName());
     cacheloader.load(cachePath);
 
-    if (!cacheloader.loaded()) {
-      logger(INFO) << "No actual blockchain cache found, rebuilding internal structures...";
-      rebuildCache();
+    bool cacheLoaded = cacheloader.loaded();
+    if (cacheLoaded) {
+      if (!journalLoaded) {
+        m_cacheJournal.reset(snapshotTips.front());
+      } else if (cacheloader.snapshot() != 0) {
+        // a crash came between writing a snapshot and rebasing the journal on it
+        uint64_t firstRecord = m_cacheJournal.snapshots()[cacheloader.snapshot()].second;
+        journalRecords.erase(journalRecords.begin(), journalRecords.begin() + static_cast<ptrdiff_t>(firstRecord));
+        m_cacheJournal.rebase(snapshotTips[cacheloader.snapshot()]);
+      }
+
+      if (!replayBlockCacheJournal(journalRecords)) {
+        logger(INFO) << "Blockchain cache journal does not match the blockchain";
+        cacheLoaded = false;
+      }
     }
 
-    if (m_blockchainIndexesEnabled) {
-      loadBlockchainIndices();
+    if (cacheLoaded) {
+      m_blockCacheLoaded = true;
+    } else {
+      logger(INFO) << "No actual blockchain cache found, rebuilding internal structures...";
+      rebuildCache();
+      m_cacheJournal.reset(getTailId());
+      scheduleCacheCompaction();
     }
 
     //if (cacheloader.loaded()) {
@@ -579,6 +603,18 @@ bool Blockchain::init(const std::string& config_folder, bool load_existing) {
     //}
   } else {
     m_blocks.clear();
+    // an empty cache is complete, start journaling from scratch
+    m_blockCacheLoaded = true;
+    m_cacheJournal.reset(NULL_HASH);
+    scheduleCacheCompaction();
+  }
+
+  if (!syncBlockHeaders() || !syncBlockLayouts() || !syncBlockUndo()) {
+    return false;
+  }
+
+  if (m_blockchainIndexesEnabled && !loadBlockchainIndices()) {
+    return false;
   }
 
   //logger(WARNING, BRIGHT_YELLOW) << "Checking blocks...";
@@ -589,7 +625,7 @@ bool Blockchain::init(const std::string& config_folder, bool load_existing) {
     block_verification_context bvc = boost::value_initialized<block_verification_context>();
     logger(INFO, BRIGHT_WHITE) << "pushBlock into context now...";
     uint32_t height=0;
-    pushBlock(m_currency.genesisBlock(), bvc, height);
+    pushBlock(m_currency.genesisBlock(), get_block_hash(m_currency.genesisBlock()), bvc, height);
     if (bvc.m_verifivation_failed) {
       logger(ERROR, BRIGHT_RED) << "Failed to add genesis block to blockchain";
       return false;
@@ -628,47 +664,162 @@ bool Blockchain::init(const std::string& config_folder, bool load_existing) {
 bool Blockchain::rebuildCache() {
   std::chrono::steady_clock::time_point timePoint = std::chrono::steady_clock::now();
   m_blockIndex.clear();
-  m_transactionMap.clear();
-  m_spent_keys.clear();
+  m_transactionMap->clear();
+  m_spent_keys->clear();
   m_outputs.clear();
   m_multisignatureOutputs.clear();
 
-  try {
+  // Blocks are decoded and hashed in batches while the previous batch is
+  // indexed, the two share the cores. Outputs are appended on this thread in height order, so
+  // global output indexes come out the same as with a sequential rebuild.
+  struct DecodedBlock {
+    BlockEntry block;
+    Crypto::Hash blockHash;
+    std::vector<Crypto::Hash> transactionHashes;
+  };
 
-  for (uint32_t b = 0; b < m_blocks.size(); ++b) {
-    if (b % 1000 == 0) {
-      logger(INFO, BRIGHT_WHITE) << "Height " << b << " of " << m_blocks.size();
-    }
-    const BlockEntry& block = m_blocks[b];
-    Crypto::Hash blockHash = get_block_hash(block.bl);
-    m_blockIndex.push(blockHash);
-    for (uint16_t t = 0; t < block.transactions.size(); ++t) {
-      const TransactionEntry& transaction = block.transactions[t];
-      Crypto::Hash transactionHash = getObjectHash(transaction.tx);
-      TransactionIndex transactionIndex = { b, t };
-      m_transactionMap.insert(std::make_pair(transactionHash, transactionIndex));
-
-      // process inputs
-      for (auto& i : transaction.tx.inputs) {
-        if (i.type() == typeid(KeyInput)) {
-          m_spent_keys.insert(std::make_pair(::boost::get<KeyInput>(i).keyImage, b));
-        } else if (i.type() == typeid(MultisignatureInput)) {
-          auto out = ::boost::get<MultisignatureInput>(i);
-          m_multisignatureOutputs[out.amount][out.outputIndex].isUsed = true;
+  const uint32_t blockCount = static_cast<uint32_t>(m_blocks.size());
+  const uint32_t batchSize = 1000;
+  const size_t threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  // without a mapping blocks can only be read through the cache, one at a time
+  const bool parallelDecode = threads > 1 && m_blocks.mapAll();
+  // this thread appends the outputs next to the inserters
+  const size_t decodeWorkers = parallelDecode ? std::max<size_t>(threads / 2, 1) : 1;
+  const size_t insertWorkers = std::max<size_t>(threads - (parallelDecode ? decodeWorkers : 0) - 1, 1);
+
+  auto decodeBatch = [&](uint32_t first, std::vector<DecodedBlock>& batch) {
+    batch.resize(std::min(batchSize, blockCount - first));
+
+    auto decodeRange = [&](size_t begin, size_t step) {
+      for (size_t i = begin; i < batch.size(); i += step) {
+        DecodedBlock& decoded = batch[i];
+        if (parallelDecode) {
+          if (!m_blocks.load(first + i, decoded.block)) {
+            throw std::runtime_error("failed to load block " + std::to_string(first + i));
+          }
+        } else {
+          decoded.block = m_blocks[first + i];
+        }
+
+        // the block lists the hashes of all but its base transaction
+        decoded.blockHash = get_block_hash(decoded.block.bl);
+        decoded.transactionHashes.resize(decoded.block.transactions.size());
+        for (size_t t = 0; t < decoded.block.transactions.size(); ++t) {
+          decoded.transactionHashes[t] = t == 0 ? getObjectHash(decoded.block.transactions[t].tx) : decoded.block.bl.transactionHashes[t - 1];
         }
       }
+    };
+
+    if (!parallelDecode) {
+      decodeRange(0, 1);
+      return;
+    }
+
+    std::vector<std::future<void>> decoders;
+    for (size_t w = 1; w < decodeWorkers; ++w) {
+      decoders.push_back(std::async(std::launch::async, decodeRange, w, decodeWorkers));
+    }
+
+    decodeRange(0, decodeWorkers);
+    for (auto& decoder : decoders) {
+      decoder.get();
+    }
+  };
+
+  auto indexBatch = [&](uint32_t first, const std::vector<DecodedBlock>& batch) {
+    // every worker owns the keys of one partition, so the maps are filled
+    // without locking
+    auto insertPartition = [&](size_t partition) {
+      for (size_t i = 0; i < batch.size(); ++i) {
+        uint32_t b = first + static_cast<uint32_t>(i);
+        const DecodedBlock& decoded = batch[i];
+        for (uint16_t t = 0; t < decoded.block.transactions.size(); ++t) {
+          const Crypto::Hash& transactionHash = decoded.transactionHashes[t];
+          if (m_transactionMap->partition(transactionHash, insertWorkers) == partition) {
+            TransactionIndex transactionIndex = { b, t };
+            m_transactionMap->insert(transactionHash, transactionIndex);
+          }
 
-      // process outputs
-      for (uint16_t o = 0; o < transaction.tx.outputs.size(); ++o) {
-        const auto& out = transaction.tx.outputs[o];
-        if (out.target.type() == typeid(KeyOutput)) {
-          m_outputs[out.amount].push_back(std::make_pair<>(transactionIndex, o));
-        } else if (out.target.type() == typeid(MultisignatureOutput)) {
-          MultisignatureOutputUsage usage = { transactionIndex, o, false };
-          m_multisignatureOutputs[out.amount].push_back(usage);
+          for (auto& in : decoded.block.transactions[t].tx.inputs) {
+            if (in.type() == typeid(KeyInput)) {
+              const Crypto::KeyImage& keyImage = ::boost::get<KeyInput>(in).keyImage;
+              if (m_spent_keys->partition(keyImage, insertWorkers) == partition) {
+                m_spent_keys->insert(keyImage, b);
+              }
+            }
+          }
         }
       }
+    };
+
+    std::vector<std::future<void>> inserters;
+    for (size_t w = 0; w < insertWorkers; ++w) {
+      inserters.push_back(std::async(std::launch::async, insertPartition, w));
     }
+
+    for (size_t i = 0; i < batch.size(); ++i) {
+      uint32_t b = first + static_cast<uint32_t>(i);
+      const DecodedBlock& decoded = batch[i];
+      m_blockIndex.push(decoded.blockHash);
+      for (uint16_t t = 0; t < decoded.block.transactions.size(); ++t) {
+        const TransactionEntry& transaction = decoded.block.transactions[t];
+        TransactionIndex transactionIndex = { b, t };
+
+        // process inputs
+        for (auto& in : transaction.tx.inputs) {
+          if (in.type() == typeid(MultisignatureInput)) {
+            auto out = ::boost::get<MultisignatureInput>(in);
+            m_multisignatureOutputs[out.amount][out.outputIndex].isUsed = true;
+          }
+        }
+
+        // process outputs
+        for (uint16_t o = 0; o < transaction.tx.outputs.size(); ++o) {
+          const auto& out = transaction.tx.outputs[o];
+          if (out.target.type() == typeid(KeyOutput)) {
+            OutputEntry entry = { transactionIndex, o, transaction.tx.unlockTime, ::boost::get<KeyOutput>(out.target).key };
+            m_outputs[out.amount].push_back(entry);
+          } else if (out.target.type() == typeid(MultisignatureOutput)) {
+            MultisignatureOutputUsage usage = { transactionIndex, o, false };
+            m_multisignatureOutputs[out.amount].push_back(usage);
+          }
+        }
+      }
+    }
+
+    for (auto& inserter : inserters) {
+      inserter.get();
+    }
+
+    commitIndexes(false);
+  };
+
+  try {
+
+  std::vector<DecodedBlock> current;
+  std::vector<DecodedBlock> next;
+  if (blockCount > 0) {
+    decodeBatch(0, current);
+  }
+
+  for (uint32_t first = 0; first < blockCount; first += batchSize) {
+    logger(INFO, BRIGHT_WHITE) << "Height " << first << " of " << blockCount;
+
+    uint32_t nextFirst = first + batchSize;
+    std::future<void> decoder;
+    if (parallelDecode && nextFirst < blockCount) {
+      decoder = std::async(std::launch::async, [&, nextFirst] { decodeBatch(nextFirst, next); });
+    }
+
+    indexBatch(first, current);
+
+    if (decoder.valid()) {
+      decoder.get();
+    } else if (nextFirst < blockCount) {
+      decodeBatch(nextFirst, next);
+    }
+
+    std::swap(current, next);
   }
 
   }
@@ -677,12 +828,140 @@ bool Blockchain::rebuildCache() {
     return false;
   }
 
-  BlockCacheSerializer::m_cacheloaded = true;
+  m_blockCacheLoaded = true;
   std::chrono::duration<double> duration = std::chrono::steady_clock::now() - timePoint;
   logger(INFO, BRIGHT_WHITE) << "Rebuilding internal structures took: " << duration.count();
   return true;
 }
 
+CompactBlockHeader Blockchain::makeBlockHeader(const BlockEntry& block, const Crypto::Hash& blockHash) {
+  CompactBlockHeader header;
+  header.timestamp = block.bl.timestamp;
+  header.cumulativeDifficulty = block.cumulative_difficulty;
+  header.blockCumulativeSize = block.block_cumulative_size;
+  header.alreadyGeneratedCoins = block.already_generated_coins;
+  header.blockHash = blockHash;
+  return header;
+}
+
+// Brings the header index in line with m_blocks after a restart. Usually it
+// already matches, after a crash only the missing tail has to be decoded.
+bool Blockchain::syncBlockHeaders() {
+  try {
+    while (m_blockHeaders.size() > m_blocks.size()) {
+      m_blockHeaders.pop();
+    }
+
+    if (!m_blockHeaders.empty() && m_blockHeaders.back().blockHash != get_block_hash(m_blocks[m_blockHeaders.size() - 1].bl)) {
+      logger(INFO, BRIGHT_YELLOW) << "Block headers index does not match the blockchain, rebuilding...";
+      m_blockHeaders.clear();
+    }
+
+    for (uint32_t b = m_blockHeaders.size(); b < m_blocks.size(); ++b) {
+      if (b % 1000 == 0) {
+        logger(INFO, BRIGHT_WHITE) << "Indexing block headers, height " << b << " of " << m_blocks.size();
+      }
+
+      const BlockEntry& block = m_blocks[b];
+      m_blockHeaders.push(makeBlockHeader(block, get_block_hash(block.bl)));
+    }
+  } catch (std::exception& e) {
+    logger(ERROR, BRIGHT_RED) << "Failed to index block headers: " << e.what();
+    return false;
+  }
+
+  return true;
+}
+
+// Encodes the entry the same way SwappedVector stores it and notes where each
+// part starts. The binary format has no framing, so the record is exactly the
+// fields of BlockEntry::serialize back to back.
+Blockchain::BlockLayout Blockchain::makeBlockLayout(const BlockEntry& block) {
+  BlockEntry& entry = const_cast<BlockEntry&>(block);
+  BinaryArray record;
+  Common::VectorOutputStream stream(record);
+  BinaryOutputStreamSerializer s(stream);
+
+  BlockLayout layout;
+  s(entry.bl, "block");
+  layout.blockSize = static_cast<uint32_t>(record.size());
+  s(entry.height, "height");
+  s(entry.block_cumulative_size, "block_cumulative_size");
+  s(entry.cumulative_difficulty, "cumulative_difficulty");
+  s(entry.already_generated_coins, "already_generated_coins");
+
+  uint64_t count = entry.transactions.size();
+  s.beginArray(count, "transactions");
+  for (TransactionEntry& transaction : entry.transactions) {
+    layout.transactionOffsets.push_back(static_cast<uint32_t>(record.size()));
+    s(transaction.tx, "tx");
+    layout.transactionSizes.push_back(static_cast<uint32_t>(record.size() - layout.transactionOffsets.back()));
+    s(transaction.m_global_output_indexes, "indexes");
+  }
+  s.endArray();
+
+  layout.recordSize = static_cast<uint32_t>(record.size());
+  return layout;
+}
+
+// Same as syncBlockHeaders for the layouts. A layout that does not add up to
+// the size of the stored record means the files went out of step, the whole
+// index is rebuilt then rather than serving wrong bytes.
+bool Blockchain::syncBlockLayouts() {
+  try {
+    while (m_blockLayouts.size() > m_blocks.size()) {
+      m_blockLayouts.pop_back();
+    }
+
+    if (!m_blockLayouts.empty() && m_blockLayouts.back().recordSize != m_blocks.rawSize(m_blockLayouts.size() - 1)) {
+      logger(INFO, BRIGHT_YELLOW) << "Block layouts do not match the blockchain, rebuilding...";
+      m_blockLayouts.clear();
+    }
+
+    for (uint32_t b = static_cast<uint32_t>(m_blockLayouts.size()); b < m_blocks.size(); ++b) {
+      if (b % 1000 == 0) {
+        logger(INFO, BRIGHT_WHITE) << "Indexing block layouts, height " << b << " of " << m_blocks.size();
+      }
+
+      m_blockLayouts.push_back(makeBlockLayout(m_blocks[b]));
+    }
+  } catch (std::exception& e) {
+    logger(ERROR, BRIGHT_RED) << "Failed to index block layouts: " << e.what();
+    return false;
+  }
+
+  return true;
+}
+
+// Same as syncBlockLayouts for the undo records, which are checked against
+// the block hashes in the headers.
+bool Blockchain::syncBlockUndo() {
+  try {
+    while (m_blockUndo.size() > m_blocks.size()) {
+      m_blockUndo.pop_back();
+    }
+
+    if (!m_blockUndo.empty() && m_blockUndo.back().blockHash != m_blockHeaders[static_cast<uint32_t>(m_blockUndo.size() - 1)].blockHash) {
+      logger(INFO, BRIGHT_YELLOW) << "Block undo records do not match the blockchain, rebuilding...";
+      m_blockUndo.clear();
+    }
+
+    for (uint32_t b = static_cast<uint32_t>(m_blockUndo.size()); b < m_blocks.size(); ++b) {
+      if (b % 1000 == 0) {
+        logger(INFO, BRIGHT_WHITE) << "Indexing block undo records, height " << b << " of " << m_blocks.size();
+      }
+
+      BlockCacheDelta delta = makeBlockCacheDelta(m_blocks[b], m_blockHeaders[b].blockHash, false);
+      pushBlockUndo(delta);
+    }
+  } catch (std::exception& e) {
+    logger(ERROR, BRIGHT_RED) << "Failed to index block undo records: " << e.what();
+    return false;
+  }
+
+  return true;
+}
+
 /*
 bool Blockchain::rebuildCache() {
   std::chrono::steady_clock::time_point timePoint = std::chrono::steady_clock::now();
@@ -730,8 +1009,8 @@ bool Blockchain::rebuildCache() {
         for (uint16_t o = 0; o < transaction.tx.outputs.size(); ++o) {
           const auto& out = transaction.tx.outputs[o];
           if (out.target.type() == typeid(KeyOutput)) {
-            auto newitem = std::make_pair<>(transactionIndex, o);
-            m_outputs[out.amount].push_back(newitem);
+            OutputEntry entry = { transactionIndex, o, transaction.tx.unlockTime, ::boost::get<KeyOutput>(out.target).key };
+            m_outputs[out.amount].push_back(entry);
           } else if (out.target.type() == typeid(MultisignatureOutput)) {
             MultisignatureOutputUsage usage = { transactionIndex, o, false };
             m_multisignatureOutputs[out.amount].push_back(usage);
@@ -750,23 +1029,404 @@ bool Blockchain::rebuildCache() {
     return false;
   }
 
-  BlockCacheSerializer::m_cacheloaded = true;
+  m_blockCacheLoaded = true;
   std::chrono::duration<double> duration = std::chrono::steady_clock::now() - timePoint;
   //logger(INFO, BRIGHT_WHITE) << "Rebuilding internal structures took: " << duration.count();
   return true;
 }
 */
 
+// Only taking the snapshot and rebasing the journal need the exclusive lock,
+// the snapshot is written out after it is released. Its tip is marked in the
+// journal first and the journal is rebased on it only once the snapshot has
+// replaced the previous one on disk, a crash in between leaves a journal that
+// brings either of them up to date.
 bool Blockchain::storeCache() {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  std::lock_guard<std::mutex> storeLock(m_cacheStoreMutex);
+
+  std::unique_ptr<BlockCacheSerializer> ser;
+  Crypto::Hash tip;
+  bool journaled;
+  {
+    std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+    if (!m_blockCacheLoaded) {
+      logger(INFO) << "save operations are skipped until cache is fully loaded...";
+      return true; // not a fatal error, normal...
+    }
+
+    // the snapshot must not name a tip that is not in the block file yet,
+    // writing out pending blocks leaves their content unchanged
+    flushBlockBatch();
+
+    tip = getTailId();
+    journaled = m_cacheJournal.isOpened();
+    if (journaled) {
+      // before the disk indexes are committed with the tip as tag
+      try {
+        m_cacheJournal.mark(tip);
+        m_cacheJournal.sync();
+      } catch (std::exception& e) {
+        logger(ERROR, BRIGHT_RED) << "Failed to write blockchain cache journal: " << e.what();
+        m_cacheJournal.close();
+        journaled = false;
+      }
+    }
+
+    ser.reset(new BlockCacheSerializer(*this, tip, logger.getLogger()));
+    if (!ser->save()) {
+      logger(ERROR, BRIGHT_RED) << "Failed to save blockchain cache";
+      return false;
+    }
+  }
 
   logger(INFO, BRIGHT_WHITE) << "Saving blockchain...";
-  BlockCacheSerializer ser(*this, getTailId(), logger.getLogger());
-  if (!ser.save(appendPath(m_config_folder, m_currency.blocksCacheFileName()))) {
+  if (!ser->write(appendPath(m_config_folder, m_currency.blocksCacheFileName()))) {
+    // the previous snapshot is still in place and the journal still applies to it
     logger(ERROR, BRIGHT_RED) << "Failed to save blockchain cache";
     return false;
   }
 
+  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  if (journaled) {
+    if (!m_cacheJournal.rebase(tip)) {
+      logger(WARNING, BRIGHT_YELLOW) << "Failed to rebase blockchain cache journal, keeping the old one";
+    }
+  } else if (!m_cacheJournal.reset(tip)) {
+    // blocks added while writing without a journal are found missing on the
+    // next start and cost a rebuild
+    logger(ERROR, BRIGHT_RED) << "Failed to reset blockchain cache journal";
+  }
+
+  return true;
+}
+
+void Blockchain::scheduleCacheCompaction() {
+  if (m_cacheCompaction.valid() && m_cacheCompaction.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+    return;
+  }
+
+  // takes the snapshot once the caller releases m_blockchain_lock, blocks
+  // keep being added while it is written out
+  m_cacheCompaction = std::async(std::launch::async, [this] { return storeCache(); });
+}
+
+void Blockchain::beginBlockBatch() {
+  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  if (m_blockBatchDepth++ == 0) {
+    m_blocks.beginBatch(BLOCK_BATCH_MAX_PENDING_SIZE);
+  }
+}
+
+bool Blockchain::endBlockBatch() {
+  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  assert(m_blockBatchDepth > 0);
+  if (--m_blockBatchDepth == 0) {
+    try {
+      flushBlockBatch();
+      m_blocks.endBatch();
+    } catch (std::exception& e) {
+      // blocks on top of the unwritten ones would be lost on restart as well
+      logger(ERROR, BRIGHT_RED) << "Failed to write blocks, no more blocks are added: " << e.what();
+      m_storageFailed = true;
+    }
+  }
+
+  return !m_storageFailed;
+}
+
+void Blockchain::precomputeProofOfWork(const std::vector<Block>& blocks) {
+  std::vector<const Block*> pending;
+  {
+    std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+    for (const Block& block : blocks) {
+      if (block.baseTransaction.inputs.size() != 1 || block.baseTransaction.inputs[0].type() != typeid(BaseInput)) {
+        continue;
+      }
+
+      uint32_t height = boost::get<BaseInput>(block.baseTransaction.inputs[0]).blockIndex;
+      if (m_checkpoints.is_in_checkpoint_zone(height) || m_blockIndex.hasBlock(get_block_hash(block))) {
+        continue;
+      }
+
+      pending.push_back(&block);
+    }
+  }
+
+  // hashing needs no chain state, the lock is not held while it runs
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    Crypto::cn_context_lease context(m_cnContextPool);
+    for (size_t i = next++; i < pending.size(); i = next++) {
+      Crypto::Hash proofOfWork;
+      m_currency.getBlockLongHash(*context, *pending[i], proofOfWork);
+    }
+  };
+
+  size_t workers = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), pending.size());
+  std::vector<std::future<void>> results;
+  for (size_t w = 1; w < workers; ++w) {
+    results.push_back(std::async(std::launch::async, worker));
+  }
+
+  if (workers != 0) {
+    worker();
+  }
+
+  for (auto& result : results) {
+    result.get();
+  }
+}
+
+// Precondition: m_blockchain_lock is locked.
+// Blocks first, their journal records after, so a crash in between only
+// leaves blocks the journal replay indexes again.
+void Blockchain::flushBlockBatch() {
+  m_blocks.flush();
+
+  std::vector<BinaryArray> records;
+  records.swap(m_pendingJournalRecords);
+  appendJournalRecords(records);
+}
+
+// Precondition: m_blockchain_lock is locked.
+// Replaces the memory-resident transaction map and spent keys, before the
+// block cache is loaded. Dumps left by the memory-resident ones are removed,
+// they would be stale by the time they are used again.
+bool Blockchain::openDiskIndexes() {
+  std::unique_ptr<DiskKeyValueIndex<Crypto::Hash, TransactionIndex>> transactionMap(new DiskKeyValueIndex<Crypto::Hash, TransactionIndex>());
+  std::unique_ptr<DiskKeyValueIndex<Crypto::KeyImage, uint32_t>> spentKeys(new DiskKeyValueIndex<Crypto::KeyImage, uint32_t>());
+  if (!transactionMap->open(appendPath(m_config_folder, m_currency.transactionsIndexFileName())) ||
+    !spentKeys->open(appendPath(m_config_folder, m_currency.spentKeysIndexFileName()))) {
+    return false;
+  }
+
+  m_transactionMap = std::move(transactionMap);
+  m_spent_keys = std::move(spentKeys);
+  remove(appendPath(m_config_folder, "transactionsmap.dat").c_str());
+  remove(appendPath(m_config_folder, "spentkeys.dat").c_str());
+  return true;
+}
+
+// Precondition: m_blockchain_lock is locked.
+// A commit is tagged with the snapshot the journal builds on, so the journal
+// must already hold every change committed, batched records included. Without
+// a journal the commit is untagged and the next start rebuilds the cache.
+void Blockchain::commitIndexes(bool force) {
+  if (m_blockchainIndexesEnabled) {
+    uint64_t explorerSize = m_paymentIdIndex.uncommittedSize() + m_generatedTransactionsIndex.uncommittedSize();
+    if (explorerSize != 0 && (force || explorerSize >= DISK_INDEX_MAX_UNCOMMITTED_SIZE)) {
+      storeBlockchainIndices();
+    }
+  }
+
+  uint64_t uncommittedSize = m_transactionMap->uncommittedSize() + m_spent_keys->uncommittedSize();
+  if (uncommittedSize == 0 || (!force && uncommittedSize < DISK_INDEX_MAX_UNCOMMITTED_SIZE)) {
+    return;
+  }
+
+  try {
+    Crypto::Hash tag = NULL_HASH;
+    if (m_blockCacheLoaded && m_cacheJournal.isOpened()) {
+      flushBlockBatch();
+      // the indexes hold at least what the last marked snapshot does
+      if (m_cacheJournal.isOpened()) {
+        tag = m_cacheJournal.snapshots().back().first;
+      }
+    }
+
+    m_transactionMap->commit(tag);
+    m_spent_keys->commit(tag);
+  } catch (std::exception& e) {
+    logger(ERROR, BRIGHT_RED) << "Failed to write blockchain indexes: " << e.what();
+  }
+}
+
+Blockchain::BlockCacheDelta Blockchain::makeBlockCacheDelta(const BlockEntry& block, const Crypto::Hash& blockHash, bool removed) {
+  BlockCacheDelta delta;
+  delta.removed = removed;
+  delta.height = block.height;
+  delta.blockHash = blockHash;
+
+  for (uint16_t t = 0; t < block.transactions.size(); ++t) {
+    const Transaction& tx = block.transactions[t].tx;
+    TransactionIndex transactionIndex = { block.height, t };
+    delta.transactionHashes.push_back(t == 0 ? getObjectHash(block.bl.baseTransaction) : block.bl.transactionHashes[t - 1]);
+
+    for (const auto& in : tx.inputs) {
+      if (in.type() == typeid(KeyInput)) {
+        delta.spentKeys.push_back(::boost::get<KeyInput>(in).keyImage);
+      } else if (in.type() == typeid(MultisignatureInput)) {
+        const MultisignatureInput& multisignatureInput = ::boost::get<MultisignatureInput>(in);
+        delta.usedMultisignatureAmounts.push_back(multisignatureInput.amount);
+        delta.usedMultisignatureIndexes.push_back(multisignatureInput.outputIndex);
+      }
+    }
+
+    for (uint16_t o = 0; o < tx.outputs.size(); ++o) {
+      const auto& out = tx.outputs[o];
+      if (out.target.type() == typeid(KeyOutput)) {
+        OutputEntry entry = { transactionIndex, o, tx.unlockTime, ::boost::get<KeyOutput>(out.target).key };
+        delta.outputAmounts.push_back(out.amount);
+        delta.outputs.push_back(entry);
+      } else if (out.target.type() == typeid(MultisignatureOutput)) {
+        MultisignatureOutputUsage usage = { transactionIndex, o, false };
+        delta.multisignatureAmounts.push_back(out.amount);
+        delta.multisignatureOutputs.push_back(usage);
+      }
+    }
+  }
+
+  return delta;
+}
+
+void Blockchain::applyBlockCacheDelta(const BlockCacheDelta& delta) {
+  if (!delta.removed) {
+    m_blockIndex.push(delta.blockHash);
+    for (uint16_t t = 0; t < delta.transactionHashes.size(); ++t) {
+      TransactionIndex transactionIndex = { delta.height, t };
+      m_transactionMap->insert(delta.transactionHashes[t], transactionIndex);
+    }
+
+    for (const Crypto::KeyImage& keyImage : delta.spentKeys) {
+      m_spent_keys->insert(keyImage, delta.height);
+    }
+
+    for (size_t i = 0; i < delta.outputs.size(); ++i) {
+      m_outputs[delta.outputAmounts[i]].push_back(delta.outputs[i]);
+    }
+
+    for (size_t i = 0; i < delta.multisignatureOutputs.size(); ++i) {
+      m_multisignatureOutputs[delta.multisignatureAmounts[i]].push_back(delta.multisignatureOutputs[i]);
+    }
+
+    for (size_t i = 0; i < delta.usedMultisignatureIndexes.size(); ++i) {
+      m_multisignatureOutputs[delta.usedMultisignatureAmounts[i]].at(delta.usedMultisignatureIndexes[i]).isUsed = true;
+    }
+
+    return;
+  }
+
+  // undo in reverse, as popTransactions does
+  for (size_t i = delta.usedMultisignatureIndexes.size(); i-- > 0;) {
+    m_multisignatureOutputs[delta.usedMultisignatureAmounts[i]].at(delta.usedMultisignatureIndexes[i]).isUsed = false;
+  }
+
+  // an undo record has no output entries, the amounts are enough to pop them
+  for (size_t i = delta.multisignatureAmounts.size(); i-- > 0;) {
+    auto amountOutputs = m_multisignatureOutputs.find(delta.multisignatureAmounts[i]);
+    if (amountOutputs == m_multisignatureOutputs.end() || amountOutputs->second.empty()) {
+      throw std::runtime_error("multisignature output missing from cache");
+    }
+
+    amountOutputs->second.pop_back();
+    if (amountOutputs->second.empty()) {
+      m_multisignatureOutputs.erase(amountOutputs);
+    }
+  }
+
+  for (size_t i = delta.outputAmounts.size(); i-- > 0;) {
+    auto amountOutputs = m_outputs.find(delta.outputAmounts[i]);
+    if (amountOutputs == m_outputs.end() || amountOutputs->second.empty()) {
+      throw std::runtime_error("output missing from cache");
+    }
+
+    amountOutputs->second.pop_back();
+    if (amountOutputs->second.empty()) {
+      m_outputs.erase(amountOutputs);
+    }
+  }
+
+  for (const Crypto::KeyImage& keyImage : delta.spentKeys) {
+    m_spent_keys->erase(keyImage);
+  }
+
+  for (const Crypto::Hash& transactionHash : delta.transactionHashes) {
+    m_transactionMap->erase(transactionHash);
+  }
+
+  m_blockIndex.pop();
+}
+
+void Blockchain::journalBlockCacheDelta(const BlockCacheDelta& delta) {
+  if (!m_cacheJournal.isOpened()) {
+    return;
+  }
+
+  // the journal must never get ahead of the block file
+  if (m_blockBatchDepth > 0) {
+    m_pendingJournalRecords.push_back(toBinaryArray(delta));
+    return;
+  }
+
+  appendJournalRecords(std::vector<BinaryArray>(1, toBinaryArray(delta)));
+}
+
+// The records are synced to disk together, once per block batch.
+void Blockchain::appendJournalRecords(const std::vector<BinaryArray>& records) {
+  if (!m_cacheJournal.isOpened() || records.empty()) {
+    return;
+  }
+
+  try {
+    for (const BinaryArray& record : records) {
+      m_cacheJournal.append(record);
+    }
+
+    m_cacheJournal.sync();
+  } catch (std::exception& e) {
+    // without the journal the whole cache is saved on shutdown instead
+    logger(ERROR, BRIGHT_RED) << "Failed to write blockchain cache journal: " << e.what();
+    m_cacheJournal.close();
+    return;
+  }
+
+  if (m_cacheJournal.recordCount() >= BLOCKCACHE_JOURNAL_COMPACTION_BLOCKS) {
+    scheduleCacheCompaction();
+  }
+}
+
+// Brings a freshly loaded snapshot up to the chain tip. Blocks written to
+// blocks.dat just before a crash may be missing from the journal, those are
+// indexed from the block file and journaled now.
+bool Blockchain::replayBlockCacheJournal(const std::vector<BinaryArray>& records) {
+  try {
+    for (const BinaryArray& record : records) {
+      BlockCacheDelta delta;
+      if (!fromBinaryArray(delta, record)) {
+        return false;
+      }
+
+      if (delta.removed) {
+        if (m_blockIndex.size() != delta.height + 1 || m_blockIndex.getTailId() != delta.blockHash) {
+          return false;
+        }
+      } else if (m_blockIndex.size() != delta.height) {
+        return false;
+      }
+
+      applyBlockCacheDelta(delta);
+    }
+
+    uint32_t height = m_blockIndex.size();
+    if (height > m_blocks.size() || (height > 0 && m_blockIndex.getTailId() != get_block_hash(m_blocks[height - 1].bl))) {
+      return false;
+    }
+
+    if (!records.empty() || height < m_blocks.size()) {
+      logger(INFO) << "Replayed " << records.size() << " blockchain cache journal records, indexing " << m_blocks.size() - height << " more blocks";
+    }
+
+    for (; height < m_blocks.size(); ++height) {
+      const BlockEntry& block = m_blocks[height];
+      BlockCacheDelta delta = makeBlockCacheDelta(block, get_block_hash(block.bl), false);
+      applyBlockCacheDelta(delta);
+      journalBlockCacheDelta(delta);
+    }
+  } catch (std::exception& e) {
+    logger(INFO) << "Failed to replay blockchain cache journal: " << e.what();
+    return false;
+  }
+
   return true;
 }
 
@@ -775,10 +1435,35 @@ bool Blockchain::deinit() {
   logger(INFO) << "Blockchain::deinit() storeCache...";
 
   try {
-    storeCache();
-    if (m_blockchainIndexesEnabled) {
-      storeBlockchainIndices();
+    // the future is replaced under the lock by scheduleCacheCompaction
+    std::future<bool> compaction;
+    {
+      std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+      flushBlockBatch();
+      compaction = std::move(m_cacheCompaction);
+    }
+
+    if (compaction.valid()) {
+      compaction.wait();
+    }
+
+    // with a working journal the snapshot only needs the journal to be current
+    bool journalOpened;
+    {
+      std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+      journalOpened = m_cacheJournal.isOpened();
+    }
+
+    if (!journalOpened) {
+      storeCache();
+    }
+
+    {
+      std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+      commitIndexes(true);
     }
+
+    m_cacheJournal.close();
   } catch(...) {/* do nothing, it will rescan if needed... */}
 
   assert(m_messageQueueList.empty());
@@ -788,10 +1473,13 @@ bool Blockchain::deinit() {
 bool Blockchain::resetAndSetGenesisBlock(const Block& b) {
   std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
   m_blocks.clear();
+  m_blockHeaders.clear();
+  m_blockLayouts.clear();
+  m_blockUndo.clear();
   m_blockIndex.clear();
-  m_transactionMap.clear();
+  m_transactionMap->clear();
 
-  m_spent_keys.clear();
+  m_spent_keys->clear();
   m_alternative_chains.clear();
   m_outputs.clear();
 
@@ -800,6 +1488,9 @@ bool Blockchain::resetAndSetGenesisBlock(const Block& b) {
   m_generatedTransactionsIndex.clear();
   m_orphanBlocksIndex.clear();
 
+  m_cacheJournal.reset(NULL_HASH);
+  scheduleCacheCompaction();
+
   block_verification_context bvc = boost::value_initialized<block_verification_context>();
   addNewBlock(b, bvc);
   return bvc.m_added_to_main_chain && !bvc.m_verifivation_failed;
@@ -807,24 +1498,24 @@ bool Blockchain::resetAndSetGenesisBlock(const Block& b) {
 
 Crypto::Hash Blockchain::getTailId(uint32_t& height) {
   assert(!m_blocks.empty());
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   height = getCurrentBlockchainHeight() - 1;
   return getTailId();
 }
 
 Crypto::Hash Blockchain::getTailId() {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   return m_blocks.empty() ? NULL_HASH : m_blockIndex.getTailId();
 }
 
 std::vector<Crypto::Hash> Blockchain::buildSparseChain() {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   assert(m_blockIndex.size() != 0);
   return doBuildSparseChain(m_blockIndex.getTailId());
 }
 
 std::vector<Crypto::Hash> Blockchain::buildSparseChain(const Crypto::Hash& startBlockId) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   assert(haveBlock(startBlockId));
   return doBuildSparseChain(startBlockId);
 }
@@ -843,7 +1534,7 @@ std::vector<Crypto::Hash> Blockchain::doBuildSparseChain(const Crypto::Hash& sta
     Crypto::Hash blockchainAncestor;
     for (auto it = m_alternative_chains.find(startBlockId); it != m_alternative_chains.end(); it = m_alternative_chains.find(blockchainAncestor)) {
       alternativeChain.emplace_back(it->first);
-      blockchainAncestor = it->second.bl.previousBlockHash;
+      blockchainAncestor = it->second.previousBlockHash;
     }
 
     for (size_t i = 1; i <= alternativeChain.size(); i *= 2) {
@@ -861,13 +1552,13 @@ std::vector<Crypto::Hash> Blockchain::doBuildSparseChain(const Crypto::Hash& sta
 }
 
 Crypto::Hash Blockchain::getBlockIdByHeight(uint32_t height) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   assert(height < m_blockIndex.size());
   return m_blockIndex.getBlockId(height);
 }
 
 bool Blockchain::getBlockByHash(const Crypto::Hash& blockHash, Block& b) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
 
   uint32_t height = 0;
 
@@ -880,20 +1571,19 @@ bool Blockchain::getBlockByHash(const Crypto::Hash& blockHash, Block& b) {
 
   auto blockByHashIterator = m_alternative_chains.find(blockHash);
   if (blockByHashIterator != m_alternative_chains.end()) {
-    b = blockByHashIterator->second.bl;
-    return true;
+    return fromBinaryArray(b, blockByHashIterator->second.block);
   }
 
   return false;
 }
 
 bool Blockchain::getBlockHeight(const Crypto::Hash& blockId, uint32_t& blockHeight) {
-  std::lock_guard<decltype(m_blockchain_lock)> lock(m_blockchain_lock);
+  ReadLock lock(*this);
   return m_blockIndex.getBlockHeight(blockId, blockHeight);
 }
 
 difficulty_type Blockchain::getDifficultyForNextBlock() {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   std::vector<uint64_t> timestamps;
   std::vector<difficulty_type> commulative_difficulties;
 
@@ -903,21 +1593,21 @@ difficulty_type Blockchain::getDifficultyForNextBlock() {
   }
 
   for (; offset < m_blocks.size(); offset++) {
-    timestamps.push_back(m_blocks[offset].bl.timestamp);
-    commulative_difficulties.push_back(m_blocks[offset].cumulative_difficulty);
+    timestamps.push_back(m_blockHeaders[offset].timestamp);
+    commulative_difficulties.push_back(m_blockHeaders[offset].cumulativeDifficulty);
   }
 
   return m_currency.nextDifficulty(timestamps, commulative_difficulties);
 }
 
 difficulty_type Blockchain::getAvgDifficulty(uint32_t height, size_t window) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   height = std::min<uint32_t>(height, (uint32_t)m_blocks.size() - 1);
   if (height <= 1)
     return 1;
 
   if (window == height) {
-    return m_blocks[height].cumulative_difficulty / height;
+    return m_blockHeaders[height].cumulativeDifficulty / height;
   }
 
   size_t offset;
@@ -925,24 +1615,24 @@ difficulty_type Blockchain::getAvgDifficulty(uint32_t height, size_t window) {
   if (offset == 0) {
     ++offset;
   }
-  difficulty_type cumulDiffForPeriod = m_blocks[height].cumulative_difficulty - m_blocks[offset].cumulative_difficulty;
+  difficulty_type cumulDiffForPeriod = m_blockHeaders[height].cumulativeDifficulty - m_blockHeaders[offset].cumulativeDifficulty;
   return cumulDiffForPeriod / std::min<uint32_t>(static_cast<uint32_t>(m_blocks.size() - 1), static_cast<uint32_t>(window));
 }
 
 difficulty_type Blockchain::getAvgDifficulty(uint32_t height) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   if (height <= 1)
     return 1;
-  return m_blocks[std::min<difficulty_type>(height, m_blocks.size())].cumulative_difficulty / std::min<difficulty_type>(height, m_blocks.size());
+  return m_blockHeaders[std::min<uint32_t>(height, m_blockHeaders.size() - 1)].cumulativeDifficulty / std::min<difficulty_type>(height, m_blocks.size());
 }
 
 uint64_t Blockchain::getBlockTimestamp(uint32_t height) {
   assert(height < m_blocks.size());
-  return m_blocks[height].bl.timestamp;
+  return m_blockHeaders[height].timestamp;
 }
 
 uint64_t Blockchain::getMinimalFee(uint32_t height) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   if (height == 0 || m_blocks.size() <= 1) {
     return 0;
   }
@@ -967,21 +1657,21 @@ uint64_t Blockchain::getMinimalFee(uint32_t height) {
   // calculate average difficulty for ~last month
   uint64_t avgCurrentDifficulty = getAvgDifficulty(height, window * 7 * 4);
   // reference trailing average difficulty
-  uint64_t avgReferenceDifficulty = m_blocks[height].cumulative_difficulty / height;
+  uint64_t avgReferenceDifficulty = m_blockHeaders[height].cumulativeDifficulty / height;
   // calculate current base reward
-  uint64_t currentReward = m_currency.calculateReward(m_blocks[height].already_generated_coins);
+  uint64_t currentReward = m_currency.calculateReward(m_blockHeaders[height].alreadyGeneratedCoins);
   // reference trailing average reward
-  uint64_t avgReferenceReward = m_blocks[height].already_generated_coins / height;
+  uint64_t avgReferenceReward = m_blockHeaders[height].alreadyGeneratedCoins / height;
 
   return m_currency.getMinimalFee(avgCurrentDifficulty, currentReward, avgReferenceDifficulty, avgReferenceReward, height);
 }
 
 uint64_t Blockchain::getCoinsInCirculation() {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   if (m_blocks.empty()) {
     return 0;
   } else {
-    return m_blocks.back().already_generated_coins;
+    return m_blockHeaders.back().alreadyGeneratedCoins;
   }
 }
 
@@ -989,7 +1679,7 @@ bool Blockchain::rollback_blockchain_switching(std::list<Block> &original_chain,
   std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
   // remove failed subchain
   for (size_t i = m_blocks.size() - 1; i >= rollback_height; i--) {
-    popBlock(get_block_hash(m_blocks.back().bl));
+    popBlock(m_blockHeaders.back().blockHash);
   }
 
   uint32_t height = static_cast<uint32_t>(rollback_height - 1);
@@ -998,7 +1688,7 @@ bool Blockchain::rollback_blockchain_switching(std::list<Block> &original_chain,
   for (auto &bl : original_chain) {
     block_verification_context bvc =
       boost::value_initialized<block_verification_context>();
-    bool r = pushBlock(bl, bvc, ++height);
+    bool r = pushBlock(bl, get_block_hash(bl), bvc, ++height);
     if (!(r && bvc.m_added_to_main_chain)) {
       logger(ERROR, BRIGHT_RED) << "PANIC!!! failed to add (again) block while "
         "chain switching during the rollback!";
@@ -1010,22 +1700,60 @@ bool Blockchain::rollback_blockchain_switching(std::list<Block> &original_chain,
   return true;
 }
 
-bool Blockchain::add_block_as_invalid(const BlockEntry& bei, const Crypto::Hash& h)
-{
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
-  m_invalid_blocks.insert(blocks_ext_by_hash::value_type(h, bei));
-  logger(INFO, BRIGHT_WHITE) << "BLOCK ADDED AS INVALID: " << h << ENDL;
-  return true;
-}
+bool Blockchain::add_block_as_invalid(const AlternativeBlockEntry& bei, const Crypto::Hash& h)
+{
+  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  AlternativeBlockEntry entry = { bei.previousBlockHash, bei.height, bei.timestamp, bei.cumulativeDifficulty, bei.blockCumulativeSize, bei.alreadyGeneratedCoins };
+  m_invalid_blocks.insert(h, std::move(entry));
+  logger(INFO, BRIGHT_WHITE) << "BLOCK ADDED AS INVALID: " << h << ENDL;
+  return true;
+}
+
+bool Blockchain::add_block_as_invalid(const Block& bl, const Crypto::Hash& h)
+{
+  AlternativeBlockEntry bei = boost::value_initialized<AlternativeBlockEntry>();
+  bei.previousBlockHash = bl.previousBlockHash;
+  bei.height = get_block_height(bl);
+  bei.timestamp = bl.timestamp;
+  return add_block_as_invalid(bei, h);
+}
+
+// Precondition: m_blockchain_lock is locked.
+// Alternative blocks below the last passed checkpoint can no longer win and
+// are dropped as the chain moves on. So are chains whose top is more than
+// ALTERNATIVE_BLOCKS_MAX_LIVE_DEPTH blocks deep, far past the deepest
+// reorganization is_alternative_block_allowed lets grow, so pruning never
+// decides which chain wins. The rest are kept within the memory budget of
+// the store.
+void Blockchain::pruneAlternativeBlocks() {
+  uint32_t tipHeight = m_blocks.size() - 1;
+  uint32_t minHeight = 0;
+  for (uint32_t checkpointHeight : m_checkpoints.getCheckpointHeights()) {
+    if (checkpointHeight <= tipHeight) {
+      minHeight = std::max(minHeight, checkpointHeight + 1);
+    }
+  }
+
+  uint32_t minLiveHeight = minHeight;
+  uint32_t maxDepth = ALTERNATIVE_BLOCKS_MAX_LIVE_DEPTH;
+  if (!m_checkpoints.is_in_checkpoint_zone(tipHeight) && tipHeight > maxDepth) {
+    minLiveHeight = std::max(minLiveHeight, tipHeight - maxDepth);
+  }
+
+  std::vector<AlternativeBlockStore::Removed> removed;
+  m_alternative_chains.prune(minHeight, minLiveHeight, removed);
+  size_t alternativeCount = removed.size();
+  m_invalid_blocks.prune(minHeight, minLiveHeight, removed);
+  for (const AlternativeBlockStore::Removed& block : removed) {
+    m_orphanBlocksIndex.remove(block.first, block.second);
+  }
 
-bool Blockchain::add_block_as_invalid(const Block& bl, const Crypto::Hash& h)
-{
-  BlockEntry bei = boost::value_initialized<BlockEntry>();
-  bei.bl = bl;
-  return add_block_as_invalid(bei, h);
+  if (alternativeCount > 0) {
+    logger(DEBUGGING) << "Pruned " << alternativeCount << " alternative blocks, " << m_alternative_chains.size() << " left using " << m_alternative_chains.memorySize() << " bytes";
+  }
 }
 
-bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::iterator>& alt_chain, bool discard_disconnected_chain) {
+bool Blockchain::switch_to_alternative_blockchain(std::list<AlternativeBlockStore::iterator>& alt_chain, bool discard_disconnected_chain) {
   std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
 
   if (!(alt_chain.size())) {
@@ -1044,7 +1772,7 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::
   std::list<Block> disconnected_chain;
   for (size_t i = m_blocks.size() - 1; i >= split_height; i--) {
     Block b = m_blocks[i].bl;
-    popBlock(get_block_hash(b));
+    popBlock(m_blockHeaders[static_cast<uint32_t>(i)].blockHash);
     //if (!(r)) { logger(ERROR, BRIGHT_RED) << "failed to remove block on chain switching"; return false; }
     disconnected_chain.push_front(b);
   }
@@ -1055,18 +1783,19 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::
   for (auto alt_ch_iter = alt_chain.begin(); alt_ch_iter != alt_chain.end(); alt_ch_iter++) {
     auto ch_ent = *alt_ch_iter;
     block_verification_context bvc = boost::value_initialized<block_verification_context>();
-    bool r = pushBlock(ch_ent->second.bl, bvc, ++height);
+    Block block;
+    bool r = fromBinaryArray(block, ch_ent->second.block) && pushBlock(block, ch_ent->first, bvc, ++height);
     if (!r || !bvc.m_added_to_main_chain) {
       logger(INFO, BRIGHT_WHITE) << "Failed to switch to alternative blockchain";
       rollback_blockchain_switching(disconnected_chain, split_height);
-      add_block_as_invalid(ch_ent->second, get_block_hash(ch_ent->second.bl));
-      logger(INFO, BRIGHT_WHITE) << "The block was inserted as invalid while connecting new alternative chain,  block_id: " << get_block_hash(ch_ent->second.bl);
-      m_orphanBlocksIndex.remove(ch_ent->second.bl);
+      add_block_as_invalid(ch_ent->second, ch_ent->first);
+      logger(INFO, BRIGHT_WHITE) << "The block was inserted as invalid while connecting new alternative chain,  block_id: " << ch_ent->first;
+      m_orphanBlocksIndex.remove(ch_ent->first, ch_ent->second.height);
       m_alternative_chains.erase(ch_ent);
 
       for (auto alt_ch_to_orph_iter = ++alt_ch_iter; alt_ch_to_orph_iter != alt_chain.end(); alt_ch_to_orph_iter++) {
-        add_block_as_invalid((*alt_ch_iter)->second, (*alt_ch_iter)->first);
-        m_orphanBlocksIndex.remove((*alt_ch_to_orph_iter)->second.bl);
+        add_block_as_invalid((*alt_ch_to_orph_iter)->second, (*alt_ch_to_orph_iter)->first);
+        m_orphanBlocksIndex.remove((*alt_ch_to_orph_iter)->first, (*alt_ch_to_orph_iter)->second.height);
         m_alternative_chains.erase(*alt_ch_to_orph_iter);
       }
 
@@ -1074,6 +1803,14 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::
     }
   }
 
+  // taken before the old chain is stored, which may rehash the store
+  std::vector<Crypto::Hash> blocksFromCommonRoot;
+  blocksFromCommonRoot.reserve(alt_chain.size() + 1);
+  blocksFromCommonRoot.push_back(alt_chain.front()->second.previousBlockHash);
+  for (auto ch_ent : alt_chain) {
+    blocksFromCommonRoot.push_back(ch_ent->first);
+  }
+
   if (!discard_disconnected_chain) {
     //pushing old chain as alternative chain
     for (auto& old_ch_ent : disconnected_chain) {
@@ -1087,15 +1824,13 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::
     }
   }
 
-  std::vector<Crypto::Hash> blocksFromCommonRoot;
-  blocksFromCommonRoot.reserve(alt_chain.size() + 1);
-  blocksFromCommonRoot.push_back(alt_chain.front()->second.bl.previousBlockHash);
-
   //removing all_chain entries from alternative chain
-  for (auto ch_ent : alt_chain) {
-    blocksFromCommonRoot.push_back(get_block_hash(ch_ent->second.bl));
-    m_orphanBlocksIndex.remove(ch_ent->second.bl);
-    m_alternative_chains.erase(ch_ent);
+  for (size_t i = 1; i < blocksFromCommonRoot.size(); ++i) {
+    auto ch_ent = m_alternative_chains.find(blocksFromCommonRoot[i]);
+    if (ch_ent != m_alternative_chains.end()) {
+      m_orphanBlocksIndex.remove(ch_ent->first, ch_ent->second.height);
+      m_alternative_chains.erase(ch_ent);
+    }
   }
 
   sendMessage(BlockchainMessage(ChainSwitchMessage(std::move(blocksFromCommonRoot))));
@@ -1104,12 +1839,12 @@ bool Blockchain::switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::
   return true;
 }
 
-difficulty_type Blockchain::get_next_difficulty_for_alternative_chain(const std::list<blocks_ext_by_hash::iterator>& alt_chain, BlockEntry& bei) {
+difficulty_type Blockchain::get_next_difficulty_for_alternative_chain(const std::list<AlternativeBlockStore::iterator>& alt_chain, uint32_t height) {
   std::vector<uint64_t> timestamps;
   std::vector<difficulty_type> commulative_difficulties;
   if (alt_chain.size() < m_currency.difficultyBlocksCount()) {
     std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
-    size_t main_chain_stop_offset = alt_chain.size() ? alt_chain.front()->second.height : bei.height;
+    size_t main_chain_stop_offset = alt_chain.size() ? alt_chain.front()->second.height : height;
     size_t main_chain_count = m_currency.difficultyBlocksCount() - std::min(m_currency.difficultyBlocksCount(), alt_chain.size());
     main_chain_count = std::min(main_chain_count, main_chain_stop_offset);
     size_t main_chain_start_offset = main_chain_stop_offset - main_chain_count;
@@ -1117,8 +1852,8 @@ difficulty_type Blockchain::get_next_difficulty_for_alternative_chain(const std:
     if (!main_chain_start_offset)
       ++main_chain_start_offset; //skip genesis block
     for (; main_chain_start_offset < main_chain_stop_offset; ++main_chain_start_offset) {
-      timestamps.push_back(m_blocks[main_chain_start_offset].bl.timestamp);
-      commulative_difficulties.push_back(m_blocks[main_chain_start_offset].cumulative_difficulty);
+      timestamps.push_back(m_blockHeaders[static_cast<uint32_t>(main_chain_start_offset)].timestamp);
+      commulative_difficulties.push_back(m_blockHeaders[static_cast<uint32_t>(main_chain_start_offset)].cumulativeDifficulty);
     }
 
     if (!((alt_chain.size() + timestamps.size()) <= m_currency.difficultyBlocksCount())) {
@@ -1126,8 +1861,8 @@ difficulty_type Blockchain::get_next_difficulty_for_alternative_chain(const std:
         "] NOT <= m_currency.difficultyBlocksCount()[" << m_currency.difficultyBlocksCount() << ']'; return false;
     }
     for (auto it : alt_chain) {
-      timestamps.push_back(it->second.bl.timestamp);
-      commulative_difficulties.push_back(it->second.cumulative_difficulty);
+      timestamps.push_back(it->second.timestamp);
+      commulative_difficulties.push_back(it->second.cumulativeDifficulty);
     }
   } else {
     timestamps.resize(std::min(alt_chain.size(), m_currency.difficultyBlocksCount()));
@@ -1135,8 +1870,8 @@ difficulty_type Blockchain::get_next_difficulty_for_alternative_chain(const std:
     size_t count = 0;
     size_t max_i = timestamps.size() - 1;
     BOOST_REVERSE_FOREACH(auto it, alt_chain) {
-      timestamps[max_i - count] = it->second.bl.timestamp;
-      commulative_difficulties[max_i - count] = it->second.cumulative_difficulty;
+      timestamps[max_i - count] = it->second.timestamp;
+      commulative_difficulties[max_i - count] = it->second.cumulativeDifficulty;
       count++;
       if (count >= m_currency.difficultyBlocksCount()) {
         break;
@@ -1219,7 +1954,7 @@ bool Blockchain::validate_miner_transaction(const Block& b, uint32_t height, siz
 }
 
 bool Blockchain::getBackwardBlocksSize(size_t from_height, std::vector<size_t>& sz, size_t count) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   if (!(from_height < m_blocks.size())) {
     logger(ERROR, BRIGHT_RED)
       << "Internal error: get_backward_blocks_sizes called with from_height="
@@ -1228,14 +1963,14 @@ bool Blockchain::getBackwardBlocksSize(size_t from_height, std::vector<size_t>&
   }
   size_t start_offset = (from_height + 1) - std::min((from_height + 1), count);
   for (size_t i = start_offset; i != from_height + 1; i++) {
-    sz.push_back(m_blocks[i].block_cumulative_size);
+    sz.push_back(m_blockHeaders[static_cast<uint32_t>(i)].blockCumulativeSize);
   }
 
   return true;
 }
 
 bool Blockchain::get_last_n_blocks_sizes(std::vector<size_t>& sz, size_t count) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   if (!m_blocks.size()) {
     return true;
   }
@@ -1251,12 +1986,12 @@ bool Blockchain::complete_timestamps_vector(uint64_t start_top_height, std::vect
   if (timestamps.size() >= m_currency.timestampCheckWindow())
     return true;
 
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   size_t need_elements = m_currency.timestampCheckWindow() - timestamps.size();
   if (!(start_top_height < m_blocks.size())) { logger(ERROR, BRIGHT_RED) << "internal error: passed start_height = " << start_top_height << " not less then m_blocks.size()=" << m_blocks.size(); return false; }
   size_t stop_offset = start_top_height > need_elements ? start_top_height - need_elements : 0;
   do {
-    timestamps.push_back(m_blocks[start_top_height].bl.timestamp);
+    timestamps.push_back(m_blockHeaders[static_cast<uint32_t>(start_top_height)].timestamp);
     if (start_top_height == 0)
       break;
     --start_top_height;
@@ -1304,21 +2039,20 @@ bool Blockchain::handle_alternative_block(const Block& b, const Crypto::Hash& id
     //we have new block in alternative chain
 
     //build alternative subchain, front -> mainchain, back -> alternative head
-    blocks_ext_by_hash::iterator alt_it = it_prev; //m_alternative_chains.find()
-    std::list<blocks_ext_by_hash::iterator> alt_chain;
+    AlternativeBlockStore::iterator alt_it = it_prev; //m_alternative_chains.find()
+    std::list<AlternativeBlockStore::iterator> alt_chain;
     std::vector<uint64_t> timestamps;
     while (alt_it != m_alternative_chains.end()) {
       alt_chain.push_front(alt_it);
-      timestamps.push_back(alt_it->second.bl.timestamp);
-      alt_it = m_alternative_chains.find(alt_it->second.bl.previousBlockHash);
+      timestamps.push_back(alt_it->second.timestamp);
+      alt_it = m_alternative_chains.find(alt_it->second.previousBlockHash);
     }
 
     if (alt_chain.size()) {
       //make sure that it has right connection to main chain
       if (!(m_blocks.size() > alt_chain.front()->second.height)) { logger(ERROR, BRIGHT_RED) << "main blockchain wrong height"; return false; }
-      Crypto::Hash h = NULL_HASH;
-      get_block_hash(m_blocks[alt_chain.front()->second.height - 1].bl, h);
-      if (!(h == alt_chain.front()->second.bl.previousBlockHash)) { logger(ERROR, BRIGHT_RED) << "alternative chain have wrong connection to main chain"; return false; }
+      Crypto::Hash h = m_blockHeaders[alt_chain.front()->second.height - 1].blockHash;
+      if (!(h == alt_chain.front()->second.previousBlockHash)) { logger(ERROR, BRIGHT_RED) << "alternative chain have wrong connection to main chain"; return false; }
       complete_timestamps_vector(alt_chain.front()->second.height - 1, timestamps);
     } else {
       if (!(mainPrev)) { logger(ERROR, BRIGHT_RED) << "internal error: broken imperative condition it_main_prev != m_blocks_index.end()"; return false; }
@@ -1336,9 +2070,11 @@ bool Blockchain::handle_alternative_block(const Block& b, const Crypto::Hash& id
       return false;
     }
 
-    BlockEntry bei = boost::value_initialized<BlockEntry>();
-    bei.bl = b;
+    AlternativeBlockEntry bei = boost::value_initialized<AlternativeBlockEntry>();
+    bei.previousBlockHash = b.previousBlockHash;
     bei.height = static_cast<uint32_t>(alt_chain.size() ? it_prev->second.height + 1 : mainPrevHeight + 1);
+    bei.timestamp = b.timestamp;
+    bei.blockCumulativeSize = cumulativeSize;
 
     bool is_a_checkpoint;
     if (!m_checkpoints.check_block(bei.height, id, is_a_checkpoint)) {
@@ -1349,10 +2085,10 @@ bool Blockchain::handle_alternative_block(const Block& b, const Crypto::Hash& id
     }
 
     // Always check PoW for alternative blocks
-    difficulty_type current_diff = get_next_difficulty_for_alternative_chain(alt_chain, bei);
+    difficulty_type current_diff = get_next_difficulty_for_alternative_chain(alt_chain, bei.height);
     if (!(current_diff)) { logger(ERROR, BRIGHT_RED) << "!!!!!!! DIFFICULTY OVERHEAD !!!!!!!"; return false; }
     Crypto::Hash proof_of_work = NULL_HASH;
-    if (!m_currency.checkProofOfWork(m_cn_context, bei.bl, current_diff, proof_of_work)) {
+    if (!m_currency.checkProofOfWork(m_cn_context, b, current_diff, proof_of_work)) {
       logger(INFO, BRIGHT_RED) <<
         "Block with id: " << id << " for alternative chain, not enough proof of work: " << proof_of_work
         << " expected difficulty: " << current_diff << " at height: " << bei.height << ENDL;
@@ -1367,18 +2103,21 @@ bool Blockchain::handle_alternative_block(const Block& b, const Crypto::Hash& id
       return false;
     }
 
-    bei.cumulative_difficulty = alt_chain.size() ? it_prev->second.cumulative_difficulty : m_blocks[mainPrevHeight].cumulative_difficulty;
-    bei.cumulative_difficulty += current_diff;
+    bei.cumulativeDifficulty = alt_chain.size() ? it_prev->second.cumulativeDifficulty : m_blockHeaders[mainPrevHeight].cumulativeDifficulty;
+    bei.cumulativeDifficulty += current_diff;
+    bei.block = toBinaryArray(b);
 
 #ifdef _DEBUG
     auto i_dres = m_alternative_chains.find(id);
     if (!(i_dres == m_alternative_chains.end())) { logger(ERROR, BRIGHT_RED) << "insertion of new alternative block returned as it already exist"; return false; }
 #endif
 
-    auto i_res = m_alternative_chains.insert(blocks_ext_by_hash::value_type(id, bei));
+    uint32_t height = bei.height;
+    difficulty_type cumulativeDifficulty = bei.cumulativeDifficulty;
+    auto i_res = m_alternative_chains.insert(id, std::move(bei));
     if (!(i_res.second)) { logger(ERROR, BRIGHT_RED) << "insertion of new alternative block returned as it already exist"; return false; }
 
-    m_orphanBlocksIndex.add(bei.bl);
+    m_orphanBlocksIndex.add(b);
 
     alt_chain.push_back(i_res.first);
 
@@ -1386,7 +2125,7 @@ bool Blockchain::handle_alternative_block(const Block& b, const Crypto::Hash& id
       //do reorganize!
       logger(INFO, BRIGHT_GREEN) <<
         "###### REORGANIZE on height: " << alt_chain.front()->second.height << " of " << m_blocks.size() - 1 <<
-        ", checkpoint is found in alternative chain on height " << bei.height;
+        ", checkpoint is found in alternative chain on height " << height;
       bool r = switch_to_alternative_blockchain(alt_chain, true);
       if (r) {
         bvc.m_added_to_main_chain = true;
@@ -1395,12 +2134,12 @@ bool Blockchain::handle_alternative_block(const Block& b, const Crypto::Hash& id
         bvc.m_verifivation_failed = true;
       }
       return r;
-    } else if (m_blocks.back().cumulative_difficulty < bei.cumulative_difficulty) //check if difficulty bigger then in main chain
+    } else if (m_blockHeaders.back().cumulativeDifficulty < cumulativeDifficulty) //check if difficulty bigger then in main chain
     {
       //do reorganize!
       logger(INFO, BRIGHT_GREEN) <<
-        "###### REORGANIZE on height: " << alt_chain.front()->second.height << " of " << m_blocks.size() - 1 << " with cum_difficulty " << m_blocks.back().cumulative_difficulty
-        << ENDL << " alternative blockchain size: " << alt_chain.size() << " with cum_difficulty " << bei.cumulative_difficulty;
+        "###### REORGANIZE on height: " << alt_chain.front()->second.height << " of " << m_blocks.size() - 1 << " with cum_difficulty " << m_blockHeaders.back().cumulativeDifficulty
+        << ENDL << " alternative blockchain size: " << alt_chain.size() << " with cum_difficulty " << cumulativeDifficulty;
       bool r = switch_to_alternative_blockchain(alt_chain, false);
       if (r) {
         bvc.m_added_to_main_chain = true;
@@ -1411,7 +2150,7 @@ bool Blockchain::handle_alternative_block(const Block& b, const Crypto::Hash& id
       return r;
     } else {
       logger(DEBUGGING, BRIGHT_BLUE) <<
-        "----- BLOCK ADDED AS ALTERNATIVE ON HEIGHT " << bei.height
+        "----- BLOCK ADDED AS ALTERNATIVE ON HEIGHT " << height
         << ENDL << "id:\t" << id
         << ENDL << "PoW:\t" << proof_of_work
         << ENDL << "difficulty:\t" << current_diff;
@@ -1431,7 +2170,7 @@ bool Blockchain::handle_alternative_block(const Block& b, const Crypto::Hash& id
 }
 
 bool Blockchain::getBlocks(uint32_t start_offset, uint32_t count, std::list<Block>& blocks, std::list<Transaction>& txs) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
 
   if (start_offset >= m_blocks.size())
     return false;
@@ -1446,7 +2185,7 @@ bool Blockchain::getBlocks(uint32_t start_offset, uint32_t count, std::list<Bloc
 }
 
 bool Blockchain::getBlocks(uint32_t start_offset, uint32_t count, std::list<Block>& blocks) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   if (start_offset >= m_blocks.size()) {
     return false;
   }
@@ -1458,90 +2197,155 @@ bool Blockchain::getBlocks(uint32_t start_offset, uint32_t count, std::list<Bloc
   return true;
 }
 
+// Precondition: m_blockchain_lock is locked.
+bool Blockchain::readRawTransaction(TransactionIndex index, std::string& transaction) {
+  const BlockLayout& layout = m_blockLayouts[index.block];
+  if (index.transaction >= layout.transactionOffsets.size()) {
+    return false;
+  }
+
+  transaction.resize(layout.transactionSizes[index.transaction]);
+  return transaction.empty() || m_blocks.readRaw(index.block, layout.transactionOffsets[index.transaction], transaction.size(), &transaction[0]);
+}
+
+bool Blockchain::getRawBlock(uint32_t height, block_complete_entry& entry) {
+  ReadLock lk(*this);
+  if (height >= m_blockLayouts.size()) {
+    return false;
+  }
+
+  const BlockLayout& layout = m_blockLayouts[height];
+  entry.block.resize(layout.blockSize);
+  if (!m_blocks.readRaw(height, 0, entry.block.size(), &entry.block[0])) {
+    logger(ERROR, BRIGHT_RED) << "Failed to read stored block at height " << height;
+    return false;
+  }
+
+  // the coinbase transaction travels inside the block
+  entry.txs.resize(layout.transactionOffsets.size() - 1);
+  for (uint16_t t = 1; t < layout.transactionOffsets.size(); ++t) {
+    if (!readRawTransaction({ height, t }, entry.txs[t - 1])) {
+      logger(ERROR, BRIGHT_RED) << "Failed to read stored transaction " << t << " of block " << height;
+      return false;
+    }
+  }
+
+  return true;
+}
+
 bool Blockchain::handleGetObjects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_RESPONSE_GET_OBJECTS::request& rsp) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   rsp.current_blockchain_height = (uint32_t)getCurrentBlockchainHeight(); // in protocol as 32bit
-  std::list<Block> blocks;
-  getBlocks(arg.blocks, blocks, rsp.missed_ids);
-
-  for (const auto& bl : blocks) {
-    std::list<Crypto::Hash> missed_tx_id;
-    std::list<Transaction> txs;
-    getTransactions(bl.transactionHashes, txs, rsp.missed_ids);
-    if (!(!missed_tx_id.size())) { logger(ERROR, BRIGHT_RED) << "Internal error: have missed missed_tx_id.size()=" << missed_tx_id.size() << ENDL << "for block id = " << get_block_hash(bl); return false; } 
+
+  // stored blocks and transactions are sent as they are, nothing is decoded
+  for (const auto& id : arg.blocks) {
+    uint32_t height = 0;
+    if (!m_blockIndex.getBlockHeight(id, height)) {
+      rsp.missed_ids.push_back(id);
+      continue;
+    }
+
     rsp.blocks.push_back(block_complete_entry());
-    block_complete_entry& e = rsp.blocks.back();
-    //pack block
-    e.block = asString(toBinaryArray(bl));
-    //pack transactions
-    for (Transaction& tx : txs) {
-      e.txs.push_back(asString(toBinaryArray(tx)));
+    if (!getRawBlock(height, rsp.blocks.back())) {
+      return false;
     }
   }
 
-  //get another transactions, if need
-  std::list<Transaction> txs;
-  getTransactions(arg.txs, txs, rsp.missed_ids);
-  //pack aside transactions
-  for (const auto& tx : txs) {
-    rsp.txs.push_back(asString(toBinaryArray(tx)));
+  for (const auto& id : arg.txs) {
+    TransactionIndex transactionIndex;
+    std::string transaction;
+    if (!m_transactionMap->find(id, transactionIndex) || !readRawTransaction(transactionIndex, transaction)) {
+      rsp.missed_ids.push_back(id);
+      continue;
+    }
+
+    rsp.txs.push_back(std::move(transaction));
   }
 
   return true;
 }
 
 bool Blockchain::getAlternativeBlocks(std::list<Block>& blocks) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   for (auto& alt_bl : m_alternative_chains) {
-    blocks.push_back(alt_bl.second.bl);
+    Block block;
+    if (fromBinaryArray(block, alt_bl.second.block)) {
+      blocks.push_back(std::move(block));
+    }
   }
 
   return true;
 }
 
 uint32_t Blockchain::getAlternativeBlocksCount() {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   return static_cast<uint32_t>(m_alternative_chains.size());
 }
 
-bool Blockchain::add_out_to_get_random_outs(std::vector<std::pair<TransactionIndex, uint16_t>>& amount_outs, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs, uint64_t amount, size_t i) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
-  const Transaction& tx = transactionByIndex(amount_outs[i].first).tx;
-  if (!(tx.outputs.size() > amount_outs[i].second)) {
-    logger(ERROR, BRIGHT_RED) << "internal error: in global outs index, transaction out index="
-      << amount_outs[i].second << " more than transaction outputs = " << tx.outputs.size() << ", for tx id = " << getObjectHash(tx); return false;
-  }
-  if (!(tx.outputs[amount_outs[i].second].target.type() == typeid(KeyOutput))) { logger(ERROR, BRIGHT_RED) << "unknown tx out type"; return false; }
+// Precondition: m_blockchain_lock is locked.
+bool Blockchain::add_out_to_get_random_outs(const std::vector<OutputEntry>& amount_outs, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs, size_t i, uint32_t height) {
+  const OutputEntry& output = amount_outs[i];
 
   //check if transaction is unlocked
-  if (!is_tx_spendtime_unlocked(tx.unlockTime))
+  if (!is_tx_spendtime_unlocked(output.unlockTime, height))
     return false;
 
   COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::out_entry& oen = *result_outs.outs.insert(result_outs.outs.end(), COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::out_entry());
   oen.global_amount_index = static_cast<uint32_t>(i);
-  oen.out_key = boost::get<KeyOutput>(tx.outputs[amount_outs[i].second].target).key;
+  oen.out_key = output.key;
   return true;
 }
 
-size_t Blockchain::find_end_of_allowed_index(const std::vector<std::pair<TransactionIndex, uint16_t>>& amount_outs) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
-  if (amount_outs.empty()) {
-    return 0;
-  }
+// Outputs of an amount are appended in block order, so the ones old enough to
+// be used as ring members form a prefix of the vector.
+// Precondition: m_blockchain_lock is locked.
+size_t Blockchain::find_end_of_allowed_index(const std::vector<OutputEntry>& amount_outs, uint32_t height) {
+  uint64_t unlockWindow = m_currency.minedMoneyUnlockWindow();
+  auto end = std::partition_point(amount_outs.begin(), amount_outs.end(), [height, unlockWindow](const OutputEntry& output) {
+    return output.transactionIndex.block + unlockWindow <= height;
+  });
 
-  size_t i = amount_outs.size();
-  do {
-    --i;
-    if (amount_outs[i].first.block + m_currency.minedMoneyUnlockWindow() <= getCurrentBlockchainHeight()) {
-      return i + 1;
+  return static_cast<size_t>(std::distance(amount_outs.begin(), end));
+}
+
+// Picks up to outs_count distinct unlocked outputs among the first up_index_limit,
+// uniformly at random like walking the range in shuffled order would. When the
+// pick is a small part of the range, indexes are drawn directly and repeats are
+// rejected against the indexes drawn so far. Small ranges, large picks, or
+// ranges where too many draws hit time locked outputs are walked in shuffled
+// order instead.
+// Precondition: m_blockchain_lock is locked.
+void Blockchain::pick_random_outs(const std::vector<OutputEntry>& amount_outs, size_t up_index_limit, uint64_t outs_count, uint32_t height, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs) {
+  // indexes drawn directly, picked or found time locked
+  std::unordered_set<size_t> drawn;
+
+  result_outs.outs.reserve(static_cast<size_t>(std::min<uint64_t>(outs_count, up_index_limit)));
+
+  if (outs_count <= RANDOM_OUTS_DIRECT_DRAW_MAX_COUNT && outs_count <= up_index_limit / 4) {
+    Crypto::random_engine<size_t> engine;
+    std::uniform_int_distribution<size_t> distribution(0, up_index_limit - 1);
+    for (uint64_t draws = 0; draws < 4 * outs_count && result_outs.outs.size() < outs_count; ++draws) {
+      size_t i = distribution(engine);
+      if (drawn.insert(i).second) {
+        add_out_to_get_random_outs(amount_outs, result_outs, i, height);
+      }
     }
-  } while (i != 0);
+  }
 
-  return 0;
+  if (result_outs.outs.size() < outs_count) {
+    ShuffleGenerator<size_t, Crypto::random_engine<size_t>> generator(up_index_limit);
+    for (size_t j = 0; j < up_index_limit && result_outs.outs.size() < outs_count; ++j) {
+      size_t i = generator();
+      if (drawn.count(i) == 0) {
+        add_out_to_get_random_outs(amount_outs, result_outs, i, height);
+      }
+    }
+  }
 }
 
 bool Blockchain::getRandomOutsByAmount(const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::request& req, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::response& res) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
+  uint32_t height = getCurrentBlockchainHeight();
 
   for (uint64_t amount : req.amounts) {
     COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount& result_outs = *res.outs.insert(res.outs.end(), COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::outs_for_amount());
@@ -1553,17 +2357,12 @@ bool Blockchain::getRandomOutsByAmount(const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_
       continue;//actually this is strange situation, wallet should use some real outs when it lookup for some mix, so, at least one out for this amount should exist
     }
 
-    std::vector<std::pair<TransactionIndex, uint16_t>>& amount_outs = it->second;
+    const std::vector<OutputEntry>& amount_outs = it->second;
     //it is not good idea to use top fresh outs, because it increases possibility of transaction canceling on split
     //lets find upper bound of not fresh outs
-    size_t up_index_limit = find_end_of_allowed_index(amount_outs);
-    if (!(up_index_limit <= amount_outs.size())) { logger(ERROR, BRIGHT_RED) << "internal error: find_end_of_allowed_index returned wrong index=" << up_index_limit << ", with amount_outs.size = " << amount_outs.size(); return false; }
-
+    size_t up_index_limit = find_end_of_allowed_index(amount_outs, height);
     if (up_index_limit > 0) {
-      ShuffleGenerator<size_t, Crypto::random_engine<size_t>> generator(up_index_limit);
-      for (uint64_t j = 0; j < up_index_limit && result_outs.outs.size() < req.outs_count; ++j) {
-        add_out_to_get_random_outs(amount_outs, result_outs, amount, generator());
-      }
+      pick_random_outs(amount_outs, up_index_limit, req.outs_count, height, result_outs);
     }
   }
   return true;
@@ -1573,7 +2372,7 @@ uint32_t Blockchain::findBlockchainSupplement(const std::vector<Crypto::Hash>& q
   assert(!qblock_ids.empty());
   assert(qblock_ids.back() == m_blockIndex.getBlockId(0));
 
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   uint32_t blockIndex=0;
   // assert above guarantees that method returns true
   m_blockIndex.findSupplement(qblock_ids, blockIndex);
@@ -1581,24 +2380,24 @@ uint32_t Blockchain::findBlockchainSupplement(const std::vector<Crypto::Hash>& q
 }
 
 uint64_t Blockchain::blockDifficulty(size_t i) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   if (!(i < m_blocks.size())) { logger(ERROR, BRIGHT_RED) << "wrong block index i = " << i << " at Blockchain::block_difficulty()"; return false; }
   if (i == 0)
-    return m_blocks[i].cumulative_difficulty;
+    return m_blockHeaders[0].cumulativeDifficulty;
 
-  return m_blocks[i].cumulative_difficulty - m_blocks[i - 1].cumulative_difficulty;
+  return m_blockHeaders[static_cast<uint32_t>(i)].cumulativeDifficulty - m_blockHeaders[static_cast<uint32_t>(i - 1)].cumulativeDifficulty;
 }
 
 uint64_t Blockchain::blockCumulativeDifficulty(size_t i) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   if (!(i < m_blocks.size())) { logger(ERROR, BRIGHT_RED) << "wrong block index i = " << i << " at Blockchain::block_     difficulty()"; return false; }
 
-  return m_blocks[i].cumulative_difficulty;
+  return m_blockHeaders[static_cast<uint32_t>(i)].cumulativeDifficulty;
 }
 
 void Blockchain::print_blockchain(uint64_t start_index, uint64_t end_index) {
   std::stringstream ss;
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   if (start_index >= m_blocks.size()) {
     logger(INFO, BRIGHT_WHITE) <<
       "Wrong starter index set: " << start_index << ", expected max index " << m_blocks.size() - 1;
@@ -1618,7 +2417,7 @@ void Blockchain::print_blockchain(uint64_t start_index, uint64_t end_index) {
 
 void Blockchain::print_blockchain_index() {
   std::stringstream ss;
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
 
   std::vector<Crypto::Hash> blockIds = m_blockIndex.getBlockIds(0, std::numeric_limits<uint32_t>::max());
   logger(INFO, BRIGHT_WHITE) << "Current blockchain index:";
@@ -1632,13 +2431,13 @@ void Blockchain::print_blockchain_index() {
 
 void Blockchain::print_blockchain_outs(const std::string& file) {
   std::stringstream ss;
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   for (const outputs_container::value_type& v : m_outputs) {
-    const std::vector<std::pair<TransactionIndex, uint16_t>>& vals = v.second;
+    const std::vector<OutputEntry>& vals = v.second;
     if (!vals.empty()) {
       ss << "amount: " << v.first << ENDL;
       for (size_t i = 0; i != vals.size(); i++) {
-        ss << "\t" << getObjectHash(transactionByIndex(vals[i].first).tx) << ": " << vals[i].second << ENDL;
+        ss << "\t" << transactionHashByIndex(vals[i].transactionIndex) << ": " << vals[i].outputIndex << ENDL;
       }
     }
   }
@@ -1652,20 +2451,44 @@ void Blockchain::print_blockchain_outs(const std::string& file) {
   }
 }
 
+void Blockchain::print_lock_statistics() {
+  BlockchainLock::Statistics stats = getLockStatistics();
+  logger(INFO, BRIGHT_WHITE) << "Blockchain lock statistics:" << ENDL
+    << "exclusive: " << stats.exclusiveCount << " locks, waited " << stats.exclusiveWaitMicroseconds << " us, held "
+    << stats.exclusiveHoldMicroseconds << " us, longest " << stats.exclusiveMaxHoldMicroseconds << " us, "
+    << stats.exclusiveWaiting << " waiting" << ENDL
+    << "shared: " << stats.sharedCount << " locks, waited " << stats.sharedWaitMicroseconds << " us, held "
+    << stats.sharedHoldMicroseconds << " us, longest " << stats.sharedMaxHoldMicroseconds << " us, "
+    << stats.sharedWaiting << " waiting";
+}
+
+void Blockchain::print_cache_statistics() {
+  Blocks::CacheStatistics stats = m_blocks.getCacheStatistics();
+  uint64_t lookups = stats.hits + stats.misses + stats.prefetched;
+  logger(INFO, BRIGHT_WHITE) << "Block cache statistics:" << ENDL
+    << "hits: " << stats.hits << ", read ahead hits: " << stats.prefetched << ", misses: " << stats.misses
+    << " (" << (lookups == 0 ? 0 : stats.misses * 100 / lookups) << "% missed)" << ENDL
+    << "cached: " << stats.items << " blocks, " << stats.bytes / 1024 << " of " << stats.budget / 1024 << " KB";
+}
+
+BlockchainLock::Statistics Blockchain::getLockStatistics() {
+  return m_blockchain_lock.getStatistics();
+}
+
 std::vector<Crypto::Hash> Blockchain::findBlockchainSupplement(const std::vector<Crypto::Hash>& remoteBlockIds, size_t maxCount,
   uint32_t& totalBlockCount, uint32_t& startBlockIndex) {
 
   assert(!remoteBlockIds.empty());
   assert(remoteBlockIds.back() == m_blockIndex.getBlockId(0));
 
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   totalBlockCount = getCurrentBlockchainHeight();
   startBlockIndex = findBlockchainSupplement(remoteBlockIds);
   return m_blockIndex.getBlockIds(startBlockIndex, static_cast<uint32_t>(maxCount));
 }
 
 bool Blockchain::haveBlock(const Crypto::Hash& id) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   if (m_blockIndex.hasBlock(id))
     return true;
   if (m_alternative_chains.count(id))
@@ -1677,19 +2500,19 @@ bool Blockchain::haveBlock(const Crypto::Hash& id) {
 }
 
 size_t Blockchain::getTotalTransactions() {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
-  return m_transactionMap.size();
+  ReadLock lk(*this);
+  return m_transactionMap->size();
 }
 
 bool Blockchain::getTransactionOutputGlobalIndexes(const Crypto::Hash& tx_id, std::vector<uint32_t>& indexs) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
-  auto it = m_transactionMap.find(tx_id);
-  if (it == m_transactionMap.end()) {
+  ReadLock lk(*this);
+  TransactionIndex transactionIndex;
+  if (!m_transactionMap->find(tx_id, transactionIndex)) {
     logger(WARNING, YELLOW) << "warning: get_tx_outputs_gindexs failed to find transaction with id = " << tx_id;
     return false;
   }
 
-  const TransactionEntry& tx = transactionByIndex(it->second);
+  TransactionEntry tx = transactionByIndex(transactionIndex);
   if (!(tx.m_global_output_indexes.size())) { logger(ERROR, BRIGHT_RED) << "internal error: global indexes for transaction " << tx_id << " is empty"; return false; }
   indexs.resize(tx.m_global_output_indexes.size());
   for (size_t i = 0; i < tx.m_global_output_indexes.size(); ++i) {
@@ -1700,7 +2523,7 @@ bool Blockchain::getTransactionOutputGlobalIndexes(const Crypto::Hash& tx_id, st
 }
 
 bool Blockchain::get_out_by_msig_gindex(uint64_t amount, uint64_t gindex, MultisignatureOutput& out) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   auto it = m_multisignatureOutputs.find(amount);
   if (it == m_multisignatureOutputs.end()) {
     return false;
@@ -1711,7 +2534,8 @@ bool Blockchain::get_out_by_msig_gindex(uint64_t amount, uint64_t gindex, Multis
   }
 
   auto msigUsage = it->second[gindex];
-  auto& targetOut = transactionByIndex(msigUsage.transactionIndex).tx.outputs[msigUsage.outputIndex].target;
+  TransactionEntry transaction = transactionByIndex(msigUsage.transactionIndex);
+  auto& targetOut = transaction.tx.outputs[msigUsage.outputIndex].target;
   if (targetOut.type() != typeid(MultisignatureOutput)) {
     return false;
   }
@@ -1723,7 +2547,7 @@ bool Blockchain::get_out_by_msig_gindex(uint64_t amount, uint64_t gindex, Multis
 
 
 bool Blockchain::checkTransactionInputs(const Transaction& tx, uint32_t& max_used_block_height, Crypto::Hash& max_used_block_id, BlockInfo* tail) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
 
   if (tail)
     tail->id = getTailId(tail->height);
@@ -1731,7 +2555,7 @@ bool Blockchain::checkTransactionInputs(const Transaction& tx, uint32_t& max_use
   bool res = checkTransactionInputs(tx, &max_used_block_height);
   if (!res) return false;
   if (!(max_used_block_height < m_blocks.size())) { logger(ERROR, BRIGHT_RED) << "internal error: max used block index=" << max_used_block_height << " is not less then blockchain size = " << m_blocks.size(); return false; }
-  get_block_hash(m_blocks[max_used_block_height].bl, max_used_block_id);
+  max_used_block_id = m_blockHeaders[max_used_block_height].blockHash;
   return true;
 }
 
@@ -1752,7 +2576,7 @@ bool Blockchain::checkTransactionInputs(const Transaction& tx, uint32_t* pmax_us
   return checkTransactionInputs(tx, tx_prefix_hash, pmax_used_block_height);
 }
 
-bool Blockchain::checkTransactionInputs(const Transaction& tx, const Crypto::Hash& tx_prefix_hash, uint32_t* pmax_used_block_height) {
+bool Blockchain::checkTransactionInputs(const Transaction& tx, const Crypto::Hash& tx_prefix_hash, uint32_t* pmax_used_block_height, std::vector<RingSignatureCheck>* deferredChecks) {
   size_t inputIndex = 0;
   if (pmax_used_block_height) {
     *pmax_used_block_height = 0;
@@ -1772,7 +2596,7 @@ bool Blockchain::checkTransactionInputs(const Transaction& tx, const Crypto::Has
       }
 
       if (!isInCheckpointZone(getCurrentBlockchainHeight())) {
-        if (!check_tx_input(in_to_key, tx_prefix_hash, tx.signatures[inputIndex], pmax_used_block_height)) {
+        if (!check_tx_input(in_to_key, tx_prefix_hash, tx.signatures[inputIndex], pmax_used_block_height, deferredChecks)) {
           logger(INFO, BRIGHT_WHITE) <<
             "Failed to check input in transaction " << transactionHash;
           return false;
@@ -1799,9 +2623,13 @@ bool Blockchain::checkTransactionInputs(const Transaction& tx, const Crypto::Has
 }
 
 bool Blockchain::is_tx_spendtime_unlocked(uint64_t unlock_time) {
+  return is_tx_spendtime_unlocked(unlock_time, getCurrentBlockchainHeight());
+}
+
+bool Blockchain::is_tx_spendtime_unlocked(uint64_t unlock_time, uint32_t height) {
   if (unlock_time < m_currency.maxBlockHeight()) {
     //interpret as block index
-    if (getCurrentBlockchainHeight() - 1 + m_currency.lockedTxAllowedDeltaBlocks() >= unlock_time)
+    if (height - 1 + m_currency.lockedTxAllowedDeltaBlocks() >= unlock_time)
       return true;
     else
       return false;
@@ -1809,7 +2637,7 @@ bool Blockchain::is_tx_spendtime_unlocked(uint64_t unlock_time) {
     //interpret as time
 
     // compare with last block timestamp + delta seconds
-    const uint64_t lastBlockTimestamp = getBlockTimestamp(getCurrentBlockchainHeight() - 1);
+    const uint64_t lastBlockTimestamp = getBlockTimestamp(height - 1);
     if (lastBlockTimestamp + m_currency.lockedTxAllowedDeltaSeconds() >= unlock_time)
       return true;
     else
@@ -1819,8 +2647,10 @@ bool Blockchain::is_tx_spendtime_unlocked(uint64_t unlock_time) {
   return false;
 }
 
-bool Blockchain::check_tx_input(const KeyInput& txin, const Crypto::Hash& tx_prefix_hash, const std::vector<Crypto::Signature>& sig, uint32_t* pmax_related_block_height) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+// With deferredChecks set the ring signature itself is not checked, it is
+// appended there for verifyRingSignatures and sig must outlive that call.
+bool Blockchain::check_tx_input(const KeyInput& txin, const Crypto::Hash& tx_prefix_hash, const std::vector<Crypto::Signature>& sig, uint32_t* pmax_related_block_height, std::vector<RingSignatureCheck>* deferredChecks) {
+  ReadLock lk(*this);
 
   struct outputs_visitor {
     std::vector<const Crypto::PublicKey *>& m_results_collector;
@@ -1829,21 +2659,15 @@ bool Blockchain::check_tx_input(const KeyInput& txin, const Crypto::Hash& tx_pre
 
     outputs_visitor(std::vector<const Crypto::PublicKey *>& results_collector, Blockchain& bch, ILogger& logger) :m_results_collector(results_collector), m_bch(bch), logger(logger, "outputs_visitor") { }
 
-    bool handle_output(const Transaction& tx, const TransactionOutput& out, size_t transactionOutputIndex) {
+    bool handle_output(const OutputEntry& output) {
       //check tx unlock time
-      if (!m_bch.is_tx_spendtime_unlocked(tx.unlockTime)) {
-        logger(INFO, BRIGHT_WHITE) <<
-          "One of outputs for one of the inputs has a wrong tx.unlockTime height of: " << tx.unlockTime;
-        return false;
-      }
-
-      if (out.target.type() != typeid(KeyOutput)) {
+      if (!m_bch.is_tx_spendtime_unlocked(output.unlockTime)) {
         logger(INFO, BRIGHT_WHITE) <<
-          "Output have wrong type id, which=" << out.target.which();
+          "One of outputs for one of the inputs has a wrong tx.unlockTime height of: " << output.unlockTime;
         return false;
       }
 
-      m_results_collector.push_back(&boost::get<KeyOutput>(out.target).key);
+      m_results_collector.push_back(&output.key);
       return true;
     }
   };
@@ -1894,7 +2718,97 @@ bool Blockchain::check_tx_input(const KeyInput& txin, const Crypto::Hash& tx_pre
     return true;
   }
 
-  return Crypto::check_ring_signature(tx_prefix_hash, txin.keyImage, output_keys, sig.data());
+  // Most block transactions were checked when they entered the pool. A hit
+  // proves only that this ring signature verified for this prefix, key image,
+  // amount and these ring member keys; whether the key image is spent is up
+  // to the caller.
+  Crypto::Hash cacheKey = RingSignatureCache::makeKey(tx_prefix_hash, txin.keyImage, txin.amount, output_keys, sig);
+  if (m_ringSignatureCache.contains(cacheKey)) {
+    return true;
+  }
+
+  if (deferredChecks != NULL) {
+    // the keys are copied, outputs added later in the block may move them
+    RingSignatureCheck check;
+    check.prefixHash = tx_prefix_hash;
+    check.keyImage = txin.keyImage;
+    check.outputKeys.reserve(output_keys.size());
+    for (const Crypto::PublicKey* key : output_keys) {
+      check.outputKeys.push_back(*key);
+    }
+
+    check.signatures = sig.data();
+    check.transaction = 0;
+    deferredChecks->push_back(std::move(check));
+    return true;
+  }
+
+  if (!Crypto::check_ring_signature(tx_prefix_hash, txin.keyImage, output_keys, sig.data(), m_ringMemberKeyCache)) {
+    return false;
+  }
+
+  m_ringSignatureCache.insert(cacheKey);
+  return true;
+}
+
+// Verifies the collected ring signatures on all hardware threads. Returns the
+// index of the first failed check, or checks.size() if all of them pass.
+size_t Blockchain::verifyRingSignatures(const std::vector<RingSignatureCheck>& checks) {
+  auto verify = [this, &checks](size_t i) {
+    const RingSignatureCheck& check = checks[i];
+    std::vector<const Crypto::PublicKey*> keys;
+    keys.reserve(check.outputKeys.size());
+    for (const Crypto::PublicKey& key : check.outputKeys) {
+      keys.push_back(&key);
+    }
+
+    return Crypto::check_ring_signature(check.prefixHash, check.keyImage, keys, check.signatures, m_ringMemberKeyCache);
+  };
+
+  size_t workers = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), checks.size() / RING_SIGNATURE_CHECKS_PER_WORKER);
+  if (workers <= 1) {
+    for (size_t i = 0; i < checks.size(); ++i) {
+      if (!verify(i)) {
+        return i;
+      }
+    }
+
+    return checks.size();
+  }
+
+  // checks are handed out in index order and a worker finishes the one it took
+  // before stopping, so every check below a failed one has been verified and
+  // the reported index does not depend on scheduling
+  std::atomic<size_t> next(0);
+  std::atomic<bool> failed(false);
+  auto worker = [&]() {
+    size_t firstFailed = checks.size();
+    while (!failed) {
+      size_t i = next++;
+      if (i >= checks.size()) {
+        break;
+      }
+
+      if (!verify(i)) {
+        firstFailed = i;
+        failed = true;
+      }
+    }
+
+    return firstFailed;
+  };
+
+  std::vector<std::future<size_t>> results;
+  for (size_t w = 1; w < workers; ++w) {
+    results.push_back(std::async(std::launch::async, worker));
+  }
+
+  size_t firstFailed = worker();
+  for (auto& result : results) {
+    firstFailed = std::min(firstFailed, result.get());
+  }
+
+  return firstFailed;
 }
 
 uint64_t Blockchain::get_adjusted_time() {
@@ -1912,7 +2826,7 @@ bool Blockchain::check_block_timestamp_main(const Block& b) {
   std::vector<uint64_t> timestamps;
   size_t offset = m_blocks.size() <= m_currency.timestampCheckWindow() ? 0 : m_blocks.size() - m_currency.timestampCheckWindow();
   for (; offset != m_blocks.size(); ++offset) {
-    timestamps.push_back(m_blocks[offset].bl.timestamp);
+    timestamps.push_back(m_blockHeaders[static_cast<uint32_t>(offset)].timestamp);
   }
 
   return check_block_timestamp(std::move(timestamps), b);
@@ -1998,6 +2912,11 @@ bool Blockchain::addNewBlock(const Block& bl_, block_verification_context& bvc)
       return false;
     }
 
+    if (m_storageFailed) {
+      logger(ERROR, BRIGHT_RED) << "Block " << id << " not added, the block file could not be written";
+      return false;
+    }
+
     uint32_t height = m_blocks.size();
 
     //check that block refers to chain tail
@@ -2006,12 +2925,14 @@ bool Blockchain::addNewBlock(const Block& bl_, block_verification_context& bvc)
       bvc.m_added_to_main_chain = false;
       add_result = handle_alternative_block(bl, id, bvc);
     } else {
-      add_result = pushBlock(bl, bvc, ++height);
+      add_result = pushBlock(bl, id, bvc, ++height);
       logger(DEBUGGING) << "...check add_result";
       if (add_result) {
         sendMessage(BlockchainMessage(NewBlockMessage(id)));
       }
     }
+
+    pruneAlternativeBlocks();
   }
 
   if (add_result && bvc.m_added_to_main_chain) {
@@ -2023,27 +2944,95 @@ bool Blockchain::addNewBlock(const Block& bl_, block_verification_context& bvc)
 }
 
 bool Blockchain::transactionByHash(const Crypto::Hash &txhash, Blockchain::TransactionEntry &transactRes) {
-
-  auto it = m_transactionMap.find(txhash);
-  if (it == m_transactionMap.end()) {
+  ReadLock lk(*this);
+  TransactionIndex transactionIndex;
+  if (!m_transactionMap->find(txhash, transactionIndex)) {
     logger(WARNING, YELLOW) << "warning: get_tx_outputs_gindexs failed to find transaction with id = " << txhash;
     return false;
   }
 
-  transactRes = transactionByIndex(it->second);
+  return readTransactionEntry(transactionIndex, transactRes);
+}
+
+Blockchain::TransactionEntry Blockchain::transactionByIndex(TransactionIndex index) {
+  TransactionEntry transaction;
+  if (!readTransactionEntry(index, transaction)) {
+    throw std::runtime_error("Blockchain::transactionByIndex");
+  }
+
+  return transaction;
+}
+
+// Precondition: m_blockchain_lock is locked.
+// A transaction entry runs from its offset to the start of the next one, or
+// to the end of the record for the last, and is decoded on its own.
+bool Blockchain::readTransactionEntry(TransactionIndex index, TransactionEntry& transaction) {
+  if (index.block >= m_blockLayouts.size()) {
+    return false;
+  }
+
+  const BlockLayout& layout = m_blockLayouts[index.block];
+  if (index.transaction >= layout.transactionOffsets.size()) {
+    return false;
+  }
+
+  uint32_t begin = layout.transactionOffsets[index.transaction];
+  uint32_t end = index.transaction + 1u < layout.transactionOffsets.size() ? layout.transactionOffsets[index.transaction + 1] : layout.recordSize;
+  BinaryArray entry(end - begin);
+  if (!m_blocks.readRaw(index.block, begin, entry.size(), entry.data())) {
+    return false;
+  }
+
+  try {
+    Common::MemoryInputStream stream(entry.data(), entry.size());
+    BinaryInputStreamSerializer s(stream);
+    transaction.serialize(s);
+  } catch (std::exception& e) {
+    logger(ERROR, BRIGHT_RED) << "Failed to decode transaction " << index.transaction << " of block " << index.block << ": " << e.what();
+    return false;
+  }
+
   return true;
 }
 
-const Blockchain::TransactionEntry& Blockchain::transactionByIndex(TransactionIndex index) {
-  return m_blocks[index.block].transactions[index.transaction];
+// Precondition: m_blockchain_lock is locked.
+// Entries come back in request order but are read in file order, so a batch
+// spread over many blocks is one forward pass over the blocks file.
+void Blockchain::readTransactionEntries(const std::vector<TransactionIndex>& indexes, std::vector<TransactionEntry>& entries) {
+  std::vector<size_t> order(indexes.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+
+  std::sort(order.begin(), order.end(), [&indexes](size_t a, size_t b) {
+    return indexes[a].block != indexes[b].block ? indexes[a].block < indexes[b].block : indexes[a].transaction < indexes[b].transaction;
+  });
+
+  entries.resize(indexes.size());
+  for (size_t i : order) {
+    if (!readTransactionEntry(indexes[i], entries[i])) {
+      throw std::runtime_error("Blockchain::readTransactionEntries");
+    }
+  }
+}
+
+// Only the base transaction is hashed, the block already lists the others.
+Crypto::Hash Blockchain::transactionHashByIndex(TransactionIndex index) {
+  const Block& block = m_blocks[index.block].bl;
+  return index.transaction == 0 ? getObjectHash(block.baseTransaction) : block.transactionHashes[index.transaction - 1];
 }
 
 bool Blockchain::transactionByOrdinal(uint64_t ordinalBlock, uint64_t ordinalTransaction, TransactionEntry &transactionRes) {
-  transactionRes = m_blocks[ordinalBlock].transactions[ordinalTransaction];
-  return true; 
+  ReadLock lk(*this);
+  if (ordinalBlock >= m_blockLayouts.size() || ordinalTransaction > std::numeric_limits<uint16_t>::max()) {
+    return false;
+  }
+
+  TransactionIndex index = { static_cast<uint32_t>(ordinalBlock), static_cast<uint16_t>(ordinalTransaction) };
+  return readTransactionEntry(index, transactionRes);
 }
 
-bool Blockchain::pushBlock(const Block& blockData, block_verification_context& bvc, uint32_t& height) {
+bool Blockchain::pushBlock(const Block& blockData, const Crypto::Hash& blockHash, block_verification_context& bvc, uint32_t& height) {
   std::vector<Transaction> transactions;
 
   //logger(INFO, BRIGHT_WHITE) << "Loading transactions...";
@@ -2053,7 +3042,7 @@ bool Blockchain::pushBlock(const Block& blockData, block_verification_context& b
     return false;
   }
 
-  if (!pushBlock(blockData, transactions, bvc)) {
+  if (!pushBlock(blockData, blockHash, transactions, bvc)) {
     logger(INFO, BRIGHT_WHITE) << "pushBlock failed, saving transactions...";
     saveTransactions(transactions, height);
     return false;
@@ -2062,14 +3051,12 @@ bool Blockchain::pushBlock(const Block& blockData, block_verification_context& b
   return true;
 }
 
-bool Blockchain::pushBlock(const Block& blockData, const std::vector<Transaction>& transactions, block_verification_context& bvc) {
+bool Blockchain::pushBlock(const Block& blockData, const Crypto::Hash& blockHash, const std::vector<Transaction>& transactions, block_verification_context& bvc) {
 
   std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
 
   auto blockProcessingStart = std::chrono::steady_clock::now();
 
-  Crypto::Hash blockHash = get_block_hash(blockData);
-
   if (m_blockIndex.hasBlock(blockHash)) {
     logger(ERROR, BRIGHT_RED) <<
       "Block " << blockHash << " already exists in blockchain.";
@@ -2142,6 +3129,7 @@ bool Blockchain::pushBlock(const Block& blockData, const std::vector<Transaction
   size_t coinbase_blob_size = getObjectBinarySize(blockData.baseTransaction);
   size_t cumulative_block_size = coinbase_blob_size;
   uint64_t fee_summary = 0;
+  std::vector<RingSignatureCheck> ringSignatureChecks;
   for (size_t i = 0; i < transactions.size(); ++i) {
     const Crypto::Hash& tx_id = blockData.transactionHashes[i];
     block.transactions.resize(block.transactions.size() + 1);
@@ -2152,7 +3140,11 @@ bool Blockchain::pushBlock(const Block& blockData, const std::vector<Transaction
     blob_size = toBinaryArray(block.transactions.back().tx).size();
     fee = getInputAmount(block.transactions.back().tx) - getOutputAmount(block.transactions.back().tx);
 
-    if (!checkTransactionInputs(block.transactions.back().tx)) {
+    // ring signatures are only collected here, they refer to transactions[i]
+    // which stays put while block.transactions grows
+    size_t firstCheck = ringSignatureChecks.size();
+    Crypto::Hash prefixHash = getObjectHash(*static_cast<const TransactionPrefix*>(&transactions[i]));
+    if (!checkTransactionInputs(transactions[i], prefixHash, NULL, &ringSignatureChecks)) {
       logger(INFO, BRIGHT_WHITE) <<
         "Block " << blockHash << " has at least one transaction with wrong inputs: " << tx_id;
       bvc.m_verifivation_failed = true;
@@ -2162,6 +3154,10 @@ bool Blockchain::pushBlock(const Block& blockData, const std::vector<Transaction
       return false;
     }
 
+    for (size_t c = firstCheck; c < ringSignatureChecks.size(); ++c) {
+      ringSignatureChecks[c].transaction = i;
+    }
+
     ++transactionIndex.transaction;
     pushTransaction(block, tx_id, transactionIndex);
 
@@ -2169,6 +3165,15 @@ bool Blockchain::pushBlock(const Block& blockData, const std::vector<Transaction
     fee_summary += fee;
   }
 
+  size_t failedCheck = verifyRingSignatures(ringSignatureChecks);
+  if (failedCheck != ringSignatureChecks.size()) {
+    logger(INFO, BRIGHT_WHITE) <<
+      "Block " << blockHash << " has at least one transaction with wrong inputs: " << blockData.transactionHashes[ringSignatureChecks[failedCheck].transaction];
+    bvc.m_verifivation_failed = true;
+    popTransactions(block, minerTransactionHash);
+    return false;
+  }
+
   if (!checkCumulativeBlockSize(blockHash, cumulative_block_size, m_blocks.size())) {
     bvc.m_verifivation_failed = true;
     return false;
@@ -2176,7 +3181,7 @@ bool Blockchain::pushBlock(const Block& blockData, const std::vector<Transaction
 
   int64_t emissionChange = 0;
   uint64_t reward = 0;
-  uint64_t already_generated_coins = m_blocks.empty() ? 0 : m_blocks.back().already_generated_coins;
+  uint64_t already_generated_coins = m_blockHeaders.empty() ? 0 : m_blockHeaders.back().alreadyGeneratedCoins;
 
   if (!validate_miner_transaction(blockData, static_cast<uint32_t>(m_blocks.size()), cumulative_block_size, already_generated_coins, fee_summary, reward, emissionChange)) {
     logger(INFO, BRIGHT_WHITE) << "Block " << blockHash << " has invalid miner transaction";
@@ -2190,10 +3195,10 @@ bool Blockchain::pushBlock(const Block& blockData, const std::vector<Transaction
   block.cumulative_difficulty = currentDifficulty;
   block.already_generated_coins = already_generated_coins + emissionChange;
   if (m_blocks.size() > 0) {
-    block.cumulative_difficulty += m_blocks.back().cumulative_difficulty;
+    block.cumulative_difficulty += m_blockHeaders.back().cumulativeDifficulty;
   }
 
-  pushBlock(block);
+  pushBlock(block, blockHash);
 
   logger(INFO, BRIGHT_GREEN) << "Block: " << block.height+1;
 
@@ -2215,19 +3220,23 @@ bool Blockchain::pushBlock(const Block& blockData, const std::vector<Transaction
   return true;
 }
 
-bool Blockchain::pushBlock(BlockEntry& block) {
-
-  Crypto::Hash blockHash = get_block_hash(block.bl);
-
+bool Blockchain::pushBlock(BlockEntry& block, const Crypto::Hash& blockHash) {
   m_blocks.push_back(block);
+  m_blockHeaders.push(makeBlockHeader(block, blockHash));
+  m_blockLayouts.push_back(makeBlockLayout(block));
   m_blockIndex.push(blockHash);
 
+  BlockCacheDelta delta = makeBlockCacheDelta(block, blockHash, false);
+  journalBlockCacheDelta(delta);
+  pushBlockUndo(delta);
+
   m_timestampIndex.add(block.bl.timestamp, blockHash);
   m_generatedTransactionsIndex.add(block.bl);
 
   //m_tx_pool.on_blockchain_inc(m_blocks.size(), blockHash);
 
   assert(m_blockIndex.size() == m_blocks.size());
+  commitIndexes(false);
 
   return true;
 }
@@ -2240,30 +3249,68 @@ void Blockchain::popBlock(const Crypto::Hash& blockHash) {
     return;
   }
 
-  std::vector<Transaction> transactions(m_blocks.back().transactions.size() - 1);
-  for (size_t i = 0; i < m_blocks.back().transactions.size() - 1; ++i) {
-    transactions[i] = m_blocks.back().transactions[1 + i].tx;
+  // only the transactions going back to the pool are decoded, each from its
+  // own slice of the block record
+  uint32_t height = m_blocks.size();
+  std::vector<TransactionIndex> indexes;
+  for (uint16_t t = 1; t < m_blockLayouts.back().transactionOffsets.size(); ++t) {
+    indexes.push_back({ height - 1, t });
+  }
+
+  std::vector<TransactionEntry> entries;
+  readTransactionEntries(indexes, entries);
+  std::vector<Transaction> transactions(entries.size());
+  for (size_t i = 0; i < entries.size(); ++i) {
+    transactions[i] = std::move(entries[i].tx);
   }
 
-  uint32_t height = m_blocks.size();
   saveTransactions(transactions, height);
+  undoLastBlock(blockHash);
 
-  popTransactions(m_blocks.back(), getObjectHash(m_blocks.back().bl.baseTransaction));
+  //m_tx_pool.on_blockchain_dec(m_blocks.size(), blockHash);
 
-  m_timestampIndex.remove(m_blocks.back().bl.timestamp, blockHash);
-  m_generatedTransactionsIndex.remove(m_blocks.back().bl);
+  assert(m_blockIndex.size() == m_blocks.size());
+  commitIndexes(false);
+}
 
-  m_blocks.pop_back();
-  m_blockIndex.pop();
+void Blockchain::pushBlockUndo(BlockCacheDelta& delta) {
+  delta.outputs.clear();
+  delta.multisignatureOutputs.clear();
+  m_blockUndo.push_back(delta);
+}
 
-  //m_tx_pool.on_blockchain_dec(m_blocks.size(), blockHash);
+// Reverses the last block from its undo record, the block itself is only
+// decoded for the explorer indexes.
+void Blockchain::undoLastBlock(const Crypto::Hash& blockHash) {
+  BlockCacheDelta delta = m_blockUndo.back();
+  if (delta.height + 1 != m_blocks.size() || delta.blockHash != blockHash) {
+    throw std::runtime_error("Blockchain::undoLastBlock: undo record does not match the chain");
+  }
 
-  assert(m_blockIndex.size() == m_blocks.size());
+  if (m_blockchainIndexesEnabled) {
+    const BlockEntry& block = m_blocks.back();
+    for (const TransactionEntry& transaction : block.transactions) {
+      m_paymentIdIndex.remove(transaction.tx);
+    }
+
+    m_generatedTransactionsIndex.remove(block.bl);
+  }
+
+  m_timestampIndex.remove(m_blockHeaders.back().timestamp, blockHash);
+
+  // journaled before blocks.dat shrinks, so a replay never runs ahead of it
+  delta.removed = true;
+  journalBlockCacheDelta(delta);
+  applyBlockCacheDelta(delta);
+
+  m_blocks.pop_back();
+  m_blockHeaders.pop();
+  m_blockLayouts.pop_back();
+  m_blockUndo.pop_back();
 }
 
 bool Blockchain::pushTransaction(BlockEntry& block, const Crypto::Hash& transactionHash, TransactionIndex transactionIndex) {
-  auto result = m_transactionMap.insert(std::make_pair(transactionHash, transactionIndex));
-  if (!result.second) {
+  if (!m_transactionMap->insert(transactionHash, transactionIndex)) {
     logger(ERROR, BRIGHT_RED) <<
       "Duplicate transaction was pushed to blockchain.";
     return false;
@@ -2274,22 +3321,21 @@ bool Blockchain::pushTransaction(BlockEntry& block, const Crypto::Hash& transact
   if (!checkMultisignatureInputsDiff(transaction.tx)) {
     logger(ERROR, BRIGHT_RED) <<
       "Double spending transaction was pushed to blockchain.";
-    m_transactionMap.erase(transactionHash);
+    m_transactionMap->erase(transactionHash);
     return false;
   }
 
   for (size_t i = 0; i < transaction.tx.inputs.size(); ++i) {
     if (transaction.tx.inputs[i].type() == typeid(KeyInput)) {
       //auto result = m_spent_keys.insert(::boost::get<KeyInput>(transaction.tx.inputs[i]).keyImage);
-      auto result = m_spent_keys.insert(std::make_pair(::boost::get<KeyInput>(transaction.tx.inputs[i]).keyImage, block.height));
-      if (!result.second) {
+      if (!m_spent_keys->insert(::boost::get<KeyInput>(transaction.tx.inputs[i]).keyImage, block.height)) {
         logger(ERROR, BRIGHT_RED) <<
           "Double spending transaction was pushed to blockchain.";
         for (size_t j = 0; j < i; ++j) {
-          m_spent_keys.erase(::boost::get<KeyInput>(transaction.tx.inputs[i - 1 - j]).keyImage);
+          m_spent_keys->erase(::boost::get<KeyInput>(transaction.tx.inputs[i - 1 - j]).keyImage);
         }
 
-        m_transactionMap.erase(transactionHash);
+        m_transactionMap->erase(transactionHash);
         return false;
       }
     }
@@ -2308,7 +3354,8 @@ bool Blockchain::pushTransaction(BlockEntry& block, const Crypto::Hash& transact
     if (transaction.tx.outputs[output].target.type() == typeid(KeyOutput)) {
       auto& amountOutputs = m_outputs[transaction.tx.outputs[output].amount];
       transaction.m_global_output_indexes[output] = static_cast<uint32_t>(amountOutputs.size());
-      amountOutputs.push_back(std::make_pair<>(transactionIndex, output));
+      OutputEntry entry = { transactionIndex, output, transaction.tx.unlockTime, ::boost::get<KeyOutput>(transaction.tx.outputs[output].target).key };
+      amountOutputs.push_back(entry);
     } else if (transaction.tx.outputs[output].target.type() == typeid(MultisignatureOutput)) {
       auto& amountOutputs = m_multisignatureOutputs[transaction.tx.outputs[output].amount];
       transaction.m_global_output_indexes[output] = static_cast<uint32_t>(amountOutputs.size());
@@ -2323,7 +3370,11 @@ bool Blockchain::pushTransaction(BlockEntry& block, const Crypto::Hash& transact
 }
 
 void Blockchain::popTransaction(const Transaction& transaction, const Crypto::Hash& transactionHash) {
-  TransactionIndex transactionIndex = m_transactionMap.at(transactionHash);
+  TransactionIndex transactionIndex;
+  if (!m_transactionMap->find(transactionHash, transactionIndex)) {
+    throw std::out_of_range("Blockchain::popTransaction: transaction is not in the chain");
+  }
+
   for (size_t outputIndex = 0; outputIndex < transaction.outputs.size(); ++outputIndex) {
     const TransactionOutput& output = transaction.outputs[transaction.outputs.size() - 1 - outputIndex];
     if (output.target.type() == typeid(KeyOutput)) {
@@ -2340,13 +3391,13 @@ void Blockchain::popTransaction(const Transaction& transaction, const Crypto::Ha
         continue;
       }
 
-      if (amountOutputs->second.back().first.block != transactionIndex.block || amountOutputs->second.back().first.transaction != transactionIndex.transaction) {
+      if (amountOutputs->second.back().transactionIndex.block != transactionIndex.block || amountOutputs->second.back().transactionIndex.transaction != transactionIndex.transaction) {
         logger(ERROR, BRIGHT_RED) <<
           "Blockchain consistency broken - invalid transaction index.";
         continue;
       }
 
-      if (amountOutputs->second.back().second != transaction.outputs.size() - 1 - outputIndex) {
+      if (amountOutputs->second.back().outputIndex != transaction.outputs.size() - 1 - outputIndex) {
         logger(ERROR, BRIGHT_RED) <<
           "Blockchain consistency broken - invalid output index.";
         continue;
@@ -2397,8 +3448,7 @@ void Blockchain::popTransaction(const Transaction& transaction, const Crypto::Ha
 
   for (auto& input : transaction.inputs) {
     if (input.type() == typeid(KeyInput)) {
-      size_t count = m_spent_keys.erase(::boost::get<KeyInput>(input).keyImage);
-      if (count != 1) {
+      if (!m_spent_keys->erase(::boost::get<KeyInput>(input).keyImage)) {
         logger(ERROR, BRIGHT_RED) <<
           "Blockchain consistency broken - cannot find spent key.";
       }
@@ -2416,8 +3466,7 @@ void Blockchain::popTransaction(const Transaction& transaction, const Crypto::Ha
 
   m_paymentIdIndex.remove(transaction);
 
-  size_t count = m_transactionMap.erase(transactionHash);
-  if (count != 1) {
+  if (!m_transactionMap->erase(transactionHash)) {
     logger(ERROR, BRIGHT_RED) <<
       "Blockchain consistency broken - cannot find transaction by hash.";
   }
@@ -2453,7 +3502,8 @@ bool Blockchain::validateInput(const MultisignatureInput& input, const Crypto::H
     return false;
   }
 
-  const Transaction& outputTransaction = m_blocks[outputIndex.transactionIndex.block].transactions[outputIndex.transactionIndex.transaction].tx;
+  TransactionEntry outputEntry = transactionByIndex(outputIndex.transactionIndex);
+  const Transaction& outputTransaction = outputEntry.tx;
   if (!is_tx_spendtime_unlocked(outputTransaction.unlockTime)) {
     logger(DEBUGGING) <<
       "Transaction << " << transactionHash << " contains multisignature input which points to a locked transaction.";
@@ -2518,66 +3568,59 @@ void Blockchain::removeLastBlock() {
     return;
   }
 
-  logger(DEBUGGING) << "Removing last block with height " << m_blocks.back().height;
-  popTransactions(m_blocks.back(), getObjectHash(m_blocks.back().bl.baseTransaction));
-
-  Crypto::Hash blockHash = getBlockIdByHeight(m_blocks.back().height);
-  m_timestampIndex.remove(m_blocks.back().bl.timestamp, blockHash);
-  m_generatedTransactionsIndex.remove(m_blocks.back().bl);
-
-  m_blocks.pop_back();
-  m_blockIndex.pop();
+  logger(DEBUGGING) << "Removing last block with height " << m_blocks.size() - 1;
+  undoLastBlock(m_blockHeaders.back().blockHash);
 
   assert(m_blockIndex.size() == m_blocks.size());
 }
 
 bool Blockchain::getLowerBound(uint64_t timestamp, uint64_t startOffset, uint32_t& height) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
 
   assert(startOffset < m_blocks.size());
 
-  auto bound = std::lower_bound(m_blocks.begin() + startOffset, m_blocks.end(), timestamp - m_currency.blockFutureTimeLimit(),
-    [](const BlockEntry& b, uint64_t timestamp) { return b.bl.timestamp < timestamp; });
+  auto bound = std::lower_bound(m_blockHeaders.begin() + startOffset, m_blockHeaders.end(), timestamp - m_currency.blockFutureTimeLimit(),
+    [](const CompactBlockHeader& b, uint64_t timestamp) { return b.timestamp < timestamp; });
 
-  if (bound == m_blocks.end()) {
+  if (bound == m_blockHeaders.end()) {
     return false;
   }
 
-  height = static_cast<uint32_t>(std::distance(m_blocks.begin(), bound));
+  height = static_cast<uint32_t>(std::distance(m_blockHeaders.begin(), bound));
   return true;
 }
 
 std::vector<Crypto::Hash> Blockchain::getBlockIds(uint32_t startHeight, uint32_t maxCount) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   return m_blockIndex.getBlockIds(startHeight, maxCount);
 }
 
 bool Blockchain::getBlockContainingTransaction(const Crypto::Hash& txId, Crypto::Hash& blockId, uint32_t& blockHeight) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
-  auto it = m_transactionMap.find(txId);
-  if (it == m_transactionMap.end()) {
+  ReadLock lk(*this);
+  TransactionIndex transactionIndex;
+  if (!m_transactionMap->find(txId, transactionIndex)) {
     return false;
   } else {
-    blockHeight = m_blocks[it->second.block].height;
-    blockId = getBlockIdByHeight(blockHeight);
+    blockHeight = transactionIndex.block;
+    blockId = m_blockHeaders[blockHeight].blockHash;
     return true;
   }
 }
 
 bool Blockchain::getAlreadyGeneratedCoins(const Crypto::Hash& hash, uint64_t& generatedCoins) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
 
   // try to find block in main chain
   uint32_t height = 0;
   if (m_blockIndex.getBlockHeight(hash, height)) {
-    generatedCoins = m_blocks[height].already_generated_coins;
+    generatedCoins = m_blockHeaders[height].alreadyGeneratedCoins;
     return true;
   }
 
   // try to find block in alternative chain
   auto blockByHashIterator = m_alternative_chains.find(hash);
   if (blockByHashIterator != m_alternative_chains.end()) {
-    generatedCoins = blockByHashIterator->second.already_generated_coins;
+    generatedCoins = blockByHashIterator->second.alreadyGeneratedCoins;
     return true;
   }
 
@@ -2586,19 +3629,19 @@ bool Blockchain::getAlreadyGeneratedCoins(const Crypto::Hash& hash, uint64_t& ge
 }
 
 bool Blockchain::getBlockSize(const Crypto::Hash& hash, size_t& size) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
 
   // try to find block in main chain
   uint32_t height = 0;
   if (m_blockIndex.getBlockHeight(hash, height)) {
-    size = m_blocks[height].block_cumulative_size;
+    size = m_blockHeaders[height].blockCumulativeSize;
     return true;
   }
 
   // try to find block in alternative chain
   auto blockByHashIterator = m_alternative_chains.find(hash);
   if (blockByHashIterator != m_alternative_chains.end()) {
-    size = blockByHashIterator->second.block_cumulative_size;
+    size = blockByHashIterator->second.blockCumulativeSize;
     return true;
   }
 
@@ -2607,7 +3650,7 @@ bool Blockchain::getBlockSize(const Crypto::Hash& hash, size_t& size) {
 }
 
 bool Blockchain::getMultisigOutputReference(const MultisignatureInput& txInMultisig, std::pair<Crypto::Hash, size_t>& outputReference) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   MultisignatureOutputsContainer::const_iterator amountIter = m_multisignatureOutputs.find(txInMultisig.amount);
   if (amountIter == m_multisignatureOutputs.end()) {
     logger(DEBUGGING) << "Transaction contains multisignature input with invalid amount.";
@@ -2618,84 +3661,118 @@ bool Blockchain::getMultisigOutputReference(const MultisignatureInput& txInMulti
     return false;
   }
   const MultisignatureOutputUsage& outputIndex = amountIter->second[txInMultisig.outputIndex];
-  const Transaction& outputTransaction = m_blocks[outputIndex.transactionIndex.block].transactions[outputIndex.transactionIndex.transaction].tx;
-  outputReference.first = getObjectHash(outputTransaction);
+  outputReference.first = transactionHashByIndex(outputIndex.transactionIndex);
   outputReference.second = outputIndex.outputIndex;
   return true;
 }
 
+// Precondition: m_blockchain_lock is locked.
+// The payment id index is tagged with the tip it was committed at, blocks
+// added after that are indexed again on the next start.
 bool Blockchain::storeBlockchainIndices() {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
-
-  logger(INFO, BRIGHT_WHITE) << "Saving blockchain indices...";
-  BlockchainIndicesSerializer ser(*this, getTailId(), logger.getLogger());
-  logger(INFO) << "Blockchain.cpp ... storeToBinaryFile...";
-
-  if (!storeToBinaryFile(ser, appendPath(m_config_folder, m_currency.blockchinIndicesFileName()))) {
-    logger(ERROR, BRIGHT_RED) << "Failed to save blockchain indices";
+  try {
+    flushBlockBatch();
+    m_paymentIdIndex.commit(m_blocks.empty() ? NULL_HASH : m_blockIndex.getTailId());
+    m_generatedTransactionsIndex.commit();
+  } catch (std::exception& e) {
+    logger(ERROR, BRIGHT_RED) << "Failed to save blockchain indices: " << e.what();
     return false;
   }
 
-  logger(INFO) << "done with storeBlockchainIndices...";
   return true;
 }
 
+// Precondition: m_blockchain_lock is locked.
+// The timestamp index is filled from the block headers and the generated
+// transactions index catches up from the block layouts. Only blocks after
+// the tip the payment id index was committed at are decoded.
 bool Blockchain::loadBlockchainIndices() {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  // left by the versions that saved the indices whole on exit
+  remove(appendPath(m_config_folder, m_currency.blockchinIndicesFileName()).c_str());
+
+  if (!m_paymentIdIndex.open(appendPath(m_config_folder, m_currency.paymentIdIndexFileName())) ||
+    !m_generatedTransactionsIndex.open(appendPath(m_config_folder, m_currency.generatedTransactionsIndexFileName()))) {
+    logger(ERROR, BRIGHT_RED) << "Failed to open the blockchain indices";
+    return false;
+  }
 
-  //logger(INFO, BRIGHT_WHITE) << "Loading blockchain indices for BlockchainExplorer...";
-  BlockchainIndicesSerializer indiceloader(*this, get_block_hash(m_blocks.back().bl), logger.getLogger());
+  try {
+    m_timestampIndex.clear();
+    for (uint32_t b = 0; b < m_blockHeaders.size(); ++b) {
+      m_timestampIndex.add(m_blockHeaders[b].timestamp, m_blockHeaders[b].blockHash);
+    }
 
-  //if (!indiceloader.indice_loaded()) {
-    BlockchainIndicesSerializer::m_indiceloaded =
-      loadFromBinaryFile(indiceloader, appendPath(m_config_folder, m_currency.blockchinIndicesFileName()));
-  //}
+    while (m_generatedTransactionsIndex.size() > m_blocks.size()) {
+      m_generatedTransactionsIndex.remove(m_generatedTransactionsIndex.size() - 1);
+    }
 
-  if (!indiceloader.indice_loaded()) {
+    uint32_t last = m_generatedTransactionsIndex.size() - 1;
+    uint64_t lastGenerated = 0;
+    uint64_t previousGenerated = 0;
+    if (m_generatedTransactionsIndex.size() > 0 && m_generatedTransactionsIndex.find(last, lastGenerated) &&
+      (last == 0 || m_generatedTransactionsIndex.find(last - 1, previousGenerated)) &&
+      lastGenerated - previousGenerated != m_blockLayouts[last].transactionOffsets.size()) {
+      logger(INFO, BRIGHT_YELLOW) << "Generated transactions index does not match the blockchain, rebuilding...";
+      m_generatedTransactionsIndex.clear();
+    }
 
-    logger(WARNING, BRIGHT_YELLOW) << "No actual blockchain indices for BlockchainExplorer found, rebuilding...";
-    std::chrono::steady_clock::time_point timePoint = std::chrono::steady_clock::now();
+    for (uint32_t b = m_generatedTransactionsIndex.size(); b < m_blocks.size(); ++b) {
+      m_generatedTransactionsIndex.add(b, m_blockLayouts[b].transactionOffsets.size());
+    }
 
-    m_paymentIdIndex.clear();
-    m_timestampIndex.clear();
-    m_generatedTransactionsIndex.clear();
+    uint32_t height = 0;
+    Crypto::Hash tag = m_paymentIdIndex.committedTag();
+    if (tag == NULL_HASH || !m_blockIndex.getBlockHeight(tag, height)) {
+      m_paymentIdIndex.clear();
+      height = 0;
+    } else {
+      ++height;
+    }
 
-    for (uint32_t b = 0; b < m_blocks.size(); ++b) {
-      if (b % 1000 == 0) {
-        logger(INFO, BRIGHT_WHITE) << "Height " << b << " of " << m_blocks.size();
-      }
-      const BlockEntry& block = m_blocks[b];
-      m_timestampIndex.add(block.bl.timestamp, get_block_hash(block.bl));
-      m_generatedTransactionsIndex.add(block.bl);
-      for (uint16_t t = 0; t < block.transactions.size(); ++t) {
-        const TransactionEntry& transaction = block.transactions[t];
-        m_paymentIdIndex.add(transaction.tx);
+    if (height < m_blocks.size()) {
+      logger(INFO, BRIGHT_WHITE) << "Indexing payment ids from height " << height << " of " << m_blocks.size();
+      std::chrono::steady_clock::time_point timePoint = std::chrono::steady_clock::now();
+
+      for (uint32_t b = height; b < m_blocks.size(); ++b) {
+        if (b % 1000 == 0) {
+          logger(INFO, BRIGHT_WHITE) << "Height " << b << " of " << m_blocks.size();
+        }
+
+        const BlockEntry& block = m_blocks[b];
+        for (const TransactionEntry& transaction : block.transactions) {
+          m_paymentIdIndex.add(transaction.tx);
+        }
       }
-    }
 
-    std::chrono::duration<double> duration = std::chrono::steady_clock::now() - timePoint;
-    logger(INFO, BRIGHT_WHITE) << "Rebuilding blockchain indices took: " << duration.count();
+      std::chrono::duration<double> duration = std::chrono::steady_clock::now() - timePoint;
+      logger(INFO, BRIGHT_WHITE) << "Indexing payment ids took: " << duration.count();
+      storeBlockchainIndices();
+    }
+  } catch (std::exception& e) {
+    logger(ERROR, BRIGHT_RED) << "Failed to load blockchain indices: " << e.what();
+    return false;
   }
+
   return true;
 }
 
 bool Blockchain::getGeneratedTransactionsNumber(uint32_t height, uint64_t& generatedTransactions) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   return m_generatedTransactionsIndex.find(height, generatedTransactions);
 }
 
 bool Blockchain::getOrphanBlockIdsByHeight(uint32_t height, std::vector<Crypto::Hash>& blockHashes) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   return m_orphanBlocksIndex.find(height, blockHashes);
 }
 
 bool Blockchain::getBlockIdsByTimestamp(uint64_t timestampBegin, uint64_t timestampEnd, uint32_t blocksNumberLimit, std::vector<Crypto::Hash>& hashes, uint32_t& blocksNumberWithinTimestamps) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   return m_timestampIndex.find(timestampBegin, timestampEnd, blocksNumberLimit, hashes, blocksNumberWithinTimestamps);
 }
 
 bool Blockchain::getTransactionIdsByPaymentId(const Crypto::Hash& paymentId, std::vector<Crypto::Hash>& transactionHashes) {
-  std::lock_guard<decltype(m_blockchain_lock)> lk(m_blockchain_lock);
+  ReadLock lk(*this);
   return m_paymentIdIndex.find(paymentId, transactionHashes);
 }
 
@@ -5,6 +5,8 @@
 #pragma once
 
 #include <atomic>
+#include <future>
+#include <mutex>
 
 #include "google/sparse_hash_set"
 #include "google/sparse_hash_map"
@@ -12,11 +14,17 @@
 
 #include "Common/ObserverManager.h"
 #include "Common/Util.h"
+#include "CryptoNoteCore/AlternativeBlockStore.h"
+#include "CryptoNoteCore/BlockCacheJournal.h"
+#include "CryptoNoteCore/BlockHeaderIndex.h"
 #include "CryptoNoteCore/BlockIndex.h"
+#include "CryptoNoteCore/BlockchainLock.h"
 #include "CryptoNoteCore/Checkpoints.h"
 #include "CryptoNoteCore/Currency.h"
 #include "CryptoNoteCore/IBlockchainStorageObserver.h"
+#include "CryptoNoteCore/KeyValueIndex.h"
 #include "CryptoNoteCore/ITransactionValidator.h"
+#include "CryptoNoteCore/RingSignatureCache.h"
 #include "CryptoNoteCore/SwappedVector.h"
 #include "CryptoNoteCore/CryptoNoteFormatUtils.h"
 #include "CryptoNoteCore/TransactionPool.h"
@@ -32,6 +40,7 @@
 using phmap::parallel_flat_hash_map;
 
 namespace CryptoNote {
+  struct block_complete_entry;
   struct NOTIFY_REQUEST_GET_OBJECTS_request;
   struct NOTIFY_RESPONSE_GET_OBJECTS_request;
   struct COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS_request;
@@ -64,8 +73,23 @@ namespace CryptoNote {
     std::vector<Crypto::Hash> getBlockIds(uint32_t startHeight, uint32_t maxCount);
 
     void setCheckpoints(Checkpoints&& chk_pts) { m_checkpoints = chk_pts; }
+    // bytes, takes effect on init
+    void setBlockCacheSize(uint64_t size) { m_blockCacheSize = size; }
+    void setDiskIndexes(bool enabled) { m_diskIndexes = enabled; }
+    // Blocks added in between are appended to the block file in large writes
+    // instead of one by one. Batches nest, the outermost end flushes. Returns
+    // false once blocks could not be written, no more blocks are added then.
+    void beginBlockBatch();
+    bool endBlockBatch();
+    // Long hashes of blocks about to be added are computed on all hardware
+    // threads, each with its own context, into the proof of work cache of the
+    // currency, where checking the blocks finds them. Blocks in the
+    // checkpoint zone are skipped.
+    void precomputeProofOfWork(const std::vector<Block>& blocks);
     bool getBlocks(uint32_t start_offset, uint32_t count, std::list<Block>& blocks, std::list<Transaction>& txs);
     bool getBlocks(uint32_t start_offset, uint32_t count, std::list<Block>& blocks);
+    // block and its non coinbase transactions as stored, without re-encoding
+    bool getRawBlock(uint32_t height, block_complete_entry& entry);
     bool getAlternativeBlocks(std::list<Block>& blocks);
     uint32_t getAlternativeBlocksCount();
     Crypto::Hash getBlockIdByHeight(uint32_t height);
@@ -122,7 +146,7 @@ namespace CryptoNote {
 
     template<class t_ids_container, class t_blocks_container, class t_missed_container>
     bool getBlocks(const t_ids_container& block_ids, t_blocks_container& blocks, t_missed_container& missed_bs) {
-      std::lock_guard<std::recursive_mutex> lk(m_blockchain_lock);
+      ReadLock lk(*this);
 
       for (const auto& bl_id : block_ids) {
         uint32_t height = 0;
@@ -140,16 +164,23 @@ namespace CryptoNote {
 
     template<class t_ids_container, class t_tx_container, class t_missed_container>
     void getBlockchainTransactions(const t_ids_container& txs_ids, t_tx_container& txs, t_missed_container& missed_txs) {
-      std::lock_guard<decltype(m_blockchain_lock)> bcLock(m_blockchain_lock);
+      ReadLock bcLock(*this);
 
+      std::vector<TransactionIndex> indexes;
       for (const auto& tx_id : txs_ids) {
-        auto it = m_transactionMap.find(tx_id);
-        if (it == m_transactionMap.end()) {
+        TransactionIndex index;
+        if (!m_transactionMap->find(tx_id, index)) {
           missed_txs.push_back(tx_id);
         } else {
-          txs.push_back(transactionByIndex(it->second).tx);
+          indexes.push_back(index);
         }
       }
+
+      std::vector<TransactionEntry> entries;
+      readTransactionEntries(indexes, entries);
+      for (auto& entry : entries) {
+        txs.push_back(std::move(entry.tx));
+      }
     }
 
     template<class t_ids_container, class t_tx_container, class t_missed_container>
@@ -172,6 +203,10 @@ namespace CryptoNote {
     void print_blockchain(uint64_t start_index, uint64_t end_index);
     void print_blockchain_index();
     void print_blockchain_outs(const std::string& file);
+    void print_lock_statistics();
+    void print_cache_statistics();
+
+    BlockchainLock::Statistics getLockStatistics();
 
     struct TransactionIndex {
       uint32_t block;
@@ -183,6 +218,22 @@ namespace CryptoNote {
       }
     };
 
+    // Global output index record. The output key and unlock time are kept here
+    // so ring members can be resolved without loading their transaction.
+    struct OutputEntry {
+      TransactionIndex transactionIndex;
+      uint16_t outputIndex;
+      uint64_t unlockTime;
+      Crypto::PublicKey key;
+
+      void serialize(ISerializer& s) {
+        s(transactionIndex, "txindex");
+        s(outputIndex, "outindex");
+        s(unlockTime, "unlock_time");
+        s(key, "key");
+      }
+    };
+
     struct TransactionEntry {
       Transaction tx;
       std::vector<uint32_t> m_global_output_indexes;
@@ -194,13 +245,45 @@ namespace CryptoNote {
     };
 
     bool transactionByHash(const Crypto::Hash &txhash, Blockchain::TransactionEntry &transactRes);
-    const TransactionEntry& transactionByIndex(TransactionIndex index);
+    // decodes only the requested transaction from the stored block record
+    TransactionEntry transactionByIndex(TransactionIndex index);
+    Crypto::Hash transactionHashByIndex(TransactionIndex index);
     bool transactionByOrdinal(uint64_t ordinalBlock, uint64_t ordinalTransaction, TransactionEntry &transactionRes);
 
   private:
 
+    // Shared lock on the storage for read only methods. It also pins m_blocks,
+    // so items returned by m_blocks[] stay valid while other readers load more.
+    class ReadLock: boost::noncopyable {
+    public:
+      explicit ReadLock(Blockchain& bc) : m_bc(bc) {
+        m_bc.m_blockchain_lock.lock_shared();
+        m_bc.m_blocks.pin();
+        m_bc.m_blockLayouts.pin();
+      }
+
+      ~ReadLock() {
+        m_bc.m_blockLayouts.unpin();
+        m_bc.m_blocks.unpin();
+        m_bc.m_blockchain_lock.unlock_shared();
+      }
+
+    private:
+      Blockchain& m_bc;
+    };
+
     bool m_indexesInitialized = false;
 
+    // Ring signature of one key input, collected while a block's transactions
+    // are applied and verified for the whole block at once.
+    struct RingSignatureCheck {
+      Crypto::Hash prefixHash;
+      Crypto::KeyImage keyImage;
+      std::vector<Crypto::PublicKey> outputKeys;
+      const Crypto::Signature* signatures;
+      size_t transaction;
+    };
+
     struct MultisignatureOutputUsage {
       TransactionIndex transactionIndex;
       uint16_t outputIndex;
@@ -231,71 +314,162 @@ namespace CryptoNote {
       }
     };
 
+    // Where the encoded block and transactions sit inside a stored BlockEntry
+    // record, so they can be sent to peers straight from the blocks file.
+    // Offsets are relative to the record, the coinbase transaction comes first.
+    struct BlockLayout {
+      uint32_t recordSize;
+      uint32_t blockSize;
+      std::vector<uint32_t> transactionOffsets;
+      std::vector<uint32_t> transactionSizes;
+
+      void serialize(ISerializer& s) {
+        s(recordSize, "record_size");
+        s(blockSize, "block_size");
+        s(transactionOffsets, "transaction_offsets");
+        s(transactionSizes, "transaction_sizes");
+      }
+    };
+
+    // Cache changes made by connecting or disconnecting one block, replayed
+    // from the journal on top of the last cache snapshot. Without the output
+    // entries it is also the undo record kept for every block of the chain.
+    struct BlockCacheDelta {
+      bool removed;
+      uint32_t height;
+      Crypto::Hash blockHash;
+      std::vector<Crypto::Hash> transactionHashes;
+      std::vector<Crypto::KeyImage> spentKeys;
+      std::vector<uint64_t> outputAmounts;
+      std::vector<OutputEntry> outputs;
+      std::vector<uint64_t> multisignatureAmounts;
+      std::vector<MultisignatureOutputUsage> multisignatureOutputs;
+      std::vector<uint64_t> usedMultisignatureAmounts;
+      std::vector<uint32_t> usedMultisignatureIndexes;
+
+      void serialize(ISerializer& s) {
+        s(removed, "removed");
+        s(height, "height");
+        s(blockHash, "block_hash");
+        s(transactionHashes, "transaction_hashes");
+        s(spentKeys, "spent_keys");
+        s(outputAmounts, "output_amounts");
+        s(outputs, "outputs");
+        s(multisignatureAmounts, "multisig_amounts");
+        s(multisignatureOutputs, "multisig_outputs");
+        s(usedMultisignatureAmounts, "used_multisig_amounts");
+        s(usedMultisignatureIndexes, "used_multisig_indexes");
+      }
+    };
+
     //typedef google::sparse_hash_set<Crypto::KeyImage> key_images_container;
-    typedef parallel_flat_hash_map<Crypto::KeyImage, uint32_t> key_images_container;
+    typedef IKeyValueIndex<Crypto::KeyImage, uint32_t> key_images_container;
 
-    typedef std::unordered_map<Crypto::Hash, BlockEntry> blocks_ext_by_hash;
-    typedef google::sparse_hash_map<uint64_t, std::vector<std::pair<TransactionIndex, uint16_t>>> outputs_container; //Crypto::Hash - tx hash, size_t - index of out in transaction
+    typedef google::sparse_hash_map<uint64_t, std::vector<OutputEntry>> outputs_container;
     typedef google::sparse_hash_map<uint64_t, std::vector<MultisignatureOutputUsage>> MultisignatureOutputsContainer;
 
     const Currency& m_currency;
     tx_memory_pool& m_tx_pool;
-    std::recursive_mutex m_blockchain_lock; // TODO: add here reader/writer lock
+    BlockchainLock m_blockchain_lock;
     Crypto::cn_context m_cn_context;
+    // contexts of the precomputeProofOfWork workers
+    Crypto::cn_context_pool m_cnContextPool;
     Tools::ObserverManager<IBlockchainStorageObserver> m_observerManager;
 
-    key_images_container m_spent_keys;
+    std::unique_ptr<key_images_container> m_spent_keys;
     size_t m_current_block_cumul_sz_limit;
-    blocks_ext_by_hash m_alternative_chains; // Crypto::Hash -> block_extended_info
-    blocks_ext_by_hash m_invalid_blocks;
+    AlternativeBlockStore m_alternative_chains;
+    // only the heights are kept, haveBlock() is all they are used for
+    AlternativeBlockStore m_invalid_blocks;
 
     outputs_container m_outputs;
 
     std::string m_config_folder;
+    uint64_t m_blockCacheSize;
+    bool m_diskIndexes;
     Checkpoints m_checkpoints;
     std::atomic<bool> m_is_in_checkpoint_zone;
 
     typedef std::unordered_map<Crypto::Hash, uint32_t> BlockMap;
 
     //typedef std::unordered_map<Crypto::Hash, TransactionIndex> TransactionMap;
-    typedef parallel_flat_hash_map<Crypto::Hash, TransactionIndex> TransactionMap;
+    typedef IKeyValueIndex<Crypto::Hash, TransactionIndex> TransactionMap;
 
     friend class BlockCacheSerializer;
-    friend class BlockchainIndicesSerializer;
 
     typedef SwappedVector<BlockEntry> Blocks;
     Blocks m_blocks;
 
     CryptoNote::BlockIndex m_blockIndex;
-    TransactionMap m_transactionMap;
+    BlockHeaderIndex m_blockHeaders;
+    SwappedVector<BlockLayout> m_blockLayouts;
+    SwappedVector<BlockCacheDelta> m_blockUndo;
+    std::unique_ptr<TransactionMap> m_transactionMap;
     MultisignatureOutputsContainer m_multisignatureOutputs;
 
-    PaymentIdIndex m_paymentIdIndex;
+    PersistentPaymentIdIndex m_paymentIdIndex;
     TimestampBlocksIndex m_timestampIndex;
     GeneratedTransactionsIndex m_generatedTransactionsIndex;
     OrphanBlocksIndex m_orphanBlocksIndex;
     bool m_blockchainIndexesEnabled;
+    RingSignatureCache m_ringSignatureCache;
+    // decompressed keys of ring members, popular outputs are decoys in many rings
+    Crypto::public_key_cache m_ringMemberKeyCache;
 
     IntrusiveLinkedList<MessageQueue<BlockchainMessage>> m_messageQueueList;
 
     Logging::LoggerRef logger;
 
+    unsigned m_blockBatchDepth;
+    // journal records of batched blocks, written once the blocks are on disk
+    std::vector<BinaryArray> m_pendingJournalRecords;
+    // the block file is behind the chain in memory, guarded by m_blockchain_lock
+    bool m_storageFailed;
+    // the indexes are complete and may be saved, guarded by m_blockchain_lock
+    bool m_blockCacheLoaded;
+    // one snapshot is written at a time, m_blockchain_lock is not held meanwhile
+    std::mutex m_cacheStoreMutex;
+
+    // declared last so a pending compaction finishes before the rest is destroyed
+    BlockCacheJournal m_cacheJournal;
+    std::future<bool> m_cacheCompaction;
+
     bool rebuildCache();
+    bool syncBlockHeaders();
+    static CompactBlockHeader makeBlockHeader(const BlockEntry& block, const Crypto::Hash& blockHash);
+    bool syncBlockLayouts();
+    bool syncBlockUndo();
+    void flushBlockBatch();
+    bool openDiskIndexes();
+    void commitIndexes(bool force);
+    void appendJournalRecords(const std::vector<BinaryArray>& records);
+    static BlockLayout makeBlockLayout(const BlockEntry& block);
+    bool readRawTransaction(TransactionIndex index, std::string& transaction);
+    bool readTransactionEntry(TransactionIndex index, TransactionEntry& transaction);
+    void readTransactionEntries(const std::vector<TransactionIndex>& indexes, std::vector<TransactionEntry>& entries);
     bool loadIndexes(std::string config_folder, bool load_existing);
 
     bool storeCache();
-    bool add_block_as_invalid(const BlockEntry& bei, const Crypto::Hash& h);
+    void scheduleCacheCompaction();
+    BlockCacheDelta makeBlockCacheDelta(const BlockEntry& block, const Crypto::Hash& blockHash, bool removed);
+    void applyBlockCacheDelta(const BlockCacheDelta& delta);
+    void journalBlockCacheDelta(const BlockCacheDelta& delta);
+    bool replayBlockCacheJournal(const std::vector<BinaryArray>& records);
+    bool add_block_as_invalid(const AlternativeBlockEntry& bei, const Crypto::Hash& h);
     bool add_block_as_invalid(const Block& bl, const Crypto::Hash& h);
-    bool switch_to_alternative_blockchain(std::list<blocks_ext_by_hash::iterator>& alt_chain, bool discard_disconnected_chain);
+    void pruneAlternativeBlocks();
+    bool switch_to_alternative_blockchain(std::list<AlternativeBlockStore::iterator>& alt_chain, bool discard_disconnected_chain);
     bool handle_alternative_block(const Block& b, const Crypto::Hash& id, block_verification_context& bvc, bool sendNewAlternativeBlockMessage = true);
-    difficulty_type get_next_difficulty_for_alternative_chain(const std::list<blocks_ext_by_hash::iterator>& alt_chain, BlockEntry& bei);
+    difficulty_type get_next_difficulty_for_alternative_chain(const std::list<AlternativeBlockStore::iterator>& alt_chain, uint32_t height);
     bool prevalidate_miner_transaction(const Block& b, uint32_t height);
     bool validate_miner_transaction(const Block& b, uint32_t height, size_t cumulativeBlockSize, uint64_t alreadyGeneratedCoins, uint64_t fee, uint64_t& reward, int64_t& emissionChange);
     bool rollback_blockchain_switching(std::list<Block>& original_chain, size_t rollback_height);
     bool get_last_n_blocks_sizes(std::vector<size_t>& sz, size_t count);
-    bool add_out_to_get_random_outs(std::vector<std::pair<TransactionIndex, uint16_t>>& amount_outs, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS_outs_for_amount& result_outs, uint64_t amount, size_t i);
+    bool add_out_to_get_random_outs(const std::vector<OutputEntry>& amount_outs, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS_outs_for_amount& result_outs, size_t i, uint32_t height);
+    void pick_random_outs(const std::vector<OutputEntry>& amount_outs, size_t up_index_limit, uint64_t outs_count, uint32_t height, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS_outs_for_amount& result_outs);
     bool is_tx_spendtime_unlocked(uint64_t unlock_time);
-    size_t find_end_of_allowed_index(const std::vector<std::pair<TransactionIndex, uint16_t>>& amount_outs);
+    bool is_tx_spendtime_unlocked(uint64_t unlock_time, uint32_t height);
+    size_t find_end_of_allowed_index(const std::vector<OutputEntry>& amount_outs, uint32_t height);
     bool check_block_timestamp_main(const Block& b);
     bool check_block_timestamp(std::vector<uint64_t> timestamps, const Block& b);
     uint64_t get_adjusted_time();
@@ -304,14 +478,17 @@ namespace CryptoNote {
     std::vector<Crypto::Hash> doBuildSparseChain(const Crypto::Hash& startBlockId) const;
     bool getBlockCumulativeSize(const Block& block, size_t& cumulativeSize);
     bool update_next_comulative_size_limit();
-    bool check_tx_input(const KeyInput& txin, const Crypto::Hash& tx_prefix_hash, const std::vector<Crypto::Signature>& sig, uint32_t* pmax_related_block_height = NULL);
-    bool checkTransactionInputs(const Transaction& tx, const Crypto::Hash& tx_prefix_hash, uint32_t* pmax_used_block_height = NULL);
+    bool check_tx_input(const KeyInput& txin, const Crypto::Hash& tx_prefix_hash, const std::vector<Crypto::Signature>& sig, uint32_t* pmax_related_block_height = NULL, std::vector<RingSignatureCheck>* deferredChecks = NULL);
+    bool checkTransactionInputs(const Transaction& tx, const Crypto::Hash& tx_prefix_hash, uint32_t* pmax_used_block_height = NULL, std::vector<RingSignatureCheck>* deferredChecks = NULL);
+    size_t verifyRingSignatures(const std::vector<RingSignatureCheck>& checks);
     bool checkTransactionInputs(const Transaction& tx, uint32_t* pmax_used_block_height = NULL);
     bool have_tx_keyimg_as_spent(const Crypto::KeyImage &key_im);
-    bool pushBlock(const Block& blockData, block_verification_context& bvc, uint32_t& height);
-    bool pushBlock(const Block& blockData, const std::vector<Transaction>& transactions, block_verification_context& bvc);
-    bool pushBlock(BlockEntry& block);
+    bool pushBlock(const Block& blockData, const Crypto::Hash& blockHash, block_verification_context& bvc, uint32_t& height);
+    bool pushBlock(const Block& blockData, const Crypto::Hash& blockHash, const std::vector<Transaction>& transactions, block_verification_context& bvc);
+    bool pushBlock(BlockEntry& block, const Crypto::Hash& blockHash);
     void popBlock(const Crypto::Hash& blockHash);
+    void pushBlockUndo(BlockCacheDelta& delta);
+    void undoLastBlock(const Crypto::Hash& blockHash);
     bool pushTransaction(BlockEntry& block, const Crypto::Hash& transactionHash, TransactionIndex transactionIndex);
     void popTransaction(const Transaction& transaction, const Crypto::Hash& transactionHash);
     void popTransactions(const BlockEntry& block, const Crypto::Hash& minerTransactionHash);
@@ -326,6 +503,7 @@ namespace CryptoNote {
     void sendMessage(const BlockchainMessage& message);
 
     friend class LockedBlockchainStorage;
+    friend class SharedLockedBlockchainStorage;
   };
 
   class LockedBlockchainStorage: boost::noncopyable {
@@ -341,18 +519,35 @@ namespace CryptoNote {
   private:
 
     Blockchain& m_bc;
-    std::lock_guard<std::recursive_mutex> m_lock;
+    std::lock_guard<BlockchainLock> m_lock;
+  };
+
+  // read only counterpart of LockedBlockchainStorage, several may be held at once
+  class SharedLockedBlockchainStorage: boost::noncopyable {
+  public:
+
+    SharedLockedBlockchainStorage(Blockchain& bc)
+      : m_bc(bc), m_lock(bc) {}
+
+    Blockchain* operator -> () {
+      return &m_bc;
+    }
+
+  private:
+
+    Blockchain& m_bc;
+    Blockchain::ReadLock m_lock;
   };
 
   template<class visitor_t> bool Blockchain::scanOutputKeysForIndexes(const KeyInput& tx_in_to_key, visitor_t& vis, uint32_t* pmax_related_block_height) {
 
-    std::lock_guard<std::recursive_mutex> lk(m_blockchain_lock);
+    ReadLock lk(*this);
     auto it = m_outputs.find(tx_in_to_key.amount);
     if (it == m_outputs.end() || !tx_in_to_key.outputIndexes.size())
       return false;
 
     std::vector<uint32_t> absolute_offsets = relative_output_offsets_to_absolute(tx_in_to_key.outputIndexes);
-    std::vector<std::pair<TransactionIndex, uint16_t>>& amount_outs_vec = it->second;
+    std::vector<OutputEntry>& amount_outs_vec = it->second;
 
     size_t count = 0;
     for (uint64_t i : absolute_offsets) {
@@ -362,25 +557,15 @@ namespace CryptoNote {
         return false;
       }
 
-      const TransactionEntry& tx = transactionByIndex(amount_outs_vec[i].first);
-
-      if (!(amount_outs_vec[i].second < tx.tx.outputs.size())) {
-        logger(Logging::ERROR, Logging::BRIGHT_RED)
-          << "Wrong index in transaction outputs: "
-          << amount_outs_vec[i].second << ", expected less then "
-          << tx.tx.outputs.size();
-        return false;
-      }
-
-      if (!vis.handle_output(tx.tx, tx.tx.outputs[amount_outs_vec[i].second], amount_outs_vec[i].second)) {
+      if (!vis.handle_output(amount_outs_vec[i])) {
         logger(Logging::INFO) << "Failed to handle_output for output no = " << count << 
 	  ", with absolute offset " << i;
         return false;
       }
 
       if (count++ == absolute_offsets.size()-1 && pmax_related_block_height) {
-        if (*pmax_related_block_height < amount_outs_vec[i].first.block) {
-          *pmax_related_block_height = amount_outs_vec[i].first.block;
+        if (*pmax_related_block_height < amount_outs_vec[i].transactionIndex.block) {
+          *pmax_related_block_height = amount_outs_vec[i].transactionIndex.block;
         }
       }
     }
@@ -17,6 +17,9 @@
 
 #include "BlockchainIndices.h"
 
+#include <algorithm>
+#include <cstring>
+
 #include "Common/StringTools.h"
 #include "CryptoNoteCore/CryptoNoteTools.h"
 #include "CryptoNoteCore/CryptoNoteFormatUtils.h"
@@ -27,6 +30,14 @@ namespace CryptoNote {
 
 namespace {
   const size_t DEFAULT_BUCKET_COUNT = 5;
+
+  bool timestampLess(uint64_t timestamp, const std::pair<uint64_t, Crypto::Hash>& entry) {
+    return timestamp < entry.first;
+  }
+
+  bool entryLess(const std::pair<uint64_t, Crypto::Hash>& entry, uint64_t timestamp) {
+    return entry.first < timestamp;
+  }
 }
 
 PaymentIdIndex::PaymentIdIndex(bool _enabled) : index(DEFAULT_BUCKET_COUNT, paymentIdHash), enabled(_enabled) {
@@ -112,15 +123,119 @@ void PaymentIdIndex::serialize(ISerializer& s) {
   s(index, "index");
 }
 
+PersistentPaymentIdIndex::PersistentPaymentIdIndex(bool _enabled) : enabled(_enabled) {
+}
+
+bool PersistentPaymentIdIndex::open(const std::string& fileName) {
+  if (!enabled) {
+    return true;
+  }
+
+  // records carry no value, the transaction hash is part of the key
+  if (index.open(fileName, sizeof(Record), 0)) {
+    return true;
+  }
+
+  try {
+    index.clear();
+  } catch (std::exception&) {
+    return false;
+  }
+
+  return true;
+}
+
+bool PersistentPaymentIdIndex::makeRecord(const Transaction& transaction, Record& record) {
+  if (!BlockchainExplorerDataBuilder::getPaymentId(transaction, record.paymentId)) {
+    return false;
+  }
+
+  record.transactionHash = getObjectHash(transaction);
+  return true;
+}
+
+bool PersistentPaymentIdIndex::add(const Transaction& transaction) {
+  if (!enabled) {
+    return false;
+  }
+
+  Record record;
+  if (!makeRecord(transaction, record)) {
+    return false;
+  }
+
+  index.insertNew(&record, &record);
+  return true;
+}
+
+bool PersistentPaymentIdIndex::remove(const Transaction& transaction) {
+  if (!enabled) {
+    return false;
+  }
+
+  Record record;
+  if (!makeRecord(transaction, record)) {
+    return false;
+  }
+
+  return index.erase(&record);
+}
+
+bool PersistentPaymentIdIndex::find(const Crypto::Hash& paymentId, std::vector<Crypto::Hash>& transactionHashes) {
+  if (!enabled) {
+    throw std::runtime_error("Payment id index disabled.");
+  }
+
+  std::vector<uint8_t> records;
+  if (index.findByPrefix(&paymentId, sizeof paymentId, records) == 0) {
+    return false;
+  }
+
+  for (size_t offset = 0; offset < records.size(); offset += sizeof(Record)) {
+    Record record;
+    memcpy(&record, records.data() + offset, sizeof record);
+    transactionHashes.emplace_back(record.transactionHash);
+  }
+
+  return true;
+}
+
+std::vector<Crypto::Hash> PersistentPaymentIdIndex::find(const Crypto::Hash& paymentId) {
+  std::vector<Crypto::Hash> transactionHashes;
+  find(paymentId, transactionHashes);
+  return transactionHashes;
+}
+
+void PersistentPaymentIdIndex::clear() {
+  if (enabled) {
+    index.clear();
+  }
+}
+
+Crypto::Hash PersistentPaymentIdIndex::committedTag() {
+  return enabled ? index.committedTag() : NULL_HASH;
+}
+
+uint64_t PersistentPaymentIdIndex::uncommittedSize() {
+  return enabled ? index.uncommittedSize() : 0;
+}
+
+void PersistentPaymentIdIndex::commit(const Crypto::Hash& tag) {
+  if (enabled) {
+    index.commit(tag);
+  }
+}
+
 TimestampBlocksIndex::TimestampBlocksIndex(bool _enabled) : enabled(_enabled) {
 }
 
+// timestamps mostly grow with the height, so entries go in at or near the end
 bool TimestampBlocksIndex::add(uint64_t timestamp, const Crypto::Hash& hash) {
   if (!enabled) {
     return false;
   }
 
-  index.emplace(timestamp, hash);
+  index.insert(std::upper_bound(index.begin(), index.end(), timestamp, timestampLess), Entry(timestamp, hash));
   return true;
 }
 
@@ -129,8 +244,7 @@ bool TimestampBlocksIndex::remove(uint64_t timestamp, const Crypto::Hash& hash)
     return false;
   }
 
-  auto range = index.equal_range(timestamp);
-  for (auto iter = range.first; iter != range.second; ++iter) {
+  for (auto iter = std::lower_bound(index.begin(), index.end(), timestamp, entryLess); iter != index.end() && iter->first == timestamp; ++iter) {
     if (iter->second == hash) {
       index.erase(iter);
       return true;
@@ -150,8 +264,8 @@ bool TimestampBlocksIndex::find(uint64_t timestampBegin, uint64_t timestampEnd,
     //std::swap(timestampBegin, timestampEnd);
     return false;
   }
-  auto begin = index.lower_bound(timestampBegin);
-  auto end = index.upper_bound(timestampEnd);
+  auto begin = std::lower_bound(index.begin(), index.end(), timestampBegin, entryLess);
+  auto end = std::upper_bound(begin, index.end(), timestampEnd, timestampLess);
 
   hashesNumberWithinTimestamps = static_cast<uint32_t>(std::distance(begin, end));
 
@@ -168,14 +282,6 @@ void TimestampBlocksIndex::clear() {
   }
 }
 
-void TimestampBlocksIndex::serialize(ISerializer& s) {
-  if (!enabled) {
-    throw std::runtime_error("Timestamp block index disabled.");
-  }
-
-  s(index, "index");
-}
-
 TimestampTransactionsIndex::TimestampTransactionsIndex(bool _enabled) : enabled(_enabled) {
 }
 
@@ -240,7 +346,55 @@ void TimestampTransactionsIndex::serialize(ISerializer& s) {
   s(index, "index");
 }
 
-GeneratedTransactionsIndex::GeneratedTransactionsIndex(bool _enabled) : lastGeneratedTxNumber(0), enabled(_enabled) {
+GeneratedTransactionsIndex::GeneratedTransactionsIndex(bool _enabled) : enabled(_enabled) {
+}
+
+bool GeneratedTransactionsIndex::open(const std::string& fileName) {
+  if (!enabled) {
+    return true;
+  }
+
+  index.clear();
+  unchanged = 0;
+  file.open(fileName, std::ios::in | std::ios::out | std::ios::binary);
+  if (!file) {
+    file.clear();
+    file.open(fileName, std::ios::out | std::ios::binary);
+    file.close();
+    file.open(fileName, std::ios::in | std::ios::out | std::ios::binary);
+    if (!file) {
+      return false;
+    }
+
+    writeCount();
+    return static_cast<bool>(file);
+  }
+
+  uint64_t count = 0;
+  file.read(reinterpret_cast<char*>(&count), sizeof count);
+  if (!file) {
+    // empty or truncated header, start over
+    file.clear();
+    writeCount();
+    return static_cast<bool>(file);
+  }
+
+  file.seekg(0, std::ios::end);
+  uint64_t available = (static_cast<uint64_t>(file.tellg()) - sizeof count) / sizeof(uint64_t);
+  index.resize(std::min(count, available));
+  file.seekg(sizeof count);
+  if (!index.empty()) {
+    file.read(reinterpret_cast<char*>(index.data()), index.size() * sizeof(uint64_t));
+  }
+
+  if (!file) {
+    file.clear();
+    index.clear();
+  }
+
+  unchanged = index.size();
+  writeCount();
+  return static_cast<bool>(file);
 }
 
 bool GeneratedTransactionsIndex::add(const Block& block) {
@@ -249,16 +403,16 @@ bool GeneratedTransactionsIndex::add(const Block& block) {
   }
 
   uint32_t blockHeight = boost::get<BaseInput>(block.baseTransaction.inputs.front()).blockIndex;
+  return add(blockHeight, block.transactionHashes.size() + 1); //Plus miner tx
+}
 
-  if (index.size() != blockHeight) {
+bool GeneratedTransactionsIndex::add(uint32_t height, uint64_t transactionCount) {
+  if (!enabled || height != index.size()) {
     return false;
-  } 
-
-  bool status = index.emplace(blockHeight, lastGeneratedTxNumber + block.transactionHashes.size() + 1).second; //Plus miner tx
-  if (status) {
-    lastGeneratedTxNumber += block.transactionHashes.size() + 1;
   }
-  return status;
+
+  index.push_back((index.empty() ? 0 : index.back()) + transactionCount);
+  return true;
 }
 
 bool GeneratedTransactionsIndex::remove(const Block& block) {
@@ -266,24 +420,16 @@ bool GeneratedTransactionsIndex::remove(const Block& block) {
     return false;
   }
 
-  uint32_t blockHeight = boost::get<BaseInput>(block.baseTransaction.inputs.front()).blockIndex;
+  return remove(boost::get<BaseInput>(block.baseTransaction.inputs.front()).blockIndex);
+}
 
-  if (blockHeight != index.size() - 1) {
+bool GeneratedTransactionsIndex::remove(uint32_t height) {
+  if (!enabled || index.empty() || height != index.size() - 1) {
     return false;
   }
 
-  auto iter = index.find(blockHeight);
-  assert(iter != index.end());
-  index.erase(iter);
-
-  if (blockHeight != 0) {
-    iter = index.find(blockHeight - 1);
-    assert(iter != index.end());
-    lastGeneratedTxNumber = iter->second;
-  } else {
-    lastGeneratedTxNumber = 0;
-  }
-  
+  index.pop_back();
+  unchanged = std::min(unchanged, index.size());
   return true;
 }
 
@@ -292,30 +438,63 @@ bool GeneratedTransactionsIndex::find(uint32_t height, uint64_t& generatedTransa
     throw std::runtime_error("Generated transactions index disabled.");
   }
 
-  if (height > std::numeric_limits<uint32_t>::max()) {
-    return false;
-  }
-  auto iter = index.find(height);
-  if (iter == index.end()) {
+  if (height >= index.size()) {
     return false;
   }
-  generatedTransactions = iter->second;
+
+  generatedTransactions = index[height];
   return true;
 }
 
+uint32_t GeneratedTransactionsIndex::size() const {
+  return static_cast<uint32_t>(index.size());
+}
+
 void GeneratedTransactionsIndex::clear() {
   if (enabled) {
     index.clear();
+    unchanged = 0;
   }
 }
 
-void GeneratedTransactionsIndex::serialize(ISerializer& s) {
-  if (!enabled) {
-    throw std::runtime_error("Generated transactions index disabled.");
+uint64_t GeneratedTransactionsIndex::uncommittedSize() const {
+  if (!enabled || !file.is_open()) {
+    return 0;
   }
 
-  s(index, "index");
-  s(lastGeneratedTxNumber, "lastGeneratedTxNumber");
+  return (index.size() - unchanged) * sizeof(uint64_t) + (storedCount != index.size() ? sizeof storedCount : 0);
+}
+
+// The values go before the count, so a crash in between leaves a count that
+// only covers values already written. An index that was never opened stays
+// in memory.
+void GeneratedTransactionsIndex::commit() {
+  if (uncommittedSize() == 0) {
+    return;
+  }
+
+  if (unchanged < index.size()) {
+    file.seekp(sizeof(uint64_t) + unchanged * sizeof(uint64_t));
+    file.write(reinterpret_cast<const char*>(index.data() + unchanged), (index.size() - unchanged) * sizeof(uint64_t));
+    if (!file) {
+      throw std::runtime_error("GeneratedTransactionsIndex::commit: could not write to generated transactions file");
+    }
+  }
+
+  writeCount();
+  unchanged = index.size();
+}
+
+void GeneratedTransactionsIndex::writeCount() {
+  uint64_t count = index.size();
+  file.seekp(0);
+  file.write(reinterpret_cast<const char*>(&count), sizeof count);
+  file.flush();
+  if (!file) {
+    throw std::runtime_error("GeneratedTransactionsIndex: could not write count to generated transactions file");
+  }
+
+  storedCount = count;
 }
 
 OrphanBlocksIndex::OrphanBlocksIndex(bool _enabled) : enabled(_enabled) {
@@ -337,8 +516,14 @@ bool OrphanBlocksIndex::remove(const Block& block) {
     return false;
   }
 
-  Crypto::Hash blockHash = get_block_hash(block);
-  uint32_t blockHeight = boost::get<BaseInput>(block.baseTransaction.inputs.front()).blockIndex;
+  return remove(get_block_hash(block), boost::get<BaseInput>(block.baseTransaction.inputs.front()).blockIndex);
+}
+
+bool OrphanBlocksIndex::remove(const Crypto::Hash& blockHash, uint32_t blockHeight) {
+  if (!enabled) {
+    return false;
+  }
+
   auto range = index.equal_range(blockHeight);
   for (auto iter = range.first; iter != range.second; ++iter) {
     if (iter->second == blockHash) {
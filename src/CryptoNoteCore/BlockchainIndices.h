@@ -18,12 +18,15 @@
 #pragma once
 
 #include <boost/functional/hash.hpp>
+#include <fstream>
 #include <map>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "crypto/hash.h"
 #include "CryptoNoteBasic.h"
+#include "CryptoNoteCore/DiskHashTable.h"
 
 namespace CryptoNote {
 
@@ -54,6 +57,42 @@ private:
   bool enabled = false;
 };
 
+// Transactions by payment id, kept on disk. A record is the payment id
+// followed by the transaction hash, so all transactions with one payment id
+// share a bucket and are read from the same pages. A transaction is added
+// once, so records are inserted without looking for a duplicate in what can
+// be a long chain for a popular payment id. Changes are held in memory until
+// commit(), which is tagged with the chain tip they belong to.
+class PersistentPaymentIdIndex {
+public:
+  PersistentPaymentIdIndex(bool enabled);
+
+  // an unusable file is started over, false if that fails too
+  bool open(const std::string& fileName);
+  bool add(const Transaction& transaction);
+  bool remove(const Transaction& transaction);
+  bool find(const Crypto::Hash& paymentId, std::vector<Crypto::Hash>& transactionHashes);
+  std::vector<Crypto::Hash> find(const Crypto::Hash& paymentId);
+  void clear();
+
+  Crypto::Hash committedTag();
+  uint64_t uncommittedSize();
+  void commit(const Crypto::Hash& tag);
+
+private:
+  struct Record {
+    Crypto::Hash paymentId;
+    Crypto::Hash transactionHash;
+  };
+
+  bool makeRecord(const Transaction& transaction, Record& record);
+
+  DiskHashTable index;
+  bool enabled = false;
+};
+
+// Block hashes sorted by timestamp in a flat array. It is filled from the
+// block headers on start, so it is never stored on its own.
 class TimestampBlocksIndex {
 public:
   TimestampBlocksIndex(bool enabled);
@@ -63,14 +102,10 @@ public:
   bool find(uint64_t timestampBegin, uint64_t timestampEnd, uint32_t hashesNumberLimit, std::vector<Crypto::Hash>& hashes, uint32_t& hashesNumberWithinTimestamps);
   void clear();
 
-  void serialize(ISerializer& s);
-
-  template<class Archive> 
-  void serialize(Archive& archive, unsigned int version) {
-    archive & index;
-  }
 private:
-  std::multimap<uint64_t, Crypto::Hash> index;
+  typedef std::pair<uint64_t, Crypto::Hash> Entry;
+
+  std::vector<Entry> index;
   bool enabled = false;
 };
 
@@ -94,25 +129,34 @@ private:
   bool enabled = false;
 };
 
+// Number of transactions up to and including each height, a dense array
+// stored the same way as the block headers: a uint64_t count followed by
+// the values. Changes are kept in memory until commit(), which writes the
+// new values and then the count.
 class GeneratedTransactionsIndex {
 public:
   GeneratedTransactionsIndex(bool enabled);
 
+  bool open(const std::string& fileName);
   bool add(const Block& block);
+  bool add(uint32_t height, uint64_t transactionCount);
   bool remove(const Block& block);
+  bool remove(uint32_t height);
   bool find(uint32_t height, uint64_t& generatedTransactions);
+  uint32_t size() const;
   void clear();
 
-  void serialize(ISerializer& s);
+  uint64_t uncommittedSize() const;
+  void commit();
 
-  template<class Archive> 
-  void serialize(Archive& archive, unsigned int version) {
-    archive & index;
-    archive & lastGeneratedTxNumber;
-  }
 private:
-  std::unordered_map<uint32_t, uint64_t> index;
-  uint64_t lastGeneratedTxNumber;
+  void writeCount();
+
+  std::fstream file;
+  std::vector<uint64_t> index;
+  // leading values that match the file, and the count stored in it
+  size_t unchanged = 0;
+  uint64_t storedCount = 0;
   bool enabled = false;
 };
 
@@ -122,6 +166,7 @@ public:
 
   bool add(const Block& block);
   bool remove(const Block& block);
+  bool remove(const Crypto::Hash& blockHash, uint32_t blockHeight);
   bool find(uint32_t height, std::vector<Crypto::Hash>& blockHashes);
   void clear();
 private:
@@ -0,0 +1,114 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "BlockchainLock.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace CryptoNote {
+
+BlockchainLock::BlockchainLock() : m_writerDepth(0), m_waitingWriters(0), m_waitingReaders(0), m_statistics() {
+}
+
+void BlockchainLock::lock() {
+  std::thread::id self = std::this_thread::get_id();
+  std::unique_lock<std::mutex> lk(m_mutex);
+  if (m_writerDepth > 0 && m_writer == self) {
+    ++m_writerDepth;
+    return;
+  }
+
+  // upgrading would deadlock against another upgrading reader
+  assert(m_readers.find(self) == m_readers.end());
+
+  Clock::time_point start = Clock::now();
+  ++m_waitingWriters;
+  m_condition.wait(lk, [this] { return m_writerDepth == 0 && m_readers.empty(); });
+  --m_waitingWriters;
+
+  m_writer = self;
+  m_writerDepth = 1;
+  m_writerSince = Clock::now();
+  ++m_statistics.exclusiveCount;
+  m_statistics.exclusiveWaitMicroseconds += microseconds(m_writerSince - start);
+}
+
+void BlockchainLock::unlock() {
+  std::lock_guard<std::mutex> lk(m_mutex);
+  assert(m_writerDepth > 0 && m_writer == std::this_thread::get_id());
+  if (--m_writerDepth > 0) {
+    return;
+  }
+
+  uint64_t held = microseconds(Clock::now() - m_writerSince);
+  m_statistics.exclusiveHoldMicroseconds += held;
+  m_statistics.exclusiveMaxHoldMicroseconds = std::max(m_statistics.exclusiveMaxHoldMicroseconds, held);
+  m_writer = std::thread::id();
+  m_condition.notify_all();
+}
+
+void BlockchainLock::lock_shared() {
+  std::thread::id self = std::this_thread::get_id();
+  std::unique_lock<std::mutex> lk(m_mutex);
+  if (m_writerDepth > 0 && m_writer == self) {
+    // the writer already excludes everyone else
+    ++m_writerDepth;
+    return;
+  }
+
+  auto reader = m_readers.find(self);
+  if (reader != m_readers.end()) {
+    ++reader->second.depth;
+    return;
+  }
+
+  Clock::time_point start = Clock::now();
+  ++m_waitingReaders;
+  m_condition.wait(lk, [this] { return m_writerDepth == 0 && m_waitingWriters == 0; });
+  --m_waitingReaders;
+
+  ReaderState state = { 1, Clock::now() };
+  m_readers.insert(std::make_pair(self, state));
+  ++m_statistics.sharedCount;
+  m_statistics.sharedWaitMicroseconds += microseconds(state.since - start);
+}
+
+void BlockchainLock::unlock_shared() {
+  std::thread::id self = std::this_thread::get_id();
+  std::lock_guard<std::mutex> lk(m_mutex);
+  if (m_writerDepth > 0 && m_writer == self) {
+    --m_writerDepth;
+    assert(m_writerDepth > 0);
+    return;
+  }
+
+  auto reader = m_readers.find(self);
+  assert(reader != m_readers.end());
+  if (--reader->second.depth > 0) {
+    return;
+  }
+
+  uint64_t held = microseconds(Clock::now() - reader->second.since);
+  m_statistics.sharedHoldMicroseconds += held;
+  m_statistics.sharedMaxHoldMicroseconds = std::max(m_statistics.sharedMaxHoldMicroseconds, held);
+  m_readers.erase(reader);
+  if (m_readers.empty()) {
+    m_condition.notify_all();
+  }
+}
+
+BlockchainLock::Statistics BlockchainLock::getStatistics() {
+  std::lock_guard<std::mutex> lk(m_mutex);
+  Statistics statistics = m_statistics;
+  statistics.exclusiveWaiting = m_waitingWriters;
+  statistics.sharedWaiting = m_waitingReaders;
+  return statistics;
+}
+
+uint64_t BlockchainLock::microseconds(Clock::duration duration) {
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+}
+
+}
@@ -0,0 +1,85 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace CryptoNote
+{
+  // Reader/writer lock for the blockchain storage. Both modes are recursive,
+  // and a thread holding the exclusive lock may also take the shared one.
+  // Going from shared to exclusive is not supported, a reader must not call
+  // into anything that modifies the chain. Waiting writers block new readers,
+  // so a steady stream of RPC reads can not starve block acceptance.
+  class BlockchainLock {
+
+  public:
+    struct Statistics {
+      uint64_t exclusiveCount;
+      uint64_t exclusiveWaitMicroseconds;
+      uint64_t exclusiveHoldMicroseconds;
+      uint64_t exclusiveMaxHoldMicroseconds;
+      uint64_t sharedCount;
+      uint64_t sharedWaitMicroseconds;
+      uint64_t sharedHoldMicroseconds;
+      uint64_t sharedMaxHoldMicroseconds;
+      // threads blocked in lock and lock_shared right now
+      uint32_t exclusiveWaiting;
+      uint32_t sharedWaiting;
+    };
+
+    BlockchainLock();
+
+    void lock();
+    void unlock();
+    void lock_shared();
+    void unlock_shared();
+
+    Statistics getStatistics();
+
+  private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct ReaderState {
+      unsigned depth;
+      Clock::time_point since;
+    };
+
+    static uint64_t microseconds(Clock::duration duration);
+
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    std::thread::id m_writer;
+    unsigned m_writerDepth;
+    Clock::time_point m_writerSince;
+    unsigned m_waitingWriters;
+    unsigned m_waitingReaders;
+    std::unordered_map<std::thread::id, ReaderState> m_readers;
+    Statistics m_statistics;
+  };
+
+  // lock_guard counterpart for the shared mode
+  template<class Lockable> class SharedLockGuard {
+  public:
+    explicit SharedLockGuard(Lockable& lockable) : m_lockable(lockable) {
+      m_lockable.lock_shared();
+    }
+
+    ~SharedLockGuard() {
+      m_lockable.unlock_shared();
+    }
+
+    SharedLockGuard(const SharedLockGuard&) = delete;
+    SharedLockGuard& operator=(const SharedLockGuard&) = delete;
+
+  private:
+    Lockable& m_lockable;
+  };
+}
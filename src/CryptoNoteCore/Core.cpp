@@ -131,6 +131,8 @@ bool core::init(const CoreConfig& config, const MinerConfig& minerConfig, bool l
   if (!(r)) { logger(ERROR, BRIGHT_RED) << "Failed to initialize memory pool"; return false; }
 
   //logger(INFO) << "Initialize block chain...";
+  m_blockchain.setBlockCacheSize(config.blockCacheSize);
+  m_blockchain.setDiskIndexes(config.diskIndexes);
   r = m_blockchain.init(m_config_folder, load_existing);
   if (!(r)) { logger(ERROR, BRIGHT_RED) << "Failed to initialize blockchain storage"; return false; }
 
@@ -556,6 +558,14 @@ void core::print_blockchain_outs(const std::string& file) {
   m_blockchain.print_blockchain_outs(file);
 }
 
+void core::print_blockchain_lock_statistics() {
+  m_blockchain.print_lock_statistics();
+}
+
+void core::print_blockchain_cache_statistics() {
+  m_blockchain.print_cache_statistics();
+}
+
 bool core::get_random_outs_for_amounts(const COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::request& req, COMMAND_RPC_GET_RANDOM_OUTPUTS_FOR_AMOUNTS::response& res) {
   return m_blockchain.getRandomOutsByAmount(req, res);
 }
@@ -577,6 +587,18 @@ void core::update_block_template_and_resume_mining() {
   m_miner->resume();
 }
 
+void core::begin_block_batch() {
+  m_blockchain.beginBlockBatch();
+}
+
+bool core::end_block_batch() {
+  return m_blockchain.endBlockBatch();
+}
+
+void core::precompute_proof_of_work(const std::vector<Block>& blocks) {
+  m_blockchain.precomputeProofOfWork(blocks);
+}
+
 bool core::handle_block_found(Block& b) {
   block_verification_context bvc = boost::value_initialized<block_verification_context>();
   handle_incoming_block(b, bvc, true, true);
@@ -728,7 +750,7 @@ std::vector<Crypto::Hash> core::buildSparseChain() {
 }
 
 std::vector<Crypto::Hash> core::buildSparseChain(const Crypto::Hash& startBlockId) {
-  LockedBlockchainStorage lbs(m_blockchain);
+  SharedLockedBlockchainStorage lbs(m_blockchain);
   assert(m_blockchain.haveBlock(startBlockId));
   return m_blockchain.buildSparseChain(startBlockId);
 }
@@ -738,7 +760,7 @@ bool core::handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS::request& arg, NOTIFY_R
 }
 
 Crypto::Hash core::getBlockIdByHeight(uint32_t height) {
-  LockedBlockchainStorage lbs(m_blockchain);
+  SharedLockedBlockchainStorage lbs(m_blockchain);
 
   if (height < m_blockchain.getCurrentBlockchainHeight()) {
     return m_blockchain.getBlockIdByHeight(height);
@@ -802,7 +824,7 @@ void core::poolUpdated() {
 bool core::queryBlocks(const std::vector<Crypto::Hash>& knownBlockIds, uint64_t timestamp,
   uint32_t& resStartHeight, uint32_t& resCurrentHeight, uint32_t& resFullOffset, std::vector<BlockFullInfo>& entries) {
 
-  LockedBlockchainStorage lbs(m_blockchain);
+  SharedLockedBlockchainStorage lbs(m_blockchain);
 
   uint32_t currentHeight = lbs->getCurrentBlockchainHeight();
   uint32_t startOffset = 0;
@@ -830,36 +852,32 @@ bool core::queryBlocks(const std::vector<Crypto::Hash>& knownBlockIds, uint64_t
     return true;
   }
 
-  std::list<Block> blocks;
-  lbs->getBlocks(startFullOffset, blocksLeft, blocks);
+  // block ids come from the index instead of hashing every block again, and
+  // blocks newer than the timestamp are sent as stored without decoding them
+  std::vector<Crypto::Hash> fullBlockIds = lbs->getBlockIds(startFullOffset, blocksLeft);
+  uint32_t height = startFullOffset;
 
-  for (auto& b : blocks) {
+  for (const auto& id : fullBlockIds) {
     BlockFullInfo item;
 
-    item.block_id = get_block_hash(b);
-
-    if (b.timestamp >= timestamp) {
-      // query transactions
-      std::list<Transaction> txs;
-      std::list<Crypto::Hash> missedTxs;
-      lbs->getTransactions(b.transactionHashes, txs, missedTxs);
+    item.block_id = id;
 
-      // fill data
+    if (lbs->getBlockTimestamp(height) >= timestamp) {
       block_complete_entry& completeEntry = item;
-      completeEntry.block = asString(toBinaryArray(b));
-      for (auto& tx : txs) {
-        completeEntry.txs.push_back(asString(toBinaryArray(tx)));
+      if (!lbs->getRawBlock(height, completeEntry)) {
+        return false;
       }
     }
 
     entries.push_back(std::move(item));
+    ++height;
   }
 
   return true;
 }
 
 bool core::findStartAndFullOffsets(const std::vector<Crypto::Hash>& knownBlockIds, uint64_t timestamp, uint32_t& startOffset, uint32_t& startFullOffset) {
-  LockedBlockchainStorage lbs(m_blockchain);
+  SharedLockedBlockchainStorage lbs(m_blockchain);
 
   if (knownBlockIds.empty()) {
     logger(ERROR, BRIGHT_RED) << "knownBlockIds is empty";
@@ -882,7 +900,7 @@ bool core::findStartAndFullOffsets(const std::vector<Crypto::Hash>& knownBlockId
 std::vector<Crypto::Hash> core::findIdsForShortBlocks(uint32_t startOffset, uint32_t startFullOffset) {
   assert(startOffset <= startFullOffset);
 
-  LockedBlockchainStorage lbs(m_blockchain);
+  SharedLockedBlockchainStorage lbs(m_blockchain);
 
   std::vector<Crypto::Hash> result;
   if (startOffset < startFullOffset) {
@@ -894,7 +912,7 @@ std::vector<Crypto::Hash> core::findIdsForShortBlocks(uint32_t startOffset, uint
 
 bool core::queryBlocksLite(const std::vector<Crypto::Hash>& knownBlockIds, uint64_t timestamp, uint32_t& resStartHeight,
   uint32_t& resCurrentHeight, uint32_t& resFullOffset, std::vector<BlockShortInfo>& entries) {
-  LockedBlockchainStorage lbs(m_blockchain);
+  SharedLockedBlockchainStorage lbs(m_blockchain);
 
   resCurrentHeight = lbs->getCurrentBlockchainHeight();
   resStartHeight = 0;
@@ -920,11 +938,13 @@ bool core::queryBlocksLite(const std::vector<Crypto::Hash>& knownBlockIds, uint6
 
   std::list<Block> blocks;
   lbs->getBlocks(resFullOffset, blocksLeft, blocks);
+  std::vector<Crypto::Hash> fullBlockIds = lbs->getBlockIds(resFullOffset, static_cast<uint32_t>(blocks.size()));
+  auto fullBlockId = fullBlockIds.begin();
 
   for (auto& b : blocks) {
     BlockShortInfo item;
 
-    item.blockId = get_block_hash(b);
+    item.blockId = *fullBlockId++;
 
     if (b.timestamp >= timestamp) {
       std::list<Transaction> txs;
@@ -933,10 +953,13 @@ bool core::queryBlocksLite(const std::vector<Crypto::Hash>& knownBlockIds, uint6
 
       item.block = asString(toBinaryArray(b));
 
+      // transactions of a main chain block are all found, in block order
+      bool blockOrder = txs.size() == b.transactionHashes.size();
+      size_t txIndex = 0;
       for (const auto& tx: txs) {
         TransactionPrefixInfo info;
         info.txPrefix = tx;
-        info.txHash = getObjectHash(tx);
+        info.txHash = blockOrder ? b.transactionHashes[txIndex++] : getObjectHash(tx);
 
         item.txPrefixes.push_back(std::move(info));
       }
@@ -969,15 +992,16 @@ bool core::scanOutputkeysForIndices(const KeyInput& txInToKey, std::list<std::pa
   struct outputs_visitor
   {
     std::list<std::pair<Crypto::Hash, size_t>>& m_resultsCollector;
-    outputs_visitor(std::list<std::pair<Crypto::Hash, size_t>>& resultsCollector):m_resultsCollector(resultsCollector){}
-    bool handle_output(const Transaction& tx, const TransactionOutput& out, size_t transactionOutputIndex)
+    Blockchain& m_blockchain;
+    outputs_visitor(std::list<std::pair<Crypto::Hash, size_t>>& resultsCollector, Blockchain& blockchain):m_resultsCollector(resultsCollector), m_blockchain(blockchain){}
+    bool handle_output(const Blockchain::OutputEntry& output)
     {
-      m_resultsCollector.push_back(std::make_pair(getObjectHash(tx), transactionOutputIndex));
+      m_resultsCollector.push_back(std::make_pair(m_blockchain.transactionHashByIndex(output.transactionIndex), output.outputIndex));
       return true;
     }
   };
     
-  outputs_visitor vi(outputReferences);
+  outputs_visitor vi(outputReferences, m_blockchain);
     
   return m_blockchain.scanOutputKeysForIndexes(txInToKey, vi);
 }
@@ -1211,7 +1235,7 @@ bool core::handleIncomingTransaction(const Transaction& tx, const Crypto::Hash&
 
 std::unique_ptr<IBlock> core::getBlock(const Crypto::Hash& blockId) {
   std::lock_guard<decltype(m_mempool)> lk(m_mempool);
-  LockedBlockchainStorage lbs(m_blockchain);
+  SharedLockedBlockchainStorage lbs(m_blockchain);
 
   std::unique_ptr<BlockWithTransactions> blockPtr(new BlockWithTransactions());
   if (!lbs->getBlockByHash(blockId, blockPtr->block)) {
@@ -6,11 +6,19 @@
 
 #include "Common/Util.h"
 #include "Common/CommandLine.h"
+#include "CryptoNoteConfig.h"
 
 namespace CryptoNote {
 
+namespace {
+const command_line::arg_descriptor<uint64_t> arg_block_cache_size = {"block-cache-size", "Memory for decoded blocks kept in memory, in megabytes", BLOCK_CACHE_DEFAULT_SIZE, true};
+const command_line::arg_descriptor<bool> arg_disk_indexes = {"disk-indexes", "Keep the transaction and spent key image indexes on disk instead of in memory"};
+}
+
 CoreConfig::CoreConfig() {
   configFolder = Tools::getDefaultDataDirectory();
+  blockCacheSize = BLOCK_CACHE_DEFAULT_SIZE * 1024 * 1024;
+  diskIndexes = false;
 }
 
 void CoreConfig::init(const boost::program_options::variables_map& options) {
@@ -18,8 +26,18 @@ void CoreConfig::init(const boost::program_options::variables_map& options) {
     configFolder = command_line::get_arg(options, command_line::arg_data_dir);
     configFolderDefaulted = options[command_line::arg_data_dir.name].defaulted();
   }
+
+  if (command_line::has_arg(options, arg_block_cache_size)) {
+    blockCacheSize = command_line::get_arg(options, arg_block_cache_size) * 1024 * 1024;
+  }
+
+  if (command_line::has_arg(options, arg_disk_indexes)) {
+    diskIndexes = true;
+  }
 }
 
 void CoreConfig::initOptions(boost::program_options::options_description& desc) {
+  command_line::add_arg(desc, arg_block_cache_size);
+  command_line::add_arg(desc, arg_disk_indexes);
 }
 } //namespace CryptoNote
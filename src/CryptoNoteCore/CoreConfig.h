@@ -19,6 +19,9 @@ public:
 
   std::string configFolder;
   bool configFolderDefaulted = true;
+  // bytes
+  uint64_t blockCacheSize;
+  bool diskIndexes;
 };
 
 } //namespace CryptoNote
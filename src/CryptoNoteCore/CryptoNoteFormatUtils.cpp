@@ -505,6 +505,29 @@ bool get_block_longhash(cn_context &context, const Block& b, Hash& res, uint32_t
   return true;
 }
 
+bool get_block_longhashes(cn_context *const *contexts, const Block* blocks, Hash* res, uint32_t* extrahashIDs, size_t count) {
+  assert(count <= SLOW_HASH_MAX_WAYS);
+  BinaryArray bd[SLOW_HASH_MAX_WAYS];
+  const void* data[SLOW_HASH_MAX_WAYS];
+  size_t lengths[SLOW_HASH_MAX_WAYS];
+  for (size_t i = 0; i < count; ++i) {
+    if (blocks[i].majorVersion != blocks[0].majorVersion || !get_block_hashing_blob(blocks[i], bd[i])) {
+      return false;
+    }
+
+    data[i] = bd[i].data();
+    lengths[i] = bd[i].size();
+  }
+
+  // read before hashing, as get_block_longhash does
+  for (size_t i = 0; i < count; ++i) {
+    extrahashIDs[i] = extrahashPos(contexts[i]->data);
+  }
+
+  cn_slow_hash_multi(blocks[0].majorVersion, contexts, data, lengths, res, count);
+  return true;
+}
+
 std::vector<uint32_t> relative_output_offsets_to_absolute(const std::vector<uint32_t>& off) {
   std::vector<uint32_t> res = off;
   for (size_t i = 1; i < res.size(); i++)
@@ -67,6 +67,8 @@ bool get_aux_block_header_hash(const Block& b, Crypto::Hash& res);
 bool get_block_hash(const Block& b, Crypto::Hash& res);
 Crypto::Hash get_block_hash(const Block& b);
 bool get_block_longhash(Crypto::cn_context &context, const Block& b, Crypto::Hash& res, uint32_t &extrahashID);
+// long hashes of up to Crypto::SLOW_HASH_MAX_WAYS blocks of one major version, computed together
+bool get_block_longhashes(Crypto::cn_context *const *contexts, const Block* blocks, Crypto::Hash* res, uint32_t* extrahashIDs, size_t count);
 bool get_inputs_money_amount(const Transaction& tx, uint64_t& money);
 uint64_t get_outs_money_amount(const Transaction& tx);
 bool check_inputs_types_supported(const TransactionPrefix& tx);
@@ -18,6 +18,8 @@
 
 #undef ERROR
 
+#define PROOF_OF_WORK_CACHE_SIZE 4096
+
 using namespace Logging;
 using namespace Common;
 
@@ -46,6 +48,12 @@ const std::vector<uint64_t> Currency::PRETTY_AMOUNTS = {
   10000000000000000000ull
 };
 
+// the cache exists from the start, blocks may be hashed before init
+Currency::Currency(Logging::ILogger& log) :
+  m_proofOfWorkCache(std::make_shared<ProofOfWorkCache>(PROOF_OF_WORK_CACHE_SIZE)),
+  logger(log, "currency") {
+}
+
 bool Currency::init() {
   if (!generateGenesisBlock()) {
     logger(ERROR, BRIGHT_RED) << "Failed to generate genesis block";
@@ -61,8 +69,18 @@ bool Currency::init() {
     m_blocksFileName = "testnet_" + m_blocksFileName;
     m_blocksCacheFileName = "testnet_" + m_blocksCacheFileName;
     m_blockIndexesFileName = "testnet_" + m_blockIndexesFileName;
+    m_blockHeadersFileName = "testnet_" + m_blockHeadersFileName;
+    m_blocksCacheJournalFileName = "testnet_" + m_blocksCacheJournalFileName;
+    m_blockLayoutsFileName = "testnet_" + m_blockLayoutsFileName;
+    m_blockLayoutIndexesFileName = "testnet_" + m_blockLayoutIndexesFileName;
+    m_blockUndoFileName = "testnet_" + m_blockUndoFileName;
+    m_blockUndoIndexesFileName = "testnet_" + m_blockUndoIndexesFileName;
+    m_transactionsIndexFileName = "testnet_" + m_transactionsIndexFileName;
+    m_spentKeysIndexFileName = "testnet_" + m_spentKeysIndexFileName;
     m_txPoolFileName = "testnet_" + m_txPoolFileName;
     m_blockchinIndicesFileName = "testnet_" + m_blockchinIndicesFileName;
+    m_paymentIdIndexFileName = "testnet_" + m_paymentIdIndexFileName;
+    m_generatedTransactionsIndexFileName = "testnet_" + m_generatedTransactionsIndexFileName;
   }
 
   return true;
@@ -569,11 +587,27 @@ difficulty_type Currency::nextDifficultyLWMA(std::vector<uint64_t> timestamps, s
     return next_difficulty;
 }
 
+// Same hash as get_block_longhash, the hashing blob is needed for the key anyway.
+bool Currency::getBlockLongHash(Crypto::cn_context& context, const Block& block, Crypto::Hash& proofOfWork) const {
+  BinaryArray blob;
+  if (!get_block_hashing_blob(block, blob)) {
+    return false;
+  }
+
+  Crypto::Hash key = Crypto::cn_fast_hash(blob.data(), blob.size());
+  if (m_proofOfWorkCache->find(key, proofOfWork)) {
+    return true;
+  }
+
+  Crypto::cn_slow_hash(block.majorVersion, context, blob.data(), blob.size(), proofOfWork);
+  m_proofOfWorkCache->insert(key, proofOfWork);
+  return true;
+}
+
 bool Currency::checkProofOfWork(Crypto::cn_context& context, const Block& block, difficulty_type currentDiffic,
   Crypto::Hash& proofOfWork) const {
 
-  uint32_t extrahashID=0;
-  if (!get_block_longhash(context, block, proofOfWork, extrahashID)) {
+  if (!getBlockLongHash(context, block, proofOfWork)) {
     logger(INFO) << "Failed to get longhash...";
     return false;
   }
@@ -651,8 +685,18 @@ CurrencyBuilder::CurrencyBuilder(Logging::ILogger &log) : m_currency(log) {
   blocksFileName(parameters::CRYPTONOTE_BLOCKS_FILENAME);
   blocksCacheFileName(parameters::CRYPTONOTE_BLOCKSCACHE_FILENAME);
   blockIndexesFileName(parameters::CRYPTONOTE_BLOCKINDEXES_FILENAME);
+  blockHeadersFileName(parameters::CRYPTONOTE_BLOCKHEADERS_FILENAME);
+  blocksCacheJournalFileName(parameters::CRYPTONOTE_BLOCKSCACHE_JOURNAL_FILENAME);
+  blockLayoutsFileName(parameters::CRYPTONOTE_BLOCKLAYOUTS_FILENAME);
+  blockLayoutIndexesFileName(parameters::CRYPTONOTE_BLOCKLAYOUTINDEXES_FILENAME);
+  blockUndoFileName(parameters::CRYPTONOTE_BLOCKUNDO_FILENAME);
+  blockUndoIndexesFileName(parameters::CRYPTONOTE_BLOCKUNDOINDEXES_FILENAME);
+  transactionsIndexFileName(parameters::CRYPTONOTE_TRANSACTIONS_INDEX_FILENAME);
+  spentKeysIndexFileName(parameters::CRYPTONOTE_SPENT_KEYS_INDEX_FILENAME);
   txPoolFileName(parameters::CRYPTONOTE_POOLDATA_FILENAME);
   blockchinIndicesFileName(parameters::CRYPTONOTE_BLOCKCHAIN_INDICES_FILENAME);
+  paymentIdIndexFileName(parameters::CRYPTONOTE_PAYMENT_ID_INDEX_FILENAME);
+  generatedTransactionsIndexFileName(parameters::CRYPTONOTE_GENERATED_TRANSACTIONS_INDEX_FILENAME);
 
   testnet(false);
 }
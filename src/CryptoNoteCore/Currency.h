@@ -5,6 +5,7 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 #include <boost/utility.hpp>
@@ -13,6 +14,7 @@
 #include "../Logging/LoggerRef.h"
 #include "CryptoNoteBasic.h"
 #include "Difficulty.h"
+#include "ProofOfWorkCache.h"
 
 namespace CryptoNote {
 
@@ -68,8 +70,18 @@ public:
   const std::string& blocksFileName() const { return m_blocksFileName; }
   const std::string& blocksCacheFileName() const { return m_blocksCacheFileName; }
   const std::string& blockIndexesFileName() const { return m_blockIndexesFileName; }
+  const std::string& blockHeadersFileName() const { return m_blockHeadersFileName; }
+  const std::string& blocksCacheJournalFileName() const { return m_blocksCacheJournalFileName; }
+  const std::string& blockLayoutsFileName() const { return m_blockLayoutsFileName; }
+  const std::string& blockLayoutIndexesFileName() const { return m_blockLayoutIndexesFileName; }
+  const std::string& blockUndoFileName() const { return m_blockUndoFileName; }
+  const std::string& blockUndoIndexesFileName() const { return m_blockUndoIndexesFileName; }
+  const std::string& transactionsIndexFileName() const { return m_transactionsIndexFileName; }
+  const std::string& spentKeysIndexFileName() const { return m_spentKeysIndexFileName; }
   const std::string& txPoolFileName() const { return m_txPoolFileName; }
   const std::string& blockchinIndicesFileName() const { return m_blockchinIndicesFileName; }
+  const std::string& paymentIdIndexFileName() const { return m_paymentIdIndexFileName; }
+  const std::string& generatedTransactionsIndexFileName() const { return m_generatedTransactionsIndexFileName; }
 
   bool isTestnet() const { return m_testnet; }
 
@@ -107,13 +119,14 @@ uint64_t getMinimalFee(uint64_t avgCurrentDifficulty, uint64_t currentReward, ui
   difficulty_type nextDifficulty(std::vector<uint64_t> timestamps, std::vector<difficulty_type> cumulativeDifficulties) const;
   difficulty_type nextDifficultyLWMA(std::vector<uint64_t> timestamps, std::vector<difficulty_type> cumulativeDifficulties) const;
 
+  // long hash of the block, taken from the proof of work cache or computed and added to it
+  bool getBlockLongHash(Crypto::cn_context& context, const Block& block, Crypto::Hash& proofOfWork) const;
   bool checkProofOfWork(Crypto::cn_context& context, const Block& block, difficulty_type currentDiffic, Crypto::Hash& proofOfWork) const;
 
   size_t getApproximateMaximumInputCount(size_t transactionSize, size_t outputCount, size_t mixinCount) const;
 
 private:
-  Currency(Logging::ILogger& log) : logger(log, "currency") {
-  }
+  Currency(Logging::ILogger& log);
 
   bool init();
 
@@ -167,8 +180,18 @@ private:
   std::string m_blocksFileName;
   std::string m_blocksCacheFileName;
   std::string m_blockIndexesFileName;
+  std::string m_blockHeadersFileName;
+  std::string m_blocksCacheJournalFileName;
+  std::string m_blockLayoutsFileName;
+  std::string m_blockLayoutIndexesFileName;
+  std::string m_blockUndoFileName;
+  std::string m_blockUndoIndexesFileName;
+  std::string m_transactionsIndexFileName;
+  std::string m_spentKeysIndexFileName;
   std::string m_txPoolFileName;
   std::string m_blockchinIndicesFileName;
+  std::string m_paymentIdIndexFileName;
+  std::string m_generatedTransactionsIndexFileName;
 
   static const std::vector<uint64_t> PRETTY_AMOUNTS;
 
@@ -177,6 +200,9 @@ private:
   Block m_genesisBlock;
   Crypto::Hash m_genesisBlockHash;
 
+  // shared by the copies of the currency
+  std::shared_ptr<ProofOfWorkCache> m_proofOfWorkCache;
+
   Logging::LoggerRef logger;
 
   friend class CurrencyBuilder;
@@ -242,8 +268,18 @@ public:
   CurrencyBuilder& blocksFileName(const std::string& val) { m_currency.m_blocksFileName = val; return *this; }
   CurrencyBuilder& blocksCacheFileName(const std::string& val) { m_currency.m_blocksCacheFileName = val; return *this; }
   CurrencyBuilder& blockIndexesFileName(const std::string& val) { m_currency.m_blockIndexesFileName = val; return *this; }
+  CurrencyBuilder& blockHeadersFileName(const std::string& val) { m_currency.m_blockHeadersFileName = val; return *this; }
+  CurrencyBuilder& blocksCacheJournalFileName(const std::string& val) { m_currency.m_blocksCacheJournalFileName = val; return *this; }
+  CurrencyBuilder& blockLayoutsFileName(const std::string& val) { m_currency.m_blockLayoutsFileName = val; return *this; }
+  CurrencyBuilder& blockLayoutIndexesFileName(const std::string& val) { m_currency.m_blockLayoutIndexesFileName = val; return *this; }
+  CurrencyBuilder& blockUndoFileName(const std::string& val) { m_currency.m_blockUndoFileName = val; return *this; }
+  CurrencyBuilder& blockUndoIndexesFileName(const std::string& val) { m_currency.m_blockUndoIndexesFileName = val; return *this; }
+  CurrencyBuilder& transactionsIndexFileName(const std::string& val) { m_currency.m_transactionsIndexFileName = val; return *this; }
+  CurrencyBuilder& spentKeysIndexFileName(const std::string& val) { m_currency.m_spentKeysIndexFileName = val; return *this; }
   CurrencyBuilder& txPoolFileName(const std::string& val) { m_currency.m_txPoolFileName = val; return *this; }
   CurrencyBuilder& blockchinIndicesFileName(const std::string& val) { m_currency.m_blockchinIndicesFileName = val; return *this; }
+  CurrencyBuilder& paymentIdIndexFileName(const std::string& val) { m_currency.m_paymentIdIndexFileName = val; return *this; }
+  CurrencyBuilder& generatedTransactionsIndexFileName(const std::string& val) { m_currency.m_generatedTransactionsIndexFileName = val; return *this; }
 
   CurrencyBuilder& testnet(bool val) { m_currency.m_testnet = val; return *this; }
 
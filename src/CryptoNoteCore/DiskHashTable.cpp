@@ -0,0 +1,614 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "DiskHashTable.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+#include "crypto/crypto.h"
+
+namespace CryptoNote {
+
+namespace {
+const uint64_t TABLE_MAGIC = 0x3154484b53494446; // "FDISKHT1"
+const uint32_t TABLE_VERSION = 1;
+const uint64_t LOG_MAGIC = 0x31474f4c54484b44; // "DKHTLOG1"
+const uint32_t PAGE_SIZE = 4096;
+const uint64_t INITIAL_BUCKETS = 256;
+const uint64_t OVERFLOW_PAGE_FLAG = 1ULL << 63;
+// a bucket is split whenever the table gets fuller than this, in percent
+const uint64_t MAX_LOAD = 75;
+const uint64_t LOG_ENTRY_SIZE = sizeof(uint64_t) + sizeof(uint32_t) + PAGE_SIZE;
+
+bool fileExists(const std::string& fileName) {
+  std::ifstream file(fileName, std::ios::binary);
+  return static_cast<bool>(file);
+}
+}
+
+DiskHashTable::DiskHashTable() : m_header(), m_recordSize(0), m_opened(false) {
+}
+
+DiskHashTable::~DiskHashTable() {
+  close();
+}
+
+bool DiskHashTable::open(const std::string& fileName, uint32_t keySize, uint32_t valueSize) {
+  std::lock_guard<std::mutex> lk(m_mutex);
+  unmapFiles();
+  m_dirtyPages.clear();
+  m_opened = false;
+
+  m_fileName = fileName;
+  m_overflowFileName = fileName + ".overflow";
+  m_logFileName = fileName + ".log";
+  m_header = Header();
+  m_header.keySize = keySize;
+  m_header.valueSize = valueSize;
+  m_recordSize = keySize + valueSize;
+  if (keySize < 16 || m_recordSize > PAGE_SIZE - sizeof(PageHeader)) {
+    return false;
+  }
+
+  bool usable;
+  try {
+    if (!fileExists(m_fileName)) {
+      create(keySize, valueSize);
+      usable = true;
+    } else {
+      usable = replayLog() && readHeader() && m_header.keySize == keySize && m_header.valueSize == valueSize && mapFiles();
+    }
+  } catch (std::exception&) {
+    usable = false;
+  }
+
+  // a table cut short can not be trusted either
+  usable = usable && m_mapping.size() >= (bucketCount() + 1) * PAGE_SIZE &&
+    (m_header.overflowPages == 0 || m_overflowMapping.size() >= m_header.overflowPages * PAGE_SIZE);
+
+  if (!usable) {
+    // left for clear() to start over with
+    unmapFiles();
+    m_header = Header();
+    m_header.keySize = keySize;
+    m_header.valueSize = valueSize;
+    return false;
+  }
+
+  m_opened = true;
+  return true;
+}
+
+void DiskHashTable::close() {
+  std::lock_guard<std::mutex> lk(m_mutex);
+  unmapFiles();
+  m_dirtyPages.clear();
+  m_opened = false;
+}
+
+bool DiskHashTable::find(const void* key, void* value) {
+  std::lock_guard<std::mutex> lk(m_mutex);
+  Slot slot;
+  if (!findSlot(static_cast<const uint8_t*>(key), slot)) {
+    return false;
+  }
+
+  memcpy(value, record(readPage(slot.page), slot.index) + m_header.keySize, m_header.valueSize);
+  return true;
+}
+
+size_t DiskHashTable::findByPrefix(const void* prefix, uint32_t prefixSize, std::vector<uint8_t>& keys) {
+  std::lock_guard<std::mutex> lk(m_mutex);
+  if (prefixSize < 16 || prefixSize > m_header.keySize) {
+    throw std::invalid_argument("DiskHashTable::findByPrefix: invalid prefix size");
+  }
+
+  size_t found = 0;
+  PageId page = bucketPage(bucketOf(hashKey(static_cast<const uint8_t*>(prefix))));
+  for (;;) {
+    const uint8_t* data = readPage(page);
+    const PageHeader* header = reinterpret_cast<const PageHeader*>(data);
+    for (uint32_t i = 0; i < header->count; ++i) {
+      const uint8_t* key = record(data, i);
+      if (memcmp(key, prefix, prefixSize) == 0) {
+        keys.insert(keys.end(), key, key + m_header.keySize);
+        ++found;
+      }
+    }
+
+    if (header->next == 0) {
+      return found;
+    }
+
+    page = overflowPage(header->next);
+  }
+}
+
+bool DiskHashTable::insert(const void* key, const void* value) {
+  std::lock_guard<std::mutex> lk(m_mutex);
+  Slot slot;
+  if (findSlot(static_cast<const uint8_t*>(key), slot)) {
+    return false;
+  }
+
+  add(key, value);
+  return true;
+}
+
+void DiskHashTable::insertNew(const void* key, const void* value) {
+  std::lock_guard<std::mutex> lk(m_mutex);
+  add(key, value);
+}
+
+bool DiskHashTable::erase(const void* key) {
+  std::lock_guard<std::mutex> lk(m_mutex);
+  Slot slot;
+  if (!findSlot(static_cast<const uint8_t*>(key), slot)) {
+    return false;
+  }
+
+  // the last record of the page takes the place of the erased one
+  uint8_t* page = writePage(slot.page);
+  PageHeader* header = reinterpret_cast<PageHeader*>(page);
+  --header->count;
+  if (slot.index != header->count) {
+    memcpy(record(page, slot.index), record(page, header->count), m_recordSize);
+  }
+
+  if (header->count == 0 && isOverflowPage(slot.page)) {
+    reinterpret_cast<PageHeader*>(writePage(slot.previous))->next = header->next;
+    freeOverflowPage(slot.page);
+  }
+
+  --m_header.count;
+  return true;
+}
+
+void DiskHashTable::clear() {
+  std::lock_guard<std::mutex> lk(m_mutex);
+  create(m_header.keySize, m_header.valueSize);
+  m_opened = true;
+}
+
+uint64_t DiskHashTable::size() {
+  std::lock_guard<std::mutex> lk(m_mutex);
+  return m_header.count;
+}
+
+uint64_t DiskHashTable::uncommittedSize() {
+  std::lock_guard<std::mutex> lk(m_mutex);
+  return m_dirtyPages.size() * PAGE_SIZE;
+}
+
+Crypto::Hash DiskHashTable::committedTag() {
+  std::lock_guard<std::mutex> lk(m_mutex);
+  return m_header.tag;
+}
+
+// Writes out all pages changed since the last commit. With a tag they go
+// through the log, so a crash at any point leaves either the previous or
+// this state once the log is replayed on open.
+void DiskHashTable::commit(const Crypto::Hash& tag) {
+  std::lock_guard<std::mutex> lk(m_mutex);
+  if (!m_opened) {
+    throw std::runtime_error("DiskHashTable::commit: " + m_fileName + " is not opened");
+  }
+
+  m_header.tag = tag;
+
+  std::unique_ptr<uint8_t[]> headerPage(new uint8_t[PAGE_SIZE]());
+  memcpy(headerPage.get(), &m_header, sizeof m_header);
+
+  // the header goes first, a tagless commit cut short then reads as untagged
+  PageList pages;
+  pages.reserve(m_dirtyPages.size() + 1);
+  pages.push_back(std::make_pair(PageId(0), static_cast<const uint8_t*>(headerPage.get())));
+  for (auto& dirtyPage : m_dirtyPages) {
+    pages.push_back(std::make_pair(dirtyPage.first, static_cast<const uint8_t*>(dirtyPage.second.get())));
+  }
+
+  std::sort(pages.begin() + 1, pages.end());
+
+  bool logged = tag != Crypto::Hash();
+  if (logged) {
+    writeLog(pages);
+  }
+
+  unmapFiles();
+  try {
+    storePages(pages);
+  } catch (std::exception&) {
+    // the pages stay in memory, reads keep working until a commit succeeds
+    mapFiles();
+    throw;
+  }
+
+  if (logged) {
+    std::remove(m_logFileName.c_str());
+  }
+
+  m_dirtyPages.clear();
+  if (!mapFiles()) {
+    m_opened = false;
+    throw std::runtime_error("DiskHashTable::commit: could not map " + m_fileName);
+  }
+}
+
+DiskHashTable::PageId DiskHashTable::bucketPage(uint64_t bucket) {
+  return bucket + 1;
+}
+
+DiskHashTable::PageId DiskHashTable::overflowPage(uint64_t number) {
+  return number | OVERFLOW_PAGE_FLAG;
+}
+
+bool DiskHashTable::isOverflowPage(PageId page) {
+  return (page & OVERFLOW_PAGE_FLAG) != 0;
+}
+
+uint32_t DiskHashTable::checksum(const uint8_t* page) {
+  Crypto::Hash hash;
+  Crypto::cn_fast_hash(page, PAGE_SIZE, hash);
+  uint32_t result;
+  memcpy(&result, &hash, sizeof result);
+  return result;
+}
+
+// The keys are hashes themselves, the salted mix only keeps keys ground to
+// share a bucket on one node from doing so on another.
+uint64_t DiskHashTable::hashKey(const uint8_t* key) const {
+  uint64_t words[2];
+  memcpy(words, key, sizeof words);
+  uint64_t hash = (words[0] ^ m_header.salt[0]) * 0x9e3779b97f4a7c15ULL;
+  hash ^= hash >> 32;
+  hash += words[1] ^ m_header.salt[1];
+  hash *= 0xc2b2ae3d27d4eb4fULL;
+  return hash ^ (hash >> 29);
+}
+
+uint64_t DiskHashTable::bucketCount() const {
+  return (INITIAL_BUCKETS << m_header.level) + m_header.splitBucket;
+}
+
+uint64_t DiskHashTable::bucketOf(uint64_t hash) const {
+  uint64_t levelBuckets = INITIAL_BUCKETS << m_header.level;
+  uint64_t bucket = hash & (levelBuckets - 1);
+  if (bucket < m_header.splitBucket) {
+    bucket = hash & (2 * levelBuckets - 1);
+  }
+
+  return bucket;
+}
+
+uint32_t DiskHashTable::pageCapacity() const {
+  return (PAGE_SIZE - sizeof(PageHeader)) / m_recordSize;
+}
+
+uint8_t* DiskHashTable::record(uint8_t* page, uint32_t index) const {
+  return page + sizeof(PageHeader) + static_cast<size_t>(index) * m_recordSize;
+}
+
+const uint8_t* DiskHashTable::record(const uint8_t* page, uint32_t index) const {
+  return page + sizeof(PageHeader) + static_cast<size_t>(index) * m_recordSize;
+}
+
+const uint8_t* DiskHashTable::readPage(PageId page) {
+  auto dirtyPage = m_dirtyPages.find(page);
+  if (dirtyPage != m_dirtyPages.end()) {
+    return dirtyPage->second.get();
+  }
+
+  const System::MemoryMappedFile& mapping = isOverflowPage(page) ? m_overflowMapping : m_mapping;
+  uint64_t offset = isOverflowPage(page) ? ((page & ~OVERFLOW_PAGE_FLAG) - 1) * PAGE_SIZE : page * PAGE_SIZE;
+  if (!mapping.isOpened() || offset + PAGE_SIZE > mapping.size()) {
+    throw std::runtime_error("DiskHashTable: page " + std::to_string(page & ~OVERFLOW_PAGE_FLAG) + " is missing from " + m_fileName);
+  }
+
+  return mapping.data() + offset;
+}
+
+uint8_t* DiskHashTable::writePage(PageId page) {
+  auto dirtyPage = m_dirtyPages.find(page);
+  if (dirtyPage != m_dirtyPages.end()) {
+    return dirtyPage->second.get();
+  }
+
+  std::unique_ptr<uint8_t[]> data(new uint8_t[PAGE_SIZE]);
+  memcpy(data.get(), readPage(page), PAGE_SIZE);
+  return m_dirtyPages.insert(std::make_pair(page, std::move(data))).first->second.get();
+}
+
+uint8_t* DiskHashTable::newPage(PageId page) {
+  std::unique_ptr<uint8_t[]>& data = m_dirtyPages[page];
+  data.reset(new uint8_t[PAGE_SIZE]());
+  return data.get();
+}
+
+bool DiskHashTable::findSlot(const uint8_t* key, Slot& slot) {
+  PageId previous = 0;
+  PageId page = bucketPage(bucketOf(hashKey(key)));
+  for (;;) {
+    const uint8_t* data = readPage(page);
+    const PageHeader* header = reinterpret_cast<const PageHeader*>(data);
+    for (uint32_t i = 0; i < header->count; ++i) {
+      if (memcmp(record(data, i), key, m_header.keySize) == 0) {
+        slot.page = page;
+        slot.previous = previous;
+        slot.index = i;
+        return true;
+      }
+    }
+
+    if (header->next == 0) {
+      return false;
+    }
+
+    previous = page;
+    page = overflowPage(header->next);
+  }
+}
+
+void DiskHashTable::add(const void* key, const void* value) {
+  std::vector<uint8_t> newRecord(m_recordSize);
+  memcpy(newRecord.data(), key, m_header.keySize);
+  memcpy(newRecord.data() + m_header.keySize, value, m_header.valueSize);
+  append(bucketOf(hashKey(newRecord.data())), newRecord.data());
+
+  ++m_header.count;
+  if (m_header.count * 100 > bucketCount() * pageCapacity() * MAX_LOAD) {
+    split();
+  }
+}
+
+// Only the bucket page and the first overflow page take new records, a new
+// overflow page is linked in front of the others. Appending to the long chain
+// of a popular prefix reads two pages at most, space freed deeper in a chain
+// is reused once the bucket is split.
+void DiskHashTable::append(uint64_t bucket, const uint8_t* newRecord) {
+  PageId page = bucketPage(bucket);
+  const PageHeader* header = reinterpret_cast<const PageHeader*>(readPage(page));
+  if (header->count == pageCapacity()) {
+    uint64_t first = header->next;
+    if (first != 0 && reinterpret_cast<const PageHeader*>(readPage(overflowPage(first)))->count < pageCapacity()) {
+      page = overflowPage(first);
+    } else {
+      PageId next = allocateOverflowPage();
+      reinterpret_cast<PageHeader*>(writePage(next))->next = first;
+      reinterpret_cast<PageHeader*>(writePage(page))->next = next & ~OVERFLOW_PAGE_FLAG;
+      page = next;
+    }
+  }
+
+  uint8_t* data = writePage(page);
+  PageHeader* writableHeader = reinterpret_cast<PageHeader*>(data);
+  memcpy(record(data, writableHeader->count), newRecord, m_recordSize);
+  ++writableHeader->count;
+}
+
+DiskHashTable::PageId DiskHashTable::allocateOverflowPage() {
+  uint64_t number = m_header.freeOverflowPage;
+  if (number != 0) {
+    m_header.freeOverflowPage = reinterpret_cast<const PageHeader*>(readPage(overflowPage(number)))->next;
+  } else {
+    number = ++m_header.overflowPages;
+  }
+
+  newPage(overflowPage(number));
+  return overflowPage(number);
+}
+
+void DiskHashTable::freeOverflowPage(PageId page) {
+  reinterpret_cast<PageHeader*>(newPage(page))->next = m_header.freeOverflowPage;
+  m_header.freeOverflowPage = page & ~OVERFLOW_PAGE_FLAG;
+}
+
+// Moves the records of the bucket at the split pointer that hash one bit
+// further into a new bucket at the end of the table.
+void DiskHashTable::split() {
+  uint64_t levelBuckets = INITIAL_BUCKETS << m_header.level;
+  uint64_t bucket = m_header.splitBucket;
+
+  std::vector<uint8_t> records;
+  PageId page = bucketPage(bucket);
+  for (;;) {
+    const uint8_t* data = readPage(page);
+    const PageHeader* header = reinterpret_cast<const PageHeader*>(data);
+    records.insert(records.end(), record(data, 0), record(data, header->count));
+    uint64_t next = header->next;
+
+    if (isOverflowPage(page)) {
+      freeOverflowPage(page);
+    } else {
+      newPage(page);
+    }
+
+    if (next == 0) {
+      break;
+    }
+
+    page = overflowPage(next);
+  }
+
+  newPage(bucketPage(levelBuckets + bucket));
+  if (++m_header.splitBucket == levelBuckets) {
+    ++m_header.level;
+    m_header.splitBucket = 0;
+  }
+
+  for (size_t offset = 0; offset < records.size(); offset += m_recordSize) {
+    append(bucketOf(hashKey(&records[offset])), &records[offset]);
+  }
+}
+
+void DiskHashTable::create(uint32_t keySize, uint32_t valueSize) {
+  unmapFiles();
+  m_dirtyPages.clear();
+  std::remove(m_logFileName.c_str());
+
+  m_header = Header();
+  m_header.magic = TABLE_MAGIC;
+  m_header.version = TABLE_VERSION;
+  m_header.keySize = keySize;
+  m_header.valueSize = valueSize;
+  m_header.salt[0] = Crypto::rand<uint64_t>();
+  m_header.salt[1] = Crypto::rand<uint64_t>();
+
+  std::vector<uint8_t> page(PAGE_SIZE);
+  memcpy(page.data(), &m_header, sizeof m_header);
+
+  std::ofstream file(m_fileName, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char*>(page.data()), page.size());
+  std::fill(page.begin(), page.end(), 0);
+  for (uint64_t bucket = 0; bucket < INITIAL_BUCKETS; ++bucket) {
+    file.write(reinterpret_cast<const char*>(page.data()), page.size());
+  }
+
+  file.flush();
+  std::ofstream overflowFile(m_overflowFileName, std::ios::binary | std::ios::trunc);
+  if (!file || !overflowFile) {
+    throw std::runtime_error("DiskHashTable: could not create " + m_fileName);
+  }
+
+  file.close();
+  overflowFile.close();
+  if (!mapFiles()) {
+    throw std::runtime_error("DiskHashTable: could not map " + m_fileName);
+  }
+}
+
+bool DiskHashTable::readHeader() {
+  std::ifstream file(m_fileName, std::ios::binary);
+  Header header;
+  file.read(reinterpret_cast<char*>(&header), sizeof header);
+  if (!file || header.magic != TABLE_MAGIC || header.version != TABLE_VERSION) {
+    return false;
+  }
+
+  m_header = header;
+  return true;
+}
+
+bool DiskHashTable::mapFiles() {
+  std::error_code ec;
+  m_mapping.openReadOnly(m_fileName, ec);
+  if (ec) {
+    return false;
+  }
+
+  // an empty file can not be mapped, there is nothing to read from it either
+  if (m_header.overflowPages > 0) {
+    m_overflowMapping.openReadOnly(m_overflowFileName, ec);
+    if (ec) {
+      m_mapping.close(ec);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void DiskHashTable::unmapFiles() {
+  std::error_code ignore;
+  if (m_mapping.isOpened()) {
+    m_mapping.close(ignore);
+  }
+
+  if (m_overflowMapping.isOpened()) {
+    m_overflowMapping.close(ignore);
+  }
+}
+
+// Finishes a commit interrupted after its log was complete. A log without
+// its trailer belongs to a commit that never touched the table and is dropped.
+bool DiskHashTable::replayLog() {
+  std::ifstream log(m_logFileName, std::ios::binary | std::ios::ate);
+  if (!log) {
+    return true;
+  }
+
+  uint64_t logSize = static_cast<uint64_t>(log.tellg());
+  log.seekg(0);
+
+  PageList pages;
+  std::vector<std::unique_ptr<uint8_t[]>> buffers;
+  bool complete = false;
+  if (logSize >= 2 * sizeof(uint64_t) && (logSize - 2 * sizeof(uint64_t)) % LOG_ENTRY_SIZE == 0) {
+    uint64_t entryCount = (logSize - 2 * sizeof(uint64_t)) / LOG_ENTRY_SIZE;
+    complete = true;
+    for (uint64_t i = 0; i < entryCount && complete; ++i) {
+      PageId page;
+      uint32_t pageChecksum;
+      std::unique_ptr<uint8_t[]> data(new uint8_t[PAGE_SIZE]);
+      log.read(reinterpret_cast<char*>(&page), sizeof page);
+      log.read(reinterpret_cast<char*>(&pageChecksum), sizeof pageChecksum);
+      log.read(reinterpret_cast<char*>(data.get()), PAGE_SIZE);
+      complete = log && checksum(data.get()) == pageChecksum;
+      pages.push_back(std::make_pair(page, static_cast<const uint8_t*>(data.get())));
+      buffers.push_back(std::move(data));
+    }
+
+    uint64_t trailer[2];
+    log.read(reinterpret_cast<char*>(trailer), sizeof trailer);
+    complete = complete && log && trailer[0] == LOG_MAGIC && trailer[1] == entryCount && entryCount > 0 && pages[0].first == 0;
+  }
+
+  log.close();
+  if (complete) {
+    try {
+      storePages(pages);
+    } catch (std::exception&) {
+      return false;
+    }
+  }
+
+  std::remove(m_logFileName.c_str());
+  return true;
+}
+
+void DiskHashTable::writeLog(const PageList& pages) {
+  std::ofstream log(m_logFileName, std::ios::binary | std::ios::trunc);
+  for (const auto& page : pages) {
+    uint32_t pageChecksum = checksum(page.second);
+    log.write(reinterpret_cast<const char*>(&page.first), sizeof page.first);
+    log.write(reinterpret_cast<const char*>(&pageChecksum), sizeof pageChecksum);
+    log.write(reinterpret_cast<const char*>(page.second), PAGE_SIZE);
+  }
+
+  uint64_t trailer[2] = { LOG_MAGIC, pages.size() };
+  log.write(reinterpret_cast<const char*>(trailer), sizeof trailer);
+  log.flush();
+  if (!log) {
+    throw std::runtime_error("DiskHashTable: could not write " + m_logFileName);
+  }
+}
+
+void DiskHashTable::storePages(const PageList& pages) {
+  std::fstream file(m_fileName, std::ios::in | std::ios::out | std::ios::binary);
+  std::fstream overflowFile(m_overflowFileName, std::ios::in | std::ios::out | std::ios::binary);
+  if (!file || !overflowFile) {
+    throw std::runtime_error("DiskHashTable: could not open " + m_fileName);
+  }
+
+  for (const auto& page : pages) {
+    if (isOverflowPage(page.first)) {
+      overflowFile.seekp(((page.first & ~OVERFLOW_PAGE_FLAG) - 1) * PAGE_SIZE);
+      overflowFile.write(reinterpret_cast<const char*>(page.second), PAGE_SIZE);
+    } else {
+      file.seekp(page.first * PAGE_SIZE);
+      file.write(reinterpret_cast<const char*>(page.second), PAGE_SIZE);
+    }
+  }
+
+  file.flush();
+  overflowFile.flush();
+  if (!file || !overflowFile) {
+    throw std::runtime_error("DiskHashTable: could not write " + m_fileName);
+  }
+}
+
+}
@@ -0,0 +1,131 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "crypto/hash.h"
+#include "System/MemoryMappedFile.h"
+
+namespace CryptoNote
+{
+  // Hash table of fixed size records kept on disk, for keys that are already
+  // uniformly distributed such as transaction hashes and key images. Buckets
+  // are 4 KB pages grown one at a time by linear hashing, records that do not
+  // fit go to overflow pages in a second file.
+  //
+  // Lookups read pages through a read-only mapping, so hot pages live in the
+  // OS page cache instead of the heap. Modified pages are held in memory until
+  // commit(), which writes them to a write-ahead log first and then in place.
+  // The files on disk therefore always hold the state of the last commit, and
+  // the tag passed to it tells the caller which state that is. Committing with
+  // a null tag skips the log, a crash while writing leaves the table untagged.
+  class DiskHashTable {
+
+  public:
+    DiskHashTable();
+    ~DiskHashTable();
+
+    // keySize must be at least 16, the first 16 bytes of a key are hashed.
+    // Returns false if the files can not be used, clear() starts over then.
+    bool open(const std::string& fileName, uint32_t keySize, uint32_t valueSize);
+    void close();
+
+    bool find(const void* key, void* value);
+    // Appends the keys starting with prefix to keys. Keys sharing their first
+    // 16 bytes share a bucket, so prefixSize must be at least 16.
+    size_t findByPrefix(const void* prefix, uint32_t prefixSize, std::vector<uint8_t>& keys);
+    // returns false and leaves the table unchanged if the key is present
+    bool insert(const void* key, const void* value);
+    // skips the lookup, for keys the caller knows are not present
+    void insertNew(const void* key, const void* value);
+    bool erase(const void* key);
+    void clear();
+
+    uint64_t size();
+    // bytes held in memory until the next commit
+    uint64_t uncommittedSize();
+    Crypto::Hash committedTag();
+    void commit(const Crypto::Hash& tag);
+
+  private:
+    typedef uint64_t PageId;
+
+    struct Header {
+      uint64_t magic;
+      uint32_t version;
+      uint32_t keySize;
+      uint32_t valueSize;
+      uint32_t level;
+      uint64_t splitBucket;
+      uint64_t count;
+      uint64_t overflowPages;
+      uint64_t freeOverflowPage;
+      uint64_t salt[2];
+      Crypto::Hash tag;
+    };
+
+    struct PageHeader {
+      uint32_t count;
+      uint32_t reserved;
+      uint64_t next;
+    };
+
+    struct Slot {
+      PageId page;
+      PageId previous;
+      uint32_t index;
+    };
+
+    typedef std::vector<std::pair<PageId, const uint8_t*>> PageList;
+
+    static PageId bucketPage(uint64_t bucket);
+    static PageId overflowPage(uint64_t number);
+    static bool isOverflowPage(PageId page);
+    static uint32_t checksum(const uint8_t* page);
+
+    uint64_t hashKey(const uint8_t* key) const;
+    uint64_t bucketCount() const;
+    uint64_t bucketOf(uint64_t hash) const;
+    uint32_t pageCapacity() const;
+    uint8_t* record(uint8_t* page, uint32_t index) const;
+    const uint8_t* record(const uint8_t* page, uint32_t index) const;
+
+    const uint8_t* readPage(PageId page);
+    uint8_t* writePage(PageId page);
+    uint8_t* newPage(PageId page);
+
+    bool findSlot(const uint8_t* key, Slot& slot);
+    void add(const void* key, const void* value);
+    void append(uint64_t bucket, const uint8_t* record);
+    PageId allocateOverflowPage();
+    void freeOverflowPage(PageId page);
+    void split();
+
+    void create(uint32_t keySize, uint32_t valueSize);
+    bool readHeader();
+    bool mapFiles();
+    void unmapFiles();
+    bool replayLog();
+    void writeLog(const PageList& pages);
+    void storePages(const PageList& pages);
+
+    std::mutex m_mutex;
+    std::string m_fileName;
+    std::string m_overflowFileName;
+    std::string m_logFileName;
+    System::MemoryMappedFile m_mapping;
+    System::MemoryMappedFile m_overflowMapping;
+    Header m_header;
+    uint32_t m_recordSize;
+    std::unordered_map<PageId, std::unique_ptr<uint8_t[]>> m_dirtyPages;
+    bool m_opened;
+  };
+}
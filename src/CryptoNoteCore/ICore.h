@@ -52,7 +52,15 @@ public:
   virtual bool on_idle() = 0;
   virtual void pause_mining() = 0;
   virtual void update_block_template_and_resume_mining() = 0;
+  // blocks handled in between are written to disk together, false if they
+  // could not be, no more blocks are accepted then
+  virtual void begin_block_batch() = 0;
+  virtual bool end_block_batch() = 0;
+  // proof of work of blocks about to be handled in a batch is hashed up front, in parallel
+  virtual void precompute_proof_of_work(const std::vector<CryptoNote::Block>& blocks) = 0;
   virtual bool handle_incoming_block_blob(const CryptoNote::BinaryArray& block_blob, CryptoNote::block_verification_context& bvc, bool control_miner, bool relay_block) = 0;
+  // for a block the caller already parsed and checked the blob size of
+  virtual bool handle_incoming_block(const CryptoNote::Block& b, CryptoNote::block_verification_context& bvc, bool control_miner, bool relay_block) = 0;
   virtual bool handle_get_objects(NOTIFY_REQUEST_GET_OBJECTS_request& arg, NOTIFY_RESPONSE_GET_OBJECTS_request& rsp) = 0; //Deprecated. Should be removed with CryptoNoteProtocolHandler.
   virtual void on_synchronized() = 0;
   virtual void on_not_synchronized() = 0;
@@ -0,0 +1,204 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <parallel_hashmap/phmap.h>
+#include <parallel_hashmap/phmap_dump.h>
+
+#include "Common/Util.h"
+#include "CryptoNoteCore/DiskHashTable.h"
+
+namespace CryptoNote
+{
+  // Lookup table behind the large blockchain indexes, such as transaction
+  // hash to position and spent key images. Keys are hashes, keys and values
+  // are fixed size PODs.
+  template<class Key, class Value> class IKeyValueIndex {
+  public:
+    virtual ~IKeyValueIndex() {}
+
+    virtual bool find(const Key& key, Value& value) = 0;
+    // returns false and leaves the index unchanged if the key is present
+    virtual bool insert(const Key& key, const Value& value) = 0;
+    virtual bool erase(const Key& key) = 0;
+    virtual void clear() = 0;
+    virtual uint64_t size() = 0;
+
+    bool contains(const Key& key) {
+      Value value;
+      return find(key, value);
+    }
+
+    // inserts of keys in different partitions may run concurrently
+    virtual size_t partition(const Key& key, size_t partitions) = 0;
+
+    // The index goes with the block cache snapshot of the chain ending at tip.
+    // takeSnapshot is called under the blockchain lock and returns the writer
+    // that saves the snapshot to fileName, which needs no lock. A disk-resident
+    // index only commits. loadSnapshot is given the tip of the snapshot loaded
+    // and of the ones taken after it, an index ahead of the loaded snapshot is
+    // brought to the chain tip by the journal all the same. It returns false if
+    // the index matches none of them.
+    virtual std::function<bool()> takeSnapshot(const std::string& fileName, const Crypto::Hash& tip) = 0;
+    virtual bool loadSnapshot(const std::string& fileName, const std::vector<Crypto::Hash>& tips) = 0;
+
+    // Changes a disk-resident index holds in memory between snapshots. The tag
+    // of a commit is the tip of the snapshot they build on, or null.
+    virtual uint64_t uncommittedSize() = 0;
+    virtual void commit(const Crypto::Hash& tag) = 0;
+  };
+
+  template<class Key, class Value> class MemoryKeyValueIndex : public IKeyValueIndex<Key, Value> {
+  public:
+    virtual bool find(const Key& key, Value& value) override {
+      auto it = m_map.find(key);
+      if (it == m_map.end()) {
+        return false;
+      }
+
+      value = it->second;
+      return true;
+    }
+
+    virtual bool insert(const Key& key, const Value& value) override {
+      return m_map.insert(std::make_pair(key, value)).second;
+    }
+
+    virtual bool erase(const Key& key) override {
+      return m_map.erase(key) != 0;
+    }
+
+    virtual void clear() override {
+      m_map.clear();
+    }
+
+    virtual uint64_t size() override {
+      return m_map.size();
+    }
+
+    // every submap is a partition of its own, they are filled without locking
+    virtual size_t partition(const Key& key, size_t partitions) override {
+      return m_map.subidx(m_map.hash(key)) % partitions;
+    }
+
+    // the copy is dumped once the lock is released, next to the previous dump
+    // which it replaces only once it is on disk
+    virtual std::function<bool()> takeSnapshot(const std::string& fileName, const Crypto::Hash& tip) override {
+      std::shared_ptr<Map> snapshot = std::make_shared<Map>(m_map);
+      return [snapshot, fileName] {
+        std::string newFileName = fileName + ".new";
+        {
+          phmap::BinaryOutputArchive archive(newFileName.c_str());
+          if (!snapshot->dump(archive)) {
+            return false;
+          }
+        }
+
+        return !Tools::replace_file_durably(newFileName, fileName);
+      };
+    }
+
+    virtual bool loadSnapshot(const std::string& fileName, const std::vector<Crypto::Hash>& tips) override {
+      try {
+        phmap::BinaryInputArchive archive(fileName.c_str());
+        return m_map.load(archive);
+      } catch (std::exception&) {
+        m_map.clear();
+        return false;
+      }
+    }
+
+    virtual uint64_t uncommittedSize() override {
+      return 0;
+    }
+
+    virtual void commit(const Crypto::Hash& tag) override {
+    }
+
+  private:
+    typedef phmap::parallel_flat_hash_map<Key, Value> Map;
+    Map m_map;
+  };
+
+  template<class Key, class Value> class DiskKeyValueIndex : public IKeyValueIndex<Key, Value> {
+    static_assert(std::is_pod<Key>::value && std::is_pod<Value>::value, "DiskKeyValueIndex stores keys and values as is");
+
+  public:
+    // an unusable file is started over, false if that fails too
+    bool open(const std::string& fileName) {
+      if (m_table.open(fileName, sizeof(Key), sizeof(Value))) {
+        return true;
+      }
+
+      try {
+        m_table.clear();
+      } catch (std::exception&) {
+        return false;
+      }
+
+      return true;
+    }
+
+    virtual bool find(const Key& key, Value& value) override {
+      return m_table.find(&key, &value);
+    }
+
+    virtual bool insert(const Key& key, const Value& value) override {
+      return m_table.insert(&key, &value);
+    }
+
+    virtual bool erase(const Key& key) override {
+      return m_table.erase(&key);
+    }
+
+    virtual void clear() override {
+      m_table.clear();
+    }
+
+    virtual uint64_t size() override {
+      return m_table.size();
+    }
+
+    // the table takes a lock per call, one inserter does not contend on it
+    virtual size_t partition(const Key& key, size_t partitions) override {
+      return 0;
+    }
+
+    virtual std::function<bool()> takeSnapshot(const std::string& fileName, const Crypto::Hash& tip) override {
+      bool committed = true;
+      try {
+        m_table.commit(tip);
+      } catch (std::exception&) {
+        committed = false;
+      }
+
+      return [committed] { return committed; };
+    }
+
+    virtual bool loadSnapshot(const std::string& fileName, const std::vector<Crypto::Hash>& tips) override {
+      return std::find(tips.begin(), tips.end(), m_table.committedTag()) != tips.end();
+    }
+
+    virtual uint64_t uncommittedSize() override {
+      return m_table.uncommittedSize();
+    }
+
+    virtual void commit(const Crypto::Hash& tag) override {
+      m_table.commit(tag);
+    }
+
+  private:
+    DiskHashTable m_table;
+  };
+}
@@ -259,9 +259,11 @@ namespace CryptoNote
       std::atomic<bool> found(false);
       uint32_t startNonce = Crypto::rand<uint32_t>();
 
+      // repeated calls, as when a chain of blocks is mined, reuse the scratchpads
+      static Crypto::cn_context_pool contextPool;
       for (unsigned i = 0; i < nthreads; ++i) {
         threads[i] = std::async(std::launch::async, [&, i]() {
-          Crypto::cn_context localctx;
+          Crypto::cn_context_lease localctx(contextPool);
           Crypto::Hash h;
 
           Block lb(bl); // copy to local block
@@ -270,7 +272,7 @@ namespace CryptoNote
             lb.nonce = nonce;
 
             uint32_t extrahashID=0;
-            if (!get_block_longhash(localctx, lb, h, extrahashID)) {
+            if (!get_block_longhash(*localctx, lb, h, extrahashID)) {
               return;
             }
 
@@ -354,8 +356,19 @@ namespace CryptoNote
     uint32_t nonce = m_starter_nonce + th_local_index;
     difficulty_type local_diff = 0;
     uint32_t local_template_ver = 0;
-    Crypto::cn_context context;
+    // nonces nonce, nonce + m_threads_total, ... are hashed together
+    size_t ways = Crypto::cn_slow_hash_ways(m_threads_total);
+    std::vector<std::unique_ptr<Crypto::cn_context>> contexts;
+    Crypto::cn_context* contextPointers[Crypto::SLOW_HASH_MAX_WAYS];
+    for (size_t i = 0; i < ways; ++i) {
+      contexts.emplace_back(new Crypto::cn_context());
+      contextPointers[i] = contexts.back().get();
+    }
+
+    logger(INFO) << "Miner thread [" << th_local_index << "] hashes " << ways << " nonce(s) at once, scratchpads on " << contexts.front()->pages_name();
+
     Block b;
+    std::vector<Block> blocks;
 
     while(!m_stop)
     {
@@ -373,6 +386,7 @@ namespace CryptoNote
 
         local_template_ver = m_template_no;
         nonce = m_starter_nonce + th_local_index;
+        blocks.assign(ways, b);
       }
 
       if(!local_template_ver)//no any set_block_template call
@@ -382,32 +396,40 @@ namespace CryptoNote
         continue;
       }
 
-      b.nonce = nonce;
-      Crypto::Hash h;
-      uint32_t extrahashID=0;
-      if (!m_stop && !get_block_longhash(context, b, h, extrahashID)) {
+      for (size_t i = 0; i < ways; ++i) {
+        blocks[i].nonce = nonce + static_cast<uint32_t>(i) * m_threads_total;
+      }
+
+      Crypto::Hash h[Crypto::SLOW_HASH_MAX_WAYS];
+      uint32_t extrahashID[Crypto::SLOW_HASH_MAX_WAYS];
+      if (!m_stop && !get_block_longhashes(contextPointers, blocks.data(), h, extrahashID, ways)) {
         logger(ERROR) << "Failed to get block long hash";
         m_stop = true;
       }
 
-      if (!m_stop && check_hash(h, local_diff))
-      {
+      for (size_t i = 0; i < ways && !m_stop; ++i) {
+        if (!check_hash(h[i], local_diff)) {
+          continue;
+        }
+
         //we lucky!
         ++m_config.current_extra_message_index;
 
         logger(INFO, GREEN) << "Found block for difficulty: " << local_diff;
-        logger(INFO, GREEN) << "  found for extra-hash position(0-7): " << extrahashID;
+        logger(INFO, GREEN) << "  found for extra-hash position(0-7): " << extrahashID[i];
 
-        if(!m_handler.handle_block_found(b)) {
+        if(!m_handler.handle_block_found(blocks[i])) {
           --m_config.current_extra_message_index;
         } else {
           //success update, lets update config
           Common::saveStringToFile(m_config_folder_path + "/" + CryptoNote::parameters::MINER_CONFIG_FILE_NAME, storeToJson(m_config));
         }
+
+        break;
       }
 
-      nonce += m_threads_total;
-      ++m_hashes;
+      nonce += static_cast<uint32_t>(ways) * m_threads_total;
+      m_hashes += ways;
     }
     logger(INFO) << "Miner thread stopped ["<< th_local_index << "]";
     return true;
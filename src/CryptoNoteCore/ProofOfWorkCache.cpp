@@ -0,0 +1,36 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "ProofOfWorkCache.h"
+
+namespace CryptoNote {
+
+ProofOfWorkCache::ProofOfWorkCache(size_t capacity) : m_capacity(capacity) {
+}
+
+bool ProofOfWorkCache::find(const Crypto::Hash& key, Crypto::Hash& proofOfWork) {
+  std::lock_guard<std::mutex> lk(m_mutex);
+  auto it = m_proofsOfWork.find(key);
+  if (it == m_proofsOfWork.end()) {
+    return false;
+  }
+
+  proofOfWork = it->second;
+  return true;
+}
+
+void ProofOfWorkCache::insert(const Crypto::Hash& key, const Crypto::Hash& proofOfWork) {
+  std::lock_guard<std::mutex> lk(m_mutex);
+  if (!m_proofsOfWork.emplace(key, proofOfWork).second) {
+    return;
+  }
+
+  m_order.push_back(key);
+  if (m_order.size() > m_capacity) {
+    m_proofsOfWork.erase(m_order.front());
+    m_order.pop_front();
+  }
+}
+
+}
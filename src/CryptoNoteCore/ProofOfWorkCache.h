@@ -0,0 +1,35 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+#include "crypto/hash.h"
+
+namespace CryptoNote
+{
+  // Bounded map from the fast hash of a block hashing blob to its long hash,
+  // so a block seen again, as an alternative block that is switched in later,
+  // a block announced by several peers or a submitted one, is not hashed
+  // again. The blob covers the whole header and the transaction tree root,
+  // so entries never need invalidation. The oldest entries are dropped first.
+  class ProofOfWorkCache {
+
+  public:
+    explicit ProofOfWorkCache(size_t capacity);
+
+    bool find(const Crypto::Hash& key, Crypto::Hash& proofOfWork);
+    void insert(const Crypto::Hash& key, const Crypto::Hash& proofOfWork);
+
+  private:
+    const size_t m_capacity;
+    std::mutex m_mutex;
+    std::unordered_map<Crypto::Hash, Crypto::Hash> m_proofsOfWork;
+    std::deque<Crypto::Hash> m_order;
+  };
+}
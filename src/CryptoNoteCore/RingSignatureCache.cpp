@@ -0,0 +1,54 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "RingSignatureCache.h"
+
+#include <cstring>
+
+namespace CryptoNote {
+
+RingSignatureCache::RingSignatureCache(size_t capacity) : m_capacity(capacity) {
+}
+
+Crypto::Hash RingSignatureCache::makeKey(const Crypto::Hash& prefixHash, const Crypto::KeyImage& keyImage, uint64_t amount, const std::vector<const Crypto::PublicKey*>& outputKeys, const std::vector<Crypto::Signature>& signatures) {
+  std::vector<uint8_t> data(sizeof prefixHash + sizeof keyImage + sizeof amount + outputKeys.size() * sizeof(Crypto::PublicKey) + signatures.size() * sizeof(Crypto::Signature));
+  uint8_t* out = data.data();
+  memcpy(out, &prefixHash, sizeof prefixHash);
+  out += sizeof prefixHash;
+  memcpy(out, &keyImage, sizeof keyImage);
+  out += sizeof keyImage;
+  memcpy(out, &amount, sizeof amount);
+  out += sizeof amount;
+
+  for (const Crypto::PublicKey* key : outputKeys) {
+    memcpy(out, key, sizeof *key);
+    out += sizeof *key;
+  }
+
+  if (!signatures.empty()) {
+    memcpy(out, signatures.data(), signatures.size() * sizeof(Crypto::Signature));
+  }
+
+  return Crypto::cn_fast_hash(data.data(), data.size());
+}
+
+bool RingSignatureCache::contains(const Crypto::Hash& key) {
+  std::lock_guard<std::mutex> lk(m_mutex);
+  return m_keys.count(key) != 0;
+}
+
+void RingSignatureCache::insert(const Crypto::Hash& key) {
+  std::lock_guard<std::mutex> lk(m_mutex);
+  if (!m_keys.insert(key).second) {
+    return;
+  }
+
+  m_order.push_back(key);
+  if (m_order.size() > m_capacity) {
+    m_keys.erase(m_order.front());
+    m_order.pop_front();
+  }
+}
+
+}
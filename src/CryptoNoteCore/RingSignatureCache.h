@@ -0,0 +1,42 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+#include "crypto/crypto.h"
+#include "crypto/hash.h"
+
+namespace CryptoNote
+{
+  // Bounded set of ring signatures already found valid, so transactions checked
+  // on their way into the pool are not checked again when their block arrives.
+  // An entry is keyed on the prefix hash, the key image, the input amount, the
+  // resolved ring member keys and the signatures, everything check_ring_signature
+  // is given and the amount the keys were resolved for. After a reorg the
+  // same input may resolve to other keys, that gives another key and a miss, so
+  // entries never need invalidation. The oldest entries are dropped first.
+  class RingSignatureCache {
+
+  public:
+    explicit RingSignatureCache(size_t capacity);
+
+    static Crypto::Hash makeKey(const Crypto::Hash& prefixHash, const Crypto::KeyImage& keyImage, uint64_t amount, const std::vector<const Crypto::PublicKey*>& outputKeys, const std::vector<Crypto::Signature>& signatures);
+
+    bool contains(const Crypto::Hash& key);
+    void insert(const Crypto::Hash& key);
+
+  private:
+    const size_t m_capacity;
+    std::mutex m_mutex;
+    std::unordered_set<Crypto::Hash> m_keys;
+    std::deque<Crypto::Hash> m_order;
+  };
+}
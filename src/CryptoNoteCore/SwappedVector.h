@@ -4,21 +4,31 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cassert>
 #include <cstdint>
 #include <cstddef>
+#include <condition_variable>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <list>
-#include <map>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include <exception>
 
+#include "Common/MemoryInputStream.h"
 #include "Common/StdInputStream.h"
 #include "Common/StdOutputStream.h"
+#include "Common/VectorOutputStream.h"
+#include "crypto/hash.h"
 #include "Serialization/BinaryInputStreamSerializer.h"
 #include "Serialization/BinaryOutputStreamSerializer.h"
+#include "System/MemoryMappedFile.h"
 
 template<class T> class SwappedVector {
 public:
@@ -136,7 +146,17 @@ public:
   ~SwappedVector();
   //SwappedVector& operator=(const SwappedVector&) = delete;
 
-  bool open(const std::string& itemFileName, const std::string& indexFileName, uint64_t poolSize); //size_t poolSize);
+  struct CacheStatistics {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t prefetched;
+    uint64_t items;
+    uint64_t bytes;
+    uint64_t budget;
+  };
+
+  // cacheSize is the memory budget of the decoded items in bytes
+  bool open(const std::string& itemFileName, const std::string& indexFileName, uint64_t cacheSize);
   void close();
 
   bool empty() const;
@@ -150,44 +170,148 @@ public:
   void pop_back();
   void push_back(const T& item);
 
+  // Maps every stored item so load() can be used. Returns false if the items
+  // file can not be mapped.
+  bool mapAll();
+  // Decodes an item straight from the mapping without touching the cache, so
+  // several threads may load at once while the vector is not modified.
+  bool load(uint64_t index, T& item) const;
+
+  // Serialized size of an item, and a copy of part of its serialized bytes.
+  // Both skip decoding, readRaw is safe to call together with operator[].
+  uint64_t rawSize(uint64_t index) const;
+  bool readRaw(uint64_t index, uint64_t offset, uint64_t size, void* data);
+
+  // operator[] may be called from several threads as long as the vector is
+  // not modified meanwhile. While pinned, items handed out stay in memory and
+  // the cache grows past its budget instead, it shrinks back on the last unpin.
+  void pin();
+  void unpin();
+
+  // Between beginBatch and endBatch appended items are kept in memory and
+  // written with one write per file on flush, or once maxPendingSize bytes
+  // are pending. Items are still written before their sizes and the count
+  // last, so a crash loses the unflushed tail but never leaves a torn item.
+  void beginBatch(uint64_t maxPendingSize);
+  void flush();
+  void endBatch();
+
+  // Once operator[] walks forward through consecutive items, the next count
+  // items are decoded into the cache by a background thread. 0 turns it off.
+  void setReadAhead(uint64_t count);
+  CacheStatistics getCacheStatistics();
+
 private:
-  struct ItemEntry;
-  struct CacheEntry;
+  // The index starts with a magic and the item count, followed by the size
+  // and a checksum of every item. Indexes written before the checksums, a bare
+  // count followed by the sizes, are converted on open.
+  static const uint64_t INDEX_MAGIC = 0x3158444e49565753; // "SWVINDX1"
+  static const uint64_t INDEX_HEADER_SIZE = 2 * sizeof(uint64_t);
+  static const uint64_t INDEX_COUNT_POSITION = sizeof(uint64_t);
+  // items checked against their checksums on open, going back from the tail
+  static const uint64_t VERIFIED_TAIL_ITEMS = 1000;
+  static const uint64_t VERIFIED_TAIL_SIZE = 64 * 1024 * 1024;
+
+  struct IndexEntry {
+    uint32_t size;
+    uint32_t checksum;
+  };
 
-  struct ItemEntry {
-  public:
+  // Two queue (2Q) cache. Items seen once wait in a FIFO limited to a quarter
+  // of the budget, and only an item asked for again shortly after it dropped
+  // out of there moves to the LRU list of frequently used ones. A long scan
+  // therefore only cycles the FIFO and leaves the working set alone. Items are
+  // budgeted by their serialized size, which tracks the decoded one closely
+  // enough. Both queues are lists, so handed out items never move.
+  enum CacheQueue { RECENT_QUEUE, FREQUENT_QUEUE };
+
+  struct CacheEntry {
+    uint64_t index;
+    uint64_t bytes;
     T item;
-    typename std::list<CacheEntry>::iterator cacheIter;
   };
 
-  struct CacheEntry {
-  public:
-    typename std::map<uint64_t, ItemEntry>::iterator itemIter;
+  typedef std::list<CacheEntry> CacheList;
+
+  struct CacheLocation {
+    CacheQueue queue;
+    typename CacheList::iterator entry;
   };
 
   std::fstream m_itemsFile;
   std::fstream m_indexesFile;
-  //size_t m_poolSize;
-  uint64_t m_poolSize;
+  std::string m_itemsFileName;
+  // read only view of the items file, items are decoded straight from it
+  System::MemoryMappedFile m_itemsMapping;
+  // bytes of the mapping not overwritten through m_itemsFile since it was mapped
+  uint64_t m_mappingValidSize;
+  uint64_t m_cacheSize;
   std::vector<uint64_t> m_offsets;
   uint64_t m_itemsFileSize;
-  std::map<uint64_t, ItemEntry> m_items;
-  std::list<CacheEntry> m_cache;
+  // items and size of the files as last written, the rest waits in m_pendingItems
+  uint64_t m_committedCount;
+  uint64_t m_committedItemsSize;
+  bool m_batching;
+  uint64_t m_maxPendingSize;
+  std::vector<uint8_t> m_pendingItems;
+  CacheList m_recent;
+  CacheList m_frequent;
+  uint64_t m_recentBytes;
+  uint64_t m_frequentBytes;
+  std::unordered_map<uint64_t, CacheLocation> m_cached;
+  // indexes recently dropped from m_recent, newest first
+  std::list<uint64_t> m_ghosts;
+  std::unordered_map<uint64_t, std::list<uint64_t>::iterator> m_ghostByIndex;
   uint64_t m_cacheHits;
   uint64_t m_cacheMisses;
-
-  T* prepare(uint64_t index);
+  uint64_t m_prefetched;
+  unsigned m_pins;
+  // guards the cache, and m_offsets and the mapping against the read ahead thread
+  std::mutex m_cacheMutex;
+
+  uint64_t m_readAhead;
+  uint64_t m_lastAccess;
+  unsigned m_sequentialAccesses;
+  uint64_t m_prefetchNext;
+  uint64_t m_prefetchEnd;
+  // bumped whenever stored items change, so a decode in flight is dropped
+  uint64_t m_generation;
+  bool m_stopPrefetch;
+  // Decoded ahead items wait here until asked for. Nothing handed out lives
+  // here, so the read ahead thread never evicts an item a caller still holds.
+  std::unordered_map<uint64_t, T> m_readAheadItems;
+  std::condition_variable m_prefetchCondition;
+  std::thread m_prefetchThread;
+
+  T* insert(uint64_t index, uint64_t bytes);
+  void evict(uint64_t index);
+  void makeRoom(uint64_t bytes);
+  void forget(CacheQueue queue);
+  void clearCache();
+  void noteAccess(uint64_t index);
+  void prefetch();
+  void stopPrefetch();
+  void flushPending();
+  void writeIndexEntries(uint64_t first, const std::vector<IndexEntry>& entries);
+  void writeCount(uint64_t count);
+  bool loadIndex(const std::string& indexFileName);
+  static uint32_t checksum(const uint8_t* data, size_t size);
+  bool mapItems(uint64_t requiredSize);
+  uint64_t itemSize(uint64_t index) const;
 };
 
-template<class T> SwappedVector<T>::SwappedVector() {
+template<class T> SwappedVector<T>::SwappedVector() : m_mappingValidSize(0), m_cacheSize(0), m_itemsFileSize(0),
+  m_committedCount(0), m_committedItemsSize(0), m_batching(false), m_maxPendingSize(0), m_recentBytes(0), m_frequentBytes(0),
+  m_cacheHits(0), m_cacheMisses(0), m_prefetched(0), m_pins(0), m_readAhead(0), m_lastAccess(0), m_sequentialAccesses(0),
+  m_prefetchNext(0), m_prefetchEnd(0), m_generation(0), m_stopPrefetch(false) {
 }
 
 template<class T> SwappedVector<T>::~SwappedVector() {
   close();
 }
 
-template<class T> bool SwappedVector<T>::open(const std::string& itemFileName, const std::string& indexFileName, uint64_t poolSize) { //size_t poolSize) {
-  if (poolSize == 0) {
+template<class T> bool SwappedVector<T>::open(const std::string& itemFileName, const std::string& indexFileName, uint64_t cacheSize) {
+  if (cacheSize == 0) {
     //fprintf(stderr, "\nFedoragold: The file pool size is zero.\n");
     return false;
   }
@@ -195,67 +319,19 @@ template<class T> bool SwappedVector<T>::open(const std::string& itemFileName, c
   m_itemsFile.open(itemFileName, std::ios::in | std::ios::out | std::ios::binary);
   m_indexesFile.open(indexFileName, std::ios::in | std::ios::out | std::ios::binary);
   if (m_itemsFile && m_indexesFile) {
-
-    uint64_t count;
-    try {
-      m_indexesFile.read(reinterpret_cast<char*>(&count), sizeof count);
-    } catch(...) { return false; }
-
-    if (!m_indexesFile) {
-      //fprintf(stderr, "\nFedoragold could not open indexes file or block file.\n");
+    m_itemsFileName = itemFileName;
+    if (!loadIndex(indexFileName)) {
       return false;
     }
-
-    //fprintf(stderr, "indexes count is: %llu\n", count);
-
-    std::vector<uint64_t> offsets;
-    offsets.reserve(count);
-    uint64_t itemsFileSize = 0;
-
-    for (uint64_t i = 0; i < count; ++i) {
-      uint32_t itemSize=0;
-
-      try {
-        m_indexesFile.read(reinterpret_cast<char*>(&itemSize), sizeof itemSize);
-        //fprintf(stderr, "itemSize: %u, iteration: %llu, of: %llu\n", itemSize, i, count);
-        offsets.push_back(itemsFileSize);
-      } catch(std::exception& e) {
-        //fprintf(stderr, "exception reading indexes: %s\n", e.what());
-
-        if (!m_indexesFile.eof()) {
-          //fprintf(stderr, "\nFedoragold could not read from indexes file.\n");
-          return false;
-        }
-        else {
-          fprintf(stderr, "Blockchain indexes file appears to be corrupted. Attempting automatic recovery\n");
-          fprintf(stderr, " by rewinding to %s\n", std::to_string(i).c_str());
-          m_indexesFile.clear(); //clear the error
-          m_indexesFile.seekp(0); //retain compability with C98
-          m_indexesFile.write(reinterpret_cast<char*>(&i), sizeof i); //update the count
-          m_indexesFile.flush(); //commit
-          break;
-        }
-      }
-
-      itemsFileSize += itemSize;
-    }
-
-    m_offsets.swap(offsets);
-    m_itemsFileSize = itemsFileSize;
-
   } else {
-
-    //fprintf(stderr, "\nClose cases here...\n");
-
     m_itemsFile.open(itemFileName, std::ios::out | std::ios::binary);
     m_itemsFile.close();
     m_indexesFile.close();
     m_itemsFile.open(itemFileName, std::ios::in | std::ios::out | std::ios::binary);
     m_indexesFile.open(indexFileName, std::ios::out | std::ios::binary);
-    uint64_t count = 0;
-    m_indexesFile.write(reinterpret_cast<char*>(&count), sizeof count);
+    uint64_t header[2] = { INDEX_MAGIC, 0 };
+    m_indexesFile.write(reinterpret_cast<char*>(header), sizeof header);
     if (!m_indexesFile) {
-      //fprintf(stderr, "\nFedoragold could not create indexes file.\n");
       return false;
     }
 
@@ -265,19 +341,42 @@ template<class T> bool SwappedVector<T>::open(const std::string& itemFileName, c
     m_itemsFileSize = 0;
   }
 
-  m_poolSize = poolSize;
-  //fprintf(stderr, "poolsize is: %llu\n", m_poolSize);
+  m_cacheSize = cacheSize;
+  m_committedCount = m_offsets.size();
+  m_committedItemsSize = m_itemsFileSize;
+  m_batching = false;
+  m_pendingItems.clear();
+
+  m_itemsFileName = itemFileName;
+  mapItems(m_itemsFileSize);
 
-  m_items.clear();
-  m_cache.clear();
+  clearCache();
   m_cacheHits = 0;
   m_cacheMisses = 0;
+  m_prefetched = 0;
 
   //fprintf(stderr, "\nSwapVector.open completed\n");
   return true;
 }
 
 template<class T> void SwappedVector<T>::close() {
+  stopPrefetch();
+
+  {
+    std::lock_guard<std::mutex> lk(m_cacheMutex);
+    try {
+      flushPending();
+    } catch (std::exception&) {
+      // the unwritten tail is simply missing on the next start
+    }
+
+    m_batching = false;
+  }
+
+  std::error_code ignore;
+  m_itemsMapping.close(ignore);
+  m_mappingValidSize = 0;
+
   //jojapoppa, add this to the regular log output... stdout doesn't work well with the GUI
   //std::cout << "SwappedVector cache hits: " << m_cacheHits << ", misses: " << m_cacheMisses << " (" << std::fixed << std::setprecision(2) << static_cast<double>(m_cacheMisses) / (m_cacheHits + m_cacheMisses) * 100 << "%)" << std::endl;
 }
@@ -299,32 +398,56 @@ template<class T> typename SwappedVector<T>::const_iterator SwappedVector<T>::en
 }
 
 template<class T> const T& SwappedVector<T>::operator[](uint64_t index) {
-  auto itemIter = m_items.find(index);
-  if (itemIter != m_items.end()) {
-    if (itemIter->second.cacheIter != --m_cache.end()) {
-      m_cache.splice(m_cache.end(), m_cache, itemIter->second.cacheIter);
+  std::lock_guard<std::mutex> lk(m_cacheMutex);
+  noteAccess(index);
+
+  auto cached = m_cached.find(index);
+  if (cached != m_cached.end()) {
+    CacheLocation& location = cached->second;
+    if (location.queue == FREQUENT_QUEUE) {
+      m_frequent.splice(m_frequent.begin(), m_frequent, location.entry);
     }
 
     ++m_cacheHits;
-    return itemIter->second.item;
+    return location.entry->item;
   }
 
   if (index >= m_offsets.size()) {
     throw std::runtime_error("SwappedVector::operator[]");
   }
 
-  if (!m_itemsFile) {
-    throw std::runtime_error("SwappedVector::operator[]");
+  auto readAhead = m_readAheadItems.find(index);
+  if (readAhead != m_readAheadItems.end()) {
+    T* item = insert(index, itemSize(index));
+    std::swap(readAhead->second, *item);
+    m_readAheadItems.erase(readAhead);
+    ++m_prefetched;
+    return *item;
   }
 
-  m_itemsFile.seekg(m_offsets[index]);
   T tempItem;
-  
-  Common::StdInputStream stream(m_itemsFile);
-  CryptoNote::BinaryInputStreamSerializer archive(stream);
-  serialize(tempItem, archive);
+  uint64_t offset = m_offsets[index];
+  uint64_t size = itemSize(index);
+  if (offset >= m_committedItemsSize) {
+    Common::MemoryInputStream stream(m_pendingItems.data() + (offset - m_committedItemsSize), static_cast<size_t>(size));
+    CryptoNote::BinaryInputStreamSerializer archive(stream);
+    serialize(tempItem, archive);
+  } else if (mapItems(offset + size)) {
+    Common::MemoryInputStream stream(m_itemsMapping.data() + offset, static_cast<size_t>(size));
+    CryptoNote::BinaryInputStreamSerializer archive(stream);
+    serialize(tempItem, archive);
+  } else {
+    if (!m_itemsFile) {
+      throw std::runtime_error("SwappedVector::operator[]");
+    }
+
+    m_itemsFile.seekg(offset);
+    Common::StdInputStream stream(m_itemsFile);
+    CryptoNote::BinaryInputStreamSerializer archive(stream);
+    serialize(tempItem, archive);
+  }
 
-  T* item = prepare(index);
+  T* item = insert(index, size);
   std::swap(tempItem, *item);
   ++m_cacheMisses;
   return *item;
@@ -343,94 +466,593 @@ template<class T> void SwappedVector<T>::clear() {
     throw std::runtime_error("SwappedVector::clear");
   }
 
-  m_indexesFile.seekp(0);
+  m_indexesFile.seekp(INDEX_COUNT_POSITION);
   uint64_t count = 0;
   m_indexesFile.write(reinterpret_cast<char*>(&count), sizeof count);
   if (!m_indexesFile) {
     throw std::runtime_error("SwappedVector::clear");
   }
 
+  std::lock_guard<std::mutex> lk(m_cacheMutex);
   m_offsets.clear();
   m_itemsFileSize = 0;
-  m_items.clear();
-  m_cache.clear();
+  m_mappingValidSize = 0;
+  m_committedCount = 0;
+  m_committedItemsSize = 0;
+  m_pendingItems.clear();
+  clearCache();
 }
 
 template<class T> void SwappedVector<T>::pop_back() {
-  if (!m_indexesFile) {
-    throw std::runtime_error("SwappedVector::pop_back");
-  }
+  std::lock_guard<std::mutex> lk(m_cacheMutex);
+  if (m_offsets.size() > m_committedCount) {
+    // never written, just forget it
+    m_pendingItems.resize(m_offsets.back() - m_committedItemsSize);
+  } else {
+    if (!m_indexesFile) {
+      throw std::runtime_error("SwappedVector::pop_back");
+    }
 
-  m_indexesFile.seekp(0);
-  uint64_t count = m_offsets.size() - 1;
-  m_indexesFile.write(reinterpret_cast<char*>(&count), sizeof count);
-  if (!m_indexesFile) {
-    throw std::runtime_error("SwappedVector::pop_back");
+    m_indexesFile.seekp(INDEX_COUNT_POSITION);
+    uint64_t count = m_offsets.size() - 1;
+    m_indexesFile.write(reinterpret_cast<char*>(&count), sizeof count);
+    if (!m_indexesFile) {
+      throw std::runtime_error("SwappedVector::pop_back");
+    }
+
+    m_committedCount = count;
+    m_committedItemsSize = m_offsets.back();
   }
 
   m_itemsFileSize = m_offsets.back();
   m_offsets.pop_back();
-  auto itemIter = m_items.find(m_offsets.size());
-  if (itemIter != m_items.end()) {
-    m_cache.erase(itemIter->second.cacheIter);
-    m_items.erase(itemIter);
-  }
+  ++m_generation;
+  evict(m_offsets.size());
+  m_readAheadItems.erase(m_offsets.size());
 }
 
 template<class T> void SwappedVector<T>::push_back(const T& item) {
+  std::lock_guard<std::mutex> lk(m_cacheMutex);
   uint64_t itemsFileSize;
 
-  {
+  if (m_batching) {
+    Common::VectorOutputStream stream(m_pendingItems);
+    CryptoNote::BinaryOutputStreamSerializer archive(stream);
+    serialize(const_cast<T&>(item), archive);
+
+    itemsFileSize = m_committedItemsSize + m_pendingItems.size();
+  } else {
     if (!m_itemsFile) {
       throw std::runtime_error("SwappedVector::push_back: invalid block file");
     }
 
-    m_itemsFile.seekp(m_itemsFileSize);
-
-    Common::StdOutputStream stream(m_itemsFile);
+    std::vector<uint8_t> record;
+    Common::VectorOutputStream stream(record);
     CryptoNote::BinaryOutputStreamSerializer archive(stream);
     serialize(const_cast<T&>(item), archive);
 
-    itemsFileSize = m_itemsFile.tellp();
+    m_itemsFile.seekp(m_itemsFileSize);
+    // bytes rewritten after a pop_back are stale in the current mapping
+    m_mappingValidSize = std::min(m_mappingValidSize, m_itemsFileSize);
+    m_itemsFile.write(reinterpret_cast<const char*>(record.data()), record.size());
+    if (!m_itemsFile) {
+      throw std::runtime_error("SwappedVector::push_back: could not write to block file");
+    }
+
+    itemsFileSize = m_itemsFileSize + record.size();
+
+    IndexEntry entry = { static_cast<uint32_t>(record.size()), checksum(record.data(), record.size()) };
+    writeIndexEntries(m_offsets.size(), std::vector<IndexEntry>(1, entry));
+    writeCount(m_offsets.size() + 1);
+
+    m_committedCount = m_offsets.size() + 1;
+    m_committedItemsSize = itemsFileSize;
+  }
+
+  m_offsets.push_back(m_itemsFileSize);
+  m_itemsFileSize = itemsFileSize;
+
+  T* newItem = insert(m_offsets.size() - 1, itemSize(m_offsets.size() - 1));
+  *newItem = item;
+
+  if (m_batching && m_pendingItems.size() >= m_maxPendingSize) {
+    flushPending();
+  }
+}
+
+template<class T> void SwappedVector<T>::beginBatch(uint64_t maxPendingSize) {
+  std::lock_guard<std::mutex> lk(m_cacheMutex);
+  m_batching = true;
+  m_maxPendingSize = maxPendingSize;
+}
+
+template<class T> void SwappedVector<T>::flush() {
+  std::lock_guard<std::mutex> lk(m_cacheMutex);
+  flushPending();
+}
+
+template<class T> void SwappedVector<T>::endBatch() {
+  std::lock_guard<std::mutex> lk(m_cacheMutex);
+  flushPending();
+  m_batching = false;
+}
+
+// Precondition: m_cacheMutex is locked.
+template<class T> void SwappedVector<T>::flushPending() {
+  if (m_offsets.size() == m_committedCount) {
+    return;
+  }
+
+  if (!m_itemsFile || !m_indexesFile) {
+    throw std::runtime_error("SwappedVector::flush: invalid block file");
+  }
+
+  m_itemsFile.seekp(m_committedItemsSize);
+  m_mappingValidSize = std::min(m_mappingValidSize, m_committedItemsSize);
+  m_itemsFile.write(reinterpret_cast<const char*>(m_pendingItems.data()), m_pendingItems.size());
+  m_itemsFile.flush();
+  if (!m_itemsFile) {
+    throw std::runtime_error("SwappedVector::flush: could not write to block file");
+  }
+
+  std::vector<IndexEntry> entries;
+  entries.reserve(m_offsets.size() - m_committedCount);
+  for (uint64_t i = m_committedCount; i < m_offsets.size(); ++i) {
+    IndexEntry entry = { static_cast<uint32_t>(itemSize(i)), checksum(m_pendingItems.data() + (m_offsets[i] - m_committedItemsSize), itemSize(i)) };
+    entries.push_back(entry);
+  }
+
+  writeIndexEntries(m_committedCount, entries);
+  m_indexesFile.flush();
+  uint64_t count = m_offsets.size();
+  writeCount(count);
+  m_indexesFile.flush();
+  if (!m_indexesFile) {
+    throw std::runtime_error("SwappedVector::flush: could not write count to indexes file");
+  }
+
+  m_committedCount = count;
+  m_committedItemsSize = m_itemsFileSize;
+  m_pendingItems.clear();
+}
+
+template<class T> bool SwappedVector<T>::mapAll() {
+  return m_offsets.size() == m_committedCount && (m_itemsFileSize == 0 || mapItems(m_itemsFileSize));
+}
+
+template<class T> bool SwappedVector<T>::load(uint64_t index, T& item) const {
+  if (index >= m_offsets.size()) {
+    return false;
+  }
+
+  uint64_t offset = m_offsets[index];
+  uint64_t size = itemSize(index);
+  if (!m_itemsMapping.isOpened() || offset + size > m_mappingValidSize) {
+    return false;
+  }
+
+  Common::MemoryInputStream stream(m_itemsMapping.data() + offset, static_cast<size_t>(size));
+  CryptoNote::BinaryInputStreamSerializer archive(stream);
+  serialize(item, archive);
+  return true;
+}
+
+template<class T> uint64_t SwappedVector<T>::rawSize(uint64_t index) const {
+  return index < m_offsets.size() ? itemSize(index) : 0;
+}
+
+template<class T> bool SwappedVector<T>::readRaw(uint64_t index, uint64_t offset, uint64_t size, void* data) {
+  if (index >= m_offsets.size() || offset + size > itemSize(index)) {
+    return false;
+  }
+
+  // the mapping may be replaced by a reader missing the cache, copy under its lock
+  std::lock_guard<std::mutex> lk(m_cacheMutex);
+  uint64_t position = m_offsets[index] + offset;
+  if (m_offsets[index] >= m_committedItemsSize) {
+    memcpy(data, m_pendingItems.data() + (position - m_committedItemsSize), static_cast<size_t>(size));
+    return true;
+  }
+
+  if (mapItems(position + size)) {
+    memcpy(data, m_itemsMapping.data() + position, static_cast<size_t>(size));
+    return true;
+  }
+
+  if (!m_itemsFile) {
+    return false;
+  }
+
+  m_itemsFile.seekg(position);
+  m_itemsFile.read(static_cast<char*>(data), size);
+  return static_cast<bool>(m_itemsFile);
+}
+
+template<class T> void SwappedVector<T>::pin() {
+  std::lock_guard<std::mutex> lk(m_cacheMutex);
+  ++m_pins;
+}
+
+template<class T> void SwappedVector<T>::unpin() {
+  std::lock_guard<std::mutex> lk(m_cacheMutex);
+  assert(m_pins > 0);
+  if (--m_pins == 0) {
+    makeRoom(0);
+  }
+}
+
+template<class T> void SwappedVector<T>::setReadAhead(uint64_t count) {
+  std::lock_guard<std::mutex> lk(m_cacheMutex);
+  m_readAhead = count;
+  m_prefetchEnd = m_prefetchNext;
+  if (m_readAhead > 0 && !m_prefetchThread.joinable()) {
+    m_stopPrefetch = false;
+    m_prefetchThread = std::thread(&SwappedVector<T>::prefetch, this);
+  }
+}
+
+template<class T> typename SwappedVector<T>::CacheStatistics SwappedVector<T>::getCacheStatistics() {
+  std::lock_guard<std::mutex> lk(m_cacheMutex);
+  CacheStatistics statistics = { m_cacheHits, m_cacheMisses, m_prefetched, m_cached.size(), m_recentBytes + m_frequentBytes, m_cacheSize };
+  return statistics;
+}
+
+// Precondition: m_cacheMutex is locked.
+// New items go to the FIFO unless they were dropped from it not long ago.
+// Room is made before inserting, so the returned item survives until the next call.
+template<class T> T* SwappedVector<T>::insert(uint64_t index, uint64_t bytes) {
+  evict(index);
+  makeRoom(bytes);
+
+  CacheQueue queue = RECENT_QUEUE;
+  auto ghost = m_ghostByIndex.find(index);
+  if (ghost != m_ghostByIndex.end()) {
+    m_ghosts.erase(ghost->second);
+    m_ghostByIndex.erase(ghost);
+    queue = FREQUENT_QUEUE;
+  }
+
+  CacheList& list = queue == RECENT_QUEUE ? m_recent : m_frequent;
+  (queue == RECENT_QUEUE ? m_recentBytes : m_frequentBytes) += bytes;
+  CacheEntry entry = { index, bytes, T() };
+  list.push_front(std::move(entry));
+  CacheLocation location = { queue, list.begin() };
+  m_cached[index] = location;
+  return &list.front().item;
+}
+
+template<class T> void SwappedVector<T>::evict(uint64_t index) {
+  auto cached = m_cached.find(index);
+  if (cached != m_cached.end()) {
+    CacheLocation& location = cached->second;
+    if (location.queue == RECENT_QUEUE) {
+      m_recentBytes -= location.entry->bytes;
+      m_recent.erase(location.entry);
+    } else {
+      m_frequentBytes -= location.entry->bytes;
+      m_frequent.erase(location.entry);
+    }
+
+    m_cached.erase(cached);
+  }
+}
+
+// Precondition: m_cacheMutex is locked.
+template<class T> void SwappedVector<T>::makeRoom(uint64_t bytes) {
+  if (m_pins > 0) {
+    return;
+  }
+
+  while (!m_cached.empty() && m_recentBytes + m_frequentBytes + bytes > m_cacheSize) {
+    forget(m_frequent.empty() || m_recentBytes > m_cacheSize / 4 ? RECENT_QUEUE : FREQUENT_QUEUE);
+  }
+
+  // a re-use gap of up to twice the cached item count still counts as hot
+  size_t ghosts = std::max<size_t>(2 * m_cached.size(), 1024);
+  while (m_ghosts.size() > ghosts) {
+    m_ghostByIndex.erase(m_ghosts.back());
+    m_ghosts.pop_back();
+  }
+}
+
+template<class T> void SwappedVector<T>::forget(CacheQueue queue) {
+  CacheList& list = queue == RECENT_QUEUE ? m_recent : m_frequent;
+  assert(!list.empty());
+  uint64_t index = list.back().index;
+  (queue == RECENT_QUEUE ? m_recentBytes : m_frequentBytes) -= list.back().bytes;
+  list.pop_back();
+  m_cached.erase(index);
+
+  if (queue == RECENT_QUEUE && m_ghostByIndex.find(index) == m_ghostByIndex.end()) {
+    m_ghosts.push_front(index);
+    m_ghostByIndex[index] = m_ghosts.begin();
+  }
+}
+
+template<class T> void SwappedVector<T>::clearCache() {
+  m_recent.clear();
+  m_frequent.clear();
+  m_recentBytes = 0;
+  m_frequentBytes = 0;
+  m_cached.clear();
+  m_ghosts.clear();
+  m_ghostByIndex.clear();
+  m_readAheadItems.clear();
+  m_prefetchNext = 0;
+  m_prefetchEnd = 0;
+  m_sequentialAccesses = 0;
+  ++m_generation;
+}
+
+// Precondition: m_cacheMutex is locked.
+// Three forward steps in a row count as a scan, the read ahead window is
+// then refilled whenever less than half of it is left.
+template<class T> void SwappedVector<T>::noteAccess(uint64_t index) {
+  m_sequentialAccesses = index == m_lastAccess + 1 ? m_sequentialAccesses + 1 : 0;
+  m_lastAccess = index;
+  if (m_readAhead == 0 || m_sequentialAccesses < 2 || index + m_readAhead / 2 < m_prefetchEnd) {
+    return;
+  }
+
+  m_prefetchNext = std::max(m_prefetchNext, index + 1);
+  m_prefetchEnd = std::min<uint64_t>(index + 1 + m_readAhead, m_offsets.size());
+  if (m_prefetchNext < m_prefetchEnd) {
+    m_prefetchCondition.notify_one();
+  }
+}
+
+// Read ahead thread. Only the bytes are copied under the lock, decoding runs
+// without it, and the item is dropped if the vector changed meanwhile. The
+// file is never touched from here, items not yet mapped are left alone.
+// m_prefetched counts the decoded ahead items that were actually used.
+template<class T> void SwappedVector<T>::prefetch() {
+  std::unique_lock<std::mutex> lk(m_cacheMutex);
+  for (;;) {
+    m_prefetchCondition.wait(lk, [this] { return m_stopPrefetch || m_prefetchNext < m_prefetchEnd; });
+    if (m_stopPrefetch) {
+      return;
+    }
+
+    uint64_t index = m_prefetchNext++;
+    if (index >= m_offsets.size() || m_cached.find(index) != m_cached.end() || m_readAheadItems.find(index) != m_readAheadItems.end()) {
+      continue;
+    }
+
+    uint64_t offset = m_offsets[index];
+    uint64_t size = itemSize(index);
+    if (!m_itemsMapping.isOpened() || offset + size > m_mappingValidSize) {
+      m_prefetchNext = m_prefetchEnd;
+      continue;
+    }
+
+    std::vector<uint8_t> record(m_itemsMapping.data() + offset, m_itemsMapping.data() + offset + size);
+    uint64_t generation = m_generation;
+    lk.unlock();
+
+    T item;
+    bool decoded = true;
+    try {
+      Common::MemoryInputStream stream(record.data(), record.size());
+      CryptoNote::BinaryInputStreamSerializer archive(stream);
+      serialize(item, archive);
+    } catch (std::exception&) {
+      decoded = false;
+    }
+
+    lk.lock();
+    if (decoded && generation == m_generation && m_cached.find(index) == m_cached.end()) {
+      // whatever an abandoned scan left behind goes first
+      if (m_readAheadItems.size() >= 2 * m_readAhead) {
+        m_readAheadItems.clear();
+      }
+
+      std::swap(m_readAheadItems[index], item);
+    }
+  }
+}
+
+template<class T> void SwappedVector<T>::stopPrefetch() {
+  if (!m_prefetchThread.joinable()) {
+    return;
   }
 
   {
-    if (!m_indexesFile) {
-      throw std::runtime_error("SwappedVector::push_back: invalid block indexes file");
+    std::lock_guard<std::mutex> lk(m_cacheMutex);
+    m_stopPrefetch = true;
+  }
+
+  m_prefetchCondition.notify_one();
+  m_prefetchThread.join();
+}
+
+template<class T> void SwappedVector<T>::writeIndexEntries(uint64_t first, const std::vector<IndexEntry>& entries) {
+  if (!m_indexesFile) {
+    throw std::runtime_error("SwappedVector: invalid indexes file");
+  }
+
+  m_indexesFile.seekp(INDEX_HEADER_SIZE + sizeof(IndexEntry) * first);
+  m_indexesFile.write(reinterpret_cast<const char*>(entries.data()), sizeof(IndexEntry) * entries.size());
+  if (!m_indexesFile) {
+    throw std::runtime_error("SwappedVector: could not write to indexes file");
+  }
+}
+
+template<class T> void SwappedVector<T>::writeCount(uint64_t count) {
+  m_indexesFile.seekp(INDEX_COUNT_POSITION);
+  m_indexesFile.write(reinterpret_cast<char*>(&count), sizeof count);
+  if (!m_indexesFile) {
+    throw std::runtime_error("SwappedVector: could not write count to indexes file");
+  }
+}
+
+// Reads the index and checks the newest items against their checksums. The
+// count is cut back to the first item that is missing from the items file or
+// fails its checksum, so a damaged tail costs only the items after it.
+template<class T> bool SwappedVector<T>::loadIndex(const std::string& indexFileName) {
+  std::vector<IndexEntry> entries;
+  bool legacy = false;
+  {
+    System::MemoryMappedFile indexesMapping;
+    std::error_code ec;
+    indexesMapping.openReadOnly(indexFileName, ec);
+    if (ec || indexesMapping.size() < sizeof(uint64_t)) {
+      return false;
     }
 
-    m_indexesFile.seekp(sizeof(uint64_t) + sizeof(uint32_t) * m_offsets.size());
-    uint32_t itemSize = static_cast<uint32_t>(itemsFileSize - m_itemsFileSize);
-    m_indexesFile.write(reinterpret_cast<char*>(&itemSize), sizeof itemSize);
-    if (!m_indexesFile) {
-      throw std::runtime_error("SwappedVector::push_back: could not write to indexes file");
+    uint64_t magic;
+    memcpy(&magic, indexesMapping.data(), sizeof magic);
+    if (magic == INDEX_MAGIC) {
+      if (indexesMapping.size() < INDEX_HEADER_SIZE) {
+        return false;
+      }
+
+      uint64_t count;
+      memcpy(&count, indexesMapping.data() + INDEX_COUNT_POSITION, sizeof count);
+      count = std::min<uint64_t>(count, (indexesMapping.size() - INDEX_HEADER_SIZE) / sizeof(IndexEntry));
+      entries.resize(count);
+      memcpy(entries.data(), indexesMapping.data() + INDEX_HEADER_SIZE, sizeof(IndexEntry) * count);
+    } else {
+      legacy = true;
+      uint64_t count = std::min<uint64_t>(magic, (indexesMapping.size() - sizeof(uint64_t)) / sizeof(uint32_t));
+      entries.resize(count);
+      for (uint64_t i = 0; i < count; ++i) {
+        memcpy(&entries[i].size, indexesMapping.data() + sizeof(uint64_t) + i * sizeof(uint32_t), sizeof(uint32_t));
+      }
+    }
+  }
+
+  m_itemsFile.seekg(0, std::ios::end);
+  uint64_t itemsFileSize = static_cast<uint64_t>(m_itemsFile.tellg());
+  m_offsets.clear();
+  m_offsets.reserve(entries.size());
+  uint64_t offset = 0;
+  for (const IndexEntry& entry : entries) {
+    if (offset + entry.size > itemsFileSize) {
+      break;
+    }
+
+    m_offsets.push_back(offset);
+    offset += entry.size;
+  }
+
+  uint64_t count = m_offsets.size();
+  m_itemsFileSize = offset;
+  m_mappingValidSize = 0;
+  bool mapped = count > 0 && mapItems(m_itemsFileSize);
+  std::vector<uint8_t> buffer;
+  auto itemChecksum = [&](uint64_t index) {
+    if (mapped) {
+      return checksum(m_itemsMapping.data() + m_offsets[index], entries[index].size);
+    }
+
+    buffer.resize(entries[index].size);
+    m_itemsFile.clear();
+    m_itemsFile.seekg(m_offsets[index]);
+    m_itemsFile.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+    return checksum(buffer.data(), buffer.size());
+  };
+
+  if (legacy) {
+    fprintf(stderr, "Adding checksums to %s, this is done once\n", indexFileName.c_str());
+    for (uint64_t i = 0; i < count; ++i) {
+      entries[i].checksum = itemChecksum(i);
+    }
+  } else {
+    uint64_t first = count;
+    uint64_t verifiedSize = 0;
+    while (first > 0 && count - first < VERIFIED_TAIL_ITEMS && verifiedSize < VERIFIED_TAIL_SIZE) {
+      --first;
+      verifiedSize += entries[first].size;
+    }
+
+    for (uint64_t i = first; i < count; ++i) {
+      if (itemChecksum(i) != entries[i].checksum) {
+        count = i;
+        break;
+      }
+    }
+  }
+
+  uint64_t storedCount = entries.size();
+  if (count < storedCount) {
+    fprintf(stderr, "%s is damaged at item %s, dropping %s items from there on\n", indexFileName.c_str(),
+      std::to_string(count).c_str(), std::to_string(entries.size() - count).c_str());
+    m_itemsFileSize = count < m_offsets.size() ? m_offsets[count] : m_itemsFileSize;
+    m_offsets.resize(count);
+  }
+
+  entries.resize(count);
+  if (legacy) {
+    // written aside and renamed over the old index, a crash leaves either one
+    std::string newIndexFileName = indexFileName + ".new";
+    {
+      std::ofstream newIndex(newIndexFileName, std::ios::binary | std::ios::trunc);
+      uint64_t header[2] = { INDEX_MAGIC, count };
+      newIndex.write(reinterpret_cast<const char*>(header), sizeof header);
+      newIndex.write(reinterpret_cast<const char*>(entries.data()), sizeof(IndexEntry) * entries.size());
+      if (!newIndex) {
+        return false;
+      }
     }
 
-    m_indexesFile.seekp(0);
-    uint64_t count = m_offsets.size() + 1;
+    m_indexesFile.close();
+    if (std::rename(newIndexFileName.c_str(), indexFileName.c_str()) != 0) {
+      std::remove(indexFileName.c_str());
+      if (std::rename(newIndexFileName.c_str(), indexFileName.c_str()) != 0) {
+        return false;
+      }
+    }
+
+    m_indexesFile.open(indexFileName, std::ios::in | std::ios::out | std::ios::binary);
+    if (!m_indexesFile) {
+      return false;
+    }
+  } else if (count < storedCount) {
+    m_indexesFile.seekp(INDEX_COUNT_POSITION);
     m_indexesFile.write(reinterpret_cast<char*>(&count), sizeof count);
+    m_indexesFile.flush();
     if (!m_indexesFile) {
-      throw std::runtime_error("SwappedVector::push_back: could not write count to indexes file. file error");
+      return false;
     }
   }
 
-  m_offsets.push_back(m_itemsFileSize);
-  m_itemsFileSize = itemsFileSize;
+  return true;
+}
 
-  T* newItem = prepare(m_offsets.size() - 1);
-  *newItem = item;
+template<class T> uint32_t SwappedVector<T>::checksum(const uint8_t* data, size_t size) {
+  Crypto::Hash hash = Crypto::cn_fast_hash(data, size);
+  uint32_t result;
+  memcpy(&result, &hash, sizeof result);
+  return result;
+}
+
+template<class T> uint64_t SwappedVector<T>::itemSize(uint64_t index) const {
+  uint64_t end = index + 1 < m_offsets.size() ? m_offsets[index + 1] : m_itemsFileSize;
+  return end - m_offsets[index];
 }
 
-template<class T> T* SwappedVector<T>::prepare(uint64_t index) {
-  if (m_items.size() == m_poolSize) {
-    auto cacheIter = m_cache.begin();
-    m_items.erase(cacheIter->itemIter);
-    m_cache.erase(cacheIter);
+// Makes sure the first requiredSize bytes of the items file can be read from
+// the mapping, remapping after appends. Returns false if the file can not be
+// mapped, the caller then falls back to stream reads.
+template<class T> bool SwappedVector<T>::mapItems(uint64_t requiredSize) {
+  if (requiredSize == 0) {
+    return false;
+  }
+
+  if (m_itemsMapping.isOpened() && requiredSize <= m_mappingValidSize) {
+    return true;
+  }
+
+  // the mapping only sees what was handed to the OS
+  m_itemsFile.flush();
+
+  std::error_code ec;
+  m_itemsMapping.openReadOnly(m_itemsFileName, ec);
+  if (ec) {
+    m_mappingValidSize = 0;
+    return false;
   }
 
-  auto itemIter = m_items.insert(std::make_pair(index, ItemEntry()));
-  CacheEntry cacheEntry = { itemIter.first };
-  auto cacheIter = m_cache.insert(m_cache.end(), cacheEntry);
-  itemIter.first->second.cacheIter = cacheIter;
-  return &itemIter.first->second.item;
+  m_mappingValidSize = m_itemsMapping.size();
+  return requiredSize <= m_mappingValidSize;
 }
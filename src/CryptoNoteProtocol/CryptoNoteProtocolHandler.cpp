@@ -376,10 +376,21 @@ int CryptoNoteProtocolHandler::handle_response_get_objects(int command,
   updateObservedHeight(arg.current_blockchain_height, context);
   context.m_remote_blockchain_height = arg.current_blockchain_height;
 
+  // every blob is parsed here once, the blocks are handed on parsed
+  std::vector<Block> blocks;
+  blocks.reserve(arg.blocks.size());
   size_t count = 0;
   for (const block_complete_entry& block_entry : arg.blocks) {
     ++count;
-    Block b;
+    if (block_entry.block.size() > m_currency.maxBlockBlobSize()) {
+      logger(Logging::ERROR) << context << "sent wrong block: " <<
+        "too big size " << block_entry.block.size() << ", dropping connection";
+      context.m_state = CryptoNoteConnectionContext::state_shutdown;
+      return 1;
+    }
+
+    blocks.emplace_back();
+    Block& b = blocks.back();
     if (!fromBinaryArray(b, asBinaryArray(block_entry.block))) {
       logger(Logging::ERROR) << context << "sent wrong block: " << 
         "failed to parse and validate block: \r\n" << toHex(asBinaryArray(block_entry.block)) <<
@@ -388,10 +399,12 @@ int CryptoNoteProtocolHandler::handle_response_get_objects(int command,
       return 1;
     }
 
+    auto blockHash = get_block_hash(b);
+
     // to avoid concurrency in core between connections, 
     // suspend connections which delivered block later than first one
     if (count == 2) {
-      if (m_core.have_block(get_block_hash(b))) {
+      if (m_core.have_block(blockHash)) {
         context.m_state = CryptoNoteConnectionContext::state_idle;
         context.m_needed_objects.clear();
         context.m_requested_objects.clear();
@@ -400,7 +413,6 @@ int CryptoNoteProtocolHandler::handle_response_get_objects(int command,
       }
     }
 
-    auto blockHash = get_block_hash(b);
     auto req_it = context.m_requested_objects.find(blockHash);
     if (req_it == context.m_requested_objects.end()) {
       logger(Logging::ERROR) << context << "sent wrong NOTIFY_RESPONSE_GET_OBJECTS: " <<
@@ -435,7 +447,25 @@ int CryptoNoteProtocolHandler::handle_response_get_objects(int command,
     m_core.pause_mining();
     BOOST_SCOPE_EXIT_ALL(this) { m_core.update_block_template_and_resume_mining(); };
 
-    int result = processObjects(context, arg.blocks);
+    // a response carries up to BLOCKS_SYNCHRONIZING_DEFAULT_COUNT blocks, write them in one go
+    m_core.begin_block_batch();
+    bool batchEnded = false;
+    BOOST_SCOPE_EXIT_ALL(this, &batchEnded) {
+      if (!batchEnded) {
+        m_core.end_block_batch();
+      }
+    };
+
+    m_core.precompute_proof_of_work(blocks);
+
+    int result = processObjects(context, arg.blocks, blocks);
+    batchEnded = true;
+    if (!m_core.end_block_batch()) {
+      logger(Logging::ERROR, Logging::BRIGHT_RED) << context << "Failed to write blocks, stopping synchronization";
+      context.m_state = CryptoNoteConnectionContext::state_shutdown;
+      return 1;
+    }
+
     if (result != 0) {
       return result;
     }
@@ -453,11 +483,12 @@ int CryptoNoteProtocolHandler::handle_response_get_objects(int command,
   return 1;
 }
 
-int CryptoNoteProtocolHandler::processObjects(CryptoNoteConnectionContext& context, const std::vector<block_complete_entry>& blocks) {
+int CryptoNoteProtocolHandler::processObjects(CryptoNoteConnectionContext& context, const std::vector<block_complete_entry>& blockEntries, const std::vector<Block>& blocks) {
 
   //logger(DEBUGGING) << "processObjects!!!!!!!!!!!!!!";
 	
-  for (const block_complete_entry& block_entry : blocks) {
+  for (size_t i = 0; i < blockEntries.size(); ++i) {
+    const block_complete_entry& block_entry = blockEntries[i];
     if (m_stop) {
       break;
     }
@@ -490,7 +521,7 @@ int CryptoNoteProtocolHandler::processObjects(CryptoNoteConnectionContext& conte
 
     // process block
     block_verification_context bvc = boost::value_initialized<block_verification_context>();
-    m_core.handle_incoming_block_blob(asBinaryArray(block_entry.block), bvc, false, false);
+    m_core.handle_incoming_block(blocks[i], bvc, false, false);
 
     if (bvc.m_verifivation_failed) {
       logger(Logging::DEBUGGING) << context << "Block verification failed, dropping connection";
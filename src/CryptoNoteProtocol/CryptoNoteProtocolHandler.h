@@ -82,7 +82,7 @@ namespace CryptoNote
     bool on_connection_not_synchronized();
     void updateObservedHeight(uint32_t peerHeight, const CryptoNoteConnectionContext& context);
     void recalculateMaxObservedHeight(const CryptoNoteConnectionContext& context);
-    int processObjects(CryptoNoteConnectionContext& context, const std::vector<block_complete_entry>& blocks);
+    int processObjects(CryptoNoteConnectionContext& context, const std::vector<block_complete_entry>& blockEntries, const std::vector<Block>& blocks);
     Logging::LoggerRef logger;
 
   private:
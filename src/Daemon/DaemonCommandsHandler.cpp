@@ -29,6 +29,8 @@ DaemonCommandsHandler::DaemonCommandsHandler(CryptoNote::core& core, CryptoNote:
   m_consoleHandler.setHandler("print_bc", boost::bind(&DaemonCommandsHandler::print_bc, this, _1), "Print blockchain info in a given blocks range, print_bc <begin_height> [<end_height>]");
   m_consoleHandler.setHandler("print_bci", boost::bind(&DaemonCommandsHandler::print_bci, this, _1), "Print blockchain indexes");
   m_consoleHandler.setHandler("print_bc_outs", boost::bind(&DaemonCommandsHandler::print_bc_outs, this, _1), "Print blockchain outputs");
+  m_consoleHandler.setHandler("print_bc_locks", boost::bind(&DaemonCommandsHandler::print_bc_locks, this, _1), "Print blockchain lock wait and hold times");
+  m_consoleHandler.setHandler("print_bc_cache", boost::bind(&DaemonCommandsHandler::print_bc_cache, this, _1), "Print block cache hits, misses and memory use");
   m_consoleHandler.setHandler("print_block", boost::bind(&DaemonCommandsHandler::print_block, this, _1), "Print block, print_block <block_hash> | <block_height>");
   m_consoleHandler.setHandler("print_tx", boost::bind(&DaemonCommandsHandler::print_tx, this, _1), "Print transaction, print_tx <transaction_hash>");
   m_consoleHandler.setHandler("start_mining", boost::bind(&DaemonCommandsHandler::start_mining, this, _1), "Start mining for specified address, start_mining <addr> [threads=1]");
@@ -151,6 +153,18 @@ bool DaemonCommandsHandler::print_bci(const std::vector<std::string>& args)
   m_core.print_blockchain_index();
   return true;
 }
+//--------------------------------------------------------------------------------
+bool DaemonCommandsHandler::print_bc_locks(const std::vector<std::string>& args)
+{
+  m_core.print_blockchain_lock_statistics();
+  return true;
+}
+//--------------------------------------------------------------------------------
+bool DaemonCommandsHandler::print_bc_cache(const std::vector<std::string>& args)
+{
+  m_core.print_blockchain_cache_statistics();
+  return true;
+}
 
 bool DaemonCommandsHandler::set_log(const std::vector<std::string>& args)
 {
@@ -318,4 +318,16 @@ void cn_slow_hash_f(size_t majorVersion, void * contextData, const void * data,
     cn_slow_hash(majorVersion, data, length, (char *)hash, 0, 1, 0, (uint32_t)CN_PAGE_SIZE, (uint32_t)CN_SCRATCHPAD, CN_ITERATIONS);
 }
 
+/* the portable version has no interleaved loop, the hashes are done one by one */
+void cn_slow_hash_multi_f(size_t majorVersion, void *const * contextData, const void *const * data, const size_t * length, void *const * hash, size_t count){
+    size_t i;
+    for (i = 0; i < count; i++) {
+        cn_slow_hash_f(majorVersion, contextData[i], data[i], length[i], hash[i]);
+    }
+}
+
+size_t cn_slow_hash_ways(size_t threads){
+    return 1;
+}
+
 #endif
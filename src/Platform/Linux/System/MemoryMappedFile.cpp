@@ -0,0 +1,320 @@
+// Copyright (c) 2012-2017, The CryptoNote developers, The Bytecoin developers
+// Copyright (c) 2018-2019, The TurtleCoin Developers
+//
+// Please see the included LICENSE file for more information.
+
+#include "MemoryMappedFile.h"
+
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Common/ScopeExit.h"
+
+namespace System
+{
+    MemoryMappedFile::MemoryMappedFile(): m_file(-1), m_size(0), m_data(nullptr), m_readOnly(false) {}
+
+    MemoryMappedFile::~MemoryMappedFile()
+    {
+        std::error_code ignore;
+        close(ignore);
+    }
+
+    const std::string &MemoryMappedFile::path() const
+    {
+        assert(isOpened());
+
+        return m_path;
+    }
+
+    uint64_t MemoryMappedFile::size() const
+    {
+        assert(isOpened());
+
+        return m_size;
+    }
+
+    const uint8_t *MemoryMappedFile::data() const
+    {
+        assert(isOpened());
+
+        return m_data;
+    }
+
+    uint8_t *MemoryMappedFile::data()
+    {
+        assert(isOpened());
+
+        return m_data;
+    }
+
+    bool MemoryMappedFile::isOpened() const
+    {
+        return m_data != nullptr;
+    }
+
+    void MemoryMappedFile::create(const std::string &path, uint64_t size, bool overwrite, std::error_code &ec)
+    {
+        if (isOpened())
+        {
+            close(ec);
+            if (ec)
+            {
+                return;
+            }
+        }
+
+        Tools::ScopeExit failExitHandler([this, &ec] {
+            ec = std::error_code(errno, std::system_category());
+            std::error_code ignore;
+            close(ignore);
+        });
+
+        m_file = ::open(path.c_str(), O_RDWR | O_CREAT | (overwrite ? O_TRUNC : O_EXCL), S_IRUSR | S_IWUSR);
+        if (m_file == -1)
+        {
+            return;
+        }
+
+        if (::ftruncate(m_file, static_cast<off_t>(size)) == -1)
+        {
+            return;
+        }
+
+        void *data = ::mmap(nullptr, static_cast<size_t>(size), PROT_READ | PROT_WRITE, MAP_SHARED, m_file, 0);
+        if (data == MAP_FAILED)
+        {
+            return;
+        }
+
+        m_data = static_cast<uint8_t *>(data);
+        m_size = size;
+        m_path = path;
+        m_readOnly = false;
+        ec = std::error_code();
+
+        failExitHandler.cancel();
+    }
+
+    void MemoryMappedFile::create(const std::string &path, uint64_t size, bool overwrite)
+    {
+        std::error_code ec;
+        create(path, size, overwrite, ec);
+        if (ec)
+        {
+            throw std::system_error(ec, "MemoryMappedFile::create");
+        }
+    }
+
+    void MemoryMappedFile::open(const std::string &path, bool readOnly, std::error_code &ec)
+    {
+        if (isOpened())
+        {
+            close(ec);
+            if (ec)
+            {
+                return;
+            }
+        }
+
+        Tools::ScopeExit failExitHandler([this, &ec] {
+            ec = std::error_code(errno, std::system_category());
+            std::error_code ignore;
+            close(ignore);
+        });
+
+        m_file = ::open(path.c_str(), readOnly ? O_RDONLY : O_RDWR);
+        if (m_file == -1)
+        {
+            return;
+        }
+
+        struct stat fileStat;
+        if (::fstat(m_file, &fileStat) == -1)
+        {
+            return;
+        }
+
+        // an empty file cannot be mapped
+        if (fileStat.st_size == 0)
+        {
+            errno = EINVAL;
+            return;
+        }
+
+        m_size = static_cast<uint64_t>(fileStat.st_size);
+
+        void *data = ::mmap(
+            nullptr,
+            static_cast<size_t>(m_size),
+            readOnly ? PROT_READ : PROT_READ | PROT_WRITE,
+            MAP_SHARED,
+            m_file,
+            0);
+        if (data == MAP_FAILED)
+        {
+            return;
+        }
+
+        m_data = static_cast<uint8_t *>(data);
+        m_path = path;
+        m_readOnly = readOnly;
+        ec = std::error_code();
+
+        failExitHandler.cancel();
+    }
+
+    void MemoryMappedFile::open(const std::string &path, std::error_code &ec)
+    {
+        open(path, false, ec);
+    }
+
+    void MemoryMappedFile::open(const std::string &path)
+    {
+        std::error_code ec;
+        open(path, false, ec);
+        if (ec)
+        {
+            throw std::system_error(ec, "MemoryMappedFile::open");
+        }
+    }
+
+    void MemoryMappedFile::openReadOnly(const std::string &path, std::error_code &ec)
+    {
+        open(path, true, ec);
+    }
+
+    void MemoryMappedFile::openReadOnly(const std::string &path)
+    {
+        std::error_code ec;
+        open(path, true, ec);
+        if (ec)
+        {
+            throw std::system_error(ec, "MemoryMappedFile::openReadOnly");
+        }
+    }
+
+    void MemoryMappedFile::rename(const std::string &newPath, std::error_code &ec)
+    {
+        assert(isOpened());
+
+        if (::rename(m_path.c_str(), newPath.c_str()) == 0)
+        {
+            m_path = newPath;
+            ec = std::error_code();
+        }
+        else
+        {
+            ec = std::error_code(errno, std::system_category());
+        }
+    }
+
+    void MemoryMappedFile::rename(const std::string &newPath)
+    {
+        assert(isOpened());
+
+        std::error_code ec;
+        rename(newPath, ec);
+        if (ec)
+        {
+            throw std::system_error(ec, "MemoryMappedFile::rename");
+        }
+    }
+
+    void MemoryMappedFile::close(std::error_code &ec)
+    {
+        if (m_data != nullptr)
+        {
+            if (!m_readOnly)
+            {
+                flush(m_data, m_size, ec);
+                if (ec)
+                {
+                    return;
+                }
+            }
+
+            if (::munmap(m_data, static_cast<size_t>(m_size)) == 0)
+            {
+                m_data = nullptr;
+            }
+            else
+            {
+                ec = std::error_code(errno, std::system_category());
+                return;
+            }
+        }
+
+        if (m_file != -1)
+        {
+            if (::close(m_file) == 0)
+            {
+                m_file = -1;
+            }
+            else
+            {
+                ec = std::error_code(errno, std::system_category());
+                return;
+            }
+        }
+
+        m_size = 0;
+        ec = std::error_code();
+    }
+
+    void MemoryMappedFile::close()
+    {
+        std::error_code ec;
+        close(ec);
+        if (ec)
+        {
+            throw std::system_error(ec, "MemoryMappedFile::close");
+        }
+    }
+
+    void MemoryMappedFile::flush(uint8_t *data, uint64_t size, std::error_code &ec)
+    {
+        assert(isOpened());
+
+        uintptr_t pageSize = static_cast<uintptr_t>(::sysconf(_SC_PAGESIZE));
+        uintptr_t dataAddr = reinterpret_cast<uintptr_t>(data);
+        uintptr_t pageOffset = (dataAddr / pageSize) * pageSize;
+
+        if (::msync(reinterpret_cast<void *>(pageOffset), static_cast<size_t>(dataAddr - pageOffset + size), MS_SYNC) == 0)
+        {
+            ec = std::error_code();
+        }
+        else
+        {
+            ec = std::error_code(errno, std::system_category());
+        }
+    }
+
+    void MemoryMappedFile::flush(uint8_t *data, uint64_t size)
+    {
+        assert(isOpened());
+
+        std::error_code ec;
+        flush(data, size, ec);
+        if (ec)
+        {
+            throw std::system_error(ec, "MemoryMappedFile::flush");
+        }
+    }
+
+    void MemoryMappedFile::swap(MemoryMappedFile &other)
+    {
+        std::swap(m_file, other.m_file);
+        std::swap(m_path, other.m_path);
+        std::swap(m_data, other.m_data);
+        std::swap(m_size, other.m_size);
+        std::swap(m_readOnly, other.m_readOnly);
+    }
+
+} // namespace System
@@ -0,0 +1,78 @@
+// Copyright (c) 2012-2017, The CryptoNote developers, The Bytecoin developers
+// Copyright (c) 2018-2019, The TurtleCoin Developers
+//
+// Please see the included LICENSE file for more information.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <system_error>
+
+namespace System
+{
+    class MemoryMappedFile
+    {
+      public:
+        MemoryMappedFile();
+
+        ~MemoryMappedFile();
+
+        MemoryMappedFile(const MemoryMappedFile &) = delete;
+
+        MemoryMappedFile &operator=(const MemoryMappedFile &) = delete;
+
+        void create(const std::string &path, uint64_t size, bool overwrite, std::error_code &ec);
+
+        void create(const std::string &path, uint64_t size, bool overwrite);
+
+        void open(const std::string &path, std::error_code &ec);
+
+        void open(const std::string &path);
+
+        /* Maps the whole file for reading only, while other handles may keep
+           appending to it. The mapping does not grow with the file, reopen it
+           to see data written past the mapped size. */
+        void openReadOnly(const std::string &path, std::error_code &ec);
+
+        void openReadOnly(const std::string &path);
+
+        void close(std::error_code &ec);
+
+        void close();
+
+        const std::string &path() const;
+
+        uint64_t size() const;
+
+        const uint8_t *data() const;
+
+        uint8_t *data();
+
+        bool isOpened() const;
+
+        void rename(const std::string &newPath, std::error_code &ec);
+
+        void rename(const std::string &newPath);
+
+        void flush(uint8_t *data, uint64_t size, std::error_code &ec);
+
+        void flush(uint8_t *data, uint64_t size);
+
+        void swap(MemoryMappedFile &other);
+
+      private:
+        void open(const std::string &path, bool readOnly, std::error_code &ec);
+
+        int m_file;
+
+        std::string m_path;
+
+        uint64_t m_size;
+
+        uint8_t *m_data;
+
+        bool m_readOnly;
+    };
+
+} // namespace System
@@ -19,7 +19,8 @@ namespace System
         m_fileHandle(INVALID_HANDLE_VALUE),
         m_mappingHandle(INVALID_HANDLE_VALUE),
         m_size(0),
-        m_data(nullptr)
+        m_data(nullptr),
+        m_readOnly(false)
     {
     }
 
@@ -120,6 +121,7 @@ namespace System
 
         m_size = size;
         m_path = path;
+        m_readOnly = false;
         ec = std::error_code();
 
         failExitHandler.cancel();
@@ -135,7 +137,7 @@ namespace System
         }
     }
 
-    void MemoryMappedFile::open(const std::string &path, std::error_code &ec)
+    void MemoryMappedFile::open(const std::string &path, bool readOnly, std::error_code &ec)
     {
         if (isOpened())
         {
@@ -154,8 +156,8 @@ namespace System
 
         m_fileHandle = ::CreateFile(
             path.c_str(),
-            GENERIC_READ | GENERIC_WRITE,
-            FILE_SHARE_DELETE | FILE_SHARE_READ,
+            readOnly ? GENERIC_READ : GENERIC_READ | GENERIC_WRITE,
+            readOnly ? FILE_SHARE_DELETE | FILE_SHARE_READ | FILE_SHARE_WRITE : FILE_SHARE_DELETE | FILE_SHARE_READ,
             NULL,
             OPEN_EXISTING,
             FILE_ATTRIBUTE_NORMAL,
@@ -174,34 +176,56 @@ namespace System
 
         m_size = static_cast<uint64_t>(fileSize.QuadPart);
 
-        m_mappingHandle = ::CreateFileMapping(m_fileHandle, NULL, PAGE_READWRITE, 0, 0, NULL);
+        m_mappingHandle = ::CreateFileMapping(m_fileHandle, NULL, readOnly ? PAGE_READONLY : PAGE_READWRITE, 0, 0, NULL);
         if (m_mappingHandle == NULL)
         {
             return;
         }
 
-        m_data = reinterpret_cast<uint8_t *>(::MapViewOfFile(m_mappingHandle, FILE_MAP_ALL_ACCESS, 0, 0, 0));
+        m_data = reinterpret_cast<uint8_t *>(
+            ::MapViewOfFile(m_mappingHandle, readOnly ? FILE_MAP_READ : FILE_MAP_ALL_ACCESS, 0, 0, 0));
         if (m_data == NULL)
         {
             return;
         }
 
         m_path = path;
+        m_readOnly = readOnly;
         ec = std::error_code();
 
         failExitHandler.cancel();
     }
 
+    void MemoryMappedFile::open(const std::string &path, std::error_code &ec)
+    {
+        open(path, false, ec);
+    }
+
     void MemoryMappedFile::open(const std::string &path)
     {
         std::error_code ec;
-        open(path, ec);
+        open(path, false, ec);
         if (ec)
         {
             throw std::system_error(ec, "MemoryMappedFile::open");
         }
     }
 
+    void MemoryMappedFile::openReadOnly(const std::string &path, std::error_code &ec)
+    {
+        open(path, true, ec);
+    }
+
+    void MemoryMappedFile::openReadOnly(const std::string &path)
+    {
+        std::error_code ec;
+        open(path, true, ec);
+        if (ec)
+        {
+            throw std::system_error(ec, "MemoryMappedFile::openReadOnly");
+        }
+    }
+
     void MemoryMappedFile::rename(const std::string &newPath, std::error_code &ec)
     {
         assert(isOpened());
@@ -235,10 +259,13 @@ namespace System
         BOOL result;
         if (m_data != nullptr)
         {
-            flush(m_data, m_size, ec);
-            if (ec)
+            if (!m_readOnly)
             {
-                return;
+                flush(m_data, m_size, ec);
+                if (ec)
+                {
+                    return;
+                }
             }
 
             result = ::UnmapViewOfFile(m_data);
@@ -332,6 +359,7 @@ namespace System
         std::swap(m_path, other.m_path);
         std::swap(m_data, other.m_data);
         std::swap(m_size, other.m_size);
+        std::swap(m_readOnly, other.m_readOnly);
     }
 
 } // namespace System
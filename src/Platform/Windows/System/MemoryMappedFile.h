@@ -26,6 +26,13 @@ namespace System
 
         void open(const std::string &path);
 
+        /* Maps the whole file for reading only, while other handles may keep
+           appending to it. The mapping does not grow with the file, reopen it
+           to see data written past the mapped size. */
+        void openReadOnly(const std::string &path, std::error_code &ec);
+
+        void openReadOnly(const std::string &path);
+
         void close(std::error_code &ec);
 
         void close();
@@ -51,6 +58,8 @@ namespace System
         void swap(MemoryMappedFile &other);
 
       private:
+        void open(const std::string &path, bool readOnly, std::error_code &ec);
+
         void *m_fileHandle;
 
         void *m_mappingHandle;
@@ -60,6 +69,8 @@ namespace System
         uint64_t m_size;
 
         uint8_t *m_data;
+
+        bool m_readOnly;
     };
 
 } // namespace System
@@ -27,6 +27,12 @@ void cn_slow_hash_f(size_t v, void * a, const void * b, size_t c, void * d, bool
 (*cn_slow_hash_fp)(v, a, b, c, d, e);
 }
 
+void (*cn_slow_hash_multi_fp)(size_t, void *const *, const void *const *, const size_t *, void *const *, size_t);
+
+void cn_slow_hash_multi_f(size_t v, void *const * a, const void *const * b, const size_t * c, void *const * d, size_t e){
+(*cn_slow_hash_multi_fp)(v, a, b, c, d, e);
+}
+
 #if defined(__GNUC__)
 #define likely(x) (__builtin_expect(!!(x), 1))
 #define unlikely(x) (__builtin_expect(!!(x), 0))
@@ -192,6 +198,60 @@ uint32_t extrahashPos(void *ctxdata) {
   return (((struct cn_ctx *)(ctxdata))->state.hs.b[0] & 7);
 }
 
+static size_t l3_cache_size = 0;
+
+static void cpuid_count(unsigned int leaf, unsigned int subleaf, int regs[4]) {
+#if defined(_MSC_VER)
+  __cpuidex(regs, leaf, subleaf);
+#else
+  __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Size of the L3 cache from the deterministic cache parameters, leaf 4 on
+// Intel and 0x8000001D on AMD, or 0 if the CPU does not report it.
+static size_t detect_l3_cache_size(void) {
+  static const unsigned int leaves[2] = { 4, 0x8000001D };
+  int regs[4];
+  unsigned int l, subleaf;
+
+  for (l = 0; l < 2; l++) {
+    cpuid_count(leaves[l] & 0x80000000, 0, regs);
+    if ((unsigned int) regs[0] < leaves[l]) {
+      continue;
+    }
+
+    for (subleaf = 0; subleaf < 16; subleaf++) {
+      unsigned int eax, ebx, ecx;
+      cpuid_count(leaves[l], subleaf, regs);
+      eax = regs[0];
+      ebx = regs[1];
+      ecx = regs[2];
+      if ((eax & 0x1f) == 0) {
+        break;
+      }
+
+      if (((eax >> 5) & 7) == 3) {
+        return (size_t) (((ebx >> 22) & 0x3ff) + 1) * (((ebx >> 12) & 0x3ff) + 1) * ((ebx & 0xfff) + 1) * (ecx + 1);
+      }
+    }
+  }
+
+  return 0;
+}
+
+// Every hash in flight needs its scratchpad in the cache. Without AES-NI the
+// table based rounds are bound by throughput and interleaving does not pay.
+size_t cn_slow_hash_ways(size_t threads) {
+  size_t ways;
+  if (cn_slow_hash_multi_fp != &cn_slow_hash_multi_aesni || threads == 0) {
+    return 1;
+  }
+
+  ways = l3_cache_size / ((size_t) MEMORY * threads);
+  return ways < 1 ? 1 : (ways > SLOW_HASH_MAX_WAYS ? SLOW_HASH_MAX_WAYS : ways);
+}
+
 INITIALIZER(detect_aes) {
   int ecx;
 #if defined(_MSC_VER)
@@ -203,4 +263,6 @@ INITIALIZER(detect_aes) {
   __cpuid(1, a, b, ecx, d);
 #endif
   cn_slow_hash_fp = (ecx & (1 << 25)) ? &cn_slow_hash_aesni : &cn_slow_hash_noaesni;
+  cn_slow_hash_multi_fp = (ecx & (1 << 25)) ? &cn_slow_hash_multi_aesni : &cn_slow_hash_multi_noaesni;
+  l3_cache_size = detect_l3_cache_size();
 }
@@ -0,0 +1,330 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/* Field arithmetic on 5 unsigned limbs of 51 bits, used by crypto-ops.c in
+   place of the 10 limb ref10 code when CRYPTO_OPS_FE51 is defined. The
+   group and scalar code is the same for both.
+
+   Limbs are not kept fully reduced. fe_mul, fe_sq and fe_sq2 return limbs
+   below 2^52 and take limbs up to 2^58, fe_sub returns limbs below 2^52
+   above its first operand, fe_add does not carry at all. */
+
+__extension__ typedef unsigned __int128 uint128_t;
+
+static const uint64_t fe_mask51 = 0x7ffffffffffffULL;
+
+static uint64_t load_8(const unsigned char *in) {
+  uint64_t result;
+  result = (uint64_t) in[0];
+  result |= ((uint64_t) in[1]) << 8;
+  result |= ((uint64_t) in[2]) << 16;
+  result |= ((uint64_t) in[3]) << 24;
+  result |= ((uint64_t) in[4]) << 32;
+  result |= ((uint64_t) in[5]) << 40;
+  result |= ((uint64_t) in[6]) << 48;
+  result |= ((uint64_t) in[7]) << 56;
+  return result;
+}
+
+static void store_8(unsigned char *out, uint64_t in) {
+  int i;
+  for (i = 0; i < 8; ++i) {
+    out[i] = (unsigned char) (in >> (8 * i));
+  }
+}
+
+/*
+h = 0
+*/
+
+static void fe_0(fe h) {
+  h[0] = 0;
+  h[1] = 0;
+  h[2] = 0;
+  h[3] = 0;
+  h[4] = 0;
+}
+
+/*
+h = 1
+*/
+
+static void fe_1(fe h) {
+  h[0] = 1;
+  h[1] = 0;
+  h[2] = 0;
+  h[3] = 0;
+  h[4] = 0;
+}
+
+/*
+h = f + g
+Can overlap h with f or g.
+*/
+
+static void fe_add(fe h, const fe f, const fe g) {
+  h[0] = f[0] + g[0];
+  h[1] = f[1] + g[1];
+  h[2] = f[2] + g[2];
+  h[3] = f[3] + g[3];
+  h[4] = f[4] + g[4];
+}
+
+/*
+Replace (f,g) with (g,g) if b == 1;
+replace (f,g) with (f,g) if b == 0.
+
+Preconditions: b in {0,1}.
+*/
+
+static void fe_cmov(fe f, const fe g, unsigned int b) {
+  uint64_t mask = (uint64_t) 0 - (uint64_t) b;
+  f[0] ^= (f[0] ^ g[0]) & mask;
+  f[1] ^= (f[1] ^ g[1]) & mask;
+  f[2] ^= (f[2] ^ g[2]) & mask;
+  f[3] ^= (f[3] ^ g[3]) & mask;
+  f[4] ^= (f[4] ^ g[4]) & mask;
+}
+
+/*
+h = f
+*/
+
+static void fe_copy(fe h, const fe f) {
+  h[0] = f[0];
+  h[1] = f[1];
+  h[2] = f[2];
+  h[3] = f[3];
+  h[4] = f[4];
+}
+
+/*
+h = f - g, computed as f + 2p - g once g is carried below 2^51.
+Can overlap h with f or g.
+*/
+
+static void fe_sub(fe h, const fe f, const fe g) {
+  uint64_t g0 = g[0];
+  uint64_t g1 = g[1];
+  uint64_t g2 = g[2];
+  uint64_t g3 = g[3];
+  uint64_t g4 = g[4];
+
+  g1 += g0 >> 51; g0 &= fe_mask51;
+  g2 += g1 >> 51; g1 &= fe_mask51;
+  g3 += g2 >> 51; g2 &= fe_mask51;
+  g4 += g3 >> 51; g3 &= fe_mask51;
+  g0 += (g4 >> 51) * 19; g4 &= fe_mask51;
+
+  h[0] = (f[0] + 0xfffffffffffdaULL) - g0;
+  h[1] = (f[1] + 0xffffffffffffeULL) - g1;
+  h[2] = (f[2] + 0xffffffffffffeULL) - g2;
+  h[3] = (f[3] + 0xffffffffffffeULL) - g3;
+  h[4] = (f[4] + 0xffffffffffffeULL) - g4;
+}
+
+/*
+h = -f
+*/
+
+static void fe_neg(fe h, const fe f) {
+  fe zero;
+  fe_0(zero);
+  fe_sub(h, zero, f);
+}
+
+/*
+Carries the products of fe_mul and fe_sq into h. 2^255 = 19 (mod p) folds
+the top carry back into the lowest limb.
+*/
+
+static void fe_carry128(fe h, uint128_t r0, uint128_t r1, uint128_t r2, uint128_t r3, uint128_t r4) {
+  uint64_t h0, h1, h2, h3, h4;
+
+  r1 += r0 >> 51; h0 = (uint64_t) r0 & fe_mask51;
+  r2 += r1 >> 51; h1 = (uint64_t) r1 & fe_mask51;
+  r3 += r2 >> 51; h2 = (uint64_t) r2 & fe_mask51;
+  r4 += r3 >> 51; h3 = (uint64_t) r3 & fe_mask51;
+  r0 = h0 + (r4 >> 51) * 19; h4 = (uint64_t) r4 & fe_mask51;
+  h1 += (uint64_t) (r0 >> 51); h0 = (uint64_t) r0 & fe_mask51;
+
+  h[0] = h0;
+  h[1] = h1;
+  h[2] = h2;
+  h[3] = h3;
+  h[4] = h4;
+}
+
+/*
+h = f * g
+Can overlap h with f or g.
+*/
+
+static void fe_mul(fe h, const fe f, const fe g) {
+  uint64_t f0 = f[0];
+  uint64_t f1 = f[1];
+  uint64_t f2 = f[2];
+  uint64_t f3 = f[3];
+  uint64_t f4 = f[4];
+  uint64_t g0 = g[0];
+  uint64_t g1 = g[1];
+  uint64_t g2 = g[2];
+  uint64_t g3 = g[3];
+  uint64_t g4 = g[4];
+  uint64_t g1_19 = 19 * g1;
+  uint64_t g2_19 = 19 * g2;
+  uint64_t g3_19 = 19 * g3;
+  uint64_t g4_19 = 19 * g4;
+
+  uint128_t r0 = (uint128_t) f0 * g0 + (uint128_t) f1 * g4_19 + (uint128_t) f2 * g3_19 + (uint128_t) f3 * g2_19 + (uint128_t) f4 * g1_19;
+  uint128_t r1 = (uint128_t) f0 * g1 + (uint128_t) f1 * g0 + (uint128_t) f2 * g4_19 + (uint128_t) f3 * g3_19 + (uint128_t) f4 * g2_19;
+  uint128_t r2 = (uint128_t) f0 * g2 + (uint128_t) f1 * g1 + (uint128_t) f2 * g0 + (uint128_t) f3 * g4_19 + (uint128_t) f4 * g3_19;
+  uint128_t r3 = (uint128_t) f0 * g3 + (uint128_t) f1 * g2 + (uint128_t) f2 * g1 + (uint128_t) f3 * g0 + (uint128_t) f4 * g4_19;
+  uint128_t r4 = (uint128_t) f0 * g4 + (uint128_t) f1 * g3 + (uint128_t) f2 * g2 + (uint128_t) f3 * g1 + (uint128_t) f4 * g0;
+
+  fe_carry128(h, r0, r1, r2, r3, r4);
+}
+
+/*
+h = f * f
+Can overlap h with f.
+*/
+
+static void fe_sq(fe h, const fe f) {
+  uint64_t f0 = f[0];
+  uint64_t f1 = f[1];
+  uint64_t f2 = f[2];
+  uint64_t f3 = f[3];
+  uint64_t f4 = f[4];
+  uint64_t f0_2 = 2 * f0;
+  uint64_t f1_2 = 2 * f1;
+  uint64_t f1_38 = 38 * f1;
+  uint64_t f2_38 = 38 * f2;
+  uint64_t f3_19 = 19 * f3;
+  uint64_t f3_38 = 38 * f3;
+  uint64_t f4_19 = 19 * f4;
+
+  uint128_t r0 = (uint128_t) f0 * f0 + (uint128_t) f1_38 * f4 + (uint128_t) f2_38 * f3;
+  uint128_t r1 = (uint128_t) f0_2 * f1 + (uint128_t) f2_38 * f4 + (uint128_t) f3_19 * f3;
+  uint128_t r2 = (uint128_t) f0_2 * f2 + (uint128_t) f1 * f1 + (uint128_t) f3_38 * f4;
+  uint128_t r3 = (uint128_t) f0_2 * f3 + (uint128_t) f1_2 * f2 + (uint128_t) f4_19 * f4;
+  uint128_t r4 = (uint128_t) f0_2 * f4 + (uint128_t) f1_2 * f3 + (uint128_t) f2 * f2;
+
+  fe_carry128(h, r0, r1, r2, r3, r4);
+}
+
+/*
+h = 2 * f * f
+Can overlap h with f.
+*/
+
+static void fe_sq2(fe h, const fe f) {
+  uint64_t f0 = f[0];
+  uint64_t f1 = f[1];
+  uint64_t f2 = f[2];
+  uint64_t f3 = f[3];
+  uint64_t f4 = f[4];
+  uint64_t f0_2 = 2 * f0;
+  uint64_t f1_2 = 2 * f1;
+  uint64_t f1_38 = 38 * f1;
+  uint64_t f2_38 = 38 * f2;
+  uint64_t f3_19 = 19 * f3;
+  uint64_t f3_38 = 38 * f3;
+  uint64_t f4_19 = 19 * f4;
+
+  uint128_t r0 = (uint128_t) f0 * f0 + (uint128_t) f1_38 * f4 + (uint128_t) f2_38 * f3;
+  uint128_t r1 = (uint128_t) f0_2 * f1 + (uint128_t) f2_38 * f4 + (uint128_t) f3_19 * f3;
+  uint128_t r2 = (uint128_t) f0_2 * f2 + (uint128_t) f1 * f1 + (uint128_t) f3_38 * f4;
+  uint128_t r3 = (uint128_t) f0_2 * f3 + (uint128_t) f1_2 * f2 + (uint128_t) f4_19 * f4;
+  uint128_t r4 = (uint128_t) f0_2 * f4 + (uint128_t) f1_2 * f3 + (uint128_t) f2 * f2;
+
+  fe_carry128(h, r0 << 1, r1 << 1, r2 << 1, r3 << 1, r4 << 1);
+}
+
+/*
+Writes the unique representative of h mod p in 0 .. p - 1.
+*/
+
+static void fe_tobytes(unsigned char *s, const fe h) {
+  uint64_t t0 = h[0];
+  uint64_t t1 = h[1];
+  uint64_t t2 = h[2];
+  uint64_t t3 = h[3];
+  uint64_t t4 = h[4];
+  int i;
+
+  /* two carry passes bring h below 2^255 + 2^13 * 19, then below 2^255 */
+  for (i = 0; i < 2; ++i) {
+    t1 += t0 >> 51; t0 &= fe_mask51;
+    t2 += t1 >> 51; t1 &= fe_mask51;
+    t3 += t2 >> 51; t2 &= fe_mask51;
+    t4 += t3 >> 51; t3 &= fe_mask51;
+    t0 += (t4 >> 51) * 19; t4 &= fe_mask51;
+  }
+
+  /* h + 19 carries into bit 255 exactly when h >= p, then h - p = h + 19 - 2^255 */
+  t0 += 19;
+  t1 += t0 >> 51; t0 &= fe_mask51;
+  t2 += t1 >> 51; t1 &= fe_mask51;
+  t3 += t2 >> 51; t2 &= fe_mask51;
+  t4 += t3 >> 51; t3 &= fe_mask51;
+  t0 += (t4 >> 51) * 19; t4 &= fe_mask51;
+
+  /* the value is now h + 19 mod p in 19 .. 2^255 - 1, take the 19 back off
+     by adding 2^255 - 19 and dropping bit 255 */
+  t0 += 0x8000000000000ULL - 19;
+  t1 += 0x8000000000000ULL - 1;
+  t2 += 0x8000000000000ULL - 1;
+  t3 += 0x8000000000000ULL - 1;
+  t4 += 0x8000000000000ULL - 1;
+
+  t1 += t0 >> 51; t0 &= fe_mask51;
+  t2 += t1 >> 51; t1 &= fe_mask51;
+  t3 += t2 >> 51; t2 &= fe_mask51;
+  t4 += t3 >> 51; t3 &= fe_mask51;
+  t4 &= fe_mask51;
+
+  store_8(s, t0 | (t1 << 51));
+  store_8(s + 8, (t1 >> 13) | (t2 << 38));
+  store_8(s + 16, (t2 >> 26) | (t3 << 25));
+  store_8(s + 24, (t3 >> 39) | (t4 << 12));
+}
+
+/*
+h = s, without the top bit of s[31].
+Returns -1 if that is not below 2^255 - 19.
+*/
+
+static int fe_frombytes_vartime(fe h, const unsigned char *s) {
+  uint64_t h0 = load_8(s) & fe_mask51;
+  uint64_t h1 = (load_8(s + 6) >> 3) & fe_mask51;
+  uint64_t h2 = (load_8(s + 12) >> 6) & fe_mask51;
+  uint64_t h3 = (load_8(s + 19) >> 1) & fe_mask51;
+  uint64_t h4 = (load_8(s + 24) >> 12) & fe_mask51;
+
+  /* Validate the number to be canonical */
+  if (h4 == fe_mask51 && h3 == fe_mask51 && h2 == fe_mask51 && h1 == fe_mask51 &&
+    h0 >= fe_mask51 - 18) {
+    return -1;
+  }
+
+  h[0] = h0;
+  h[1] = h1;
+  h[2] = h2;
+  h[3] = h3;
+  h[4] = h4;
+  return 0;
+}
+
+/*
+h = s, with all 256 bits of it.
+*/
+
+static void fe_frombytes256(fe h, const unsigned char *s) {
+  h[0] = load_8(s) & fe_mask51;
+  h[1] = (load_8(s + 6) >> 3) & fe_mask51;
+  h[2] = (load_8(s + 12) >> 6) & fe_mask51;
+  h[3] = (load_8(s + 19) >> 1) & fe_mask51;
+  h[4] = load_8(s + 24) >> 12;
+}
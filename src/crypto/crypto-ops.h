@@ -1,8 +1,20 @@
 #pragma once
 
+/* The field backend is chosen at build time: 5 limbs of 51 bits on 64-bit
+   targets whose compiler has 128-bit integers, the 10 limbs of ref10
+   elsewhere or when CRYPTO_OPS_REF10 is defined. */
+
+#if !defined(CRYPTO_OPS_REF10) && defined(__SIZEOF_INT128__) && (defined(__x86_64__) || defined(__aarch64__))
+#define CRYPTO_OPS_FE51
+#endif
+
 /* From fe.h */
 
+#if defined(CRYPTO_OPS_FE51)
+typedef uint64_t fe[5];
+#else
 typedef int32_t fe[10];
+#endif
 
 /* From ge.h */
 
@@ -93,6 +105,7 @@ void ge_sub(ge_p1p1 *, const ge_p3 *, const ge_cached *);
 /* From ge_tobytes.c */
 
 void ge_tobytes(unsigned char *, const ge_p2 *);
+void ge_tobytes_batch(unsigned char *, const ge_p2 *, fe *, size_t);
 
 /* From sc_reduce.c */
 
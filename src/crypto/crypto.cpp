@@ -7,8 +7,11 @@
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <memory>
 #include <mutex>
+#include <unordered_map>
+#include <vector>
 
 #if defined(_MSC_VER)
 #include <malloc.h>
@@ -533,43 +536,163 @@ bool crypto_ops::check_tx_proof(const Hash &prefix_hash, const PublicKey &R, con
     sc_mulsub(reinterpret_cast<unsigned char*>(&sig[sec_index]) + 32, reinterpret_cast<unsigned char*>(&sig[sec_index]), reinterpret_cast<const unsigned char*>(&sec), reinterpret_cast<unsigned char*>(&k));
   }
 
-  bool crypto_ops::check_ring_signature(const Hash &prefix_hash, const KeyImage &image,
-    const PublicKey *const *pubs, size_t pubs_count,
-    const Signature *sig) {
-    size_t i;
-    ge_p3 image_unp;
-    ge_dsmp image_pre;
-    EllipticCurveScalar sum, h;
-    rs_comm *const buf = reinterpret_cast<rs_comm *>(alloca(rs_comm_size(pubs_count)));
-#if !defined(NDEBUG)
-    for (i = 0; i < pubs_count; i++) {
-      assert(check_key(*pubs[i]));
+  struct public_key_cache::impl {
+    struct entry {
+      ge_p3 point;
+      ge_p3 hashed;
+    };
+
+    explicit impl(size_t capacity) : capacity(capacity) {
     }
-#endif
+
+    const size_t capacity;
+    mutex lock;
+    std::unordered_map<PublicKey, entry> entries;
+    std::deque<PublicKey> order;
+  };
+
+  public_key_cache::public_key_cache(size_t capacity) : m_impl(new impl(capacity)) {
+  }
+
+  public_key_cache::~public_key_cache() {
+  }
+
+  static void decompress_ring_member(const PublicKey &pub, ge_p3 &point, ge_p3 &hashed) {
+    if (ge_frombytes_vartime(&point, reinterpret_cast<const unsigned char*>(&pub)) != 0) {
+      abort();
+    }
+    hash_to_ec(pub, hashed);
+  }
+
+  // Buffers of one thread, a check only allocates for a larger ring than the
+  // thread has checked before.
+  struct ring_scratch {
+    std::vector<ge_p3> points;
+    std::vector<ge_p3> hashed;
+    std::vector<ge_p2> comm;
+    std::unique_ptr<fe[]> tmp;
+    size_t tmp_size = 0;
+    std::vector<size_t> missing;
+  };
+
+  static ring_scratch &get_ring_scratch(size_t pubs_count) {
+    static thread_local ring_scratch scratch;
+    scratch.points.resize(pubs_count);
+    scratch.hashed.resize(pubs_count);
+    scratch.comm.resize(2 * pubs_count);
+    if (scratch.tmp_size < 2 * pubs_count) {
+      scratch.tmp.reset(new fe[2 * pubs_count]);
+      scratch.tmp_size = 2 * pubs_count;
+    }
+    scratch.missing.clear();
+    return scratch;
+  }
+
+  // Rejects the key image and the scalars before any ring member is
+  // decompressed, a signature failing these is never checked further.
+  static bool check_ring_signature_encoding(const KeyImage &image, size_t pubs_count, const Signature *sig,
+    ge_p3 &image_unp) {
     if (ge_frombytes_vartime(&image_unp, reinterpret_cast<const unsigned char*>(&image)) != 0) {
       return false;
     }
+    for (size_t i = 0; i < pubs_count; i++) {
+      if (sc_check(reinterpret_cast<const unsigned char*>(&sig[i])) != 0 || sc_check(reinterpret_cast<const unsigned char*>(&sig[i]) + 32) != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // The commitments of all ring members are encoded together, so the ring
+  // costs one field inversion instead of two per member.
+  static bool check_ring_signature_points(const Hash &prefix_hash, const ge_p3 &image_unp,
+    ring_scratch &scratch, size_t pubs_count, const Signature *sig) {
+    size_t i;
+    ge_dsmp image_pre;
+    EllipticCurveScalar sum, h;
+    rs_comm *const buf = reinterpret_cast<rs_comm *>(alloca(rs_comm_size(pubs_count)));
     ge_dsm_precomp(image_pre, &image_unp);
     sc_0(reinterpret_cast<unsigned char*>(&sum));
     buf->h = prefix_hash;
     for (i = 0; i < pubs_count; i++) {
-      ge_p2 tmp2;
-      ge_p3 tmp3;
-      if (sc_check(reinterpret_cast<const unsigned char*>(&sig[i])) != 0 || sc_check(reinterpret_cast<const unsigned char*>(&sig[i]) + 32) != 0) {
-        return false;
-      }
-      if (ge_frombytes_vartime(&tmp3, reinterpret_cast<const unsigned char*>(&*pubs[i])) != 0) {
-        abort();
-      }
-      ge_double_scalarmult_base_vartime(&tmp2, reinterpret_cast<const unsigned char*>(&sig[i]), &tmp3, reinterpret_cast<const unsigned char*>(&sig[i]) + 32);
-      ge_tobytes(reinterpret_cast<unsigned char*>(&buf->ab[i].a), &tmp2);
-      hash_to_ec(*pubs[i], tmp3);
-      ge_double_scalarmult_precomp_vartime(&tmp2, reinterpret_cast<const unsigned char*>(&sig[i]) + 32, &tmp3, reinterpret_cast<const unsigned char*>(&sig[i]), image_pre);
-      ge_tobytes(reinterpret_cast<unsigned char*>(&buf->ab[i].b), &tmp2);
+      ge_double_scalarmult_base_vartime(&scratch.comm[2 * i], reinterpret_cast<const unsigned char*>(&sig[i]), &scratch.points[i], reinterpret_cast<const unsigned char*>(&sig[i]) + 32);
+      ge_double_scalarmult_precomp_vartime(&scratch.comm[2 * i + 1], reinterpret_cast<const unsigned char*>(&sig[i]) + 32, &scratch.hashed[i], reinterpret_cast<const unsigned char*>(&sig[i]), image_pre);
       sc_add(reinterpret_cast<unsigned char*>(&sum), reinterpret_cast<unsigned char*>(&sum), reinterpret_cast<const unsigned char*>(&sig[i]));
     }
+    ge_tobytes_batch(reinterpret_cast<unsigned char*>(buf->ab), scratch.comm.data(), scratch.tmp.get(), 2 * pubs_count);
     hash_to_scalar(buf, rs_comm_size(pubs_count), h);
     sc_sub(reinterpret_cast<unsigned char*>(&h), reinterpret_cast<unsigned char*>(&h), reinterpret_cast<unsigned char*>(&sum));
     return sc_isnonzero(reinterpret_cast<unsigned char*>(&h)) == 0;
   }
+
+  bool crypto_ops::check_ring_signature(const Hash &prefix_hash, const KeyImage &image,
+    const PublicKey *const *pubs, size_t pubs_count,
+    const Signature *sig) {
+    ge_p3 image_unp;
+#if !defined(NDEBUG)
+    for (size_t i = 0; i < pubs_count; i++) {
+      assert(check_key(*pubs[i]));
+    }
+#endif
+    if (!check_ring_signature_encoding(image, pubs_count, sig, image_unp)) {
+      return false;
+    }
+    ring_scratch &scratch = get_ring_scratch(pubs_count);
+    for (size_t i = 0; i < pubs_count; i++) {
+      decompress_ring_member(*pubs[i], scratch.points[i], scratch.hashed[i]);
+    }
+    return check_ring_signature_points(prefix_hash, image_unp, scratch, pubs_count, sig);
+  }
+
+  bool crypto_ops::check_ring_signature(const Hash &prefix_hash, const KeyImage &image,
+    const PublicKey *const *pubs, size_t pubs_count,
+    const Signature *sig, public_key_cache &cache) {
+    public_key_cache::impl &c = *cache.m_impl;
+    ge_p3 image_unp;
+#if !defined(NDEBUG)
+    for (size_t i = 0; i < pubs_count; i++) {
+      assert(check_key(*pubs[i]));
+    }
+#endif
+    if (!check_ring_signature_encoding(image, pubs_count, sig, image_unp)) {
+      return false;
+    }
+    ring_scratch &scratch = get_ring_scratch(pubs_count);
+    std::vector<ge_p3> &points = scratch.points;
+    std::vector<ge_p3> &hashed = scratch.hashed;
+    std::vector<size_t> &missing = scratch.missing;
+    {
+      lock_guard<mutex> lock(c.lock);
+      for (size_t i = 0; i < pubs_count; i++) {
+        auto it = c.entries.find(*pubs[i]);
+        if (it == c.entries.end()) {
+          missing.push_back(i);
+        } else {
+          points[i] = it->second.point;
+          hashed[i] = it->second.hashed;
+        }
+      }
+    }
+    // decompressed outside the lock, other threads keep hitting the cache
+    for (size_t i : missing) {
+      decompress_ring_member(*pubs[i], points[i], hashed[i]);
+    }
+    if (!missing.empty()) {
+      lock_guard<mutex> lock(c.lock);
+      for (size_t i : missing) {
+        public_key_cache::impl::entry e;
+        e.point = points[i];
+        e.hashed = hashed[i];
+        if (!c.entries.emplace(*pubs[i], e).second) {
+          continue;
+        }
+        c.order.push_back(*pubs[i]);
+        if (c.order.size() > c.capacity) {
+          c.entries.erase(c.order.front());
+          c.order.pop_front();
+        }
+      }
+    }
+    return check_ring_signature_points(prefix_hash, image_unp, scratch, pubs_count, sig);
+  }
 }
@@ -6,6 +6,7 @@
 
 #include <cstddef>
 #include <limits>
+#include <memory>
 #include <mutex>
 #include <type_traits>
 #include <vector>
@@ -32,6 +33,25 @@ namespace Crypto {
 //  uint8_t data[32];
 //};
 
+  /* Bounded cache of decompressed ring member keys and their hash_to_ec
+   * points, safe to share between threads checking ring signatures. Popular
+   * outputs are decoys in many rings, their keys are decompressed once.
+   */
+  class public_key_cache {
+  public:
+    explicit public_key_cache(size_t capacity);
+    ~public_key_cache();
+
+  private:
+    public_key_cache(const public_key_cache &);
+    void operator=(const public_key_cache &);
+
+    struct impl;
+    std::unique_ptr<impl> m_impl;
+
+    friend class crypto_ops;
+  };
+
   class crypto_ops {
     crypto_ops();
     crypto_ops(const crypto_ops &);
@@ -90,6 +110,10 @@ namespace Crypto {
       const PublicKey *const *, size_t, const Signature *);
     friend bool check_ring_signature(const Hash &, const KeyImage &,
       const PublicKey *const *, size_t, const Signature *);
+    static bool check_ring_signature(const Hash &, const KeyImage &,
+      const PublicKey *const *, size_t, const Signature *, public_key_cache &);
+    friend bool check_ring_signature(const Hash &, const KeyImage &,
+      const PublicKey *const *, size_t, const Signature *, public_key_cache &);
   };
 
   void hash_to_scalar(const void *data, size_t length, EllipticCurveScalar &res);
@@ -111,23 +135,17 @@ namespace Crypto {
   public:
     typedef T result_type;
 
-#ifdef __clang__
-    constexpr static T min() {
+    /* constexpr as std::uniform_int_distribution requires, the parentheses
+     * keep the windows.h min and max macros out
+     */
+    constexpr static T (min)() {
       return (std::numeric_limits<T>::min)();
     }
 
-    constexpr static T max() {
+    constexpr static T (max)() {
       return (std::numeric_limits<T>::max)();
     }
-#else
-    static T(min)() {
-      return (std::numeric_limits<T>::min)();
-    }
 
-    static T(max)() {
-      return (std::numeric_limits<T>::max)();
-    }
-#endif
     typename std::enable_if<std::is_unsigned<T>::value, T>::type operator()() {
       return rand<T>();
     }
@@ -254,6 +272,11 @@ namespace Crypto {
     const Signature *sig) {
     return crypto_ops::check_ring_signature(prefix_hash, image, pubs, pubs_count, sig);
   }
+  inline bool check_ring_signature(const Hash &prefix_hash, const KeyImage &image,
+    const PublicKey *const *pubs, size_t pubs_count,
+    const Signature *sig, public_key_cache &cache) {
+    return crypto_ops::check_ring_signature(prefix_hash, image, pubs, pubs_count, sig, cache);
+  }
 
   /* Variants with vector<const PublicKey *> parameters.
    */
@@ -268,6 +291,11 @@ namespace Crypto {
     const Signature *sig) {
     return check_ring_signature(prefix_hash, image, pubs.data(), pubs.size(), sig);
   }
+  inline bool check_ring_signature(const Hash &prefix_hash, const KeyImage &image,
+    const std::vector<const PublicKey *> &pubs,
+    const Signature *sig, public_key_cache &cache) {
+    return check_ring_signature(prefix_hash, image, pubs.data(), pubs.size(), sig, cache);
+  }
 
   static inline const KeyImage &EllipticCurveScalar2KeyImage(const EllipticCurveScalar &k) { return (const KeyImage&)k; }
   static inline const PublicKey &EllipticCurveScalar2PublicKey(const EllipticCurveScalar &k) { return (const PublicKey&)k; }
@@ -52,12 +52,19 @@ void hash_process(union hash_state *state, const uint8_t *buf, size_t count);
 enum {
   HASH_SIZE = 32,
   HASH_DATA_AREA = 136,
-  SLOW_HASH_CONTEXT_SIZE = 2097552
+  SLOW_HASH_CONTEXT_SIZE = 2097552,
+  SLOW_HASH_MAX_WAYS = 4
 };
 
 void cn_fast_hash(const void *data, size_t length, char *hash);
 
 void cn_slow_hash_f(size_t, void *, const void *, size_t, void *, bool);
+/* Hashes count (at most SLOW_HASH_MAX_WAYS) inputs at once, each with its own
+   context, with the same results as count calls to cn_slow_hash_f. */
+void cn_slow_hash_multi_f(size_t, void *const *, const void *const *, const size_t *, void *const *, size_t);
+/* Number of hashes cn_slow_hash_multi_f should interleave when threads of
+   them run at once, from the AES support and the L3 cache size of the CPU. */
+size_t cn_slow_hash_ways(size_t threads);
 
 void hash_extra_blake(const void *data, size_t length, char *hash);
 void hash_extra_groestl(const void *data, size_t length, char *hash);
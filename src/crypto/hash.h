@@ -5,6 +5,9 @@
 #pragma once
 
 #include <stddef.h>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include <CryptoTypes.h>
 #include "generic-ops.h"
@@ -29,9 +32,17 @@ namespace Crypto {
     return h;
   }
 
+  // The scratchpad is put on huge pages when the system has them, which saves
+  // TLB misses on the random accesses of the main loop, else on normal pages.
   class cn_context {
   public:
 
+    enum pages_type {
+      NORMAL_PAGES,
+      TRANSPARENT_HUGE_PAGES,
+      HUGE_PAGES
+    };
+
     cn_context();
     ~cn_context() noexcept(false);
 #if !defined(_MSC_VER) || _MSC_VER >= 1800
@@ -39,17 +50,79 @@ namespace Crypto {
     void operator=(const cn_context &) = delete;
 #endif
 
+    pages_type pages() const { return pagesType; }
+    const char *pages_name() const;
+
     void *data;
 
   private:
 
     friend inline void cn_slow_hash(size_t, cn_context &, const void *, size_t, Hash &, bool);
+
+    size_t size;
+    pages_type pagesType;
+  };
+
+  // Contexts of finished tasks are kept for the next ones, so short-lived
+  // workers do not map and lock a scratchpad each. At most max_idle are kept,
+  // by default one per hardware thread.
+  class cn_context_pool {
+  public:
+
+    explicit cn_context_pool(size_t max_idle = 0);
+
+    std::unique_ptr<cn_context> acquire();
+    void release(std::unique_ptr<cn_context> context);
+
+  private:
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<cn_context>> idle;
+    size_t maxIdle;
+  };
+
+  // A context taken from a pool and given back when the lease ends.
+  class cn_context_lease {
+  public:
+
+    explicit cn_context_lease(cn_context_pool &pool) : pool(pool), context(pool.acquire()) {
+    }
+
+    ~cn_context_lease() {
+      pool.release(std::move(context));
+    }
+
+#if !defined(_MSC_VER) || _MSC_VER >= 1800
+    cn_context_lease(const cn_context_lease &) = delete;
+    void operator=(const cn_context_lease &) = delete;
+#endif
+
+    cn_context &operator*() const { return *context; }
+    cn_context *operator->() const { return context.get(); }
+
+  private:
+
+    cn_context_pool &pool;
+    std::unique_ptr<cn_context> context;
   };
 
   inline void cn_slow_hash(size_t majorVersion, cn_context &context, const void *data, size_t length, Hash &hash, bool walletkey=false) {
     (*cn_slow_hash_f)(majorVersion, context.data, data, length, reinterpret_cast<void *>(&hash), walletkey);
   }
 
+  // Hashes count inputs at once, each with its own context. count is at most
+  // SLOW_HASH_MAX_WAYS, cn_slow_hash_ways tells how many pay off.
+  inline void cn_slow_hash_multi(size_t majorVersion, cn_context *const *contexts, const void *const *data, const size_t *lengths, Hash *hashes, size_t count) {
+    void *contextData[SLOW_HASH_MAX_WAYS];
+    void *hashData[SLOW_HASH_MAX_WAYS];
+    for (size_t i = 0; i < count; ++i) {
+      contextData[i] = contexts[i]->data;
+      hashData[i] = &hashes[i];
+    }
+
+    cn_slow_hash_multi_f(majorVersion, contextData, data, lengths, hashData, count);
+  }
+
   inline void tree_hash(const Hash *hashes, size_t count, Hash &root_hash) {
     tree_hash(reinterpret_cast<const char (*)[HASH_SIZE]>(hashes), count, reinterpret_cast<char *>(&root_hash));
   }
@@ -2,7 +2,12 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <new>
+#include <thread>
 
 #include "hash.h"
 
@@ -17,12 +22,28 @@ using std::bad_alloc;
 namespace Crypto {
 
   enum {
-    MAP_SIZE = SLOW_HASH_CONTEXT_SIZE + ((-SLOW_HASH_CONTEXT_SIZE) & 0xfff)
+    MAP_SIZE = SLOW_HASH_CONTEXT_SIZE + ((-SLOW_HASH_CONTEXT_SIZE) & 0xfff),
+    HUGE_PAGE_SIZE = 1 << 21
   };
 
 #if defined(WIN32)
 
+  // large pages need the "Lock pages in memory" privilege, without it the
+  // allocation fails and normal pages are used. The context is a little over
+  // one large page and takes two.
   cn_context::cn_context() {
+    SIZE_T largePageSize = GetLargePageMinimum();
+    if (largePageSize != 0) {
+      size = (MAP_SIZE + largePageSize - 1) / largePageSize * largePageSize;
+      data = VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+      if (data != nullptr) {
+        pagesType = HUGE_PAGES;
+        return;
+      }
+    }
+
+    size = MAP_SIZE;
+    pagesType = NORMAL_PAGES;
     data = VirtualAlloc(nullptr, MAP_SIZE, MEM_COMMIT, PAGE_READWRITE);
     if (data == nullptr) {
       throw bad_alloc();
@@ -37,7 +58,86 @@ namespace Crypto {
 
 #else
 
+#if defined(MADV_HUGEPAGE)
+  static bool transparentHugePagesEnabled() {
+    FILE *file = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+    if (file == nullptr) {
+      return false;
+    }
+
+    char mode[64] = {};
+    bool enabled = fgets(mode, sizeof(mode), file) != nullptr && strstr(mode, "[never]") == nullptr;
+    fclose(file);
+    return enabled;
+  }
+#endif
+
+#if defined(MAP_HUGETLB) || defined(MADV_HUGEPAGE)
+  // normal pages starting at a 2 MiB boundary, the ends around the aligned
+  // part of a larger mapping are given back
+  static void *mapHugePageAligned() {
+    void *region = mmap(nullptr, MAP_SIZE + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+      return MAP_FAILED;
+    }
+
+    uintptr_t begin = reinterpret_cast<uintptr_t>(region);
+    uintptr_t aligned = (begin + HUGE_PAGE_SIZE - 1) & ~static_cast<uintptr_t>(HUGE_PAGE_SIZE - 1);
+    uintptr_t end = begin + MAP_SIZE + HUGE_PAGE_SIZE;
+    if (aligned != begin) {
+      munmap(region, aligned - begin);
+    }
+
+    if (end != aligned + MAP_SIZE) {
+      munmap(reinterpret_cast<void *>(aligned + MAP_SIZE), end - (aligned + MAP_SIZE));
+    }
+
+    return reinterpret_cast<void *>(aligned);
+  }
+#endif
+
+  // Huge pages from the reserved pool are tried first, then transparent huge
+  // pages, then normal pages. The scratchpad stays in memory either way.
   cn_context::cn_context() {
+#if defined(MAP_HUGETLB)
+    // The context is a little over 2 MiB, so only the scratchpad at its start
+    // goes on a huge page and the state after it stays on a normal page. Each
+    // context takes one page from the pool, vm.nr_hugepages should be at least
+    // the number of hashing threads. Fails right away if the pool is empty.
+    data = mapHugePageAligned();
+    if (data != MAP_FAILED) {
+      if (mmap(data, HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB | MAP_POPULATE, -1, 0) != MAP_FAILED) {
+        size = MAP_SIZE;
+        pagesType = HUGE_PAGES;
+        mlock(static_cast<uint8_t *>(data) + HUGE_PAGE_SIZE, MAP_SIZE - HUGE_PAGE_SIZE);
+        return;
+      }
+
+      munmap(data, MAP_SIZE);
+    }
+#endif
+
+#if defined(MADV_HUGEPAGE)
+    static const bool transparentHugePages = transparentHugePagesEnabled();
+    if (transparentHugePages) {
+      // the kernel only uses a huge page for an aligned 2 MiB range
+      data = mapHugePageAligned();
+      if (data != MAP_FAILED) {
+        size = MAP_SIZE;
+        if (madvise(data, size, MADV_HUGEPAGE) == 0) {
+          pagesType = TRANSPARENT_HUGE_PAGES;
+          // faults the scratchpad in, on a huge page if the kernel has one free
+          mlock(data, size);
+          return;
+        }
+
+        munmap(data, size);
+      }
+    }
+#endif
+
+    size = MAP_SIZE;
+    pagesType = NORMAL_PAGES;
 #if !defined(__APPLE__)
     data = mmap(nullptr, MAP_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
 #else
@@ -50,11 +150,48 @@ namespace Crypto {
   }
 
   cn_context::~cn_context() noexcept(false) {
-    if (munmap(data, MAP_SIZE) != 0) {
+    if (munmap(data, size) != 0) {
       throw bad_alloc();
     }
   }
 
 #endif
 
+  const char *cn_context::pages_name() const {
+    switch (pagesType) {
+    case HUGE_PAGES:
+      return "huge pages";
+    case TRANSPARENT_HUGE_PAGES:
+      return "transparent huge pages";
+    default:
+      return "normal pages";
+    }
+  }
+
+  cn_context_pool::cn_context_pool(size_t max_idle) : maxIdle(max_idle) {
+    if (maxIdle == 0) {
+      maxIdle = std::max(1u, std::thread::hardware_concurrency());
+    }
+  }
+
+  std::unique_ptr<cn_context> cn_context_pool::acquire() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!idle.empty()) {
+        std::unique_ptr<cn_context> context = std::move(idle.back());
+        idle.pop_back();
+        return context;
+      }
+    }
+
+    return std::unique_ptr<cn_context>(new cn_context());
+  }
+
+  void cn_context_pool::release(std::unique_ptr<cn_context> context) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (context && idle.size() < maxIdle) {
+      idle.push_back(std::move(context));
+    }
+  }
+
 }
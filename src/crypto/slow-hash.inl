@@ -2,19 +2,68 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
-static void
 #if defined(AESNI)
-cn_slow_hash_aesni
+#define SLOW_HASH_FN(name) name##_aesni
+#define SLOW_HASH_SINGLE_ROUND(x, key) x = _mm_aesenc_si128(x, key)
 #else
-cn_slow_hash_noaesni
+#define SLOW_HASH_FN(name) name##_noaesni
+#define SLOW_HASH_SINGLE_ROUND(x, key) aesb_single_round((uint8_t *) &x, (uint8_t *) &x, (uint8_t *) &key)
 #endif
-(size_t majorVersion, void *restrict context, const void *restrict data, size_t length, void *restrict hash, bool walletkey)
+
+#if !defined(SLOW_HASH_STEP)
+
+// hi,lo = 64bit x 64bit multiply of x and y
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SLOW_HASH_MUL128(x, y, hi, lo) \
+  __asm__("mulq %3\n\t" \
+    : "=d" (hi), \
+    "=a" (lo) \
+    : "%a" (x), \
+    "rm" (y) \
+    : "cc" )
+#else
+#define SLOW_HASH_MUL128(x, y, hi, lo) lo = mul128(x, y, &hi)
+#endif
+
+// One iteration of the main loop of hash w in cn_slow_hash_loop. The hashes
+// use their own scratchpads, so the steps of different hashes are independent.
+#define SLOW_HASH_STEP(w) \
+  { \
+    uint8_t *long_state = ctxs[w]->long_state; \
+    __m128i c_x = _mm_load_si128((__m128i *)&long_state[a[w][0] & 0x1FFFF0]); \
+    __m128i a_x = _mm_load_si128((__m128i *)a[w]); \
+    ALIGNED_DECL(uint64_t c[2], 16); \
+    uint64_t b[2], hi, lo; \
+    uint64_t *nextblock; \
+    \
+    SLOW_HASH_SINGLE_ROUND(c_x, a_x); \
+    _mm_store_si128((__m128i *)c, c_x); \
+    \
+    b_x[w] = _mm_xor_si128(b_x[w], c_x); \
+    _mm_store_si128((__m128i *)&long_state[a[w][0] & 0x1FFFF0], b_x[w]); \
+    \
+    nextblock = (uint64_t *)&long_state[c[0] & 0x1FFFF0]; \
+    b[0] = nextblock[0]; \
+    b[1] = nextblock[1]; \
+    SLOW_HASH_MUL128(c[0], b[0], hi, lo); \
+    a[w][0] += hi; \
+    a[w][1] += lo; \
+    nextblock[0] = a[w][0]; \
+    nextblock[1] = a[w][1]; \
+    \
+    a[w][0] ^= b[0]; \
+    a[w][1] ^= b[1]; \
+    b_x[w] = c_x; \
+  }
+
+#endif
+
+// Absorbs the input and fills the scratchpad from the Keccak state.
+static void SLOW_HASH_FN(cn_slow_hash_explode)(struct cn_ctx *restrict ctx, const void *restrict data, size_t length)
 {
-#define ctx ((struct cn_ctx *) context)
   ALIGNED_DECL(uint8_t ExpandedKey[256], 16);
   size_t i;
-  __m128i *longoutput, *expkey, *xmminput, b_x;
-  ALIGNED_DECL(uint64_t a[2], 16);
+  __m128i *longoutput, *expkey, *xmminput;
   hash_process(&ctx->state.hs, (const uint8_t*) data, length);
 
   memcpy(ctx->text, ctx->state.init, INIT_SIZE_BYTE);
@@ -73,62 +122,67 @@ cn_slow_hash_noaesni
     ctx->a[i] = ((uint64_t *)ctx->state.k)[i] ^  ((uint64_t *)ctx->state.k)[i+4];
     ctx->b[i] = ((uint64_t *)ctx->state.k)[i+2] ^  ((uint64_t *)ctx->state.k)[i+6];
   }
+}
 
-  b_x = _mm_load_si128((__m128i *)ctx->b);
-  a[0] = ctx->a[0];
-  a[1] = ctx->a[1];
+// Runs the main loops of ways hashes side by side, so the latency of the AES
+// round and the multiply of one hash is hidden behind the work of the others.
+static void SLOW_HASH_FN(cn_slow_hash_loop)(struct cn_ctx *const *ctxs, size_t ways)
+{
+  ALIGNED_DECL(uint64_t a[SLOW_HASH_MAX_WAYS][2], 16);
+  __m128i b_x[SLOW_HASH_MAX_WAYS];
+  size_t i, w;
 
-  for(i = 0; likely(i < 0x80000); i++)
+  for (w = 0; w < ways; w++)
   {
-    __m128i c_x = _mm_load_si128((__m128i *)&ctx->long_state[a[0] & 0x1FFFF0]);
-    __m128i a_x = _mm_load_si128((__m128i *)a);
-    ALIGNED_DECL(uint64_t c[2], 16);
-    ALIGNED_DECL(uint64_t b[2], 16);
-    uint64_t *nextblock, *dst;
-
-#if defined(AESNI)
-    c_x = _mm_aesenc_si128(c_x, a_x);
-#else
-    aesb_single_round((uint8_t *) &c_x, (uint8_t *) &c_x, (uint8_t *) &a_x);
-#endif
-
-    _mm_store_si128((__m128i *)c, c_x);
-    //__builtin_prefetch(&ctx->long_state[c[0] & 0x1FFFF0], 0, 1);
-
-    b_x = _mm_xor_si128(b_x, c_x);
-    _mm_store_si128((__m128i *)&ctx->long_state[a[0] & 0x1FFFF0], b_x);
+    b_x[w] = _mm_load_si128((__m128i *)ctxs[w]->b);
+    a[w][0] = ctxs[w]->a[0];
+    a[w][1] = ctxs[w]->a[1];
+  }
 
-    nextblock = (uint64_t *)&ctx->long_state[c[0] & 0x1FFFF0];
-    b[0] = nextblock[0];
-    b[1] = nextblock[1];
+  switch (ways)
+  {
+  case 1:
+    for(i = 0; likely(i < 0x80000); i++)
+    {
+      SLOW_HASH_STEP(0);
+    }
+    break;
 
+  case 2:
+    for(i = 0; likely(i < 0x80000); i++)
     {
-      uint64_t hi, lo;
-      // hi,lo = 64bit x 64bit multiply of c[0] and b[0]
+      SLOW_HASH_STEP(0);
+      SLOW_HASH_STEP(1);
+    }
+    break;
 
-#if defined(__GNUC__) && defined(__x86_64__)
-      __asm__("mulq %3\n\t"
-        : "=d" (hi),
-        "=a" (lo)
-        : "%a" (c[0]),
-        "rm" (b[0])
-        : "cc" );
-#else
-      lo = mul128(c[0], b[0], &hi);
-#endif
+  case 3:
+    for(i = 0; likely(i < 0x80000); i++)
+    {
+      SLOW_HASH_STEP(0);
+      SLOW_HASH_STEP(1);
+      SLOW_HASH_STEP(2);
+    }
+    break;
 
-      a[0] += hi;
-      a[1] += lo;
+  case 4:
+    for(i = 0; likely(i < 0x80000); i++)
+    {
+      SLOW_HASH_STEP(0);
+      SLOW_HASH_STEP(1);
+      SLOW_HASH_STEP(2);
+      SLOW_HASH_STEP(3);
     }
-    dst = (uint64_t *) &ctx->long_state[c[0] & 0x1FFFF0];
-    dst[0] = a[0];
-    dst[1] = a[1];
-
-    a[0] ^= b[0];
-    a[1] ^= b[1];
-    b_x = c_x;
-    //__builtin_prefetch(&ctx->long_state[a[0] & 0x1FFFF0], 0, 3);
+    break;
   }
+}
+
+// Folds the scratchpad back into the Keccak state and picks the final hash.
+static void SLOW_HASH_FN(cn_slow_hash_implode)(struct cn_ctx *restrict ctx, void *restrict hash, bool walletkey)
+{
+  ALIGNED_DECL(uint8_t ExpandedKey[256], 16);
+  size_t i;
+  __m128i *longoutput, *expkey, *xmminput;
 
   memcpy(ctx->text, ctx->state.init, INIT_SIZE_BYTE);
 #if defined(AESNI)
@@ -139,6 +193,10 @@ cn_slow_hash_noaesni
   memcpy(ExpandedKey, ctx->aes_ctx->key->exp_data, ctx->aes_ctx->key->exp_data_len);
 #endif
 
+  longoutput = (__m128i *) ctx->long_state;
+  expkey = (__m128i *) ExpandedKey;
+  xmminput = (__m128i *) ctx->text;
+
   //for (i = 0; likely(i < MEMORY); i += INIT_SIZE_BYTE)
   //    aesni_parallel_xor(&ctx->text, ExpandedKey, &ctx->long_state[i]);
 
@@ -191,3 +249,34 @@ cn_slow_hash_noaesni
     extra_hashes[ctx->state.hs.b[0] & 7](&ctx->state, 200, hash);
   }
 }
+
+static void SLOW_HASH_FN(cn_slow_hash)(size_t majorVersion, void *restrict context, const void *restrict data, size_t length, void *restrict hash, bool walletkey)
+{
+  struct cn_ctx *ctx = (struct cn_ctx *) context;
+  SLOW_HASH_FN(cn_slow_hash_explode)(ctx, data, length);
+  SLOW_HASH_FN(cn_slow_hash_loop)(&ctx, 1);
+  SLOW_HASH_FN(cn_slow_hash_implode)(ctx, hash, walletkey);
+}
+
+// Same results as count calls to cn_slow_hash, with the main loops interleaved.
+static void SLOW_HASH_FN(cn_slow_hash_multi)(size_t majorVersion, void *const *contexts, const void *const *data, const size_t *lengths, void *const *hashes, size_t count)
+{
+  struct cn_ctx *ctxs[SLOW_HASH_MAX_WAYS];
+  size_t w;
+
+  for (w = 0; w < count; w++)
+  {
+    ctxs[w] = (struct cn_ctx *) contexts[w];
+    SLOW_HASH_FN(cn_slow_hash_explode)(ctxs[w], data[w], lengths[w]);
+  }
+
+  SLOW_HASH_FN(cn_slow_hash_loop)(ctxs, count);
+
+  for (w = 0; w < count; w++)
+  {
+    SLOW_HASH_FN(cn_slow_hash_implode)(ctxs[w], hashes[w], false);
+  }
+}
+
+#undef SLOW_HASH_FN
+#undef SLOW_HASH_SINGLE_ROUND
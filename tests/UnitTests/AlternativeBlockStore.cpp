@@ -0,0 +1,130 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <algorithm>
+
+#include "CryptoNoteCore/AlternativeBlockStore.h"
+#include "crypto/crypto.h"
+
+using namespace CryptoNote;
+
+namespace {
+
+const size_t BLOCK_SIZE = 1000;
+
+Crypto::Hash addBlock(AlternativeBlockStore& store, uint32_t height, const Crypto::Hash& previous, difficulty_type cumulativeDifficulty = 0) {
+  AlternativeBlockEntry entry = AlternativeBlockEntry();
+  entry.previousBlockHash = previous;
+  entry.height = height;
+  entry.cumulativeDifficulty = cumulativeDifficulty;
+  entry.block.resize(BLOCK_SIZE);
+
+  Crypto::Hash hash = Crypto::rand<Crypto::Hash>();
+  EXPECT_TRUE(store.insert(hash, std::move(entry)).second);
+  return hash;
+}
+
+bool wasRemoved(const std::vector<AlternativeBlockStore::Removed>& removed, const Crypto::Hash& hash, uint32_t height) {
+  return std::find(removed.begin(), removed.end(), AlternativeBlockStore::Removed(hash, height)) != removed.end();
+}
+
+}
+
+TEST(AlternativeBlockStore, pruneBelowMinHeightRemovesDescendants) {
+  AlternativeBlockStore store(1024 * 1024);
+  Crypto::Hash a1 = addBlock(store, 10, Crypto::rand<Crypto::Hash>());
+  Crypto::Hash a2 = addBlock(store, 11, a1);
+  Crypto::Hash a3 = addBlock(store, 12, a2);
+  Crypto::Hash b = addBlock(store, 20, Crypto::rand<Crypto::Hash>());
+
+  std::vector<AlternativeBlockStore::Removed> removed;
+  store.prune(11, 0, removed);
+
+  ASSERT_EQ(3, removed.size());
+  ASSERT_TRUE(wasRemoved(removed, a1, 10));
+  ASSERT_TRUE(wasRemoved(removed, a2, 11));
+  ASSERT_TRUE(wasRemoved(removed, a3, 12));
+  ASSERT_EQ(1, store.size());
+  ASSERT_EQ(1, store.count(b));
+}
+
+TEST(AlternativeBlockStore, pruneKeepsAncestorsOfLiveBlocks) {
+  AlternativeBlockStore store(1024 * 1024);
+  Crypto::Hash c1 = addBlock(store, 5, Crypto::rand<Crypto::Hash>());
+  Crypto::Hash c2 = addBlock(store, 6, c1);
+  Crypto::Hash c3 = addBlock(store, 15, c2);
+  Crypto::Hash d = addBlock(store, 6, Crypto::rand<Crypto::Hash>());
+
+  std::vector<AlternativeBlockStore::Removed> removed;
+  store.prune(0, 10, removed);
+
+  ASSERT_EQ(1, removed.size());
+  ASSERT_TRUE(wasRemoved(removed, d, 6));
+  ASSERT_EQ(1, store.count(c1));
+  ASSERT_EQ(1, store.count(c2));
+  ASSERT_EQ(1, store.count(c3));
+}
+
+TEST(AlternativeBlockStore, pruneDropsWeakestTipsOverBudget) {
+  AlternativeBlockStore probe(0);
+  addBlock(probe, 0, Crypto::rand<Crypto::Hash>());
+  uint64_t entrySize = probe.memorySize();
+
+  // a strong chain a1..a3 with a weak branch b off a1, and a weak chain c
+  AlternativeBlockStore store(3 * entrySize + entrySize / 2);
+  Crypto::Hash a1 = addBlock(store, 1, Crypto::rand<Crypto::Hash>(), 100);
+  Crypto::Hash a2 = addBlock(store, 2, a1, 200);
+  Crypto::Hash a3 = addBlock(store, 3, a2, 300);
+  Crypto::Hash b = addBlock(store, 2, a1, 150);
+  Crypto::Hash c1 = addBlock(store, 4, Crypto::rand<Crypto::Hash>(), 50);
+  Crypto::Hash c2 = addBlock(store, 5, c1, 60);
+
+  std::vector<AlternativeBlockStore::Removed> removed;
+  store.prune(0, 0, removed);
+
+  ASSERT_EQ(3, removed.size());
+  ASSERT_TRUE(wasRemoved(removed, c2, 5));
+  ASSERT_TRUE(wasRemoved(removed, c1, 4));
+  ASSERT_TRUE(wasRemoved(removed, b, 2));
+  ASSERT_EQ(3 * entrySize, store.memorySize());
+  ASSERT_EQ(1, store.count(a1));
+  ASSERT_EQ(1, store.count(a2));
+  ASSERT_EQ(1, store.count(a3));
+}
+
+TEST(AlternativeBlockStore, pruneOverBudgetShrinksChainsFromTheTop) {
+  AlternativeBlockStore probe(0);
+  addBlock(probe, 0, Crypto::rand<Crypto::Hash>());
+  uint64_t entrySize = probe.memorySize();
+
+  // invalid blocks carry no difficulty, the lowest of them go first
+  AlternativeBlockStore store(2 * entrySize + entrySize / 2);
+  Crypto::Hash d1 = addBlock(store, 1, Crypto::rand<Crypto::Hash>());
+  Crypto::Hash d2 = addBlock(store, 2, d1);
+  Crypto::Hash d3 = addBlock(store, 3, d2);
+  Crypto::Hash e = addBlock(store, 2, Crypto::rand<Crypto::Hash>());
+
+  std::vector<AlternativeBlockStore::Removed> removed;
+  store.prune(0, 0, removed);
+
+  ASSERT_EQ(2, removed.size());
+  ASSERT_EQ(AlternativeBlockStore::Removed(e, 2), removed[0]);
+  ASSERT_EQ(AlternativeBlockStore::Removed(d3, 3), removed[1]);
+  ASSERT_EQ(1, store.count(d1));
+  ASSERT_EQ(1, store.count(d2));
+}
+
+TEST(AlternativeBlockStore, pruneWithinBudgetRemovesNothing) {
+  AlternativeBlockStore store(1024 * 1024);
+  Crypto::Hash e1 = addBlock(store, 3, Crypto::rand<Crypto::Hash>());
+  addBlock(store, 4, e1);
+
+  std::vector<AlternativeBlockStore::Removed> removed;
+  store.prune(0, 0, removed);
+
+  ASSERT_TRUE(removed.empty());
+  ASSERT_EQ(2, store.size());
+}
@@ -0,0 +1,256 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <fstream>
+#include <boost/filesystem/operations.hpp>
+
+#include "CryptoNoteCore/BlockCacheJournal.h"
+#include "crypto/crypto.h"
+
+using namespace CryptoNote;
+
+namespace {
+
+class BlockCacheJournalTest : public ::testing::Test {
+protected:
+  virtual void SetUp() override {
+    m_dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("test_data_%%%%%%%%%%%%");
+    boost::filesystem::create_directories(m_dir);
+    m_fileName = (m_dir / "blockscache.journal").string();
+  }
+
+  virtual void TearDown() override {
+    boost::system::error_code ignoredErrorCode;
+    boost::filesystem::remove_all(m_dir, ignoredErrorCode);
+  }
+
+  // records of different sizes, so a cut can fall anywhere in one
+  std::vector<BinaryArray> writeJournal(const Crypto::Hash& baseHash, size_t count) {
+    std::vector<BinaryArray> records;
+    BlockCacheJournal journal;
+    std::vector<BinaryArray> existing;
+    journal.open(m_fileName, existing);
+    EXPECT_TRUE(journal.reset(baseHash));
+    for (size_t i = 0; i < count; ++i) {
+      BinaryArray record(10 + i * 7);
+      for (size_t j = 0; j < record.size(); ++j) {
+        record[j] = static_cast<uint8_t>(i + j);
+      }
+
+      journal.append(record);
+      records.push_back(record);
+    }
+
+    return records;
+  }
+
+  boost::filesystem::path m_dir;
+  std::string m_fileName;
+};
+
+}
+
+TEST_F(BlockCacheJournalTest, missingJournalIsNotLoaded) {
+  BlockCacheJournal journal;
+  std::vector<BinaryArray> records;
+  ASSERT_FALSE(journal.open(m_fileName, records));
+  ASSERT_TRUE(records.empty());
+  ASSERT_FALSE(journal.isOpened());
+}
+
+TEST_F(BlockCacheJournalTest, recordsAreReplayedInOrder) {
+  Crypto::Hash baseHash = Crypto::rand<Crypto::Hash>();
+  std::vector<BinaryArray> written = writeJournal(baseHash, 20);
+
+  BlockCacheJournal journal;
+  std::vector<BinaryArray> records;
+  ASSERT_TRUE(journal.open(m_fileName, records));
+  ASSERT_EQ(baseHash, journal.baseHash());
+  ASSERT_EQ(written, records);
+  ASSERT_EQ(written.size(), journal.recordCount());
+}
+
+TEST_F(BlockCacheJournalTest, truncatedRecordIsDropped) {
+  Crypto::Hash baseHash = Crypto::rand<Crypto::Hash>();
+  std::vector<BinaryArray> written = writeJournal(baseHash, 20);
+  uint64_t fileSize = boost::filesystem::file_size(m_fileName);
+
+  // every cut inside the last record, its header included
+  uint64_t lastRecordSize = 2 * sizeof(uint32_t) + written.back().size();
+  for (uint64_t cut = 1; cut < lastRecordSize; cut += 5) {
+    writeJournal(baseHash, 20);
+    boost::filesystem::resize_file(m_fileName, fileSize - cut);
+
+    BlockCacheJournal journal;
+    std::vector<BinaryArray> records;
+    ASSERT_TRUE(journal.open(m_fileName, records));
+    ASSERT_EQ(std::vector<BinaryArray>(written.begin(), written.end() - 1), records);
+    ASSERT_EQ(fileSize - lastRecordSize, boost::filesystem::file_size(m_fileName));
+  }
+}
+
+TEST_F(BlockCacheJournalTest, appendAfterTruncationFollowsLastGoodRecord) {
+  Crypto::Hash baseHash = Crypto::rand<Crypto::Hash>();
+  std::vector<BinaryArray> written = writeJournal(baseHash, 5);
+  boost::filesystem::resize_file(m_fileName, boost::filesystem::file_size(m_fileName) - 3);
+
+  BinaryArray next(50, 0xaa);
+  {
+    BlockCacheJournal journal;
+    std::vector<BinaryArray> records;
+    ASSERT_TRUE(journal.open(m_fileName, records));
+    ASSERT_EQ(4, records.size());
+    journal.append(next);
+    ASSERT_EQ(5, journal.recordCount());
+  }
+
+  written.back() = next;
+  BlockCacheJournal journal;
+  std::vector<BinaryArray> records;
+  ASSERT_TRUE(journal.open(m_fileName, records));
+  ASSERT_EQ(written, records);
+}
+
+TEST_F(BlockCacheJournalTest, damagedRecordEndsReplay) {
+  Crypto::Hash baseHash = Crypto::rand<Crypto::Hash>();
+  std::vector<BinaryArray> written = writeJournal(baseHash, 10);
+
+  // a byte in the payload of the fourth record
+  uint64_t offset = sizeof(Crypto::Hash);
+  for (size_t i = 0; i < 3; ++i) {
+    offset += 2 * sizeof(uint32_t) + written[i].size();
+  }
+
+  {
+    std::fstream file(m_fileName, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(offset + 2 * sizeof(uint32_t) + 1);
+    file.put(static_cast<char>(written[3][1] ^ 0xff));
+  }
+
+  BlockCacheJournal journal;
+  std::vector<BinaryArray> records;
+  ASSERT_TRUE(journal.open(m_fileName, records));
+  ASSERT_EQ(std::vector<BinaryArray>(written.begin(), written.begin() + 3), records);
+  ASSERT_EQ(3, journal.recordCount());
+}
+
+TEST_F(BlockCacheJournalTest, resetStartsOverFromNewBase) {
+  writeJournal(Crypto::rand<Crypto::Hash>(), 10);
+
+  Crypto::Hash newBase = Crypto::rand<Crypto::Hash>();
+  {
+    BlockCacheJournal journal;
+    std::vector<BinaryArray> records;
+    ASSERT_TRUE(journal.open(m_fileName, records));
+    ASSERT_TRUE(journal.reset(newBase));
+    ASSERT_EQ(0, journal.recordCount());
+  }
+
+  BlockCacheJournal journal;
+  std::vector<BinaryArray> records;
+  ASSERT_TRUE(journal.open(m_fileName, records));
+  ASSERT_EQ(newBase, journal.baseHash());
+  ASSERT_TRUE(records.empty());
+}
+
+TEST_F(BlockCacheJournalTest, journalWithoutBaseHashIsNotLoaded) {
+  writeJournal(Crypto::rand<Crypto::Hash>(), 1);
+  boost::filesystem::resize_file(m_fileName, sizeof(Crypto::Hash) - 1);
+
+  BlockCacheJournal journal;
+  std::vector<BinaryArray> records;
+  ASSERT_FALSE(journal.open(m_fileName, records));
+  ASSERT_TRUE(records.empty());
+}
+
+TEST_F(BlockCacheJournalTest, markedSnapshotsAreListed) {
+  Crypto::Hash baseHash = Crypto::rand<Crypto::Hash>();
+  Crypto::Hash tip = Crypto::rand<Crypto::Hash>();
+  std::vector<BinaryArray> written = writeJournal(baseHash, 3);
+  {
+    BlockCacheJournal journal;
+    std::vector<BinaryArray> records;
+    ASSERT_TRUE(journal.open(m_fileName, records));
+    journal.mark(tip);
+    written.push_back(BinaryArray(40, 0xaa));
+    journal.append(written.back());
+    journal.sync();
+  }
+
+  std::vector<std::pair<Crypto::Hash, uint64_t>> snapshots;
+  snapshots.push_back(std::make_pair(baseHash, 0));
+  snapshots.push_back(std::make_pair(tip, 3));
+
+  BlockCacheJournal journal;
+  std::vector<BinaryArray> records;
+  ASSERT_TRUE(journal.open(m_fileName, records));
+  ASSERT_EQ(baseHash, journal.baseHash());
+  ASSERT_EQ(snapshots, journal.snapshots());
+  ASSERT_EQ(written, records);
+  ASSERT_EQ(4, journal.recordCount());
+}
+
+TEST_F(BlockCacheJournalTest, truncatedMarkIsDropped) {
+  Crypto::Hash baseHash = Crypto::rand<Crypto::Hash>();
+  std::vector<BinaryArray> written = writeJournal(baseHash, 3);
+  {
+    BlockCacheJournal journal;
+    std::vector<BinaryArray> records;
+    ASSERT_TRUE(journal.open(m_fileName, records));
+    journal.mark(Crypto::rand<Crypto::Hash>());
+  }
+
+  boost::filesystem::resize_file(m_fileName, boost::filesystem::file_size(m_fileName) - 1);
+
+  BlockCacheJournal journal;
+  std::vector<BinaryArray> records;
+  ASSERT_TRUE(journal.open(m_fileName, records));
+  ASSERT_EQ(1, journal.snapshots().size());
+  ASSERT_EQ(written, records);
+}
+
+TEST_F(BlockCacheJournalTest, rebaseKeepsRecordsAfterMark) {
+  Crypto::Hash tip = Crypto::rand<Crypto::Hash>();
+  writeJournal(Crypto::rand<Crypto::Hash>(), 5);
+
+  BinaryArray next(30, 0x55);
+  BinaryArray last(60, 0x66);
+  {
+    BlockCacheJournal journal;
+    std::vector<BinaryArray> records;
+    ASSERT_TRUE(journal.open(m_fileName, records));
+    journal.mark(tip);
+    journal.append(next);
+    ASSERT_TRUE(journal.rebase(tip));
+    ASSERT_EQ(tip, journal.baseHash());
+    ASSERT_EQ(1, journal.recordCount());
+    ASSERT_EQ(1, journal.snapshots().size());
+
+    // appends continue in the new journal
+    journal.append(last);
+  }
+
+  BlockCacheJournal journal;
+  std::vector<BinaryArray> records;
+  ASSERT_TRUE(journal.open(m_fileName, records));
+  ASSERT_EQ(tip, journal.baseHash());
+  ASSERT_EQ(std::vector<BinaryArray>({ next, last }), records);
+  ASSERT_FALSE(boost::filesystem::exists(m_fileName + ".new"));
+}
+
+TEST_F(BlockCacheJournalTest, rebaseOnUnmarkedTipKeepsJournal) {
+  Crypto::Hash baseHash = Crypto::rand<Crypto::Hash>();
+  std::vector<BinaryArray> written = writeJournal(baseHash, 5);
+
+  BlockCacheJournal journal;
+  std::vector<BinaryArray> records;
+  ASSERT_TRUE(journal.open(m_fileName, records));
+  ASSERT_FALSE(journal.rebase(Crypto::rand<Crypto::Hash>()));
+  ASSERT_FALSE(journal.rebase(baseHash));
+  ASSERT_TRUE(journal.isOpened());
+  ASSERT_EQ(baseHash, journal.baseHash());
+  ASSERT_EQ(written.size(), journal.recordCount());
+}
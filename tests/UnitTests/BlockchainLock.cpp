@@ -0,0 +1,152 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <future>
+#include <thread>
+#include <vector>
+
+#include "CryptoNoteCore/BlockchainLock.h"
+
+using namespace CryptoNote;
+
+namespace {
+
+// returns once the given numbers of threads are blocked on the lock
+void waitForWaiters(BlockchainLock& lock, uint32_t exclusive, uint32_t shared) {
+  for (;;) {
+    BlockchainLock::Statistics statistics = lock.getStatistics();
+    if (statistics.exclusiveWaiting == exclusive && statistics.sharedWaiting == shared) {
+      return;
+    }
+
+    std::this_thread::yield();
+  }
+}
+
+}
+
+TEST(BlockchainLock, bothModesAreRecursive) {
+  BlockchainLock lock;
+  lock.lock();
+  lock.lock();
+  lock.lock_shared();
+  lock.unlock_shared();
+  lock.unlock();
+  lock.unlock();
+
+  lock.lock_shared();
+  lock.lock_shared();
+  lock.unlock_shared();
+  lock.unlock_shared();
+
+  BlockchainLock::Statistics statistics = lock.getStatistics();
+  ASSERT_EQ(1, statistics.exclusiveCount);
+  ASSERT_EQ(1, statistics.sharedCount);
+}
+
+TEST(BlockchainLock, readersShareTheLock) {
+  BlockchainLock lock;
+  SharedLockGuard<BlockchainLock> lk(lock);
+
+  // would wait forever if readers excluded each other
+  std::async(std::launch::async, [&lock] {
+    SharedLockGuard<BlockchainLock> other(lock);
+  }).get();
+
+  ASSERT_EQ(2, lock.getStatistics().sharedCount);
+}
+
+TEST(BlockchainLock, writerWaitsForReaders) {
+  BlockchainLock lock;
+  std::atomic<bool> readerDone(false);
+  std::atomic<bool> writerSawReaderDone(false);
+
+  lock.lock_shared();
+  std::future<void> writer = std::async(std::launch::async, [&] {
+    std::lock_guard<BlockchainLock> lk(lock);
+    writerSawReaderDone = readerDone.load();
+  });
+
+  waitForWaiters(lock, 1, 0);
+  readerDone = true;
+  lock.unlock_shared();
+  writer.get();
+  ASSERT_TRUE(writerSawReaderDone);
+}
+
+TEST(BlockchainLock, waitingWriterGoesBeforeNewReaders) {
+  BlockchainLock lock;
+  std::mutex orderMutex;
+  std::vector<char> order;
+  auto record = [&](char who) {
+    std::lock_guard<std::mutex> lk(orderMutex);
+    order.push_back(who);
+  };
+
+  lock.lock_shared();
+  std::future<void> writer = std::async(std::launch::async, [&] {
+    std::lock_guard<BlockchainLock> lk(lock);
+    record('w');
+  });
+
+  waitForWaiters(lock, 1, 0);
+  std::future<void> reader = std::async(std::launch::async, [&] {
+    SharedLockGuard<BlockchainLock> lk(lock);
+    record('r');
+  });
+
+  // the new reader queues behind the waiting writer
+  waitForWaiters(lock, 1, 1);
+  {
+    std::lock_guard<std::mutex> lk(orderMutex);
+    EXPECT_TRUE(order.empty());
+  }
+
+  lock.unlock_shared();
+  writer.get();
+  reader.get();
+  ASSERT_EQ(std::vector<char>({ 'w', 'r' }), order);
+}
+
+TEST(BlockchainLock, writersExcludeEveryone) {
+  BlockchainLock lock;
+  std::atomic<int> readers(0);
+  std::atomic<int> writers(0);
+  std::atomic<bool> violated(false);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&, t] {
+      for (int i = 0; i < 2000; ++i) {
+        if ((i + t) % 5 == 0) {
+          std::lock_guard<BlockchainLock> lk(lock);
+          if (++writers != 1 || readers != 0) {
+            violated = true;
+          }
+
+          --writers;
+        } else {
+          SharedLockGuard<BlockchainLock> lk(lock);
+          ++readers;
+          if (writers != 0) {
+            violated = true;
+          }
+
+          --readers;
+        }
+      }
+    });
+  }
+
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+
+  ASSERT_FALSE(violated);
+  BlockchainLock::Statistics statistics = lock.getStatistics();
+  ASSERT_EQ(8 * 2000, statistics.exclusiveCount + statistics.sharedCount);
+}
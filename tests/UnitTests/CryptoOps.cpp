@@ -0,0 +1,172 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <cstring>
+
+#include "CryptoOpsBackend.h"
+#include "crypto/crypto.h"
+
+using Crypto::EllipticCurvePoint;
+using Crypto::EllipticCurveScalar;
+
+namespace {
+
+const size_t ITERATIONS = 500;
+
+const CryptoOpsBackend& ref10 = cryptoOpsRef10;
+const CryptoOpsBackend& tested = cryptoOpsDefault;
+
+bool operator==(const EllipticCurvePoint& a, const EllipticCurvePoint& b) {
+  return memcmp(a.data, b.data, sizeof a.data) == 0;
+}
+
+EllipticCurveScalar randomScalar() {
+  unsigned char wide[64];
+  for (size_t i = 0; i < sizeof wide; i += sizeof(uint64_t)) {
+    uint64_t value = Crypto::rand<uint64_t>();
+    memcpy(wide + i, &value, sizeof value);
+  }
+
+  EllipticCurveScalar scalar;
+  EllipticCurveScalar check;
+  tested.scReduce(scalar.data, wide);
+  ref10.scReduce(check.data, wide);
+  EXPECT_EQ(0, memcmp(scalar.data, check.data, sizeof scalar.data));
+  return scalar;
+}
+
+EllipticCurvePoint randomPoint() {
+  EllipticCurveScalar scalar = randomScalar();
+  EllipticCurvePoint point;
+  EllipticCurvePoint check;
+  tested.scalarmultBase(point.data, scalar.data);
+  ref10.scalarmultBase(check.data, scalar.data);
+  EXPECT_TRUE(point == check);
+  return point;
+}
+
+// y values at and above the field prime, and y = 0 and 1
+std::vector<EllipticCurvePoint> edgeEncodings() {
+  std::vector<EllipticCurvePoint> encodings;
+  for (unsigned char low = 0xe0; low != 0; ++low) {
+    EllipticCurvePoint point;
+    memset(point.data, 0xff, sizeof point.data);
+    point.data[31] = 0x7f;
+    point.data[0] = low;
+    encodings.push_back(point);
+    point.data[31] = 0xff;
+    encodings.push_back(point);
+  }
+
+  EllipticCurvePoint point = EllipticCurvePoint();
+  encodings.push_back(point);
+  point.data[0] = 1;
+  encodings.push_back(point);
+  point.data[31] = 0x80;
+  encodings.push_back(point);
+  return encodings;
+}
+
+}
+
+TEST(CryptoOps, decodingMatchesRef10) {
+  std::vector<EllipticCurvePoint> encodings = edgeEncodings();
+  for (size_t i = 0; i < ITERATIONS; ++i) {
+    encodings.push_back(Crypto::rand<EllipticCurvePoint>());
+    encodings.push_back(randomPoint());
+  }
+
+  for (const EllipticCurvePoint& encoding : encodings) {
+    EllipticCurvePoint point = EllipticCurvePoint();
+    EllipticCurvePoint check = EllipticCurvePoint();
+    int valid = tested.frombytes(point.data, encoding.data);
+    ASSERT_EQ(ref10.frombytes(check.data, encoding.data), valid);
+    ASSERT_TRUE(point == check);
+  }
+}
+
+TEST(CryptoOps, scalarMultiplicationMatchesRef10) {
+  for (size_t i = 0; i < ITERATIONS; ++i) {
+    EllipticCurveScalar a = randomScalar();
+    EllipticCurveScalar b = randomScalar();
+    EllipticCurvePoint p = randomPoint();
+    EllipticCurvePoint q = randomPoint();
+    EllipticCurvePoint result;
+    EllipticCurvePoint check;
+
+    ASSERT_EQ(1, tested.scalarmult(result.data, a.data, p.data));
+    ASSERT_EQ(1, ref10.scalarmult(check.data, a.data, p.data));
+    ASSERT_TRUE(result == check);
+
+    ASSERT_EQ(1, tested.doubleScalarmultBase(result.data, a.data, p.data, b.data));
+    ASSERT_EQ(1, ref10.doubleScalarmultBase(check.data, a.data, p.data, b.data));
+    ASSERT_TRUE(result == check);
+
+    ASSERT_EQ(1, tested.doubleScalarmultPrecomp(result.data, a.data, p.data, b.data, q.data));
+    ASSERT_EQ(1, ref10.doubleScalarmultPrecomp(check.data, a.data, p.data, b.data, q.data));
+    ASSERT_TRUE(result == check);
+  }
+}
+
+TEST(CryptoOps, additionMatchesRef10) {
+  for (size_t i = 0; i < ITERATIONS; ++i) {
+    EllipticCurvePoint p = randomPoint();
+    EllipticCurvePoint q = i % 10 == 0 ? p : randomPoint();
+    EllipticCurvePoint result;
+    EllipticCurvePoint check;
+
+    ASSERT_EQ(1, tested.add(result.data, p.data, q.data));
+    ASSERT_EQ(1, ref10.add(check.data, p.data, q.data));
+    ASSERT_TRUE(result == check);
+
+    ASSERT_EQ(1, tested.sub(result.data, p.data, q.data));
+    ASSERT_EQ(1, ref10.sub(check.data, p.data, q.data));
+    ASSERT_TRUE(result == check);
+  }
+}
+
+TEST(CryptoOps, hashToPointMatchesRef10) {
+  for (size_t i = 0; i < ITERATIONS; ++i) {
+    Crypto::Hash hash = Crypto::rand<Crypto::Hash>();
+    EllipticCurvePoint result;
+    EllipticCurvePoint check;
+    tested.hashToPoint(result.data, reinterpret_cast<const unsigned char*>(&hash));
+    ref10.hashToPoint(check.data, reinterpret_cast<const unsigned char*>(&hash));
+    ASSERT_TRUE(result == check);
+  }
+}
+
+TEST(CryptoOps, batchEncodingMatchesSingle) {
+  for (size_t i = 0; i < ITERATIONS / 10; ++i) {
+    size_t count = 1 + i % 8;
+    std::vector<EllipticCurvePoint> points;
+    for (size_t j = 0; j < count; ++j) {
+      points.push_back(randomPoint());
+    }
+
+    std::vector<EllipticCurvePoint> result(count);
+    std::vector<EllipticCurvePoint> check(count);
+    ASSERT_EQ(1, tested.tobytesBatch(result[0].data, points[0].data, count));
+    ASSERT_EQ(1, ref10.tobytesBatch(check[0].data, points[0].data, count));
+    for (size_t j = 0; j < count; ++j) {
+      ASSERT_TRUE(result[j] == points[j]);
+      ASSERT_TRUE(check[j] == points[j]);
+    }
+  }
+}
+
+TEST(CryptoOps, scalarArithmeticMatchesRef10) {
+  for (size_t i = 0; i < ITERATIONS; ++i) {
+    EllipticCurveScalar a = randomScalar();
+    EllipticCurveScalar b = randomScalar();
+    EllipticCurveScalar c = randomScalar();
+    EllipticCurveScalar result;
+    EllipticCurveScalar check;
+    tested.scMulsub(result.data, a.data, b.data, c.data);
+    ref10.scMulsub(check.data, a.data, b.data, c.data);
+    ASSERT_EQ(0, memcmp(result.data, check.data, sizeof result.data));
+  }
+}
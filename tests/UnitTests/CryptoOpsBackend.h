@@ -0,0 +1,38 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#pragma once
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Group operations of one crypto-ops field backend on encoded points and
+   scalars, so backends with different point layouts can be compared in one
+   binary. Functions that decode a point return 0 if it does not decode. */
+struct CryptoOpsBackend {
+  int (*frombytes)(unsigned char *out, const unsigned char *point);
+  void (*scalarmultBase)(unsigned char *out, const unsigned char *scalar);
+  int (*scalarmult)(unsigned char *out, const unsigned char *scalar, const unsigned char *point);
+  int (*doubleScalarmultBase)(unsigned char *out, const unsigned char *a, const unsigned char *point, const unsigned char *b);
+  int (*doubleScalarmultPrecomp)(unsigned char *out, const unsigned char *a, const unsigned char *pointA, const unsigned char *b, const unsigned char *pointB);
+  int (*add)(unsigned char *out, const unsigned char *p, const unsigned char *q);
+  int (*sub)(unsigned char *out, const unsigned char *p, const unsigned char *q);
+  void (*hashToPoint)(unsigned char *out, const unsigned char *hash);
+  /* encodes count points of at most 8 with one inversion */
+  int (*tobytesBatch)(unsigned char *out, const unsigned char *points, size_t count);
+  void (*scMulsub)(unsigned char *out, const unsigned char *a, const unsigned char *b, const unsigned char *c);
+  void (*scReduce)(unsigned char *out, const unsigned char *in);
+};
+
+/* the 10 limb ref10 code, built into the test under other names */
+extern const struct CryptoOpsBackend cryptoOpsRef10;
+/* the backend the Crypto library is built with */
+extern const struct CryptoOpsBackend cryptoOpsDefault;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,151 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/* Defines CRYPTO_OPS_BACKEND on top of the crypto-ops functions visible to
+   the including file. */
+
+#include <string.h>
+
+#include "CryptoOpsBackend.h"
+
+static int frombytes(unsigned char *out, const unsigned char *point) {
+  ge_p3 p;
+  if (ge_frombytes_vartime(&p, point) != 0) {
+    return 0;
+  }
+
+  ge_p3_tobytes(out, &p);
+  return 1;
+}
+
+static void scalarmultBase(unsigned char *out, const unsigned char *scalar) {
+  ge_p3 r;
+  ge_scalarmult_base(&r, scalar);
+  ge_p3_tobytes(out, &r);
+}
+
+static int scalarmult(unsigned char *out, const unsigned char *scalar, const unsigned char *point) {
+  ge_p3 p;
+  ge_p2 r;
+  if (ge_frombytes_vartime(&p, point) != 0) {
+    return 0;
+  }
+
+  ge_scalarmult(&r, scalar, &p);
+  ge_tobytes(out, &r);
+  return 1;
+}
+
+static int doubleScalarmultBase(unsigned char *out, const unsigned char *a, const unsigned char *point, const unsigned char *b) {
+  ge_p3 p;
+  ge_p2 r;
+  if (ge_frombytes_vartime(&p, point) != 0) {
+    return 0;
+  }
+
+  ge_double_scalarmult_base_vartime(&r, a, &p, b);
+  ge_tobytes(out, &r);
+  return 1;
+}
+
+static int doubleScalarmultPrecomp(unsigned char *out, const unsigned char *a, const unsigned char *pointA, const unsigned char *b, const unsigned char *pointB) {
+  ge_p3 p;
+  ge_p3 q;
+  ge_dsmp precomp;
+  ge_p2 r;
+  if (ge_frombytes_vartime(&p, pointA) != 0 || ge_frombytes_vartime(&q, pointB) != 0) {
+    return 0;
+  }
+
+  ge_dsm_precomp(precomp, &q);
+  ge_double_scalarmult_precomp_vartime(&r, a, &p, b, precomp);
+  ge_tobytes(out, &r);
+  return 1;
+}
+
+static int addOrSub(unsigned char *out, const unsigned char *point1, const unsigned char *point2, int subtract) {
+  ge_p3 p;
+  ge_p3 q;
+  ge_cached cached;
+  ge_p1p1 sum;
+  ge_p3 r;
+  if (ge_frombytes_vartime(&p, point1) != 0 || ge_frombytes_vartime(&q, point2) != 0) {
+    return 0;
+  }
+
+  ge_p3_to_cached(&cached, &q);
+  if (subtract) {
+    ge_sub(&sum, &p, &cached);
+  } else {
+    ge_add(&sum, &p, &cached);
+  }
+
+  ge_p1p1_to_p3(&r, &sum);
+  ge_p3_tobytes(out, &r);
+  return 1;
+}
+
+static int add(unsigned char *out, const unsigned char *p, const unsigned char *q) {
+  return addOrSub(out, p, q, 0);
+}
+
+static int sub(unsigned char *out, const unsigned char *p, const unsigned char *q) {
+  return addOrSub(out, p, q, 1);
+}
+
+static void hashToPoint(unsigned char *out, const unsigned char *hash) {
+  ge_p2 point;
+  ge_p1p1 point2;
+  ge_p3 r;
+  ge_fromfe_frombytes_vartime(&point, hash);
+  ge_mul8(&point2, &point);
+  ge_p1p1_to_p3(&r, &point2);
+  ge_p3_tobytes(out, &r);
+}
+
+static int tobytesBatch(unsigned char *out, const unsigned char *points, size_t count) {
+  ge_p2 p2[8];
+  fe tmp[8];
+  size_t i;
+  if (count > 8) {
+    return 0;
+  }
+
+  for (i = 0; i < count; i++) {
+    ge_p3 p;
+    if (ge_frombytes_vartime(&p, points + 32 * i) != 0) {
+      return 0;
+    }
+
+    ge_p3_to_p2(&p2[i], &p);
+  }
+
+  ge_tobytes_batch(out, p2, tmp, count);
+  return 1;
+}
+
+static void scMulsub(unsigned char *out, const unsigned char *a, const unsigned char *b, const unsigned char *c) {
+  sc_mulsub(out, a, b, c);
+}
+
+static void scReduce(unsigned char *out, const unsigned char *in) {
+  unsigned char wide[64];
+  memcpy(wide, in, 64);
+  sc_reduce(wide);
+  memcpy(out, wide, 32);
+}
+
+const struct CryptoOpsBackend CRYPTO_OPS_BACKEND = {
+  frombytes,
+  scalarmultBase,
+  scalarmult,
+  doubleScalarmultBase,
+  doubleScalarmultPrecomp,
+  add,
+  sub,
+  hashToPoint,
+  tobytesBatch,
+  scMulsub,
+  scReduce
+};
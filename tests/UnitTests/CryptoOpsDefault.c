@@ -0,0 +1,11 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "crypto/crypto-ops.h"
+
+#define CRYPTO_OPS_BACKEND cryptoOpsDefault
+#include "CryptoOpsBackend.inl"
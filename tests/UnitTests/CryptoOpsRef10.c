@@ -0,0 +1,54 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/* A second copy of crypto-ops with the ref10 field arithmetic, renamed so it
+   links next to the Crypto library whichever backend that uses. Nothing is
+   included ahead of crypto-ops.c, its static select() clashes with the one
+   of sys/select.h. */
+
+#define CRYPTO_OPS_REF10
+
+#define ge_add                               ref10_ge_add
+#define ge_double_scalarmult_base_vartime    ref10_ge_double_scalarmult_base_vartime
+#define ge_double_scalarmult_precomp_vartime ref10_ge_double_scalarmult_precomp_vartime
+#define ge_dsm_precomp                       ref10_ge_dsm_precomp
+#define ge_frombytes_vartime                 ref10_ge_frombytes_vartime
+#define ge_fromfe_frombytes_vartime          ref10_ge_fromfe_frombytes_vartime
+#define ge_mul8                              ref10_ge_mul8
+#define ge_p1p1_to_p2                        ref10_ge_p1p1_to_p2
+#define ge_p1p1_to_p3                        ref10_ge_p1p1_to_p3
+#define ge_p2_dbl                            ref10_ge_p2_dbl
+#define ge_p3_to_cached                      ref10_ge_p3_to_cached
+#define ge_p3_to_p2                          ref10_ge_p3_to_p2
+#define ge_p3_tobytes                        ref10_ge_p3_tobytes
+#define ge_scalarmult                        ref10_ge_scalarmult
+#define ge_scalarmult_base                   ref10_ge_scalarmult_base
+#define ge_sub                               ref10_ge_sub
+#define ge_tobytes                           ref10_ge_tobytes
+#define ge_tobytes_batch                     ref10_ge_tobytes_batch
+#define sc_0                                 ref10_sc_0
+#define sc_add                               ref10_sc_add
+#define sc_check                             ref10_sc_check
+#define sc_isnonzero                         ref10_sc_isnonzero
+#define sc_mulsub                            ref10_sc_mulsub
+#define sc_reduce                            ref10_sc_reduce
+#define sc_reduce32                          ref10_sc_reduce32
+#define sc_sub                               ref10_sc_sub
+#define fe_d                                 ref10_fe_d
+#define fe_d2                                ref10_fe_d2
+#define fe_fffb1                             ref10_fe_fffb1
+#define fe_fffb2                             ref10_fe_fffb2
+#define fe_fffb3                             ref10_fe_fffb3
+#define fe_fffb4                             ref10_fe_fffb4
+#define fe_ma                                ref10_fe_ma
+#define fe_ma2                               ref10_fe_ma2
+#define fe_sqrtm1                            ref10_fe_sqrtm1
+#define ge_Bi                                ref10_ge_Bi
+#define ge_base                              ref10_ge_base
+
+#include "crypto/crypto-ops.c"
+#include "crypto/crypto-ops-data.c"
+
+#define CRYPTO_OPS_BACKEND cryptoOpsRef10
+#include "CryptoOpsBackend.inl"
@@ -0,0 +1,244 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <fstream>
+#include <boost/filesystem/operations.hpp>
+
+#include "CryptoNoteCore/DiskHashTable.h"
+#include "crypto/crypto.h"
+
+using namespace CryptoNote;
+
+namespace {
+
+struct Key {
+  Crypto::Hash prefix;
+  Crypto::Hash suffix;
+};
+
+bool contains(DiskHashTable& table, const void* key) {
+  uint64_t value;
+  return table.find(key, &value);
+}
+
+class DiskHashTableTest : public ::testing::Test {
+protected:
+  virtual void SetUp() override {
+    m_dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("test_data_%%%%%%%%%%%%");
+    boost::filesystem::create_directories(m_dir);
+    m_fileName = (m_dir / "table.dat").string();
+  }
+
+  virtual void TearDown() override {
+    boost::system::error_code ignoredErrorCode;
+    boost::filesystem::remove_all(m_dir, ignoredErrorCode);
+  }
+
+  std::vector<Crypto::Hash> insertKeys(DiskHashTable& table, size_t count) {
+    std::vector<Crypto::Hash> keys;
+    for (size_t i = 0; i < count; ++i) {
+      keys.push_back(Crypto::rand<Crypto::Hash>());
+      uint64_t value = i;
+      EXPECT_TRUE(table.insert(&keys.back(), &value));
+    }
+
+    return keys;
+  }
+
+  void copyFiles(const std::string& from, const std::string& to) {
+    for (const char* suffix : { "", ".overflow" }) {
+      boost::filesystem::copy_file(from + suffix, to + suffix, boost::filesystem::copy_option::overwrite_if_exists);
+    }
+  }
+
+  boost::filesystem::path m_dir;
+  std::string m_fileName;
+};
+
+}
+
+TEST_F(DiskHashTableTest, insertFindErase) {
+  DiskHashTable table;
+  ASSERT_TRUE(table.open(m_fileName, sizeof(Crypto::Hash), sizeof(uint64_t)));
+
+  Crypto::Hash key = Crypto::rand<Crypto::Hash>();
+  uint64_t value = 42;
+  ASSERT_TRUE(table.insert(&key, &value));
+
+  uint64_t other = 7;
+  ASSERT_FALSE(table.insert(&key, &other));
+
+  uint64_t found = 0;
+  ASSERT_TRUE(table.find(&key, &found));
+  ASSERT_EQ(42, found);
+  ASSERT_EQ(1, table.size());
+
+  ASSERT_TRUE(table.erase(&key));
+  ASSERT_FALSE(table.erase(&key));
+  ASSERT_FALSE(table.find(&key, &found));
+  ASSERT_EQ(0, table.size());
+}
+
+TEST_F(DiskHashTableTest, splitsKeepAllRecords) {
+  DiskHashTable table;
+  ASSERT_TRUE(table.open(m_fileName, sizeof(Crypto::Hash), sizeof(uint64_t)));
+
+  // far more than the initial buckets hold at the load limit
+  std::vector<Crypto::Hash> keys = insertKeys(table, 100000);
+  ASSERT_EQ(keys.size(), table.size());
+
+  for (size_t i = 0; i < keys.size(); ++i) {
+    uint64_t value;
+    ASSERT_TRUE(table.find(&keys[i], &value));
+    ASSERT_EQ(i, value);
+  }
+
+  for (size_t i = 0; i < keys.size(); i += 2) {
+    ASSERT_TRUE(table.erase(&keys[i]));
+  }
+
+  for (size_t i = 0; i < keys.size(); ++i) {
+    uint64_t value;
+    ASSERT_EQ(i % 2 == 1, table.find(&keys[i], &value));
+  }
+}
+
+TEST_F(DiskHashTableTest, committedStateSurvivesReopen) {
+  Crypto::Hash tag = Crypto::rand<Crypto::Hash>();
+  std::vector<Crypto::Hash> keys;
+  {
+    DiskHashTable table;
+    ASSERT_TRUE(table.open(m_fileName, sizeof(Crypto::Hash), sizeof(uint64_t)));
+    keys = insertKeys(table, 5000);
+    table.commit(tag);
+
+    // left uncommitted, lost on close
+    insertKeys(table, 10);
+  }
+
+  DiskHashTable table;
+  ASSERT_TRUE(table.open(m_fileName, sizeof(Crypto::Hash), sizeof(uint64_t)));
+  ASSERT_EQ(tag, table.committedTag());
+  ASSERT_EQ(keys.size(), table.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    uint64_t value;
+    ASSERT_TRUE(table.find(&keys[i], &value));
+    ASSERT_EQ(i, value);
+  }
+
+  ASSERT_FALSE(table.open(m_fileName, sizeof(Crypto::Hash), sizeof(uint32_t)));
+}
+
+// The log of a commit is captured through a hard link, then laid over the
+// files of the previous commit as if the crash happened while writing pages.
+TEST_F(DiskHashTableTest, logIsReplayedUnlessTorn) {
+  std::string before = (m_dir / "before.dat").string();
+  std::string logCopy = (m_dir / "commit.log").string();
+  Crypto::Hash firstTag = Crypto::rand<Crypto::Hash>();
+  Crypto::Hash secondTag = Crypto::rand<Crypto::Hash>();
+  std::vector<Crypto::Hash> firstKeys;
+  std::vector<Crypto::Hash> secondKeys;
+  {
+    DiskHashTable table;
+    ASSERT_TRUE(table.open(m_fileName, sizeof(Crypto::Hash), sizeof(uint64_t)));
+    firstKeys = insertKeys(table, 3000);
+    table.commit(firstTag);
+    copyFiles(m_fileName, before);
+
+    secondKeys = insertKeys(table, 3000);
+    std::ofstream(m_fileName + ".log").close();
+    boost::filesystem::create_hard_link(m_fileName + ".log", logCopy);
+    table.commit(secondTag);
+  }
+
+  ASSERT_FALSE(boost::filesystem::exists(m_fileName + ".log"));
+  uint64_t logSize = boost::filesystem::file_size(logCopy);
+  ASSERT_GT(logSize, 0);
+
+  // a complete log brings the files to the second commit
+  copyFiles(before, m_fileName);
+  boost::filesystem::copy_file(logCopy, m_fileName + ".log");
+  {
+    DiskHashTable table;
+    ASSERT_TRUE(table.open(m_fileName, sizeof(Crypto::Hash), sizeof(uint64_t)));
+    ASSERT_EQ(secondTag, table.committedTag());
+    ASSERT_EQ(firstKeys.size() + secondKeys.size(), table.size());
+    ASSERT_TRUE(contains(table, &secondKeys.back()));
+  }
+
+  ASSERT_FALSE(boost::filesystem::exists(m_fileName + ".log"));
+
+  // a log cut short is dropped, the files still hold the first commit
+  copyFiles(before, m_fileName);
+  boost::filesystem::copy_file(logCopy, m_fileName + ".log");
+  boost::filesystem::resize_file(m_fileName + ".log", logSize - 100);
+  {
+    DiskHashTable table;
+    ASSERT_TRUE(table.open(m_fileName, sizeof(Crypto::Hash), sizeof(uint64_t)));
+    ASSERT_EQ(firstTag, table.committedTag());
+    ASSERT_EQ(firstKeys.size(), table.size());
+    ASSERT_TRUE(contains(table, &firstKeys.back()));
+    ASSERT_FALSE(contains(table, &secondKeys.back()));
+  }
+
+  // so is a log with a damaged page
+  copyFiles(before, m_fileName);
+  boost::filesystem::copy_file(logCopy, m_fileName + ".log");
+  {
+    std::fstream log(m_fileName + ".log", std::ios::in | std::ios::out | std::ios::binary);
+    log.seekp(100);
+    log.put('\xff');
+  }
+
+  {
+    DiskHashTable table;
+    ASSERT_TRUE(table.open(m_fileName, sizeof(Crypto::Hash), sizeof(uint64_t)));
+    ASSERT_EQ(firstTag, table.committedTag());
+    ASSERT_EQ(firstKeys.size(), table.size());
+  }
+}
+
+TEST_F(DiskHashTableTest, popularPrefixChain) {
+  DiskHashTable table;
+  ASSERT_TRUE(table.open(m_fileName, sizeof(Key), 0));
+
+  // every record of one prefix shares a bucket and its overflow chain
+  Key key;
+  key.prefix = Crypto::rand<Crypto::Hash>();
+  std::vector<Crypto::Hash> suffixes;
+  for (size_t i = 0; i < 5000; ++i) {
+    key.suffix = Crypto::rand<Crypto::Hash>();
+    suffixes.push_back(key.suffix);
+    table.insertNew(&key, &key);
+  }
+
+  Key single;
+  single.prefix = Crypto::rand<Crypto::Hash>();
+  single.suffix = Crypto::rand<Crypto::Hash>();
+  ASSERT_TRUE(table.insert(&single, &single));
+
+  std::vector<uint8_t> found;
+  ASSERT_EQ(suffixes.size(), table.findByPrefix(&key.prefix, sizeof key.prefix, found));
+  ASSERT_EQ(suffixes.size() * sizeof(Key), found.size());
+
+  for (size_t i = 0; i < suffixes.size(); i += 3) {
+    key.suffix = suffixes[i];
+    ASSERT_TRUE(table.erase(&key));
+  }
+
+  found.clear();
+  size_t left = suffixes.size() - (suffixes.size() + 2) / 3;
+  ASSERT_EQ(left, table.findByPrefix(&key.prefix, sizeof key.prefix, found));
+  ASSERT_EQ(left + 1, table.size());
+
+  for (size_t i = 0; i < suffixes.size(); ++i) {
+    key.suffix = suffixes[i];
+    ASSERT_EQ(i % 3 != 0, contains(table, &key));
+  }
+
+  found.clear();
+  ASSERT_EQ(1, table.findByPrefix(&single.prefix, sizeof single.prefix, found));
+}
@@ -0,0 +1,98 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "crypto/crypto.h"
+
+namespace {
+
+const size_t RING_SIZE = 5;
+
+class PublicKeyCacheTest : public ::testing::Test {
+public:
+  PublicKeyCacheTest() : signatures(RING_SIZE) {
+    prefixHash = Crypto::rand<Crypto::Hash>();
+    Crypto::SecretKey secretKey;
+    for (size_t i = 0; i < RING_SIZE; ++i) {
+      Crypto::generate_keys(keys[i], secretKey);
+      outputKeys.push_back(&keys[i]);
+    }
+
+    // the real output is the last one generated
+    Crypto::generate_key_image(keys[RING_SIZE - 1], secretKey, keyImage);
+    Crypto::generate_ring_signature(prefixHash, keyImage, outputKeys, secretKey, RING_SIZE - 1, signatures.data());
+  }
+
+  // the result with a cache must always be the one without
+  bool check(Crypto::public_key_cache& cache) {
+    bool valid = Crypto::check_ring_signature(prefixHash, keyImage, outputKeys, signatures.data());
+    EXPECT_EQ(valid, Crypto::check_ring_signature(prefixHash, keyImage, outputKeys, signatures.data(), cache));
+    return valid;
+  }
+
+  Crypto::Hash prefixHash;
+  Crypto::KeyImage keyImage;
+  Crypto::PublicKey keys[RING_SIZE];
+  std::vector<const Crypto::PublicKey*> outputKeys;
+  std::vector<Crypto::Signature> signatures;
+};
+
+}
+
+TEST_F(PublicKeyCacheTest, validSignatureFromCache) {
+  Crypto::public_key_cache cache(64);
+  ASSERT_TRUE(check(cache));
+  ASSERT_TRUE(check(cache));
+}
+
+TEST_F(PublicKeyCacheTest, cacheSmallerThanRing) {
+  Crypto::public_key_cache cache(2);
+  for (size_t i = 0; i < 3; ++i) {
+    ASSERT_TRUE(check(cache));
+  }
+}
+
+TEST_F(PublicKeyCacheTest, damagedSignatureFailsWithCachedKeys) {
+  Crypto::public_key_cache cache(64);
+  ASSERT_TRUE(check(cache));
+
+  signatures[1].r.data[0] ^= 1;
+  ASSERT_FALSE(check(cache));
+}
+
+TEST_F(PublicKeyCacheTest, otherPrefixFailsWithCachedKeys) {
+  Crypto::public_key_cache cache(64);
+  ASSERT_TRUE(check(cache));
+
+  prefixHash.data[0] ^= 1;
+  ASSERT_FALSE(check(cache));
+}
+
+TEST_F(PublicKeyCacheTest, replacedKeyIsNotTakenFromCache) {
+  Crypto::public_key_cache cache(64);
+  ASSERT_TRUE(check(cache));
+
+  Crypto::PublicKey original = keys[2];
+  Crypto::SecretKey secretKey;
+  Crypto::generate_keys(keys[2], secretKey);
+  ASSERT_FALSE(check(cache));
+
+  keys[2] = original;
+  ASSERT_TRUE(check(cache));
+}
+
+#if defined(NDEBUG)
+// scalars are checked before ring members are decompressed, which aborts on
+// a key that is not a point
+TEST_F(PublicKeyCacheTest, nonCanonicalScalarFailsBeforeInvalidKey) {
+  do {
+    keys[0] = Crypto::rand<Crypto::PublicKey>();
+  } while (Crypto::check_key(keys[0]));
+
+  signatures[RING_SIZE - 1].r.data[31] = 0xff;
+  Crypto::public_key_cache cache(64);
+  ASSERT_FALSE(check(cache));
+}
+#endif
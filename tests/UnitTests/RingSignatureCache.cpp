@@ -0,0 +1,105 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include "CryptoNoteCore/RingSignatureCache.h"
+
+using namespace CryptoNote;
+
+namespace {
+
+class RingSignatureCacheTest : public ::testing::Test {
+public:
+  RingSignatureCacheTest() : signatures(2) {
+    prefixHash = Crypto::rand<Crypto::Hash>();
+    keyImage = Crypto::rand<Crypto::KeyImage>();
+    keys[0] = Crypto::rand<Crypto::PublicKey>();
+    keys[1] = Crypto::rand<Crypto::PublicKey>();
+    outputKeys.push_back(&keys[0]);
+    outputKeys.push_back(&keys[1]);
+    signatures[0] = Crypto::rand<Crypto::Signature>();
+    signatures[1] = Crypto::rand<Crypto::Signature>();
+  }
+
+  Crypto::Hash makeKey() {
+    return RingSignatureCache::makeKey(prefixHash, keyImage, amount, outputKeys, signatures);
+  }
+
+  Crypto::Hash prefixHash;
+  Crypto::KeyImage keyImage;
+  uint64_t amount = 1000;
+  Crypto::PublicKey keys[2];
+  std::vector<const Crypto::PublicKey*> outputKeys;
+  std::vector<Crypto::Signature> signatures;
+};
+
+}
+
+TEST_F(RingSignatureCacheTest, sameInputHits) {
+  RingSignatureCache cache(16);
+  cache.insert(makeKey());
+
+  // the key depends on the key values, not on where they are stored
+  Crypto::PublicKey copies[2] = { keys[0], keys[1] };
+  outputKeys[0] = &copies[0];
+  outputKeys[1] = &copies[1];
+  ASSERT_TRUE(cache.contains(makeKey()));
+}
+
+TEST_F(RingSignatureCacheTest, changedKeyImageMisses) {
+  RingSignatureCache cache(16);
+  cache.insert(makeKey());
+
+  keyImage.data[0] ^= 1;
+  ASSERT_FALSE(cache.contains(makeKey()));
+}
+
+TEST_F(RingSignatureCacheTest, changedAmountMisses) {
+  RingSignatureCache cache(16);
+  cache.insert(makeKey());
+
+  amount += 1;
+  ASSERT_FALSE(cache.contains(makeKey()));
+}
+
+TEST_F(RingSignatureCacheTest, changedPrefixKeysOrSignaturesMiss) {
+  RingSignatureCache cache(16);
+  Crypto::Hash key = makeKey();
+  cache.insert(key);
+
+  prefixHash.data[0] ^= 1;
+  ASSERT_FALSE(cache.contains(makeKey()));
+  prefixHash.data[0] ^= 1;
+
+  // a reorg resolving the same indexes to other outputs
+  Crypto::PublicKey other = Crypto::rand<Crypto::PublicKey>();
+  outputKeys[1] = &other;
+  ASSERT_FALSE(cache.contains(makeKey()));
+  outputKeys[1] = &keys[1];
+
+  std::swap(outputKeys[0], outputKeys[1]);
+  ASSERT_FALSE(cache.contains(makeKey()));
+  std::swap(outputKeys[0], outputKeys[1]);
+
+  signatures[1].r.data[31] ^= 1;
+  ASSERT_FALSE(cache.contains(makeKey()));
+  signatures[1].r.data[31] ^= 1;
+
+  ASSERT_EQ(key, makeKey());
+}
+
+TEST_F(RingSignatureCacheTest, oldestEntriesAreDroppedFirst) {
+  RingSignatureCache cache(2);
+  std::vector<Crypto::Hash> entries;
+  for (uint64_t i = 0; i < 3; ++i) {
+    amount = i;
+    entries.push_back(makeKey());
+    cache.insert(entries.back());
+  }
+
+  ASSERT_FALSE(cache.contains(entries[0]));
+  ASSERT_TRUE(cache.contains(entries[1]));
+  ASSERT_TRUE(cache.contains(entries[2]));
+}
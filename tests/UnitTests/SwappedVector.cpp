@@ -0,0 +1,259 @@
+// Copyright (c) 2011-2016 The Cryptonote developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "gtest/gtest.h"
+
+#include <fstream>
+#include <boost/filesystem/operations.hpp>
+
+#include "CryptoNoteCore/SwappedVector.h"
+#include "Serialization/ISerializer.h"
+
+using namespace CryptoNote;
+
+namespace {
+
+struct Item {
+  std::string data;
+};
+
+void serialize(Item& item, ISerializer& s) {
+  s(item.data, "data");
+}
+
+// items of different sizes, each telling its index
+Item makeItem(uint64_t index) {
+  Item item;
+  item.data = std::to_string(index) + std::string(20 + index % 50, static_cast<char>('a' + index % 26));
+  return item;
+}
+
+class SwappedVectorTest : public ::testing::Test {
+protected:
+  virtual void SetUp() override {
+    m_dir = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("test_data_%%%%%%%%%%%%");
+    boost::filesystem::create_directories(m_dir);
+    m_itemsFileName = (m_dir / "blocks.dat").string();
+    m_indexFileName = (m_dir / "blockindexes.dat").string();
+  }
+
+  virtual void TearDown() override {
+    boost::system::error_code ignoredErrorCode;
+    boost::filesystem::remove_all(m_dir, ignoredErrorCode);
+  }
+
+  void fill(SwappedVector<Item>& items, uint64_t count) {
+    for (uint64_t i = items.size(); i < count; ++i) {
+      items.push_back(makeItem(i));
+    }
+  }
+
+  void expectItems(SwappedVector<Item>& items, uint64_t count) {
+    ASSERT_EQ(count, items.size());
+    for (uint64_t i = 0; i < count; ++i) {
+      ASSERT_EQ(makeItem(i).data, items[i].data);
+    }
+  }
+
+  boost::filesystem::path m_dir;
+  std::string m_itemsFileName;
+  std::string m_indexFileName;
+};
+
+}
+
+TEST_F(SwappedVectorTest, itemsSurviveReopen) {
+  {
+    SwappedVector<Item> items;
+    ASSERT_TRUE(items.open(m_itemsFileName, m_indexFileName, 1024 * 1024));
+    fill(items, 1000);
+    items.pop_back();
+    expectItems(items, 999);
+  }
+
+  SwappedVector<Item> items;
+  ASSERT_TRUE(items.open(m_itemsFileName, m_indexFileName, 1024 * 1024));
+  expectItems(items, 999);
+}
+
+TEST_F(SwappedVectorTest, batchedItemsAreWrittenOnFlush) {
+  SwappedVector<Item> items;
+  ASSERT_TRUE(items.open(m_itemsFileName, m_indexFileName, 1024 * 1024));
+  items.beginBatch(1024 * 1024);
+  fill(items, 100);
+
+  // readable from memory, nothing written yet
+  expectItems(items, 100);
+  ASSERT_EQ(0, boost::filesystem::file_size(m_itemsFileName));
+
+  items.flush();
+  uint64_t flushedSize = boost::filesystem::file_size(m_itemsFileName);
+  ASSERT_GT(flushedSize, 0);
+
+  fill(items, 200);
+  ASSERT_EQ(flushedSize, boost::filesystem::file_size(m_itemsFileName));
+  items.endBatch();
+  expectItems(items, 200);
+  items.close();
+
+  SwappedVector<Item> reopened;
+  ASSERT_TRUE(reopened.open(m_itemsFileName, m_indexFileName, 1024 * 1024));
+  expectItems(reopened, 200);
+}
+
+TEST_F(SwappedVectorTest, batchIsFlushedWhenFull) {
+  {
+    SwappedVector<Item> items;
+    ASSERT_TRUE(items.open(m_itemsFileName, m_indexFileName, 1024 * 1024));
+    items.beginBatch(1000);
+    fill(items, 100);
+    ASSERT_GT(boost::filesystem::file_size(m_itemsFileName), 0);
+    items.endBatch();
+  }
+
+  SwappedVector<Item> items;
+  ASSERT_TRUE(items.open(m_itemsFileName, m_indexFileName, 1024 * 1024));
+  expectItems(items, 100);
+}
+
+TEST_F(SwappedVectorTest, damagedItemCutsTail) {
+  uint64_t offset = 0;
+  {
+    SwappedVector<Item> items;
+    ASSERT_TRUE(items.open(m_itemsFileName, m_indexFileName, 1024 * 1024));
+    fill(items, 20);
+    for (uint64_t i = 0; i < 15; ++i) {
+      offset += items.rawSize(i);
+    }
+  }
+
+  {
+    std::fstream file(m_itemsFileName, std::ios::in | std::ios::out | std::ios::binary);
+    file.seekp(offset + 3);
+    file.put('#');
+  }
+
+  {
+    SwappedVector<Item> items;
+    ASSERT_TRUE(items.open(m_itemsFileName, m_indexFileName, 1024 * 1024));
+    expectItems(items, 15);
+
+    // appends continue right after the last good item
+    fill(items, 20);
+  }
+
+  SwappedVector<Item> items;
+  ASSERT_TRUE(items.open(m_itemsFileName, m_indexFileName, 1024 * 1024));
+  expectItems(items, 20);
+}
+
+TEST_F(SwappedVectorTest, truncatedItemsFileCutsTail) {
+  uint64_t lastSize;
+  {
+    SwappedVector<Item> items;
+    ASSERT_TRUE(items.open(m_itemsFileName, m_indexFileName, 1024 * 1024));
+    fill(items, 20);
+    lastSize = items.rawSize(19);
+  }
+
+  boost::filesystem::resize_file(m_itemsFileName, boost::filesystem::file_size(m_itemsFileName) - lastSize / 2);
+
+  SwappedVector<Item> items;
+  ASSERT_TRUE(items.open(m_itemsFileName, m_indexFileName, 1024 * 1024));
+  expectItems(items, 19);
+}
+
+TEST_F(SwappedVectorTest, cacheStaysWithinBudget) {
+  const uint64_t budget = 2000;
+  SwappedVector<Item> items;
+  ASSERT_TRUE(items.open(m_itemsFileName, m_indexFileName, budget));
+  fill(items, 500);
+  expectItems(items, 500);
+
+  SwappedVector<Item>::CacheStatistics statistics = items.getCacheStatistics();
+  ASSERT_LE(statistics.bytes, budget);
+  ASSERT_GT(statistics.items, 0);
+}
+
+TEST_F(SwappedVectorTest, pinnedItemsStayInMemory) {
+  const uint64_t budget = 2000;
+  SwappedVector<Item> items;
+  ASSERT_TRUE(items.open(m_itemsFileName, m_indexFileName, budget));
+  fill(items, 500);
+
+  items.pin();
+  std::vector<const Item*> handedOut;
+  for (uint64_t i = 0; i < 500; ++i) {
+    handedOut.push_back(&items[i]);
+  }
+
+  ASSERT_GT(items.getCacheStatistics().bytes, budget);
+  for (uint64_t i = 0; i < 500; ++i) {
+    ASSERT_EQ(makeItem(i).data, handedOut[i]->data);
+  }
+
+  items.unpin();
+  ASSERT_LE(items.getCacheStatistics().bytes, budget);
+}
+
+TEST_F(SwappedVectorTest, scanKeepsFrequentItems) {
+  const uint64_t budget = 4000;
+  {
+    SwappedVector<Item> items;
+    ASSERT_TRUE(items.open(m_itemsFileName, m_indexFileName, budget));
+    fill(items, 1000);
+  }
+
+  // appended items count as seen once, start from an empty cache instead
+  SwappedVector<Item> items;
+  ASSERT_TRUE(items.open(m_itemsFileName, m_indexFileName, budget));
+
+  // asked for again shortly after dropping out of the recent queue
+  items[0];
+  for (uint64_t i = 1; i < 200; ++i) {
+    items[i];
+  }
+
+  // a scan of items not seen before only cycles the recent queue
+  items[0];
+  for (uint64_t i = 200; i < 1000; ++i) {
+    items[i];
+  }
+
+  uint64_t hits = items.getCacheStatistics().hits;
+  items[0];
+  ASSERT_EQ(hits + 1, items.getCacheStatistics().hits);
+}
+
+TEST_F(SwappedVectorTest, readRawReturnsStoredBytes) {
+  SwappedVector<Item> items;
+  ASSERT_TRUE(items.open(m_itemsFileName, m_indexFileName, 1024 * 1024));
+  fill(items, 50);
+  items.beginBatch(1024 * 1024);
+  fill(items, 60);
+
+  // both written and pending items, read as a whole and in part
+  for (uint64_t i = 0; i < 60; ++i) {
+    Item item = makeItem(i);
+    std::vector<uint8_t> expected;
+    Common::VectorOutputStream stream(expected);
+    BinaryOutputStreamSerializer archive(stream);
+    serialize(item, archive);
+    ASSERT_EQ(expected.size(), items.rawSize(i));
+
+    std::vector<uint8_t> raw(expected.size());
+    ASSERT_TRUE(items.readRaw(i, 0, raw.size(), raw.data()));
+    ASSERT_EQ(expected, raw);
+
+    uint8_t tail[4];
+    ASSERT_TRUE(items.readRaw(i, raw.size() - sizeof tail, sizeof tail, tail));
+    ASSERT_EQ(0, memcmp(expected.data() + expected.size() - sizeof tail, tail, sizeof tail));
+    ASSERT_FALSE(items.readRaw(i, 1, raw.size(), raw.data()));
+  }
+
+  ASSERT_EQ(0, items.rawSize(60));
+  uint8_t byte;
+  ASSERT_FALSE(items.readRaw(60, 0, 1, &byte));
+  items.endBatch();
+}